@@ -3,6 +3,7 @@ TEMPLATE = subdirs
 SUBDIRS += \
     libds2 \
     ds2-dump \
+    ds2r \
     tests \
     jsoncpp
 
@@ -10,4 +11,5 @@ SUBDIRS += \
 jsoncpp.subdir = jsoncpp
 libds2.depends = jsoncpp
 ds2-dump.depends = libds2
+ds2r.depends = libds2
 ds2-test.depends = libds2
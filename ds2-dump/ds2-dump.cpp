@@ -21,7 +21,8 @@
  * Or see <http://www.gnu.org/licenses/>.
  */
 
-#include <sys/time.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <iostream>
@@ -31,15 +32,225 @@
 #include <QDate>
 #include <QVariant>
 #include <QList>
+#include <QScopedPointer>
 
 #include <ds2/ds2packet.h>
 #include <ds2/kwppacket.h>
 #include <ds2/manager.h>
 #include <ds2/controlunit.h>
 #include <ds2/exceptions.h>
+#include <ds2/jsonwriter.h>
+#include <ds2/datalog.h>
+#include <ds2/asynclogwriter.h>
+#include <ds2/decodepipeline.h>
+#include <ds2/logscheduler.h>
+#include <ds2/triggercapture.h>
+#include <ds2/derivedchannel.h>
+#include <ds2/windowaggregator.h>
+#include <ds2/compressedlog.h>
+#include <ds2/trace.h>
+#include <ds2/timeline.h>
+#include <ds2/allocationstats.h>
+#include <ds2/remote.h>
 
 #include "ds2-dump.h"
 
+namespace {
+    volatile sig_atomic_t ourInterrupted = 0;
+
+    void handleInterrupt(int)
+    {
+        ourInterrupted = 1;
+    }
+
+    /*
+     * Seconds on a clock that never jumps, used to timestamp NDJSON records.
+     */
+    double monotonicSeconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + (0.000000001 * ts.tv_nsec);
+    }
+
+    // The rate a data log channel gets when its spec doesn't ask for one
+    const double DEFAULT_LOG_RATE = 1.0;
+
+    // Seconds an ECU is assumed to take before it starts replying, unless --turnaround says otherwise
+    const double DEFAULT_TURNAROUND = 0.05;
+
+    // How long a data log waits for a decoded reply before checking for an interrupt again
+    const int PIPELINE_POLL_MSECS = 50;
+
+    /*
+     * Splits a data log result such as "rpm@10Hz" into its name and rate in Hz.  Returns 0 if no rate was given.
+     */
+    double parseLogRate(const QString &aSpec, QString &aName)
+    {
+        const int at = aSpec.indexOf('@');
+        if (at < 0) {
+            aName = aSpec;
+            return 0;
+        }
+
+        aName = aSpec.left(at);
+        QString rateString = aSpec.mid(at + 1);
+        if (rateString.endsWith("hz", Qt::CaseInsensitive)) {
+            rateString.chop(2);
+        }
+
+        bool ok;
+        const double rate = rateString.toDouble(&ok);
+        if (!ok or (rate <= 0)) {
+            throw DS2PlusPlus::CommandlineArgumentException(qPrintable(QString("Invalid rate in data log spec: %1").arg(aSpec)));
+        }
+        return rate;
+    }
+
+    /*
+     * Checks that a numeric option parses and isn't negative, or zero unless \a isZeroAllowed, so a typo fails
+     * before the port is opened instead of quietly becoming 0.
+     */
+    void checkNumericOption(const QCommandLineParser &aParser, const QString &aName, bool isInteger, bool isZeroAllowed)
+    {
+        if (!aParser.isSet(aName)) {
+            return;
+        }
+
+        bool ok;
+        const QString value = aParser.value(aName);
+        const double number = isInteger ? value.toInt(&ok) : value.toDouble(&ok);
+        if (!ok or (number < 0) or (!isZeroAllowed and (number == 0))) {
+            throw DS2PlusPlus::CommandlineArgumentException(qPrintable(QString("Please specify %1 %2 for --%3.")
+                                                                       .arg(isZeroAllowed ? "zero or a positive" : "a positive")
+                                                                       .arg(isInteger ? "integer" : "number").arg(aName)));
+        }
+    }
+
+    /*
+     * Formats a data log value the way the CSV log always has.
+     */
+    QString formatLogValue(const QVariant &aValue)
+    {
+        switch (aValue.type()) {
+        case QMetaType::Bool:
+            return aValue.toBool() ? "1" : "0";
+        case QMetaType::Char:
+        case QMetaType::Short:
+        case QMetaType::Int:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            return QString::number(aValue.toLongLong());
+        case QMetaType::UChar:
+        case QMetaType::UShort:
+        case QMetaType::UInt:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+            return QString::number(aValue.toULongLong());
+        case QMetaType::Double:
+        case QMetaType::Float:
+            return QString::number(aValue.toDouble(), 'f', 5);
+        case QMetaType::QString:
+            return aValue.toString();
+        default:
+            return QString();
+        }
+    }
+
+    QString joinLogValues(const QVector<QVariant> &someValues)
+    {
+        QStringList strings;
+        foreach (const QVariant &value, someValues) {
+            strings << formatLogValue(value);
+        }
+        return strings.join("\t");
+    }
+
+    /*
+     * Feeds one job's decoded results to its channels' trackers.  Fills someChanges with which results
+     * changed and returns how active the job is, the most active of its channels.
+     */
+    double trackActivity(QVector<DS2PlusPlus::ChannelActivity> &someChannels, const QStringList &someResults, const DS2PlusPlus::PacketResponse &aResponse, QVector<bool> &someChanges)
+    {
+        double ret = 0;
+        someChanges.resize(someResults.size());
+        for (int i=0; i < someResults.size(); i++) {
+            someChanges[i] = someChannels[i].update(aResponse.value(someResults.at(i)));
+            ret = qMax(ret, someChannels.at(i).changeRate());
+        }
+        return ret;
+    }
+
+    /*
+     * Reads the next record of a log being exported, from \a aCompressedReader if there is one and
+     * otherwise from \a aReader.  Returns false at the end of the log.
+     */
+    bool nextLogRecord(const DS2PlusPlus::DataLogReader &aReader, DS2PlusPlus::CompressedLogReader *aCompressedReader, qint64 &aRecord, QVector<QVariant> &someValues)
+    {
+        if (aCompressedReader) {
+            return aCompressedReader->next(someValues);
+        }
+
+        if (aRecord >= aReader.recordCount()) {
+            return false;
+        }
+
+        for (int i=0; i < someValues.size(); i++) {
+            someValues[i] = aReader.value(aRecord, i);
+        }
+        aRecord++;
+        return true;
+    }
+
+    /*
+     * Reports anything a stopped writer couldn't get into its file, e.g. because the disk filled up.
+     */
+    void reportWriteErrors(QTextStream &aStream, const DS2PlusPlus::AsyncLogWriter &aWriter)
+    {
+        if ((aWriter.recordsFailed() > 0) or !aWriter.writeError().isEmpty()) {
+            aStream << QString("-- Failed to write %1 records to %2: %3").arg(aWriter.recordsFailed())
+                       .arg(aWriter.fileName()).arg(aWriter.writeError()) << endl;
+        }
+    }
+
+    /*
+     * Writes the window an aggregator just closed.  A binary aggregate log gets its header with the first
+     * window: statistics are doubles, counts unsigned, and the last value keeps its channel's type.
+     */
+    void writeAggregateRow(const DS2PlusPlus::WindowAggregator &anAggregator, const QStringList &someHeaders, const QStringList &someUnits,
+                           DS2PlusPlus::DataLogWriter *aBinaryLog, DS2PlusPlus::AsyncLogWriter &aWriter)
+    {
+        using namespace DS2PlusPlus;
+
+        const QVector<QVariant> &row = anAggregator.row();
+        if (!aBinaryLog) {
+            aWriter.write((joinLogValues(row) + '\n').toUtf8());
+            return;
+        }
+
+        if (aBinaryLog->channels().isEmpty()) {
+            QVector<DataLogChannel> channels;
+            channels.append(DataLogChannel(someHeaders.at(0), someUnits.at(0), DataLogChannel::TypeDouble));
+            for (int i=1; i < someHeaders.size(); i++) {
+                switch ((i - 1) % WindowAggregator::VALUES_PER_COLUMN) {
+                case 3:
+                    channels.append(DataLogChannel(someHeaders.at(i), someUnits.at(i), DataLogChannel::TypeUInt64));
+                    break;
+                case 4:
+                    channels.append(DataLogChannel::forValue(someHeaders.at(i), someUnits.at(i), row.at(i)));
+                    break;
+                default:
+                    channels.append(DataLogChannel(someHeaders.at(i), someUnits.at(i), DataLogChannel::TypeDouble));
+                    break;
+                }
+            }
+            aBinaryLog->setChannels(channels);
+            aWriter.write(DataLogWriter::encodeHeader(channels));
+        }
+        aWriter.write(aBinaryLog->encode(row));
+    }
+}
+
 void PrettyFormat(const QList<QStringList> &rows)
 {
     QTextStream qOut(stdout);
@@ -79,6 +290,9 @@ void PrettyFormat(const QList<QStringList> &rows)
 DataCollection::DataCollection(QObject *parent) :
     QObject(parent), qOut(stdout), qErr(stderr)
 {
+    connect(this, &DataCollection::finished, this, &DataCollection::printStatistics);
+    connect(this, &DataCollection::finished, this, &DataCollection::writeTimeline);
+    connect(this, &DataCollection::finished, this, &DataCollection::printAllocations);
 }
 
 void DataCollection::run()
@@ -122,9 +336,75 @@ void DataCollection::run()
     QCommandLineOption runJobOption(QStringList() << "R" << "run-operation", "Run an operation on an ECU, prints results as JSON to stdout.");
     parser->addOption(runJobOption);
 
-    QCommandLineOption datalogOption(QStringList() << "D" << "data-log", "Create a CSV log, write until interrupted.", "ecu-jobs-and-results");
+    QCommandLineOption datalogOption(QStringList() << "D" << "data-log", "Create a CSV log, write until interrupted.  Each result may ask for a rate, e.g. DME:status:rpm@10Hz,coolant_temp@1Hz.", "ecu-jobs-and-results");
     parser->addOption(datalogOption);
 
+    QCommandLineOption binaryLogOption(QStringList() << "B" << "binary-log", "Write the data log in the binary DPP log format instead of CSV.");
+    parser->addOption(binaryLogOption);
+
+    QCommandLineOption compressOption(QStringList() << "Z" << "compress", "Write the data log in the compressed DPP log format (implies --binary-log).  Values are delta and XOR encoded in blocks of --block-records records.");
+    parser->addOption(compressOption);
+
+    QCommandLineOption blockRecordsOption("block-records", "Records per block of a compressed data log.", "count", QString::number(DS2PlusPlus::CompressedLogWriter::DEFAULT_BLOCK_RECORDS));
+    parser->addOption(blockRecordsOption);
+
+    QCommandLineOption flushIntervalOption("flush-interval", "How often the data log is flushed, in milliseconds.  0 flushes as soon as the writer catches up.", "msecs", "1000");
+    parser->addOption(flushIntervalOption);
+
+    QCommandLineOption syncIntervalOption("sync-interval", "How often the data log is synced to storage, in milliseconds.  0 leaves it to the OS until logging stops.", "msecs", "0");
+    parser->addOption(syncIntervalOption);
+
+    QCommandLineOption preallocateOption("preallocate", "Reserve this many MiB of disk ahead of the data log as it grows (Linux only).", "MiB", "4");
+    parser->addOption(preallocateOption);
+
+    QCommandLineOption logFullOption("log-when-full", "What to do when the data log writer falls behind: drop samples, or block the bus loop.", "drop|block", "drop");
+    parser->addOption(logFullOption);
+
+    QCommandLineOption previewIntervalOption("preview-interval", "Print the latest data log sample to stdout at most this often, in milliseconds.  0 disables the preview.", "msecs", "1000");
+    parser->addOption(previewIntervalOption);
+
+    QCommandLineOption dryRunOption("dry-run", "Print the data log's planned sample rates and exit without logging.");
+    parser->addOption(dryRunOption);
+
+    QCommandLineOption turnaroundOption("turnaround", "How long an ECU takes to start replying, in milliseconds, for planning the data log.  Either a default for every ECU or ECU=msecs.  May be repeated.", "msecs", "50");
+    parser->addOption(turnaroundOption);
+
+    QCommandLineOption adaptiveOption("adaptive", "Poll stable data log channels less often and give the bus time to the ones that are changing.");
+    parser->addOption(adaptiveOption);
+
+    QCommandLineOption adaptiveRangeOption("adaptive-range", "How far adaptive polling may move each job's rate, as factors of its target rate.", "min:max", "0.1:4");
+    parser->addOption(adaptiveRangeOption);
+
+    QCommandLineOption deadbandOption("deadband", "How far a numeric data log value must move to count as a change.", "value", "0");
+    parser->addOption(deadbandOption);
+
+    QCommandLineOption deltaOption("delta", "Only log values that changed since they were last logged.  In CSV and binary logs the first row is complete and later rows leave unchanged channels empty.");
+    parser->addOption(deltaOption);
+
+    QCommandLineOption deriveOption("derive", "Add a column computed from other channels as they're logged: name=expression or name[units]=expression, where the expression is RPN over numbers and channel names, e.g. \"boost[bar]=DME:status:map 1.013 -\".  May be repeated; later definitions can use earlier ones.  Not available with --format ndjson.", "definition");
+    parser->addOption(deriveOption);
+
+    QCommandLineOption aggregateOption("aggregate", "Also write the min, max, mean, sample count, and last value of every channel over each window of this many seconds to dpp-<date>.agg.csv (or .agg.dpplog with --binary-log).", "secs");
+    parser->addOption(aggregateOption);
+
+    QCommandLineOption noRawLogOption("no-raw-log", "With --aggregate, don't write the raw data log.");
+    parser->addOption(noRawLogOption);
+
+    QCommandLineOption triggerOption("trigger", "Only log around events: keep recent samples in memory and write them out when a condition on a channel fires, e.g. \"DME:status:rpm > 6000\" or \"DME:errors:count changes\".  May be repeated.  --delta is ignored.", "expression");
+    parser->addOption(triggerOption);
+
+    QCommandLineOption preTriggerOption("pre-trigger", "Seconds of samples kept from before a trigger fires.", "secs", "10");
+    parser->addOption(preTriggerOption);
+
+    QCommandLineOption postTriggerOption("post-trigger", "Seconds of samples logged after a trigger fires.", "secs", "5");
+    parser->addOption(postTriggerOption);
+
+    QCommandLineOption captureFramesOption("capture-frames", "With --trigger, also keep each raw reply and write the captured ones to dpp-<date>.frames.");
+    parser->addOption(captureFramesOption);
+
+    QCommandLineOption exportLogOption(QStringList() << "X" << "export-log", "Convert a binary or compressed data log to CSV, or to JSON records with --format json or ndjson, on stdout.", "log-file");
+    parser->addOption(exportLogOption);
+
     QCommandLineOption rawQueryOption(QStringList() << "Q" << "query", "Send packet to ECU, print raw output.", "query");
     parser->addOption(rawQueryOption);
 
@@ -134,19 +414,92 @@ void DataCollection::run()
     QCommandLineOption textPacketOption(QStringList() << "i" << "input-packet", "Treat this argument as a packet instead of reading from the serial port.  Base 16, space delimited.", "input-packet");
     parser->addOption(textPacketOption);
 
-    QCommandLineOption outputFormatOption(QStringList() << "o" << "format", "Output format.  Either text, verbose, or json.", "format", "text");
+    QCommandLineOption outputFormatOption(QStringList() << "o" << "format", "Output format.  Either text, verbose, json, or ndjson (one compact JSON record per transaction, for run-operation and data-log).", "format", "text");
     parser->addOption(outputFormatOption);
 
+    QCommandLineOption traceOption("trace", "Switch on trace categories, a comma separated list of general, query, rpn, conversion, or all.  The DPP_TRACE family of environment variables still work.", "categories");
+    parser->addOption(traceOption);
+
+    QCommandLineOption traceFormatOption("trace-format", "How trace messages are written to stderr: text or json (one object per line).", "format", "text");
+    parser->addOption(traceFormatOption);
+
+    QCommandLineOption timelineOption("timeline", "Record a timeline of every bus transaction, decode, scheduler wait and log write, and write it to <file> on exit as Chrome trace event JSON (open it in chrome://tracing or ui.perfetto.dev).", "file");
+    parser->addOption(timelineOption);
+
+    QCommandLineOption allocationsOption("allocations", "Count heap allocations per libds2 subsystem; prints each run-operation transaction and a summary on exit to stderr.  Needs libds2 built with qmake CONFIG+=allocstats.");
+    parser->addOption(allocationsOption);
+
+    QCommandLineOption statsOption("stats", "On exit, print latency percentiles and error counts for each ECU address and operation to stderr.");
+    parser->addOption(statsOption);
+
+    QCommandLineOption remoteOption("remote", "Send run-operation, probe, query, and data-log to a running ds2r instead of opening the serial port.");
+    parser->addOption(remoteOption);
+
+    QCommandLineOption invalidateCacheOption("invalidate-cache", "With --remote, make ds2r forget the cached identity, VIN and other slow changing responses for --ecu, or for every ECU.  Use after writing to an ECU or cycling the ignition.");
+    parser->addOption(invalidateCacheOption);
+
+    QCommandLineOption socketOption("socket", "The local socket ds2r is listening on.", "path", RemoteMessage::defaultSocketPath());
+    parser->addOption(socketOption);
+
     parser->process(*QCoreApplication::instance());
 
     try {
         if (parser->isSet("format")) {
-            QStringList validFormats = QStringList() << "text" << "verbose" << "json";
+            QStringList validFormats = QStringList() << "text" << "verbose" << "json" << "ndjson";
             if (!validFormats.contains(parser->value("format"))) {
                 throw CommandlineArgumentException(qPrintable(QString("Format must be one of: %1").arg(validFormats.join(", "))));
             }
         }
 
+        checkNumericOption(*parser, "block-records", true, false);
+        checkNumericOption(*parser, "flush-interval", true, true);
+        checkNumericOption(*parser, "sync-interval", true, true);
+        checkNumericOption(*parser, "preallocate", true, true);
+        checkNumericOption(*parser, "preview-interval", true, true);
+        checkNumericOption(*parser, "deadband", false, true);
+        checkNumericOption(*parser, "aggregate", false, false);
+        checkNumericOption(*parser, "pre-trigger", false, true);
+        checkNumericOption(*parser, "post-trigger", false, true);
+
+        if (parser->isSet("trace")) {
+            try {
+                Trace::enable(parser->value("trace"));
+            } catch (std::invalid_argument &error) {
+                throw CommandlineArgumentException(error.what());
+            }
+        }
+        if (parser->value("trace-format") == "json") {
+            static JsonTraceSink ourTraceSink;
+            Trace::setSink(&ourTraceSink);
+        } else if (parser->value("trace-format") != "text") {
+            throw CommandlineArgumentException("Trace format must be one of: text, json");
+        }
+
+        if (parser->isSet("timeline")) {
+            Timeline::start();
+        }
+
+        if (parser->isSet("allocations")) {
+            if (!AllocationStats::isAvailable()) {
+                throw CommandlineArgumentException("libds2 was built without allocation accounting; rebuild it with qmake CONFIG+=allocstats.");
+            }
+            AllocationStats::setEnabled(true);
+        }
+
+        // Converting a log needs neither the ECU nor the database
+        if (parser->isSet("export-log")) {
+            exportLog();
+            emit finished();
+            return;
+        }
+
+        // ds2r owns the port and the database
+        if (parser->isSet("remote")) {
+            remote();
+            emit finished();
+            return;
+        }
+
         if (!parser->isSet("reload") && !parser->isSet("list-families") && !parser->isSet("list-ecus") && !parser->isSet("list-operations")) {
             if (!parser->isSet("input-packet")) {
                 if (!parser->isSet("device")) {
@@ -249,6 +602,61 @@ void DataCollection::run()
     emit finished();
 }
 
+void DataCollection::printStatistics()
+{
+    if (parser.isNull() or dbm.isNull() or !parser->isSet("stats")) {
+        return;
+    }
+
+    const DS2PlusPlus::BusStatistics &statistics = dbm->statistics();
+    if (statistics.addresses().isEmpty()) {
+        qErr << "-- No ECU transactions were made." << endl;
+        return;
+    }
+
+    qErr << endl << statistics.summary() << flush;
+}
+
+void DataCollection::printAllocations()
+{
+    using namespace DS2PlusPlus;
+
+    if (!AllocationStats::isEnabled()) {
+        return;
+    }
+    AllocationStats::setEnabled(false);
+
+    quint64 transactions = 0;
+    foreach (const TransactionStatistics *statistics, dbm->statistics().addresses()) {
+        transactions += statistics->transactions.load();
+    }
+
+    qErr << endl << AllocationStats::summary(AllocationStats::snapshot(), transactions) << flush;
+}
+
+void DataCollection::writeTimeline()
+{
+    using namespace DS2PlusPlus;
+
+    if (!Timeline::isEnabled()) {
+        return;
+    }
+    Timeline::stop();
+
+    QFile file(parser->value("timeline"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qErr << QString("-- Unable to write the timeline to %1: %2").arg(file.fileName()).arg(file.errorString()) << endl;
+        return;
+    }
+    Timeline::writeJson(&file);
+
+    qErr << QString("-- Wrote %1 timeline events to %2").arg(Timeline::count()).arg(file.fileName());
+    if (Timeline::dropped() > 0) {
+        qErr << QString(" (%1 dropped once the buffer filled)").arg(Timeline::dropped());
+    }
+    qErr << endl;
+}
+
 void DataCollection::listFamilies()
 {
     using namespace DS2PlusPlus;
@@ -696,11 +1104,137 @@ void DataCollection::rawQuery()
     using namespace DS2PlusPlus;
 
     BasePacketPtr queryPacket(new DS2Packet(parser->value("query")));
+    dbm->responseCache().invalidate(queryPacket->targetAddress());
     BasePacketPtr responsePacket =  dbm->query(queryPacket);
 
     qOut << "<< REPLY: " << responsePacket << endl;
 }
 
+void DataCollection::remote()
+{
+    using namespace DS2PlusPlus;
+
+    RemoteClient client;
+    try {
+        client.connectTo(parser->value("socket"));
+    } catch (std::runtime_error &error) {
+        throw CommandlineArgumentException(error.what());
+    }
+
+    if (parser->isSet("query")) {
+        const DS2Packet ourPacket(parser->value("query"));
+        RemoteMessage ourRequest(RemoteMessage::RawQuery);
+        ourRequest.ecu = QString("0x%1").arg(ourPacket.targetAddress(), 2, 16, QChar('0'));
+        ourRequest.data = ourPacket.data();
+
+        const RemoteMessage ourReply = client.request(ourRequest);
+        qOut << "<< REPLY: " << BasePacketPtr(new DS2Packet(ourReply.ecu.toUShort(0, 16), ourReply.data)) << endl;
+        return;
+    }
+
+    if (parser->isSet("data-log")) {
+        QFile ourStdout;
+        ourStdout.open(stdout, QIODevice::WriteOnly);
+        JsonStreamWriter ourWriter(&ourStdout);
+
+        // ECU:job-1:result,result,result
+        QHash<quint32, TransactionRecord> ourRecords;
+        foreach (const QString &spec, parser->values("data-log")) {
+            QStringList currentSpec = spec.split(":");
+            if (currentSpec.length() != 3) {
+                throw CommandlineArgumentException("Data log spec must follow the format ECU:job:result1,result2,resultn");
+            }
+
+            RemoteMessage ourRequest(RemoteMessage::Subscribe);
+            ourRequest.ecu = currentSpec.at(0);
+            ourRequest.operation = currentSpec.at(1);
+            ourRequest.rate = 0;
+            foreach (const QString &resultSpec, currentSpec.at(2).split(",")) {
+                QString resultName;
+                ourRequest.rate = qMax(ourRequest.rate, parseLogRate(resultSpec, resultName));
+                ourRequest.results << resultName;
+            }
+            if (ourRequest.rate <= 0) {
+                ourRequest.rate = DEFAULT_LOG_RATE;
+            }
+
+            const RemoteMessage ourReply = client.request(ourRequest);
+            ourRecords[ourReply.id].operation = ourRequest.operation;
+        }
+
+        // Samples are written as NDJSON no matter the format, until ds2r goes away.
+        RemoteMessage ourSample;
+        QHash<quint32, quint64> ourDropped;
+        while (client.nextSample(ourSample)) {
+            if (ourSample.type == RemoteMessage::Error) {
+                qErr << "-- " << ourSample.error << endl;
+                continue;
+            }
+
+            // ds2r drops the oldest samples of a client that falls behind; say so instead of leaving a silent gap
+            if (ourSample.dropped > ourDropped.value(ourSample.id)) {
+                qErr << "-- Lost " << (ourSample.dropped - ourDropped.value(ourSample.id)) << " samples of "
+                     << ourRecords.value(ourSample.id).operation << " while falling behind" << endl;
+                ourDropped.insert(ourSample.id, ourSample.dropped);
+            }
+
+            TransactionRecord &ourRecord = ourRecords[ourSample.id];
+            ourRecord.ecuUuid = ourSample.ecu;
+            ourRecord.timestamp = ourSample.timestamp;
+            ourRecord.latency = ourSample.latency;
+            ourWriter.writeTransaction(ourRecord, ourSample.response, KeyPathTree(ourSample.response.keys()));
+            ourStdout.flush();
+        }
+        return;
+    }
+
+    if (parser->isSet("invalidate-cache")) {
+        RemoteMessage ourRequest(RemoteMessage::Invalidate);
+        ourRequest.ecu = parser->value("ecu");
+        client.request(ourRequest);
+        return;
+    }
+
+    if (!parser->isSet("ecu")) {
+        throw CommandlineArgumentException("A valid ECU family or address is required to proceed further.");
+    }
+
+    if (parser->isSet("probe")) {
+        RemoteMessage ourRequest(RemoteMessage::Probe);
+        ourRequest.ecu = parser->value("ecu");
+
+        const RemoteMessage ourReply = client.request(ourRequest);
+        qOut << QString("At 0x%1 we think we have: %2").arg(ourReply.response.value("address").toUInt(), 2, 16, QChar('0')).arg(ourReply.response.value("name").toString()) << endl;
+        return;
+    }
+
+    if (parser->isSet("run-operation")) {
+        RemoteMessage ourRequest(RemoteMessage::RunOperation);
+        ourRequest.ecu = parser->value("ecu");
+        ourRequest.operation = parser->value("operation");
+
+        const RemoteMessage ourReply = client.request(ourRequest);
+        const KeyPathTree ourKeyPaths(ourReply.response.keys());
+        if (parser->value("format") == "ndjson") {
+            QFile ourStdout;
+            ourStdout.open(stdout, QIODevice::WriteOnly);
+            TransactionRecord ourRecord;
+            ourRecord.ecuUuid = ourReply.ecu;
+            ourRecord.operation = ourReply.operation;
+            ourRecord.timestamp = ourReply.timestamp;
+            ourRecord.latency = ourReply.latency;
+            JsonStreamWriter(&ourStdout).writeTransaction(ourRecord, ourReply.response, ourKeyPaths);
+        } else {
+            QByteArray ourJson;
+            JsonStreamWriter(&ourJson).write(ourReply.response, ourKeyPaths);
+            qOut << "\"" << ourReply.operation << "\"" << ": " << QString::fromUtf8(ourJson) << endl;
+        }
+        return;
+    }
+
+    throw CommandlineArgumentException("Only run-operation, probe, query, data-log, and invalidate-cache can be sent to ds2r.");
+}
+
 void DataCollection::runOperation()
 {
     using namespace DS2PlusPlus;
@@ -743,7 +1277,10 @@ void DataCollection::runOperation()
 
     if (!autoDetect.isNull()) {
         QString ourJob = parser->value("operation");
-        qOut << QString("%1: %3 at 0x%2")
+        const bool isNdjson = (parser->value("format") == "ndjson");
+
+        // NDJSON consumers expect nothing but records on stdout
+        (isNdjson ? qErr : qOut) << QString("%1: %3 at 0x%2")
                 .arg(ecuUuid.isEmpty() ? "Detected" : "Using")
                 .arg(autoDetect->address(), 2, 16, QChar('0')).arg(autoDetect->name()) << endl;
 
@@ -760,14 +1297,43 @@ void DataCollection::runOperation()
             iterations = 1;
         }
 
+        // The JSON layout only depends on the operation, so work it out once for every iteration.
+        const OperationPtr ourOperation = autoDetect->operations().value(ourJob);
+        const KeyPathTree ourKeyPaths = ourOperation.isNull() ? KeyPathTree() : ourOperation->keyPathTree();
+        QByteArray ourJson;
+        JsonStreamWriter ourJsonWriter(&ourJson);
+
+        // Records go straight into a buffered QFile and are only flushed once we're done.
+        QFile ourStdout;
+        JsonStreamWriter ourRecordWriter(&ourStdout);
+        TransactionRecord ourRecord;
+        if (isNdjson) {
+            ourStdout.open(stdout, QIODevice::WriteOnly);
+            ourRecord.ecuUuid = autoDetect->uuid();
+            ourRecord.operation = ourJob;
+        }
+
         for (quint64 i=0; i < iterations; i++) {
             PacketResponse ourResponse;
 
+            const AllocationStats::Snapshot ourAllocations = AllocationStats::snapshot();
+            ourRecord.timestamp = monotonicSeconds();
             if (!ourPacket.isNull()) {
                 ourResponse = autoDetect->parseOperation(ourJob, ourPacket);
             } else {
                 ourResponse = autoDetect->executeOperation(ourJob);
             }
+            ourRecord.latency = monotonicSeconds() - ourRecord.timestamp;
+
+            if (AllocationStats::isEnabled()) {
+                qErr << "-- " << AllocationStats::line(AllocationStats::snapshot() - ourAllocations) << endl;
+            }
+
+            if (isNdjson) {
+                ourRecordWriter.writeTransaction(ourRecord, ourResponse, ourKeyPaths);
+                // Tail at whatever rate the bus allows
+                continue;
+            }
 
             if (parser->value("format") == "text") {
                 QStringList resultNames = ourResponse.keys();
@@ -811,7 +1377,9 @@ void DataCollection::runOperation()
                     qOut << endl;
                 }
             } else if (parser->value("format") == "json") {
-                qOut << "\"" << ourJob << "\"" << ": " << ResponseToJsonString(ourResponse) << endl;
+                ourJson.resize(0);
+                ourJsonWriter.write(ourResponse, ourKeyPaths);
+                qOut << "\"" << ourJob << "\"" << ": " << QString::fromUtf8(ourJson) << endl;
             }
 
             if ((i < iterations - 1) and (iterations > 1)) {
@@ -819,17 +1387,14 @@ void DataCollection::runOperation()
             }
         }
 
+        if (isNdjson) {
+            ourStdout.flush();
+        }
     } else {
         qOut << "Couldn't find a match" << endl;
     }
 }
 
-class DataLogEntry {
-public:
-    QString ecuName;
-    QString jobName;
-    QStringList results;
-};
 
 void DataCollection::dataLog()
 {
@@ -850,7 +1415,13 @@ void DataCollection::dataLog()
         QString ecuName = currentSpec.at(0);
         QString jobName = currentSpec.at(1);
         QString key = QString("%1:%2").arg(ecuName, jobName);
-        QStringList resultsList = currentSpec.at(2).split(",");
+        QStringList resultsList;
+        QList<double> ratesList;
+        foreach (const QString &resultSpec, currentSpec.at(2).split(",")) {
+            QString resultName;
+            ratesList << parseLogRate(resultSpec, resultName);
+            resultsList << resultName;
+        }
 
         if (!ecus.contains(ecuName)) {
             DS2PlusPlus::ControlUnitPtr ourEcu;
@@ -871,87 +1442,661 @@ void DataCollection::dataLog()
             jobs[key].jobName = jobName;
         }
         jobs[key].results.append(resultsList);
+        jobs[key].rates.append(ratesList);
+    }
+
+    const QList<DataLogEntry> entries = jobs.values();
+    LogScheduler scheduler = dataLogSchedule(ecus, entries);
+
+    if (parser->isSet("dry-run")) {
+        printDataLogSchedule(scheduler, entries);
+        return;
+    }
+
+    if (parser->value("format") == "ndjson") {
+        if (parser->isSet("derive")) {
+            throw CommandlineArgumentException("Derived channels need a row of every channel, so they can't be used with --format ndjson.");
+        }
+        dataLogRecords(ecus, entries, scheduler);
+        return;
     }
 
+    const bool isCompressed = parser->isSet("compress");
+    const bool isBinary = parser->isSet("binary-log") or isCompressed;
+    const int previewInterval = parser->value("preview-interval").toInt();
+
+    // All file I/O happens on the writer's thread, away from the bus timing below.
+    AsyncLogWriter logWriter;
+    logWriter.setFlushInterval(parser->value("flush-interval").toInt());
+    logWriter.setSyncInterval(parser->value("sync-interval").toInt());
+    logWriter.setPreallocation(parser->value("preallocate").toLongLong() * 1024 * 1024);
+    logWriter.setFullPolicy((parser->value("log-when-full") == "block") ? AsyncLogWriter::FullBlock : AsyncLogWriter::FullDrop);
+
+    const bool isAggregating = parser->isSet("aggregate");
+    const bool isRawLogged = !(isAggregating and parser->isSet("no-raw-log"));
+
+    const QString logDate = QDateTime::currentDateTime().toString();
+    const QString fileName = QString(isCompressed ? "dpp-%1.dpplogz" : (isBinary ? "dpp-%1.dpplog" : "dpp-%1.csv")).arg(logDate);
+    if (isRawLogged and !logWriter.open(fileName)) {
+        throw std::runtime_error(qPrintable(QString("Unable to open %1: %2").arg(fileName).arg(logWriter.errorString())));
+    }
 
-    QFile file(QString("dpp-%1.csv").arg(QDateTime::currentDateTime().toString()));
-    file.open(QIODevice::WriteOnly | QIODevice::Text);
-    QTextStream out(&file);
     QTextStream StdOut(stdout);
+    DataLogWriter binaryLog;
+    CompressedLogWriter compressedLog(parser->value("block-records").toInt());
 
     QStringList headers, formats;
+    QList<int> stringWidths, columnStarts;
 
-    foreach (const DataLogEntry &entry, jobs.values()) {
+    foreach (const DataLogEntry &entry, entries) {
+        columnStarts << headers.size();
         headers << QString("%1:%2 Time").arg(entry.ecuName).arg(entry.jobName);
         formats << "s";
+        stringWidths << 0;
 
         foreach (const QString &resultName, entry.results) {
             Result r = ecus[entry.ecuName]->operations()[entry.jobName]->results()[resultName];
             headers << QString("%1:%2:%3").arg(entry.ecuName).arg(entry.jobName).arg(resultName);
             formats << r.units();
+            // Room for the result rendered as hex, or a level name
+            stringWidths << qMax(32, 2 * r.length());
         }
     }
 
-    out << headers.join("\t") << endl;
-    out << formats.join("\t") << endl;
+    // Derived channels go after every logged one and are compiled against the columns before them.
+    DerivedChannelSet derived;
+    const int derivedStart = headers.size();
+    foreach (const QString &definition, parser->values("derive")) {
+        try {
+            const DerivedChannel channel = DerivedChannel::parse(definition);
+            derived.add(channel, headers);
+            formats << channel.units();
+            stringWidths << 0;
+        } catch (std::invalid_argument &error) {
+            throw CommandlineArgumentException(error.what());
+        }
+    }
+
+    if (isRawLogged and !isBinary) {
+        logWriter.write(QString("%1\n%2\n").arg(headers.join("\t")).arg(formats.join("\t")).toUtf8());
+    }
+
+    // Aggregates cover every channel apart from the job times, and go to their own file.
+    QScopedPointer<WindowAggregator> aggregator;
+    AsyncLogWriter aggregateWriter;
+    DataLogWriter aggregateLog;
+    QStringList aggregateHeaders, aggregateUnits;
+    int windowsWritten = 0;
+    const QString aggregateName = QString(isBinary ? "dpp-%1.agg.dpplog" : "dpp-%1.agg.csv").arg(logDate);
+    if (isAggregating) {
+        QVector<int> aggregateColumns;
+        for (int i=0; i < headers.size(); i++) {
+            if (!columnStarts.contains(i)) {
+                aggregateColumns << i;
+            }
+        }
+
+        try {
+            aggregator.reset(new WindowAggregator(parser->value("aggregate").toDouble(), aggregateColumns));
+        } catch (std::invalid_argument &error) {
+            throw CommandlineArgumentException(error.what());
+        }
+
+        aggregateHeaders = aggregator->headers(headers);
+        aggregateUnits << "s";
+        foreach (int column, aggregateColumns) {
+            aggregateUnits << formats.at(column) << formats.at(column) << formats.at(column) << QString() << formats.at(column);
+        }
+
+        if (!aggregateWriter.open(aggregateName)) {
+            throw std::runtime_error(qPrintable(QString("Unable to open %1: %2").arg(aggregateName).arg(aggregateWriter.errorString())));
+        }
+        if (!isBinary) {
+            aggregateWriter.write(QString("%1\n%2\n").arg(aggregateHeaders.join("\t")).arg(aggregateUnits.join("\t")).toUtf8());
+        }
+        aggregateWriter.start();
+    }
+
+    QList<OperationPtr> operations;
+    foreach (const DataLogEntry &entry, entries) {
+        operations << ecus[entry.ecuName]->operations().value(entry.jobName);
+    }
+
+    // With triggers, samples wait in memory and only the windows around events reach the disk.
+    QScopedPointer<TriggerCapture> capture;
+    AsyncLogWriter frameWriter;
+    const bool isCapturingFrames = parser->isSet("capture-frames") and parser->isSet("trigger");
+    if (parser->isSet("trigger")) {
+        const double preTrigger = parser->value("pre-trigger").toDouble();
+
+        // Enough room for every job running at the top of the adaptive range for the whole pre-trigger window
+        double sampleRate = 0;
+        for (int i=0; i < entries.size(); i++) {
+            sampleRate += scheduler.tasks().at(i).targetRate;
+        }
+        const int capacity = static_cast<int>(preTrigger * sampleRate * 4) + 64;
+
+        capture.reset(new TriggerCapture(preTrigger, parser->value("post-trigger").toDouble(), capacity));
+        foreach (const QString &expression, parser->values("trigger")) {
+            try {
+                capture->addTrigger(Trigger::parse(expression), headers);
+            } catch (std::invalid_argument &error) {
+                throw CommandlineArgumentException(error.what());
+            }
+        }
+
+        if (isCapturingFrames) {
+            const QString framesName = QString("dpp-%1.frames").arg(logDate);
+            if (!frameWriter.open(framesName)) {
+                throw std::runtime_error(qPrintable(QString("Unable to open %1: %2").arg(framesName).arg(frameWriter.errorString())));
+            }
+            frameWriter.start();
+        }
+    }
 
     StdOut << headers.join("\t") << endl;
     StdOut << formats.join("\t") << endl;
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    double startTime = tv.tv_sec + (0.000001 * tv.tv_usec);
+    if (isRawLogged) {
+        logWriter.start();
+    }
 
-    while (true) {
-        QStringList outValues;
-        foreach (const DataLogEntry &entry, jobs.values()) {
-            DS2PlusPlus::ControlUnitPtr ourEcu = ecus[entry.ecuName];
+    // The bus gets a thread of its own; decoding and formatting happen here, and file I/O on the writers'.
+    DecodePipeline pipeline(scheduler);
+    for (int i=0; i < entries.size(); i++) {
+        pipeline.addTask(ecus[entries.at(i).ecuName], operations.at(i));
+    }
 
-            QStringList ourResults = entry.results;
+    ourInterrupted = 0;
+    signal(SIGINT, handleInterrupt);
+    signal(SIGTERM, handleInterrupt);
 
-            gettimeofday(&tv, NULL);
-            double execTime = tv.tv_sec + (0.000001 * tv.tv_usec);
-            double curTime = execTime - startTime;
+    pipeline.start();
 
-            PacketResponse ourResponse = ourEcu->executeOperation(entry.jobName);
+    QVector<QVariant> outValues(headers.size()), deltaValues(headers.size());
+    // Rows only start once every job has filled in its columns
+    int jobsPending = entries.size();
+    QVector<bool> hasRun(entries.size(), false);
 
-            outValues << QString::number(curTime, 'f', 5);
+    const bool isDelta = parser->isSet("delta");
+    const double deadband = parser->value("deadband").toDouble();
+    QVector<QVector<ChannelActivity> > activity;
+    foreach (const DataLogEntry &entry, entries) {
+        activity.append(QVector<ChannelActivity>(entry.results.size(), ChannelActivity(deadband)));
+    }
+    QVector<bool> changes;
+    bool hasWrittenRow = false;
+    double lastPreview = -1;
+    int lastDropped = 0, lastStalls = 0;
+
+    DecodePipeline::Sample ourSample;
+    PacketResponse ourResponse;
+    forever {
+        if (ourInterrupted and pipeline.isRunning()) {
+            pipeline.stop();
+        }
 
-            foreach (const QString &resultName, ourResults) {
-                QVariant ourResult = ourResponse.value(resultName);
-                switch (ourResult.type()) {
-                case QMetaType::Short:
-                case QMetaType::Int:
-                case QMetaType::Long:
-                case QMetaType::LongLong:
-                    outValues << QString::number(ourResult.toLongLong());
-                    break;
-                case QMetaType::UShort:
-                case QMetaType::UInt:
-                case QMetaType::ULong:
-                case QMetaType::ULongLong:
-                    outValues << QString::number(ourResult.toULongLong());
-                    break;
-                case QMetaType::Double:
-                case QMetaType::Float:
-                    outValues << QString::number(ourResult.toDouble(), 'f', 5);
-                    break;
-                case QMetaType::QString:
-                    outValues << ourResult.toString();
-                    break;
-                default:
-                    outValues << "";
-                    break;
+        // Replies queued before the bus thread stopped are still written out.  The bus thread can push its
+        // last replies after the timed wait gave up, so check the queue once more after seeing it stopped.
+        if (!pipeline.next(ourSample, ourResponse, PIPELINE_POLL_MSECS)) {
+            if (pipeline.isRunning()) {
+                continue;
+            }
+            if (!pipeline.next(ourSample, ourResponse, 0)) {
+                break;
+            }
+        }
+
+        const int task = ourSample.task;
+        const DataLogEntry &entry = entries.at(task);
+        const double execTime = ourSample.time;
+        const double startTime = pipeline.startTime();
+        const Frame &ourReply = ourSample.reply;
+
+        // Everything after the decode is the logger's own time.
+        TimelineSpan ourLogSpan("row", "log");
+
+        const double taskActivity = trackActivity(activity[task], entry.results, ourResponse, changes);
+        if (scheduler.isAdaptive()) {
+            pipeline.setActivity(task, taskActivity);
+        }
+
+        // Each row holds the latest value of every channel.
+        int column = columnStarts.at(task);
+        outValues[column++] = QVariant(execTime - startTime);
+        foreach (const QString &resultName, entry.results) {
+            outValues[column++] = ourResponse.value(resultName);
+        }
+        derived.update(outValues, columnStarts.at(task), column - 1);
+
+        if (aggregator) {
+            if (aggregator->advance(execTime - startTime)) {
+                writeAggregateRow(*aggregator, aggregateHeaders, aggregateUnits, isBinary ? &aggregateLog : 0, aggregateWriter);
+                windowsWritten++;
+            }
+            aggregator->add(outValues, columnStarts.at(task) + 1, column - 1);
+            for (int j=0; j < derived.count(); j++) {
+                if (derived.updated(j)) {
+                    aggregator->add(outValues, derived.column(j), derived.column(j));
+                }
+            }
+        }
+
+        if (!hasRun.at(task)) {
+            hasRun[task] = true;
+            jobsPending--;
+        }
+        if (jobsPending > 0) {
+            continue;
+        }
+
+        // In delta mode only the first row is complete; later rows carry just this job's changed channels.
+        QList<QVector<QVariant> > rows;
+        const QVector<QVariant> *rowValues = &outValues;
+        bool isRowDue = true;
+        if (isDelta and hasWrittenRow and !capture) {
+            deltaValues.fill(QVariant());
+            column = columnStarts.at(task);
+            deltaValues[column] = outValues.at(column);
+            isRowDue = false;
+            for (int j=0; j < changes.size(); j++) {
+                column++;
+                if (changes.at(j)) {
+                    deltaValues[column] = outValues.at(column);
+                    isRowDue = true;
+                }
+            }
+            for (int j=0; j < derived.count(); j++) {
+                if (derived.changed(j)) {
+                    deltaValues[derived.column(j)] = outValues.at(derived.column(j));
+                    isRowDue = true;
+                }
+            }
+            rowValues = &deltaValues;
+        }
+
+        if (capture) {
+            CapturedSample sample;
+            sample.time = execTime - startTime;
+            sample.task = task;
+            sample.values = outValues;
+            if (isCapturingFrames) {
+                quint8 frameBytes[Frame::MAX_FRAME];
+                sample.frame = QByteArray(reinterpret_cast<const char *>(frameBytes), ourReply.serialize(frameBytes));
+            }
+
+            foreach (const QString &expression, capture->add(sample)) {
+                qErr << QString("-- Trigger '%1' fired at %2 s").arg(expression).arg(sample.time, 0, 'f', 3) << endl;
+            }
+
+            foreach (const CapturedSample &ready, capture->takeReady()) {
+                rows << ready.values;
+                if (isCapturingFrames) {
+                    frameWriter.write(QString("%1\t%2\t%3\n").arg(ready.time, 0, 'f', 5).arg(scheduler.tasks().at(ready.task).name)
+                                      .arg(QString::fromLatin1(ready.frame.toHex())).toUtf8());
                 }
             }
+        } else if (isRowDue) {
+            rows << *rowValues;
+        }
+
+        if (!isRawLogged) {
+            rows.clear();
+        }
+
+        ourLogSpan.next("output");
+        foreach (const QVector<QVariant> &row, rows) {
+            if (isBinary) {
+                // Column types come from the first samples, so the header waits for every job to have run.
+                if (binaryLog.channels().isEmpty()) {
+                    QVector<DataLogChannel> channels;
+                    for (int i=0; i < derivedStart; i++) {
+                        channels.append(DataLogChannel::forValue(headers.at(i), formats.at(i), outValues.at(i), stringWidths.at(i)));
+                    }
+                    for (int i=derivedStart; i < headers.size(); i++) {
+                        channels.append(DataLogChannel(headers.at(i), formats.at(i), DataLogChannel::TypeDouble));
+                    }
+                    binaryLog.setChannels(channels);
+                    logWriter.write(isCompressed ? compressedLog.start(channels) : DataLogWriter::encodeHeader(channels));
+                }
+
+                if (isCompressed) {
+                    const QByteArray block = compressedLog.encode(row);
+                    if (!block.isEmpty()) {
+                        logWriter.write(block);
+                    }
+                } else {
+                    logWriter.write(binaryLog.encode(row));
+                }
+            } else {
+                logWriter.write((joinLogValues(row) + '\n').toUtf8());
+            }
+            hasWrittenRow = true;
+        }
+
+        // The preview always shows the latest value of every channel.
+        if ((previewInterval > 0) and ((lastPreview < 0) or ((execTime - lastPreview) * 1000 >= previewInterval))) {
+            StdOut << joinLogValues(outValues) << endl;
+            lastPreview = execTime;
+        }
 
-            usleep(200000); // 1/5th sec sleep
+        if ((logWriter.recordsDropped() != lastDropped) or (logWriter.stalls() != lastStalls)) {
+            lastDropped = logWriter.recordsDropped();
+            lastStalls = logWriter.stalls();
+            qErr << QString("-- Log writer is falling behind: %1 samples dropped, %2 stalls").arg(lastDropped).arg(lastStalls) << endl;
         }
-        QString outputLine = outValues.join("\t");
-        out << outputLine << endl;
-        StdOut << outputLine << endl;
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    pipeline.stop();
 
-        usleep(750000); // 3/4th sec sleep
+    if (aggregator and aggregator->flush()) {
+        writeAggregateRow(*aggregator, aggregateHeaders, aggregateUnits, isBinary ? &aggregateLog : 0, aggregateWriter);
+        windowsWritten++;
     }
-    file.close();
+
+    if (isCompressed and !compressedLog.channels().isEmpty()) {
+        logWriter.write(compressedLog.finish());
+    }
+
+    logWriter.stop();
+    frameWriter.stop();
+    aggregateWriter.stop();
+    reportWriteErrors(qErr, logWriter);
+    reportWriteErrors(qErr, frameWriter);
+    reportWriteErrors(qErr, aggregateWriter);
+    if (isRawLogged) {
+        qErr << QString("-- Wrote %1 records to %2 (%3 dropped, %4 stalls, queue peaked at %5)")
+                .arg(logWriter.recordsWritten()).arg(fileName).arg(logWriter.recordsDropped())
+                .arg(logWriter.stalls()).arg(logWriter.highWaterMark()) << endl;
+    }
+    if (aggregator) {
+        qErr << QString("-- Wrote %1 windows of %2 s to %3").arg(windowsWritten)
+                .arg(aggregator->window()).arg(aggregateName) << endl;
+    }
+    qErr << QString("-- Decoded %1 replies (%2 dropped, queue peaked at %3)").arg(pipeline.samplesQueued())
+            .arg(pipeline.samplesDropped()).arg(pipeline.highWaterMark()) << endl;
+
+    const LogScheduler &ourSchedule = pipeline.scheduler();
+    for (int i=0; i < entries.size(); i++) {
+        qErr << QString("-- %1: %2 Hz (planned %3 Hz)").arg(ourSchedule.tasks().at(i).name)
+                .arg(ourSchedule.achievedRate(i), 0, 'f', 2).arg(ourSchedule.plannedRate(i), 0, 'f', 2) << endl;
+    }
+
+    if (!pipeline.errorString().isEmpty()) {
+        throw std::runtime_error(qPrintable(pipeline.errorString()));
+    }
+}
+
+DS2PlusPlus::LogScheduler DataCollection::dataLogSchedule(const QMap<QString, DS2PlusPlus::ControlUnitPtr> &someEcus, const QList<DataLogEntry> &someEntries)
+{
+    using namespace DS2PlusPlus;
+
+    // --turnaround 40 sets the default, --turnaround DME=25 overrides it for one ECU
+    double defaultTurnaround = DEFAULT_TURNAROUND;
+    QHash<QString, double> turnarounds;
+    foreach (const QString &value, parser->values("turnaround")) {
+        const int equals = value.indexOf('=');
+        bool ok;
+        const double msecs = value.mid(equals + 1).toDouble(&ok);
+        if (!ok or (msecs < 0)) {
+            throw CommandlineArgumentException(qPrintable(QString("Invalid turnaround: %1").arg(value)));
+        }
+
+        if (equals < 0) {
+            defaultTurnaround = msecs / 1000;
+        } else {
+            turnarounds.insert(value.left(equals), msecs / 1000);
+        }
+    }
+
+    LogScheduler ret;
+    foreach (const DataLogEntry &entry, someEntries) {
+        const OperationPtr operation = someEcus[entry.ecuName]->operations().value(entry.jobName);
+        if (operation.isNull()) {
+            throw std::runtime_error(qPrintable(QString("Operation '%1' could not be found in %2").arg(entry.jobName).arg(entry.ecuName)));
+        }
+
+        // The job runs as fast as its fastest channel wants
+        double rate = 0;
+        foreach (double resultRate, entry.rates) {
+            rate = qMax(rate, resultRate);
+        }
+
+        const double turnaround = turnarounds.value(entry.ecuName, defaultTurnaround);
+        ret.addTask(QString("%1:%2").arg(entry.ecuName).arg(entry.jobName), (rate > 0) ? rate : DEFAULT_LOG_RATE, LogScheduler::estimateCost(*operation, turnaround));
+    }
+
+    if (parser->isSet("adaptive")) {
+        const QStringList range = parser->value("adaptive-range").split(":");
+        bool minimumOk = false, maximumOk = false;
+        double minimum = 0, maximum = 0;
+        if (range.size() == 2) {
+            minimum = range.at(0).toDouble(&minimumOk);
+            maximum = range.at(1).toDouble(&maximumOk);
+        }
+        if (!minimumOk or !maximumOk or (minimum <= 0) or (maximum < minimum)) {
+            throw CommandlineArgumentException("The adaptive range must be two factors, min:max, with 0 < min <= max.");
+        }
+        ret.setAdaptive(minimum, maximum);
+    }
+
+    return ret;
+}
+
+void DataCollection::printDataLogSchedule(const DS2PlusPlus::LogScheduler &aScheduler, const QList<DataLogEntry> &someEntries)
+{
+    using namespace DS2PlusPlus;
+
+    qOut << qSetFieldWidth(40) << left << "Channel" << qSetFieldWidth(14) << "Bus time" << "Target" << "Planned" << qSetFieldWidth(0) << endl;
+
+    for (int i=0; i < someEntries.size(); i++) {
+        const DataLogEntry &entry = someEntries.at(i);
+        const LogScheduler::Task &task = aScheduler.tasks().at(i);
+
+        for (int j=0; j < entry.results.size(); j++) {
+            // A channel without its own rate just rides along with its job
+            const double target = (entry.rates.at(j) > 0) ? entry.rates.at(j) : task.targetRate;
+            qOut << qSetFieldWidth(40) << left << QString("%1:%2").arg(task.name).arg(entry.results.at(j))
+                 << qSetFieldWidth(14) << QString("%1 ms").arg(task.cost * 1000, 0, 'f', 1)
+                 << QString("%1 Hz").arg(target, 0, 'f', 2)
+                 << QString("%1 Hz").arg(aScheduler.plannedRate(i), 0, 'f', 2) << qSetFieldWidth(0) << endl;
+        }
+    }
+
+    qOut << endl << QString("Bus utilization at the target rates: %1%").arg(aScheduler.utilization() * 100, 0, 'f', 0) << endl;
+    if (aScheduler.utilization() > 1) {
+        qOut << "The bus can't carry every target rate, so all rates are scaled back evenly." << endl;
+    }
+}
+
+void DataCollection::dataLogRecords(const QMap<QString, DS2PlusPlus::ControlUnitPtr> &someEcus, const QList<DataLogEntry> &someEntries, DS2PlusPlus::LogScheduler &aScheduler)
+{
+    using namespace DS2PlusPlus;
+
+    // Only the requested results end up in "values", so each job gets a tree holding just those keys.
+    QList<KeyPathTree> ourKeyPaths;
+    QList<TransactionRecord> ourRecords;
+    foreach (const DataLogEntry &entry, someEntries) {
+        ourKeyPaths.append(KeyPathTree(entry.results));
+
+        TransactionRecord record;
+        record.ecuUuid = someEcus[entry.ecuName]->uuid();
+        record.operation = entry.jobName;
+        ourRecords.append(record);
+    }
+
+    // The file is written on its own thread and the bus polled on another, leaving this one to decode and format.
+    AsyncLogWriter logWriter;
+    logWriter.setFlushInterval(parser->value("flush-interval").toInt());
+    logWriter.setSyncInterval(parser->value("sync-interval").toInt());
+    logWriter.setFullPolicy((parser->value("log-when-full") == "block") ? AsyncLogWriter::FullBlock : AsyncLogWriter::FullDrop);
+    const QString fileName = QString("dpp-%1.ndjson").arg(QDateTime::currentDateTime().toString());
+    if (!logWriter.open(fileName)) {
+        throw std::runtime_error(qPrintable(QString("Unable to open %1: %2").arg(fileName).arg(logWriter.errorString())));
+    }
+    QFile ourStdout;
+    ourStdout.open(stdout, QIODevice::WriteOnly);
+
+    // Each record is built once and handed to both files.
+    QByteArray ourLine;
+    JsonStreamWriter ourWriter(&ourLine);
+
+    const bool isDelta = parser->isSet("delta");
+    const double deadband = parser->value("deadband").toDouble();
+    QVector<QVector<ChannelActivity> > activity;
+    foreach (const DataLogEntry &entry, someEntries) {
+        activity.append(QVector<ChannelActivity>(entry.results.size(), ChannelActivity(deadband)));
+    }
+    QVector<bool> changes;
+
+    DecodePipeline pipeline(aScheduler);
+    foreach (const DataLogEntry &entry, someEntries) {
+        pipeline.addTask(someEcus[entry.ecuName], someEcus[entry.ecuName]->operations().value(entry.jobName));
+    }
+
+    ourInterrupted = 0;
+    signal(SIGINT, handleInterrupt);
+    signal(SIGTERM, handleInterrupt);
+
+    logWriter.start();
+    pipeline.start();
+
+    double lastFlush = -1;
+    DecodePipeline::Sample ourSample;
+    PacketResponse ourResponse;
+    forever {
+        if (ourInterrupted and pipeline.isRunning()) {
+            pipeline.stop();
+        }
+
+        // Drain whatever the bus thread queued before it stopped, as dataLog() does
+        if (!pipeline.next(ourSample, ourResponse, PIPELINE_POLL_MSECS)) {
+            if (pipeline.isRunning()) {
+                continue;
+            }
+            if (!pipeline.next(ourSample, ourResponse, 0)) {
+                break;
+            }
+        }
+
+        const int task = ourSample.task;
+        const DataLogEntry &entry = someEntries.at(task);
+        TransactionRecord &record = ourRecords[task];
+        record.timestamp = ourSample.time;
+        record.latency = ourSample.duration;
+
+        const double taskActivity = trackActivity(activity[task], entry.results, ourResponse, changes);
+        if (aScheduler.isAdaptive()) {
+            pipeline.setActivity(task, taskActivity);
+        }
+
+        if (isDelta) {
+            // Only the results that changed, and no record at all if none did
+            PacketResponse deltaResponse;
+            for (int j=0; j < changes.size(); j++) {
+                if (changes.at(j)) {
+                    deltaResponse.insert(entry.results.at(j), ourResponse.value(entry.results.at(j)));
+                }
+            }
+            ourResponse = deltaResponse;
+        }
+
+        TimelineSpan ourOutput("output", "log");
+        if (!isDelta or !ourResponse.isEmpty()) {
+            ourLine.resize(0);
+            ourWriter.writeTransaction(record, ourResponse, ourKeyPaths.at(task));
+            logWriter.write(ourLine);
+            ourStdout.write(ourLine);
+        }
+
+        // About one flush a second rather than one per record
+        if ((lastFlush < 0) or (record.timestamp - lastFlush >= 1.0)) {
+            ourStdout.flush();
+            lastFlush = record.timestamp;
+        }
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    pipeline.stop();
+    ourStdout.flush();
+    logWriter.stop();
+    reportWriteErrors(qErr, logWriter);
+
+    qErr << QString("-- Wrote %1 records to %2 (%3 dropped, %4 replies dropped before decoding)")
+            .arg(logWriter.recordsWritten()).arg(fileName).arg(logWriter.recordsDropped()).arg(pipeline.samplesDropped()) << endl;
+
+    if (!pipeline.errorString().isEmpty()) {
+        throw std::runtime_error(qPrintable(pipeline.errorString()));
+    }
+}
+
+void DataCollection::exportLog()
+{
+    using namespace DS2PlusPlus;
+
+    // Uncompressed logs are mapped; compressed ones are decoded a block at a time.
+    const QString path = parser->value("export-log");
+    const bool isCompressed = CompressedLogReader::isCompressedLog(path);
+    DataLogReader reader;
+    QFile compressedFile(path);
+    CompressedLogReader compressedReader;
+    try {
+        if (isCompressed) {
+            if (!compressedFile.open(QIODevice::ReadOnly)) {
+                throw std::runtime_error(qPrintable(QString("Unable to open data log %1: %2").arg(path).arg(compressedFile.errorString())));
+            }
+            compressedReader.open(&compressedFile);
+        } else {
+            reader.open(path);
+        }
+    } catch (std::runtime_error &error) {
+        throw CommandlineArgumentException(error.what());
+    }
+
+    const QVector<DataLogChannel> &channels = isCompressed ? compressedReader.channels() : reader.channels();
+    QFile ourStdout;
+    ourStdout.open(stdout, QIODevice::WriteOnly);
+
+    QVector<QVariant> values(channels.size());
+    qint64 record = 0;
+
+    if ((parser->value("format") == "json") or (parser->value("format") == "ndjson")) {
+        // One compact object per record, keyed by channel name
+        QStringList names;
+        foreach (const DataLogChannel &channel, channels) {
+            names << channel.name;
+        }
+        const KeyPathTree tree(names);
+        JsonStreamWriter writer(&ourStdout, JsonStreamWriter::StyleCompact);
+
+        while (nextLogRecord(reader, isCompressed ? &compressedReader : 0, record, values)) {
+            PacketResponse response;
+            for (int i=0; i < channels.size(); i++) {
+                if (values.at(i).isValid()) {
+                    response.insert(channels.at(i).name, values.at(i));
+                }
+            }
+            writer.write(response, tree);
+            ourStdout.write("\n");
+        }
+    } else {
+        // Same layout as the CSV data log
+        QTextStream out(&ourStdout);
+        QStringList headers, formats;
+        foreach (const DataLogChannel &channel, channels) {
+            headers << channel.name;
+            formats << channel.units;
+        }
+        out << headers.join("\t") << "\n";
+        out << formats.join("\t") << "\n";
+
+        while (nextLogRecord(reader, isCompressed ? &compressedReader : 0, record, values)) {
+            out << joinLogValues(values) << "\n";
+        }
+    }
+
+    ourStdout.flush();
 }
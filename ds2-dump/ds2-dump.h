@@ -27,8 +27,20 @@
 #include <QObject>
 #include <QSharedPointer>
 #include <QCommandLineParser>
+#include <QMap>
+#include <QStringList>
 
 #include <ds2/manager.h>
+#include <ds2/logscheduler.h>
+
+class DataLogEntry {
+public:
+    QString ecuName;
+    QString jobName;
+    QStringList results;
+    /*! Requested rate in Hz for each of \ref results, 0 where none was given. */
+    QList<double> rates;
+};
 
 class DataCollection : public QObject
 {
@@ -49,9 +61,17 @@ public slots:
     void runOperation();
     void dataLog();
     void rawQuery();
+    void remote();
+    void exportLog();
+    void printStatistics();
+    void writeTimeline();
+    void printAllocations();
 
 protected:
     void serialSetup(QSharedPointer<QCommandLineParser> parser);
+    DS2PlusPlus::LogScheduler dataLogSchedule(const QMap<QString, DS2PlusPlus::ControlUnitPtr> &someEcus, const QList<DataLogEntry> &someEntries);
+    void printDataLogSchedule(const DS2PlusPlus::LogScheduler &aScheduler, const QList<DataLogEntry> &someEntries);
+    void dataLogRecords(const QMap<QString, DS2PlusPlus::ControlUnitPtr> &someEcus, const QList<DataLogEntry> &someEntries, DS2PlusPlus::LogScheduler &aScheduler);
     DS2PlusPlus::ManagerPtr dbm;
     QTextStream qOut, qErr;
     QSharedPointer<QCommandLineParser> parser;
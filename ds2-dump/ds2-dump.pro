@@ -5,7 +5,7 @@
 #-------------------------------------------------
 
 QT       -= gui
-QT       += core sql
+QT       += core sql network
 
 CONFIG   += c++11
 
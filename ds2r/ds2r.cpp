@@ -0,0 +1,431 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include <stdexcept>
+
+#include <QLocalSocket>
+
+#include <ds2/ds2packet.h>
+#include <ds2/controlunit.h>
+#include <ds2/exceptions.h>
+#include <ds2/trace.h>
+
+#include "ds2r.h"
+
+namespace {
+    // Seconds an ECU is assumed to take before it starts replying
+    const double DEFAULT_TURNAROUND = 0.05;
+
+    // Seconds of bus time assumed for a poll whose operation can't be looked up
+    const double UNKNOWN_COST = 0.1;
+
+    double monotonicSeconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + (0.000000001 * ts.tv_nsec);
+    }
+
+    int indexOfPoll(const QList<DS2PlusPlus::SubscriptionHub::Poll> &somePolls, const QString &anEcu, const QString &anOperation)
+    {
+        for (int i=0; i < somePolls.size(); i++) {
+            if ((somePolls.at(i).ecu == anEcu) and (somePolls.at(i).operation == anOperation)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    DS2PlusPlus::RemoteMessage errorReply(quint32 anId, const QString &anError)
+    {
+        DS2PlusPlus::RemoteMessage ret(DS2PlusPlus::RemoteMessage::Error, anId);
+        ret.error = anError;
+        return ret;
+    }
+}
+
+BusWorker::BusWorker(DS2PlusPlus::ManagerPtr aManager, DS2PlusPlus::SubscriptionHub *aHub, int aQueueLength, QObject *aParent) :
+    QObject(aParent), _manager(aManager), _hub(aHub), _queueLength(aQueueLength), _generation(0), _pollTimer(new QTimer(this))
+{
+    _pollTimer->setSingleShot(true);
+    connect(_pollTimer, &QTimer::timeout, this, &BusWorker::poll);
+}
+
+void BusWorker::start()
+{
+    // Nothing can be served without the database, and an exception mustn't escape a slot.
+    try {
+        _manager->initializeManager();
+    } catch (std::exception &error) {
+        emit fatal(QString::fromUtf8(error.what()));
+    }
+}
+
+DS2PlusPlus::ControlUnitPtr BusWorker::resolve(const QString &anEcu)
+{
+    using namespace DS2PlusPlus;
+
+    if (_ecus.contains(anEcu)) {
+        return _ecus.value(anEcu);
+    }
+
+    ControlUnitPtr ret;
+    if (anEcu.length() == 36) {
+        ret = ControlUnitPtr(new ControlUnit(anEcu, _manager.data()));
+    } else {
+        bool ok;
+        const quint8 address = anEcu.startsWith("0x") ? anEcu.toUShort(&ok, 16) : anEcu.toUShort(&ok, 10);
+        const QList<quint8> addresses = ok ? (QList<quint8>() << address) : ControlUnit::addressForFamily(anEcu.toUpper());
+        foreach (quint8 candidate, addresses) {
+            ret = _manager->findModuleAtAddress(candidate);
+            if (!ret.isNull()) {
+                break;
+            }
+        }
+    }
+
+    if (ret.isNull()) {
+        throw std::runtime_error(qPrintable(QString("Could not locate ECU at %1").arg(anEcu)));
+    }
+
+    _ecus.insert(anEcu, ret);
+    return ret;
+}
+
+DS2PlusPlus::OperationPtr BusWorker::findOperation(const DS2PlusPlus::ControlUnitPtr &aUnit, const QString &aName) const
+{
+    const DS2PlusPlus::OperationPtr ret = aUnit->operations().value(aName);
+    if (ret.isNull()) {
+        throw std::invalid_argument(qPrintable(QString("Operation '%1' could not be found in ECU %2").arg(aName).arg(aUnit->name())));
+    }
+    return ret;
+}
+
+void BusWorker::handle(quint64 aClient, const DS2PlusPlus::RemoteMessage &aRequest)
+{
+    using namespace DS2PlusPlus;
+
+    RemoteMessage ourReply;
+    try {
+        if (aRequest.type == RemoteMessage::Subscribe) {
+            const ControlUnitPtr ourEcu = resolve(aRequest.ecu);
+            const OperationPtr ourOperation = findOperation(ourEcu, aRequest.operation);
+
+            // Keyed by UUID, so "DME" and "0x12" share a poll
+            _ecus.insert(ourEcu->uuid(), ourEcu);
+            _hub->subscribe(aClient, aRequest.id, ourEcu->uuid(), ourOperation->name(), aRequest.results, aRequest.rate, _queueLength);
+            rebuildSchedule();
+            ourReply = RemoteMessage(RemoteMessage::Subscribed, aRequest.id);
+        } else if (aRequest.type == RemoteMessage::Invalidate) {
+            if (aRequest.ecu.isEmpty()) {
+                _manager->responseCache().clear();
+            } else {
+                _manager->responseCache().invalidate(resolve(aRequest.ecu)->address());
+            }
+            // Whatever is plugged in next has to be identified again, but running polls keep their modules
+            _ecus.clear();
+            foreach (const SubscriptionHub::Poll &poll, _polls) {
+                resolve(poll.ecu);
+            }
+            ourReply = aRequest;
+        } else if (aRequest.type == RemoteMessage::Unsubscribe) {
+            _hub->unsubscribe(aClient, aRequest.id);
+            rebuildSchedule();
+            // Acknowledged by echoing the request
+            ourReply = aRequest;
+        } else {
+            ourReply = execute(aRequest);
+        }
+    } catch (TimeoutException) {
+        ourReply = errorReply(aRequest.id, "Timed out waiting for the ECU.");
+    } catch (std::exception &error) {
+        ourReply = errorReply(aRequest.id, error.what());
+    }
+
+    emit reply(aClient, ourReply);
+}
+
+DS2PlusPlus::RemoteMessage BusWorker::execute(const DS2PlusPlus::RemoteMessage &aRequest)
+{
+    using namespace DS2PlusPlus;
+
+    switch (aRequest.type) {
+    case RemoteMessage::RunOperation: {
+        const ControlUnitPtr ourEcu = resolve(aRequest.ecu);
+        const OperationPtr ourOperation = findOperation(ourEcu, aRequest.operation);
+
+        RemoteMessage ret(RemoteMessage::Response, aRequest.id);
+        ret.ecu = ourEcu->uuid();
+        ret.operation = aRequest.operation;
+        ret.timestamp = monotonicSeconds();
+        ourEcu->executeOperation(ourOperation, ret.response);
+        ret.latency = monotonicSeconds() - ret.timestamp;
+        return ret;
+    }
+    case RemoteMessage::Probe: {
+        // Identify again; the identity itself comes from the response cache while its TTL lasts
+        _ecus.remove(aRequest.ecu);
+        const ControlUnitPtr ourEcu = resolve(aRequest.ecu);
+
+        RemoteMessage ret(RemoteMessage::ProbeResult, aRequest.id);
+        ret.ecu = ourEcu->uuid();
+        ret.response.insert("uuid", ourEcu->uuid());
+        ret.response.insert("name", ourEcu->name());
+        ret.response.insert("family", ourEcu->family());
+        ret.response.insert("address", ourEcu->address());
+        return ret;
+    }
+    case RemoteMessage::RawQuery: {
+        bool ok;
+        const quint8 address = aRequest.ecu.startsWith("0x") ? aRequest.ecu.toUShort(&ok, 16) : aRequest.ecu.toUShort(&ok, 10);
+        if (!ok) {
+            throw std::invalid_argument("A raw query needs a numerical ECU address.");
+        }
+
+        // A raw query may well be a write, so nothing cached for the ECU can be trusted afterwards
+        _manager->responseCache().invalidate(address);
+        const BasePacketPtr ourReplyPacket = _manager->query(BasePacketPtr(new DS2Packet(address, aRequest.data)));
+
+        RemoteMessage ret(RemoteMessage::RawReply, aRequest.id);
+        ret.ecu = QString("0x%1").arg(ourReplyPacket->targetAddress(), 2, 16, QChar('0'));
+        ret.data = ourReplyPacket->data();
+        return ret;
+    }
+    default:
+        throw std::invalid_argument(qPrintable(QString("Unexpected request type 0x%1").arg(aRequest.type, 2, 16, QChar('0'))));
+    }
+}
+
+void BusWorker::dropClient(quint64 aClient)
+{
+    _hub->unsubscribeAll(aClient);
+    rebuildSchedule();
+}
+
+void BusWorker::rebuildSchedule()
+{
+    using namespace DS2PlusPlus;
+
+    _generation = _hub->generation();
+    const QList<SubscriptionHub::Poll> ourPolls = _hub->polls();
+
+    // Polls that carry on keep their place in the schedule, so a subscription coming or going
+    // doesn't make every other poll due at once or throw away its measured cost.
+    for (int i=_polls.size() - 1; i >= 0; i--) {
+        if (indexOfPoll(ourPolls, _polls.at(i).ecu, _polls.at(i).operation) < 0) {
+            _scheduler.removeTask(i);
+            _polls.removeAt(i);
+        }
+    }
+
+    foreach (const SubscriptionHub::Poll &poll, ourPolls) {
+        const int task = indexOfPoll(_polls, poll.ecu, poll.operation);
+        if (task >= 0) {
+            _scheduler.setTargetRate(task, poll.rate);
+            _polls[task] = poll;
+            continue;
+        }
+
+        // An ECU that can't be found right now is still polled, so its subscribers hear about it from poll()
+        double cost = UNKNOWN_COST;
+        try {
+            cost = LogScheduler::estimateCost(*findOperation(resolve(poll.ecu), poll.operation), DEFAULT_TURNAROUND);
+        } catch (std::exception &error) {
+            DS2_TRACE(General) << "ds2r: can't plan " << poll.ecu << ":" << poll.operation << ": " << error.what();
+        }
+        // New tasks are due straight away
+        _scheduler.addTask(QString("%1:%2").arg(poll.ecu).arg(poll.operation), poll.rate, cost);
+        _polls.append(poll);
+    }
+    DS2_TRACE(General) << "ds2r: polling " << _polls.size() << " operations at " << (_scheduler.utilization() * 100) << "% of the bus";
+
+    _pollTimer->start(0);
+}
+
+void BusWorker::poll()
+{
+    using namespace DS2PlusPlus;
+
+    if (_hub->generation() != _generation) {
+        rebuildSchedule();
+        return;
+    }
+
+    double wait;
+    const int task = _scheduler.next(monotonicSeconds(), wait);
+    if (task < 0) {
+        return;
+    }
+    if (wait > 0) {
+        _pollTimer->start(qMax(1, static_cast<int>(wait * 1000)));
+        return;
+    }
+
+    const SubscriptionHub::Poll &ourPoll = _polls.at(task);
+    const double start = monotonicSeconds();
+
+    QList<quint64> ourClients;
+    try {
+        const ControlUnitPtr ourEcu = resolve(ourPoll.ecu);
+        PacketResponse ourResponse;
+        ourEcu->executeOperation(findOperation(ourEcu, ourPoll.operation), ourResponse);
+        const double latency = monotonicSeconds() - start;
+
+        // Only what some subscriber asked for goes into the hub; each of them gets its own subset from there.
+        if (!ourPoll.results.isEmpty()) {
+            PacketResponse wanted;
+            foreach (const QString &result, ourPoll.results) {
+                PacketResponse::const_iterator value = ourResponse.constFind(result);
+                if (value != ourResponse.constEnd()) {
+                    wanted.insert(result, value.value());
+                }
+            }
+            ourResponse.swap(wanted);
+        }
+        ourClients = _hub->publish(ourPoll.ecu, ourPoll.operation, start, latency, ourResponse);
+    } catch (TimeoutException) {
+        ourClients = _hub->publishError(ourPoll.ecu, ourPoll.operation, start, "Timed out waiting for the ECU.");
+    } catch (std::exception &error) {
+        ourClients = _hub->publishError(ourPoll.ecu, ourPoll.operation, start, error.what());
+    }
+
+    _scheduler.completed(task, start, monotonicSeconds() - start);
+    foreach (quint64 client, ourClients) {
+        emit samplesReady(client);
+    }
+
+    // Come back through the event loop so waiting requests get their turn
+    _pollTimer->start(0);
+}
+
+RemoteServer::RemoteServer(DS2PlusPlus::SubscriptionHub *aHub, QObject *aParent) :
+    QObject(aParent), _hub(aHub), _nextClient(1)
+{
+    connect(&_server, &QLocalServer::newConnection, this, &RemoteServer::accept);
+}
+
+void RemoteServer::listen(const QString &aPath)
+{
+    // A socket left behind by a daemon that didn't exit cleanly would stop us listening.
+    QLocalServer::removeServer(aPath);
+    _server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!_server.listen(aPath)) {
+        throw std::runtime_error(qPrintable(QString("Could not listen on %1: %2").arg(aPath).arg(_server.errorString())));
+    }
+}
+
+void RemoteServer::accept()
+{
+    while (_server.hasPendingConnections()) {
+        QLocalSocket *socket = _server.nextPendingConnection();
+        const quint64 client = _nextClient++;
+        socket->setProperty("client", client);
+
+        Client &ourClient = _clients[client];
+        ourClient.socket = socket;
+
+        connect(socket, &QLocalSocket::readyRead, this, &RemoteServer::read);
+        connect(socket, &QLocalSocket::bytesWritten, this, &RemoteServer::written);
+        connect(socket, &QLocalSocket::disconnected, this, &RemoteServer::disconnected);
+        DS2_TRACE(General) << "ds2r: client " << client << " connected";
+    }
+}
+
+void RemoteServer::read()
+{
+    using namespace DS2PlusPlus;
+
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    const quint64 client = socket->property("client").toULongLong();
+    if (!_clients.contains(client)) {
+        return;
+    }
+
+    Client &ourClient = _clients[client];
+    ourClient.reader.append(socket->readAll());
+
+    RemoteMessage ourRequest;
+    try {
+        while (ourClient.reader.next(ourRequest)) {
+            if (!RemoteMessage::isRequest(ourRequest.type)) {
+                send(client, errorReply(ourRequest.id, "Only requests can be sent to ds2r."));
+                continue;
+            }
+            emit request(client, ourRequest);
+        }
+    } catch (std::runtime_error &error) {
+        // There's no finding the next frame in a corrupt stream
+        send(client, errorReply(0, error.what()));
+        socket->disconnectFromServer();
+    }
+}
+
+void RemoteServer::send(quint64 aClient, const DS2PlusPlus::RemoteMessage &aMessage)
+{
+    if (!_clients.contains(aClient)) {
+        return;
+    }
+
+    _clients.value(aClient).socket->write(aMessage.encode());
+}
+
+void RemoteServer::drain(quint64 aClient)
+{
+    using namespace DS2PlusPlus;
+
+    if (!_clients.contains(aClient)) {
+        return;
+    }
+
+    QLocalSocket *socket = _clients.value(aClient).socket;
+    SubscriptionHub::Sample ourSample;
+    while ((socket->bytesToWrite() < MAX_PENDING_BYTES) and _hub->take(aClient, ourSample)) {
+        RemoteMessage ourMessage(ourSample.isError() ? RemoteMessage::Error : RemoteMessage::Sample, ourSample.tag);
+        ourMessage.ecu = ourSample.ecu;
+        ourMessage.operation = ourSample.operation;
+        ourMessage.timestamp = ourSample.timestamp;
+        ourMessage.latency = ourSample.latency;
+        ourMessage.response = ourSample.response;
+        ourMessage.error = ourSample.error;
+        ourMessage.dropped = ourSample.dropped;
+        socket->write(ourMessage.encode());
+    }
+}
+
+void RemoteServer::written()
+{
+    drain(sender()->property("client").toULongLong());
+}
+
+void RemoteServer::disconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    const quint64 client = socket->property("client").toULongLong();
+
+    _clients.remove(client);
+    socket->deleteLater();
+    emit clientGone(client);
+    DS2_TRACE(General) << "ds2r: client " << client << " disconnected";
+}
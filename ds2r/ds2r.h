@@ -0,0 +1,143 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DS2R_H
+#define DS2R_H
+
+#include <QHash>
+#include <QList>
+#include <QLocalServer>
+#include <QObject>
+#include <QTimer>
+
+#include <ds2/manager.h>
+#include <ds2/logscheduler.h>
+#include <ds2/remote.h>
+#include <ds2/subscriptionhub.h>
+
+/*!
+ * \brief openSerialPort opens and configures the K-line interface at \a aPath.
+ * \throws std::ios_base::failure if it can't.
+ */
+int openSerialPort(const QString &aPath);
+
+/*!
+ * \brief The BusWorker class owns the Manager and does everything that touches the bus or the database.
+ *
+ * It lives on its own thread, so a slow ECU never holds up the socket.  Requests are answered in the
+ * order they arrive; the SubscriptionHub's merged polls are run earliest deadline first in between them,
+ * and each response is published to the hub for every subscriber at once.
+ */
+class BusWorker : public QObject
+{
+    Q_OBJECT
+public:
+    /*!
+     * \param aManager Not yet initialized; start() does that on the worker's thread, which then owns the database.
+     * \param aHub Shared with the RemoteServer, which takes the samples out.
+     * \param aQueueLength Samples each subscription may have waiting before the oldest are dropped.
+     */
+    BusWorker(DS2PlusPlus::ManagerPtr aManager, DS2PlusPlus::SubscriptionHub *aHub,
+              int aQueueLength = DS2PlusPlus::SubscriptionHub::DEFAULT_QUEUE_LENGTH, QObject *aParent = 0);
+
+signals:
+    void reply(quint64 aClient, const DS2PlusPlus::RemoteMessage &aMessage);
+    void samplesReady(quint64 aClient);
+    /*! \brief The worker can't carry on, e.g. the database couldn't be opened. */
+    void fatal(const QString &anError);
+
+public slots:
+    void start();
+    void handle(quint64 aClient, const DS2PlusPlus::RemoteMessage &aRequest);
+    void dropClient(quint64 aClient);
+
+protected slots:
+    void poll();
+
+protected:
+    DS2PlusPlus::ControlUnitPtr resolve(const QString &anEcu);
+    DS2PlusPlus::OperationPtr findOperation(const DS2PlusPlus::ControlUnitPtr &aUnit, const QString &aName) const;
+    DS2PlusPlus::RemoteMessage execute(const DS2PlusPlus::RemoteMessage &aRequest);
+    void rebuildSchedule();
+
+    DS2PlusPlus::ManagerPtr _manager;
+    //! ECUs already identified, by the string the client used for them
+    QHash<QString, DS2PlusPlus::ControlUnitPtr> _ecus;
+    DS2PlusPlus::SubscriptionHub *_hub;
+    int _queueLength;
+    //! What _scheduler's tasks were built from, in task order, as of hub generation _generation
+    QList<DS2PlusPlus::SubscriptionHub::Poll> _polls;
+    quint64 _generation;
+    DS2PlusPlus::LogScheduler _scheduler;
+    QTimer *_pollTimer;
+};
+
+/*!
+ * \brief The RemoteServer class accepts connections on the local socket and passes requests to the BusWorker.
+ *
+ * Samples are only taken from the hub while a client's socket has room for them, so a client that stops
+ * reading loses its oldest samples in the hub instead of growing the daemon's write buffers.
+ */
+class RemoteServer : public QObject
+{
+    Q_OBJECT
+public:
+    /*! \brief Bytes a client may have waiting in its socket before we stop sending it samples. */
+    static const qint64 MAX_PENDING_BYTES = 64 * 1024;
+
+    explicit RemoteServer(DS2PlusPlus::SubscriptionHub *aHub, QObject *aParent = 0);
+
+    /*!
+     * \throws std::runtime_error if the socket can't be created.
+     */
+    void listen(const QString &aPath);
+
+signals:
+    void request(quint64 aClient, const DS2PlusPlus::RemoteMessage &aRequest);
+    void clientGone(quint64 aClient);
+
+public slots:
+    void send(quint64 aClient, const DS2PlusPlus::RemoteMessage &aMessage);
+    void drain(quint64 aClient);
+
+protected slots:
+    void accept();
+    void read();
+    void written();
+    void disconnected();
+
+protected:
+    class Client
+    {
+    public:
+        QLocalSocket *socket;
+        DS2PlusPlus::RemoteMessageReader reader;
+    };
+
+    QLocalServer _server;
+    DS2PlusPlus::SubscriptionHub *_hub;
+    QHash<quint64, Client> _clients;
+    quint64 _nextClient;
+};
+
+#endif // DS2R_H
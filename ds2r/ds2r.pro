@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# ds2r: keeps the bus, the definitions and the identified ECUs warm,
+# and serves requests from ds2-dump --remote over a local socket.
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += core sql network
+
+CONFIG   += c++11
+
+TARGET = ds2r
+CONFIG += console
+CONFIG -= app_bundle
+
+LIBS += -lds2
+INCLUDEPATH += ../libds2
+LIBPATH += ../libds2
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    ds2r.cpp \
+    ds2r-serial-unix.cpp
+
+HEADERS += \
+    ds2r.h
@@ -1 +1,138 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
 
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSocketNotifier>
+#include <QThread>
+#include <QTimer>
+
+#include "ds2r.h"
+
+namespace {
+    // SIGINT and SIGTERM write a byte here; the event loop reads it and quits, so everything is torn down normally.
+    int ourSignalPipe[2] = { -1, -1 };
+
+    void handleSignal(int)
+    {
+        const char byte = 1;
+        if (write(ourSignalPipe[1], &byte, sizeof(byte)) < 0) {
+            // Nothing useful can be done about it in a signal handler
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    using namespace DS2PlusPlus;
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationVersion(QString("0.1.0 (libds2 %1)").arg(Manager::version()));
+    app.setOrganizationDomain("inferiorhumanorgans.com");
+    app.setOrganizationName("Inferior Human Organs, Inc.");
+
+    QSharedPointer<QCommandLineParser> parser(new QCommandLineParser);
+    parser->setApplicationDescription("Owns the K-line interface and answers ds2-dump --remote over a local socket");
+    parser->addHelpOption();
+    parser->addVersionOption();
+
+    ManagerPtr dbm(new Manager(parser));
+
+    QCommandLineOption socketOption("socket", "The local socket to listen on.", "path", RemoteMessage::defaultSocketPath());
+    parser->addOption(socketOption);
+
+    QCommandLineOption queueLengthOption("queue-length", "Samples each subscription may have waiting before its oldest are dropped.", "samples", QString::number(SubscriptionHub::DEFAULT_QUEUE_LENGTH));
+    parser->addOption(queueLengthOption);
+
+    parser->process(app);
+
+    qRegisterMetaType<RemoteMessage>();
+
+    bool ok;
+    const int queueLength = parser->value("queue-length").toInt(&ok);
+    if (!ok or (queueLength < 1)) {
+        std::cerr << "Please specify a valid positive integer for the queue length." << std::endl;
+        return 1;
+    }
+
+    SubscriptionHub hub;
+    QThread busThread;
+    BusWorker *worker = new BusWorker(dbm, &hub, queueLength);
+    RemoteServer server(&hub);
+
+    try {
+        if (!parser->isSet("device")) {
+            throw std::invalid_argument("A serial port is required.");
+        }
+        dbm->setFd(openSerialPort(parser->value("device")));
+        server.listen(parser->value("socket"));
+    } catch (std::exception &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    if (pipe(ourSignalPipe) != 0) {
+        std::cerr << "Unable to create the signal pipe." << std::endl;
+        return 1;
+    }
+    QSocketNotifier signalNotifier(ourSignalPipe[0], QSocketNotifier::Read);
+    QObject::connect(&signalNotifier, &QSocketNotifier::activated, &app, [](int aFd) {
+        char byte;
+        if (read(aFd, &byte, sizeof(byte)) > 0) {
+            QCoreApplication::quit();
+        }
+    });
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    // Everything that touches the port or the database happens on the bus thread.
+    dbm->moveToThread(&busThread);
+    worker->moveToThread(&busThread);
+    QObject::connect(&busThread, &QThread::started, worker, &BusWorker::start);
+    QObject::connect(&busThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    QObject::connect(&server, &RemoteServer::request, worker, &BusWorker::handle);
+    QObject::connect(&server, &RemoteServer::clientGone, worker, &BusWorker::dropClient);
+    QObject::connect(worker, &BusWorker::reply, &server, &RemoteServer::send);
+    QObject::connect(worker, &BusWorker::samplesReady, &server, &RemoteServer::drain);
+    QObject::connect(worker, &BusWorker::fatal, &app, [](const QString &anError) {
+        std::cerr << qPrintable(anError) << std::endl;
+        QCoreApplication::exit(1);
+    });
+
+    busThread.start();
+    const int ret = app.exec();
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    // Returning normally lets the server remove its socket and the Manager unlink any shared value segment.
+    busThread.quit();
+    busThread.wait();
+    return ret;
+}
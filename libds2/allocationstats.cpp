@@ -0,0 +1,240 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <QAtomicInteger>
+#include <QStringList>
+
+#include <ds2/allocationstats.h>
+
+namespace {
+    QAtomicInt ourEnabled(0);
+    QAtomicInteger<quint64> ourAllocations[DS2PlusPlus::AllocationStats::SubsystemCount];
+    QAtomicInteger<quint64> ourBytes[DS2PlusPlus::AllocationStats::SubsystemCount];
+    QAtomicInteger<quint64> ourFrees;
+
+    // Plain int so reading it from inside malloc() never allocates
+    thread_local int ourSubsystem = DS2PlusPlus::AllocationStats::Unattributed;
+
+#ifdef DS2_ALLOCATION_STATS
+    inline void countAllocation(size_t aSize)
+    {
+        if (ourEnabled.load()) {
+            ourAllocations[ourSubsystem].fetchAndAddRelaxed(1);
+            ourBytes[ourSubsystem].fetchAndAddRelaxed(aSize);
+        }
+    }
+
+    inline void countFree(void *aPointer)
+    {
+        if (aPointer and ourEnabled.load()) {
+            ourFrees.fetchAndAddRelaxed(1);
+        }
+    }
+#endif
+}
+
+#ifdef DS2_ALLOCATION_STATS
+/*
+ * These take the place of the C library's allocator for the whole process, counting each call and then
+ * handing it to glibc's own implementation.  Aligned allocations aren't counted, but they are freed through
+ * here like everything else.
+ */
+extern "C" {
+    void *__libc_malloc(size_t aSize);
+    void *__libc_calloc(size_t aCount, size_t aSize);
+    void *__libc_realloc(void *aPointer, size_t aSize);
+    void __libc_free(void *aPointer);
+
+    void *malloc(size_t aSize)
+    {
+        countAllocation(aSize);
+        return __libc_malloc(aSize);
+    }
+
+    void *calloc(size_t aCount, size_t aSize)
+    {
+        countAllocation(aCount * aSize);
+        return __libc_calloc(aCount, aSize);
+    }
+
+    void *realloc(void *aPointer, size_t aSize)
+    {
+        countAllocation(aSize);
+        return __libc_realloc(aPointer, aSize);
+    }
+
+    void free(void *aPointer)
+    {
+        countFree(aPointer);
+        __libc_free(aPointer);
+    }
+}
+#endif
+
+namespace DS2PlusPlus {
+    AllocationStats::Snapshot::Snapshot() :
+        frees(0)
+    {
+        memset(allocations, 0, sizeof(allocations));
+        memset(bytes, 0, sizeof(bytes));
+    }
+
+    quint64 AllocationStats::Snapshot::totalAllocations() const
+    {
+        quint64 ret = 0;
+        for (int i=0; i < SubsystemCount; i++) {
+            ret += allocations[i];
+        }
+        return ret;
+    }
+
+    quint64 AllocationStats::Snapshot::totalBytes() const
+    {
+        quint64 ret = 0;
+        for (int i=0; i < SubsystemCount; i++) {
+            ret += bytes[i];
+        }
+        return ret;
+    }
+
+    AllocationStats::Snapshot AllocationStats::Snapshot::operator-(const Snapshot &anEarlier) const
+    {
+        Snapshot ret;
+        for (int i=0; i < SubsystemCount; i++) {
+            ret.allocations[i] = allocations[i] - anEarlier.allocations[i];
+            ret.bytes[i] = bytes[i] - anEarlier.bytes[i];
+        }
+        ret.frees = frees - anEarlier.frees;
+        return ret;
+    }
+
+    bool AllocationStats::isAvailable()
+    {
+#ifdef DS2_ALLOCATION_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool AllocationStats::isEnabled()
+    {
+        return ourEnabled.load();
+    }
+
+    void AllocationStats::setEnabled(bool isEnabled)
+    {
+        ourEnabled.store(isEnabled and isAvailable());
+    }
+
+    AllocationStats::Snapshot AllocationStats::snapshot()
+    {
+        Snapshot ret;
+        for (int i=0; i < SubsystemCount; i++) {
+            ret.allocations[i] = ourAllocations[i].load();
+            ret.bytes[i] = ourBytes[i].load();
+        }
+        ret.frees = ourFrees.load();
+        return ret;
+    }
+
+    void AllocationStats::reset()
+    {
+        for (int i=0; i < SubsystemCount; i++) {
+            ourAllocations[i].store(0);
+            ourBytes[i].store(0);
+        }
+        ourFrees.store(0);
+    }
+
+    QString AllocationStats::subsystemName(Subsystem aSubsystem)
+    {
+        switch (aSubsystem) {
+        case PacketIO:
+            return "packet I/O";
+        case Decode:
+            return "decode";
+        case DefinitionLoad:
+            return "definition load";
+        case JsonOutput:
+            return "JSON output";
+        default:
+            return "unattributed";
+        }
+    }
+
+    AllocationStats::Subsystem AllocationStats::enter(Subsystem aSubsystem)
+    {
+        const Subsystem ret = static_cast<Subsystem>(ourSubsystem);
+        ourSubsystem = aSubsystem;
+        return ret;
+    }
+
+    void AllocationStats::leave(Subsystem aPrevious)
+    {
+        ourSubsystem = aPrevious;
+    }
+
+    QString AllocationStats::summary(const Snapshot &aSnapshot, quint64 aTransactions)
+    {
+        QString ret = QString("%1  %2  %3").arg("Subsystem", -16).arg("allocations", 12).arg("bytes", 14);
+        if (aTransactions) {
+            ret += QString("  %1  %2").arg("per transaction", 15).arg("bytes each", 12);
+        }
+        ret += "\n";
+
+        for (int i=0; i <= SubsystemCount; i++) {
+            const bool isTotal = (i == SubsystemCount);
+            const quint64 allocations = isTotal ? aSnapshot.totalAllocations() : aSnapshot.allocations[i];
+            const quint64 bytes = isTotal ? aSnapshot.totalBytes() : aSnapshot.bytes[i];
+
+            ret += QString("%1  %2  %3").arg(isTotal ? QString("total") : subsystemName(static_cast<Subsystem>(i)), -16)
+                    .arg(allocations, 12).arg(bytes, 14);
+            if (aTransactions) {
+                ret += QString("  %1  %2").arg(static_cast<double>(allocations) / aTransactions, 15, 'f', 1)
+                        .arg(static_cast<double>(bytes) / aTransactions, 12, 'f', 0);
+            }
+            ret += "\n";
+        }
+
+        ret += QString("%1 frees\n").arg(aSnapshot.frees);
+        return ret;
+    }
+
+    QString AllocationStats::line(const Snapshot &aSnapshot)
+    {
+        QStringList parts;
+        for (int i=0; i < SubsystemCount; i++) {
+            if (aSnapshot.allocations[i]) {
+                parts << QString("%1 %2 (%3 B)").arg(subsystemName(static_cast<Subsystem>(i)))
+                         .arg(aSnapshot.allocations[i]).arg(aSnapshot.bytes[i]);
+            }
+        }
+
+        return QString("%1 allocations, %2 B: %3").arg(aSnapshot.totalAllocations()).arg(aSnapshot.totalBytes())
+                .arg(parts.isEmpty() ? QString("none") : parts.join(", "));
+    }
+}
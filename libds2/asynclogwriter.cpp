@@ -0,0 +1,210 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include <ds2/asynclogwriter.h>
+
+namespace {
+    // How long the writer thread naps when it finds the queue empty
+    const int IDLE_MSECS = 2;
+    // How long a blocked write() waits before trying the queue again
+    const int STALL_USECS = 100;
+}
+
+namespace DS2PlusPlus {
+    AsyncLogWriter::AsyncLogWriter(int aQueueCapacity, QObject *aParent) :
+        QThread(aParent), _queue(aQueueCapacity), _flushInterval(1000), _syncInterval(0), _preallocation(0), _allocated(0), _fullPolicy(FullDrop)
+    {
+    }
+
+    AsyncLogWriter::~AsyncLogWriter()
+    {
+        stop();
+    }
+
+    bool AsyncLogWriter::open(const QString &aPath, QIODevice::OpenMode aMode)
+    {
+        _file.setFileName(aPath);
+        if (!_file.open(aMode)) {
+            return false;
+        }
+
+        _allocated = _file.size();
+        return true;
+    }
+
+    bool AsyncLogWriter::write(const QByteArray &aRecord)
+    {
+        if (!_queue.push(aRecord)) {
+            if (_fullPolicy == FullDrop) {
+                _dropped.ref();
+                return false;
+            }
+
+            _stalls.ref();
+            while (!_queue.push(aRecord)) {
+                if (isRunning()) {
+                    QThread::usleep(STALL_USECS);
+                } else {
+                    // Nothing would ever make room; write the backlog out on this thread, as stop() does
+                    writeQueued();
+                }
+            }
+        }
+
+        const int queued = _queue.size();
+        if (queued > _highWaterMark.load()) {
+            _highWaterMark.storeRelease(queued);
+        }
+
+        return true;
+    }
+
+    void AsyncLogWriter::stop()
+    {
+        if (isRunning()) {
+            _stopping.storeRelease(1);
+            wait();
+        } else if (_file.isOpen() and !_queue.isEmpty()) {
+            // Never started; write out whatever was queued on this thread instead
+            _stopping.storeRelease(1);
+            run();
+        }
+
+        if (_file.isOpen()) {
+            _file.close();
+        }
+    }
+
+    void AsyncLogWriter::reserve(qint64 anEnd)
+    {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        if ((_preallocation <= 0) or (anEnd <= _allocated)) {
+            return;
+        }
+
+        const qint64 newEnd = anEnd + _preallocation;
+        // Failure just means we carry on without the reservation
+        fallocate(_file.handle(), FALLOC_FL_KEEP_SIZE, _allocated, newEnd - _allocated);
+        _allocated = newEnd;
+#else
+        Q_UNUSED(anEnd);
+#endif
+    }
+
+    QString AsyncLogWriter::writeError() const
+    {
+        QMutexLocker locker(&_errorLock);
+        return _writeError;
+    }
+
+    void AsyncLogWriter::setWriteError()
+    {
+        QMutexLocker locker(&_errorLock);
+        if (_writeError.isEmpty()) {
+            _writeError = _file.errorString();
+        }
+    }
+
+    void AsyncLogWriter::sync()
+    {
+        if (!_file.isOpen()) {
+            return;
+        }
+
+        if (!_file.flush()) {
+            setWriteError();
+        }
+#if defined(__linux__)
+        fdatasync(_file.handle());
+#else
+        fsync(_file.handle());
+#endif
+    }
+
+    bool AsyncLogWriter::writeQueued()
+    {
+        bool ret = false;
+        QByteArray record;
+        while (_queue.pop(record)) {
+            reserve(_file.pos() + record.size());
+            if (_file.write(record) == record.size()) {
+                _written.ref();
+            } else {
+                _failed.ref();
+                setWriteError();
+            }
+            ret = true;
+        }
+        return ret;
+    }
+
+    void AsyncLogWriter::run()
+    {
+        QElapsedTimer flushTimer, syncTimer;
+        flushTimer.start();
+        syncTimer.start();
+
+        bool isFlushed = true, isSynced = true;
+
+        forever {
+            // Anything queued before stop() was called is guaranteed to be seen by the drain below.
+            const bool isStopping = _stopping.loadAcquire();
+
+            const bool didWrite = writeQueued();
+            if (didWrite) {
+                isFlushed = isSynced = false;
+            }
+
+            if (!isFlushed and ((_flushInterval <= 0) or flushTimer.hasExpired(_flushInterval))) {
+                if (!_file.flush()) {
+                    setWriteError();
+                }
+                isFlushed = true;
+                flushTimer.restart();
+            }
+
+            if (!isSynced and (_syncInterval > 0) and syncTimer.hasExpired(_syncInterval)) {
+                sync();
+                isFlushed = isSynced = true;
+                syncTimer.restart();
+            }
+
+            if (isStopping) {
+                break;
+            }
+
+            if (!didWrite) {
+                QThread::msleep(IDLE_MSECS);
+            }
+        }
+
+        sync();
+        _stopping.storeRelease(0);
+    }
+}
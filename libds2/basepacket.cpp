@@ -10,6 +10,9 @@
 #include <QByteArray>
 
 #include <ds2/basepacket.h>
+#include <ds2/jsonwriter.h>
+#include <ds2/trace.h>
+#include <ds2/allocationstats.h>
 
 namespace DS2PlusPlus {
     const char *BasePacket::HEX_CHAR_FORMAT = "%02X";
@@ -71,7 +74,12 @@ namespace DS2PlusPlus {
         _data = someData;
     }
 
+    PayloadView BasePacket::payload() const {
+        return PayloadView(reinterpret_cast<const quint8 *>(_data.constData()), _data.length());
+    }
+
     const Json::Value *ResponseToJson(const DS2PlusPlus::PacketResponse &aResponse) {
+        AllocationScope ourAllocations(AllocationStats::JsonOutput);
         Json::Value root;
         foreach (const QString &key, aResponse.keys()) {
             const QStringList ourHier = key.split(".");
@@ -130,6 +138,8 @@ namespace DS2PlusPlus {
                 jsonValue  = Json::Value(variantValue.toULongLong());
             } else if ((variantValue.type() == static_cast<QVariant::Type>(QMetaType::Double)) || (variantValue.type() == static_cast<QVariant::Type>(QMetaType::Float))) {
                 jsonValue  = Json::Value(variantValue.toDouble());
+            } else if (variantValue.type() == static_cast<QVariant::Type>(QMetaType::Bool)) {
+                jsonValue  = Json::Value(variantValue.toBool());
             } else if (strcmp(variantValue.typeName(), "QList<uchar>")==0) {
                 jsonValue = Json::Value(Json::arrayValue);
 
@@ -149,35 +159,27 @@ namespace DS2PlusPlus {
     }
 
     const QString ResponseToJsonString(const PacketResponse &aResponse) {
-        const Json::Value *ourJson = ResponseToJson(aResponse);
-        const std::string ourStr = ourJson->toStyledString();
-        delete ourJson;
-        return QString(ourStr.c_str());
+        AllocationScope ourAllocations(AllocationStats::JsonOutput);
+        QByteArray ourJson;
+        JsonStreamWriter ourWriter(&ourJson);
+        ourWriter.write(aResponse);
+        return QString::fromUtf8(ourJson);
     }
 
     const QString HashToJsonString(const PacketResponse &aResponse, const QString &aRootNode) {
-        std::string ourStr;
-        const Json::Value *jsonNode = ResponseToJson(aResponse);
-
-        if (!aRootNode.isEmpty()) {
-            Json::Value realRoot;
-            realRoot[qPrintable(aRootNode)] = (*jsonNode);
-            ourStr = realRoot.toStyledString();
-        } else {
-            ourStr = jsonNode->toStyledString();
-        }
-
-        delete jsonNode;
-        return QString(ourStr.c_str());
+        QByteArray ourJson;
+        JsonStreamWriter ourWriter(&ourJson);
+        ourWriter.write(aResponse, aRootNode.isEmpty() ? QString::null : aRootNode);
+        return QString::fromUtf8(ourJson);
     }
 
     BasePacket::operator QByteArray () const
     {
         const QByteArray ret = this->toByteArray();
 
-        if (getenv("DPP_DEBUG_CONVERSION")) {
+        if (DS2_TRACE_ENABLED(Conversion)) {
             for (int i=0; i < ret.length(); i++) {
-                printf("%d: 0x%02x\n", i, static_cast<quint8>(ret.at(i)));
+                DS2_TRACE(Conversion) << QString("%1: 0x%2").arg(i).arg(static_cast<quint8>(ret.at(i)), 2, 16, QChar('0'));
             }
         }
         return ret;
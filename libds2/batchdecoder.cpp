@@ -0,0 +1,353 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+
+#include <ds2/batchdecoder.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#include <emmintrin.h>
+#define DS2_BATCH_SSE2
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define DS2_BATCH_AVX2
+#endif
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DS2_BATCH_NEON
+#endif
+
+namespace {
+    // Rows are decoded in blocks small enough that the intermediate integers stay in L1.
+    const int BLOCK_ROWS = 256;
+
+    // See BatchDecoder::setScalarOnly()
+    bool ourScalarOnly = false;
+
+    inline qint32 loadByte(const quint8 *aField, bool isSigned)
+    {
+        return isSigned ? static_cast<qint32>(static_cast<qint8>(aField[0])) : static_cast<qint32>(aField[0]);
+    }
+
+    inline qint32 loadShort(const quint8 *aField, bool isSigned, bool isBigEndian)
+    {
+        const quint16 word = isBigEndian ? static_cast<quint16>((aField[0] << 8) | aField[1]) : static_cast<quint16>(aField[0] | (aField[1] << 8));
+        return isSigned ? static_cast<qint32>(static_cast<qint16>(word)) : static_cast<qint32>(word);
+    }
+
+    void extractScalar(const quint8 *somePayloads, int aStride, int aPosition, int aFirstRow, int aCount, int aWidth, bool isSigned, bool isBigEndian, qint32 *anOutput)
+    {
+        for (int i=aFirstRow; i < aCount; i++) {
+            const quint8 *field = somePayloads + static_cast<ptrdiff_t>(i) * aStride + aPosition;
+            anOutput[i] = (aWidth == 1) ? loadByte(field, isSigned) : loadShort(field, isSigned, isBigEndian);
+        }
+    }
+
+    void scaleScalar(const qint32 *someValues, int aFirstRow, int aCount, double aScale, double anOffset, double *anOutput)
+    {
+        for (int i=aFirstRow; i < aCount; i++) {
+            anOutput[i] = static_cast<double>(someValues[i]) * aScale + anOffset;
+        }
+    }
+
+    void scaleFloatScalar(const qint32 *someValues, int aFirstRow, int aCount, float aScale, float anOffset, double *anOutput)
+    {
+        for (int i=aFirstRow; i < aCount; i++) {
+            // Rounded to float after each step, as the RPN stack does
+            const float product = static_cast<float>(someValues[i]) * aScale;
+            anOutput[i] = static_cast<float>(product + anOffset);
+        }
+    }
+
+#ifdef DS2_BATCH_AVX2
+    bool haveAvx2()
+    {
+        static const bool ret = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return ret;
+    }
+
+    /*
+     * Gathers a 32-bit word per row and trims it down to the field we want.  Returns the number of rows
+     * handled; the gather reads up to three bytes past the field, so rows near the end of the matrix are
+     * left for the scalar loop.
+     */
+    __attribute__((target("avx2")))
+    int extractAvx2(const quint8 *somePayloads, int aStride, int aPosition, int aCount, int aWidth, bool isSigned, bool isBigEndian, qint32 *anOutput)
+    {
+        const qint64 total = static_cast<qint64>(aStride) * aCount;
+        const qint64 lastSafe = total - aPosition - 4;
+        if ((lastSafe < 0) or (total > INT_MAX) or (aStride <= 0)) {
+            return 0;
+        }
+
+        const int safeRows = static_cast<int>(qMin<qint64>(aCount, (lastSafe / aStride) + 1));
+        const int *base = reinterpret_cast<const int *>(somePayloads + aPosition);
+
+        const __m256i byteMask = _mm256_set1_epi32(0xff);
+        const __m256i shortMask = _mm256_set1_epi32(0xffff);
+        const __m256i step = _mm256_set1_epi32(aStride * 8);
+        __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(aStride));
+
+        int i = 0;
+        for (; i + 8 <= safeRows; i += 8) {
+            __m256i value = _mm256_i32gather_epi32(base, index, 1);
+
+            if (aWidth == 1) {
+                if (isSigned) {
+                    value = _mm256_srai_epi32(_mm256_slli_epi32(value, 24), 24);
+                } else {
+                    value = _mm256_and_si256(value, byteMask);
+                }
+            } else {
+                if (isBigEndian) {
+                    value = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(value, byteMask), 8), _mm256_and_si256(_mm256_srli_epi32(value, 8), byteMask));
+                } else {
+                    value = _mm256_and_si256(value, shortMask);
+                }
+
+                if (isSigned) {
+                    value = _mm256_srai_epi32(_mm256_slli_epi32(value, 16), 16);
+                }
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(anOutput + i), value);
+            index = _mm256_add_epi32(index, step);
+        }
+
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    int scaleAvx2(const qint32 *someValues, int aCount, double aScale, double anOffset, double *anOutput)
+    {
+        const __m256d scale = _mm256_set1_pd(aScale);
+        const __m256d offset = _mm256_set1_pd(anOffset);
+
+        int i = 0;
+        for (; i + 8 <= aCount; i += 8) {
+            const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(someValues + i));
+            const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(someValues + i + 4));
+            _mm256_storeu_pd(anOutput + i, _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(low), scale), offset));
+            _mm256_storeu_pd(anOutput + i + 4, _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(high), scale), offset));
+        }
+
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    int scaleFloatAvx2(const qint32 *someValues, int aCount, float aScale, float anOffset, double *anOutput)
+    {
+        const __m256 scale = _mm256_set1_ps(aScale);
+        const __m256 offset = _mm256_set1_ps(anOffset);
+
+        int i = 0;
+        for (; i + 8 <= aCount; i += 8) {
+            const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(someValues + i));
+            const __m256 result = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(value), scale), offset);
+            _mm256_storeu_pd(anOutput + i, _mm256_cvtps_pd(_mm256_castps256_ps128(result)));
+            _mm256_storeu_pd(anOutput + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(result, 1)));
+        }
+
+        return i;
+    }
+#endif
+
+#ifdef DS2_BATCH_SSE2
+    int scaleSse2(const qint32 *someValues, int aCount, double aScale, double anOffset, double *anOutput)
+    {
+        const __m128d scale = _mm_set1_pd(aScale);
+        const __m128d offset = _mm_set1_pd(anOffset);
+
+        int i = 0;
+        for (; i + 4 <= aCount; i += 4) {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(someValues + i));
+            const __m128d low = _mm_cvtepi32_pd(value);
+            const __m128d high = _mm_cvtepi32_pd(_mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_pd(anOutput + i, _mm_add_pd(_mm_mul_pd(low, scale), offset));
+            _mm_storeu_pd(anOutput + i + 2, _mm_add_pd(_mm_mul_pd(high, scale), offset));
+        }
+
+        return i;
+    }
+
+    int scaleFloatSse2(const qint32 *someValues, int aCount, float aScale, float anOffset, double *anOutput)
+    {
+        const __m128 scale = _mm_set1_ps(aScale);
+        const __m128 offset = _mm_set1_ps(anOffset);
+
+        int i = 0;
+        for (; i + 4 <= aCount; i += 4) {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(someValues + i));
+            const __m128 result = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(value), scale), offset);
+            _mm_storeu_pd(anOutput + i, _mm_cvtps_pd(result));
+            _mm_storeu_pd(anOutput + i + 2, _mm_cvtps_pd(_mm_movehl_ps(result, result)));
+        }
+
+        return i;
+    }
+#endif
+
+#ifdef DS2_BATCH_NEON
+    int scaleNeon(const qint32 *someValues, int aCount, double aScale, double anOffset, double *anOutput)
+    {
+        const float64x2_t scale = vdupq_n_f64(aScale);
+        const float64x2_t offset = vdupq_n_f64(anOffset);
+
+        int i = 0;
+        for (; i + 4 <= aCount; i += 4) {
+            const int32x4_t value = vld1q_s32(someValues + i);
+            const float64x2_t low = vcvtq_f64_s64(vmovl_s32(vget_low_s32(value)));
+            const float64x2_t high = vcvtq_f64_s64(vmovl_high_s32(value));
+            vst1q_f64(anOutput + i, vaddq_f64(vmulq_f64(low, scale), offset));
+            vst1q_f64(anOutput + i + 2, vaddq_f64(vmulq_f64(high, scale), offset));
+        }
+
+        return i;
+    }
+
+    int scaleFloatNeon(const qint32 *someValues, int aCount, float aScale, float anOffset, double *anOutput)
+    {
+        const float32x4_t scale = vdupq_n_f32(aScale);
+        const float32x4_t offset = vdupq_n_f32(anOffset);
+
+        int i = 0;
+        for (; i + 4 <= aCount; i += 4) {
+            // A separate multiply and add; a fused one would round differently from the RPN
+            const float32x4_t result = vaddq_f32(vmulq_f32(vcvtq_f32_s32(vld1q_s32(someValues + i)), scale), offset);
+            vst1q_f64(anOutput + i, vcvt_f64_f32(vget_low_f32(result)));
+            vst1q_f64(anOutput + i + 2, vcvt_high_f64_f32(result));
+        }
+
+        return i;
+    }
+#endif
+
+    void extract(const quint8 *somePayloads, int aStride, int aPosition, int aCount, int aWidth, bool isSigned, bool isBigEndian, qint32 *anOutput)
+    {
+        int done = 0;
+#ifdef DS2_BATCH_AVX2
+        if (!ourScalarOnly and haveAvx2()) {
+            done = extractAvx2(somePayloads, aStride, aPosition, aCount, aWidth, isSigned, isBigEndian, anOutput);
+        }
+#endif
+        extractScalar(somePayloads, aStride, aPosition, done, aCount, aWidth, isSigned, isBigEndian, anOutput);
+    }
+}
+
+namespace DS2PlusPlus {
+    void BatchDecoder::extractBytes(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, qint32 *anOutput)
+    {
+        extract(somePayloads, aStride, aPosition, aCount, 1, isSigned, false, anOutput);
+    }
+
+    void BatchDecoder::extractShorts(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, bool isBigEndian, qint32 *anOutput)
+    {
+        extract(somePayloads, aStride, aPosition, aCount, 2, isSigned, isBigEndian, anOutput);
+    }
+
+    void BatchDecoder::scale(const qint32 *someValues, int aCount, double aScale, double anOffset, double *anOutput)
+    {
+        int done = 0;
+        if (!ourScalarOnly) {
+#if defined(DS2_BATCH_AVX2)
+            if (haveAvx2()) {
+                done = scaleAvx2(someValues, aCount, aScale, anOffset, anOutput);
+            } else {
+                done = scaleSse2(someValues, aCount, aScale, anOffset, anOutput);
+            }
+#elif defined(DS2_BATCH_SSE2)
+            done = scaleSse2(someValues, aCount, aScale, anOffset, anOutput);
+#elif defined(DS2_BATCH_NEON)
+            done = scaleNeon(someValues, aCount, aScale, anOffset, anOutput);
+#endif
+        }
+        scaleScalar(someValues, done, aCount, aScale, anOffset, anOutput);
+    }
+
+    void BatchDecoder::scaleFloat(const qint32 *someValues, int aCount, float aScale, float anOffset, double *anOutput)
+    {
+        int done = 0;
+        if (!ourScalarOnly) {
+#if defined(DS2_BATCH_AVX2)
+            if (haveAvx2()) {
+                done = scaleFloatAvx2(someValues, aCount, aScale, anOffset, anOutput);
+            } else {
+                done = scaleFloatSse2(someValues, aCount, aScale, anOffset, anOutput);
+            }
+#elif defined(DS2_BATCH_SSE2)
+            done = scaleFloatSse2(someValues, aCount, aScale, anOffset, anOutput);
+#elif defined(DS2_BATCH_NEON)
+            done = scaleFloatNeon(someValues, aCount, aScale, anOffset, anOutput);
+#endif
+        }
+        scaleFloatScalar(someValues, done, aCount, aScale, anOffset, anOutput);
+    }
+
+    void BatchDecoder::decodeBytes(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, double aScale, double anOffset, double *anOutput)
+    {
+        qint32 buffer[BLOCK_ROWS];
+        for (int row=0; row < aCount; row += BLOCK_ROWS) {
+            const int rows = qMin(BLOCK_ROWS, aCount - row);
+            extractBytes(somePayloads + static_cast<ptrdiff_t>(row) * aStride, aStride, aPosition, rows, isSigned, buffer);
+            scale(buffer, rows, aScale, anOffset, anOutput + row);
+        }
+    }
+
+    void BatchDecoder::decodeShorts(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, bool isBigEndian, float aScale, float anOffset, double *anOutput)
+    {
+        qint32 buffer[BLOCK_ROWS];
+        for (int row=0; row < aCount; row += BLOCK_ROWS) {
+            const int rows = qMin(BLOCK_ROWS, aCount - row);
+            extractShorts(somePayloads + static_cast<ptrdiff_t>(row) * aStride, aStride, aPosition, rows, isSigned, isBigEndian, buffer);
+            scaleFloat(buffer, rows, aScale, anOffset, anOutput + row);
+        }
+    }
+
+    const char *BatchDecoder::instructionSet()
+    {
+        if (ourScalarOnly) {
+            return "scalar";
+        }
+#if defined(DS2_BATCH_AVX2)
+        return haveAvx2() ? "avx2" : "sse2";
+#elif defined(DS2_BATCH_SSE2)
+        return "sse2";
+#elif defined(DS2_BATCH_NEON)
+        return "neon";
+#else
+        return "scalar";
+#endif
+    }
+
+    void BatchDecoder::setScalarOnly(bool isScalarOnly)
+    {
+        ourScalarOnly = isScalarOnly;
+    }
+
+    bool BatchDecoder::isScalarOnly()
+    {
+        return ourScalarOnly;
+    }
+}
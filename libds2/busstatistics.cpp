@@ -0,0 +1,246 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QStringList>
+
+#include <ds2/busstatistics.h>
+
+namespace {
+    const quint64 NO_MINIMUM = Q_UINT64_C(0xffffffffffffffff);
+
+    int highestBit(quint64 aValue)
+    {
+        int ret = -1;
+        while (aValue) {
+            aValue >>= 1;
+            ret++;
+        }
+        return ret;
+    }
+
+    QString formatLatencies(const DS2PlusPlus::LatencyHistogram &aHistogram)
+    {
+        return QString("%1/%2/%3/%4")
+                .arg(aHistogram.percentile(50) / 1000.0, 0, 'f', 1)
+                .arg(aHistogram.percentile(95) / 1000.0, 0, 'f', 1)
+                .arg(aHistogram.percentile(99) / 1000.0, 0, 'f', 1)
+                .arg(aHistogram.maximum() / 1000.0, 0, 'f', 1);
+    }
+
+    QStringList summaryRow(const QString &aName, const DS2PlusPlus::TransactionStatistics &aStatistics)
+    {
+        return QStringList() << aName
+                             << QString::number(aStatistics.transactions.load())
+                             << formatLatencies(aStatistics.firstByte)
+                             << formatLatencies(aStatistics.transaction)
+                             << QString("%1/%2").arg(aStatistics.bytesOut.load()).arg(aStatistics.bytesIn.load())
+                             << QString::number(aStatistics.timeouts.load())
+                             << QString::number(aStatistics.checksumErrors.load())
+                             << QString::number(aStatistics.echoErrors.load())
+                             << QString::number(aStatistics.retries.load());
+    }
+}
+
+namespace DS2PlusPlus {
+    LatencyHistogram::LatencyHistogram() :
+        _minimum(NO_MINIMUM)
+    {
+    }
+
+    int LatencyHistogram::bucketFor(quint64 aMicroseconds)
+    {
+        if (aMicroseconds < 2 * SUB_BUCKETS) {
+            return static_cast<int>(aMicroseconds);
+        }
+
+        // Shift so the value lands between SUB_BUCKETS and 2 * SUB_BUCKETS - 1
+        const int shift = highestBit(aMicroseconds) - 4;
+        const int ret = 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + static_cast<int>((aMicroseconds >> shift) - SUB_BUCKETS);
+        return qMin(ret, BUCKET_COUNT - 1);
+    }
+
+    quint64 LatencyHistogram::bucketUpperBound(int aBucket)
+    {
+        if (aBucket < 2 * SUB_BUCKETS) {
+            return aBucket;
+        }
+
+        const int shift = (aBucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+        const quint64 lower = static_cast<quint64>(SUB_BUCKETS + (aBucket % SUB_BUCKETS)) << shift;
+        return lower + (Q_UINT64_C(1) << shift) - 1;
+    }
+
+    void LatencyHistogram::record(quint64 aMicroseconds)
+    {
+        _buckets[bucketFor(aMicroseconds)].fetchAndAddRelaxed(1);
+        _count.fetchAndAddRelaxed(1);
+        _total.fetchAndAddRelaxed(aMicroseconds);
+
+        quint64 current = _maximum.load();
+        while ((aMicroseconds > current) and !_maximum.testAndSetRelaxed(current, aMicroseconds, current)) {
+        }
+
+        current = _minimum.load();
+        while ((aMicroseconds < current) and !_minimum.testAndSetRelaxed(current, aMicroseconds, current)) {
+        }
+    }
+
+    quint64 LatencyHistogram::minimum() const
+    {
+        const quint64 ret = _minimum.load();
+        return (ret == NO_MINIMUM) ? 0 : ret;
+    }
+
+    double LatencyHistogram::mean() const
+    {
+        const quint64 samples = count();
+        return samples ? static_cast<double>(total()) / samples : 0;
+    }
+
+    quint64 LatencyHistogram::percentile(double aPercent) const
+    {
+        quint64 samples = 0;
+        for (int i=0; i < BUCKET_COUNT; i++) {
+            samples += _buckets[i].load();
+        }
+        if (samples == 0) {
+            return 0;
+        }
+
+        // The rank of the sample we're after, counting from 1
+        const quint64 rank = qMax<quint64>(1, static_cast<quint64>(qBound(0.0, aPercent, 100.0) / 100.0 * samples + 0.5));
+        quint64 seen = 0;
+        for (int i=0; i < BUCKET_COUNT; i++) {
+            seen += _buckets[i].load();
+            if (seen >= rank) {
+                // The last bucket has no upper bound of its own
+                return (i == BUCKET_COUNT - 1) ? maximum() : qMin(bucketUpperBound(i), maximum());
+            }
+        }
+
+        return maximum();
+    }
+
+    BusStatistics::BusStatistics()
+    {
+    }
+
+    BusStatistics::~BusStatistics()
+    {
+        for (int i=0; i < 256; i++) {
+            delete _addresses[i].load();
+        }
+        qDeleteAll(_operations);
+    }
+
+    TransactionStatistics *BusStatistics::forAddress(quint8 anAddress)
+    {
+        TransactionStatistics *ret = _addresses[anAddress].loadAcquire();
+        if (ret) {
+            return ret;
+        }
+
+        // Whoever gets there first wins; anyone racing them throws their copy away.
+        TransactionStatistics *created = new TransactionStatistics;
+        if (_addresses[anAddress].testAndSetOrdered(0, created)) {
+            return created;
+        }
+
+        delete created;
+        return _addresses[anAddress].loadAcquire();
+    }
+
+    TransactionStatistics *BusStatistics::forOperation(const QString &aName)
+    {
+        QMutexLocker locker(&_operationsLock);
+
+        TransactionStatistics *&ret = _operations[aName];
+        if (!ret) {
+            ret = new TransactionStatistics;
+        }
+        return ret;
+    }
+
+    QMap<quint8, const TransactionStatistics *> BusStatistics::addresses() const
+    {
+        QMap<quint8, const TransactionStatistics *> ret;
+        for (int i=0; i < 256; i++) {
+            const TransactionStatistics *statistics = _addresses[i].loadAcquire();
+            if (statistics) {
+                ret.insert(i, statistics);
+            }
+        }
+        return ret;
+    }
+
+    QMap<QString, const TransactionStatistics *> BusStatistics::operations() const
+    {
+        QMutexLocker locker(&_operationsLock);
+
+        QMap<QString, const TransactionStatistics *> ret;
+        QMap<QString, TransactionStatistics *>::ConstIterator it;
+        for (it = _operations.constBegin(); it != _operations.constEnd(); ++it) {
+            ret.insert(it.key(), it.value());
+        }
+        return ret;
+    }
+
+    QString BusStatistics::summary() const
+    {
+        QList<QStringList> rows;
+        rows << (QStringList() << "ECU / operation" << "count" << "first byte p50/p95/p99/max ms" << "total p50/p95/p99/max ms"
+                               << "bytes out/in" << "timeouts" << "checksum" << "echo" << "retries");
+
+        const QMap<quint8, const TransactionStatistics *> ourAddresses = addresses();
+        QMap<quint8, const TransactionStatistics *>::ConstIterator address;
+        for (address = ourAddresses.constBegin(); address != ourAddresses.constEnd(); ++address) {
+            rows << summaryRow(QString("0x%1").arg(address.key(), 2, 16, QChar('0')), *address.value());
+        }
+
+        const QMap<QString, const TransactionStatistics *> ourOperations = operations();
+        QMap<QString, const TransactionStatistics *>::ConstIterator operation;
+        for (operation = ourOperations.constBegin(); operation != ourOperations.constEnd(); ++operation) {
+            rows << summaryRow(operation.key(), *operation.value());
+        }
+
+        QList<int> widths;
+        foreach (const QString &header, rows.first()) {
+            widths << header.size();
+        }
+        foreach (const QStringList &row, rows) {
+            for (int i=0; i < row.size(); i++) {
+                widths[i] = qMax(widths.at(i), row.at(i).size());
+            }
+        }
+
+        QString ret;
+        foreach (const QStringList &row, rows) {
+            QStringList cells;
+            for (int i=0; i < row.size(); i++) {
+                cells << ((i == 0) ? row.at(i).leftJustified(widths.at(i)) : row.at(i).rightJustified(widths.at(i)));
+            }
+            ret += cells.join("  ") + "\n";
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,679 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+
+#include <QFile>
+#include <QtEndian>
+
+#include <ds2/compressedlog.h>
+
+namespace {
+    const char MAGIC[] = "DPPLOGZ1";
+    const char BLOCK_MAGIC[] = "DBLK";
+    const char INDEX_MAGIC[] = "DIDX";
+    const char TRAILER_MAGIC[] = "DPPZIDX1";
+    const int MAGIC_LENGTH = 8;
+    // magic, records per block
+    const int FIXED_HEADER_LENGTH = MAGIC_LENGTH + 4;
+    // magic, record count, payload length
+    const int BLOCK_HEADER_LENGTH = 12;
+    // The start of a DataLogWriter header: magic, data offset, record length, channel count
+    const int DATA_LOG_HEADER_LENGTH = 20;
+    const int TRAILER_LENGTH = 16;
+
+    void appendLong(QByteArray &aBuffer, quint32 aValue)
+    {
+        uchar bytes[4];
+        qToLittleEndian<quint32>(aValue, bytes);
+        aBuffer.append(reinterpret_cast<const char *>(bytes), 4);
+    }
+
+    void appendLongLong(QByteArray &aBuffer, quint64 aValue)
+    {
+        uchar bytes[8];
+        qToLittleEndian<quint64>(aValue, bytes);
+        aBuffer.append(reinterpret_cast<const char *>(bytes), 8);
+    }
+
+    void appendVarint(QByteArray &aBuffer, quint64 aValue)
+    {
+        while (aValue >= 0x80) {
+            aBuffer.append(static_cast<char>((aValue & 0x7f) | 0x80));
+            aValue >>= 7;
+        }
+        aBuffer.append(static_cast<char>(aValue));
+    }
+
+    bool readVarint(const uchar *someData, int aLength, int &aPosition, quint64 &aValue)
+    {
+        aValue = 0;
+        for (int shift=0; shift < 64; shift += 7) {
+            if (aPosition >= aLength) {
+                return false;
+            }
+            const uchar byte = someData[aPosition++];
+            aValue |= static_cast<quint64>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline quint64 zigzag(qint64 aValue)
+    {
+        return (static_cast<quint64>(aValue) << 1) ^ static_cast<quint64>(aValue >> 63);
+    }
+
+    inline qint64 unzigzag(quint64 aValue)
+    {
+        return static_cast<qint64>(aValue >> 1) ^ -static_cast<qint64>(aValue & 1);
+    }
+
+    inline quint64 doubleBits(double aValue)
+    {
+        quint64 ret;
+        memcpy(&ret, &aValue, sizeof(ret));
+        return ret;
+    }
+
+    inline double bitsDouble(quint64 aBits)
+    {
+        double ret;
+        memcpy(&ret, &aBits, sizeof(ret));
+        return ret;
+    }
+
+    inline int leadingZeros(quint64 aValue)
+    {
+        int ret = 0;
+        for (quint64 bit = Q_UINT64_C(1) << 63; bit and !(aValue & bit); bit >>= 1) {
+            ret++;
+        }
+        return ret;
+    }
+
+    inline int trailingZeros(quint64 aValue)
+    {
+        int ret = 0;
+        for (quint64 bit = 1; bit and !(aValue & bit); bit <<= 1) {
+            ret++;
+        }
+        return ret;
+    }
+
+    /*
+     * Packs bits most significant first.
+     */
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(QByteArray &aBuffer) : _buffer(aBuffer), _current(0), _bits(0) {}
+
+        void write(quint64 aValue, int aCount)
+        {
+            for (int i=aCount - 1; i >= 0; i--) {
+                _current = static_cast<uchar>((_current << 1) | ((aValue >> i) & 1));
+                if (++_bits == 8) {
+                    _buffer.append(static_cast<char>(_current));
+                    _current = 0;
+                    _bits = 0;
+                }
+            }
+        }
+
+        void flush()
+        {
+            if (_bits > 0) {
+                _buffer.append(static_cast<char>(_current << (8 - _bits)));
+                _current = 0;
+                _bits = 0;
+            }
+        }
+
+    private:
+        QByteArray &_buffer;
+        uchar _current;
+        int _bits;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uchar *someData, int aLength) : _data(someData), _length(static_cast<qint64>(aLength) * 8), _position(0) {}
+
+        bool read(int aCount, quint64 &aValue)
+        {
+            if (_position + aCount > _length) {
+                return false;
+            }
+
+            aValue = 0;
+            for (int i=0; i < aCount; i++, _position++) {
+                aValue = (aValue << 1) | ((_data[_position / 8] >> (7 - (_position % 8))) & 1);
+            }
+            return true;
+        }
+
+    private:
+        const uchar *_data;
+        qint64 _length, _position;
+    };
+
+    /*
+     * Gorilla style XOR encoding: an unchanged value is a 0 bit; otherwise the XOR with the previous value
+     * is stored either inside the previous run of meaningful bits or with a new 5 bit leading zero count and
+     * 6 bit length.
+     */
+    void encodeDoubles(const QVector<quint64> &someValues, QByteArray &aStream)
+    {
+        BitWriter writer(aStream);
+        quint64 previous = 0;
+        int previousLeading = -1, previousTrailing = 0;
+
+        foreach (quint64 value, someValues) {
+            const quint64 xored = value ^ previous;
+            previous = value;
+
+            if (xored == 0) {
+                writer.write(0, 1);
+                continue;
+            }
+
+            const int leading = qMin(leadingZeros(xored), 31);
+            const int trailing = trailingZeros(xored);
+            writer.write(1, 1);
+
+            if ((previousLeading >= 0) and (leading >= previousLeading) and (trailing >= previousTrailing)) {
+                writer.write(0, 1);
+                writer.write(xored >> previousTrailing, 64 - previousLeading - previousTrailing);
+            } else {
+                const int meaningful = 64 - leading - trailing;
+                writer.write(1, 1);
+                writer.write(leading, 5);
+                writer.write(meaningful - 1, 6);
+                writer.write(xored >> trailing, meaningful);
+                previousLeading = leading;
+                previousTrailing = trailing;
+            }
+        }
+
+        writer.flush();
+    }
+
+    bool decodeDoubles(const uchar *someData, int aLength, int aCount, QVector<double> &someValues)
+    {
+        BitReader reader(someData, aLength);
+        quint64 previous = 0, bit, field;
+        int previousLeading = -1, previousTrailing = 0;
+
+        someValues.resize(0);
+        for (int i=0; i < aCount; i++) {
+            if (!reader.read(1, bit)) {
+                return false;
+            }
+
+            if (bit) {
+                if (!reader.read(1, bit)) {
+                    return false;
+                }
+
+                if (bit) {
+                    quint64 leading, meaningful;
+                    if (!reader.read(5, leading) or !reader.read(6, meaningful)) {
+                        return false;
+                    }
+                    meaningful++;
+                    if (leading + meaningful > 64) {
+                        return false;
+                    }
+                    previousLeading = static_cast<int>(leading);
+                    previousTrailing = static_cast<int>(64 - leading - meaningful);
+                } else if (previousLeading < 0) {
+                    return false;
+                }
+
+                if (!reader.read(64 - previousLeading - previousTrailing, field)) {
+                    return false;
+                }
+                previous ^= field << previousTrailing;
+            }
+
+            someValues.append(bitsDouble(previous));
+        }
+
+        return true;
+    }
+
+    bool readExactly(QIODevice *aDevice, qint64 aLength, QByteArray &aBuffer)
+    {
+        aBuffer.resize(0);
+        while (aBuffer.size() < aLength) {
+            const QByteArray chunk = aDevice->read(aLength - aBuffer.size());
+            if (chunk.isEmpty() and !aDevice->waitForReadyRead(-1)) {
+                break;
+            }
+            aBuffer.append(chunk);
+        }
+        return aBuffer.size() == aLength;
+    }
+
+    void corrupt()
+    {
+        throw std::runtime_error("Corrupt block in compressed data log");
+    }
+}
+
+namespace DS2PlusPlus {
+    CompressedLogWriter::CompressedLogWriter(int aBlockRecords) :
+        _blockRecords(qMax(aBlockRecords, 1)), _buffered(0), _recordCount(0), _offset(0)
+    {
+    }
+
+    QByteArray CompressedLogWriter::start(const QVector<DataLogChannel> &someChannels)
+    {
+        _channels = someChannels;
+        _columns = QVector<Column>(_channels.size());
+        for (int i=0; i < _columns.size(); i++) {
+            _columns[i].present.reserve(_blockRecords);
+            if (_channels.at(i).type == DataLogChannel::TypeString) {
+                _columns[i].strings.reserve(_blockRecords);
+            } else {
+                _columns[i].values.reserve(_blockRecords);
+            }
+        }
+        _buffered = 0;
+        _recordCount = 0;
+        _index.clear();
+
+        QByteArray ret(MAGIC, MAGIC_LENGTH);
+        appendLong(ret, _blockRecords);
+        ret.append(DataLogWriter::encodeHeader(_channels));
+
+        _offset = ret.size();
+        return ret;
+    }
+
+    QByteArray CompressedLogWriter::encode(const QVector<QVariant> &someValues)
+    {
+        if (someValues.size() != _channels.size()) {
+            throw std::invalid_argument(qPrintable(QString("Data log record has %1 values for %2 channels").arg(someValues.size()).arg(_channels.size())));
+        }
+
+        for (int i=0; i < _channels.size(); i++) {
+            const QVariant &value = someValues.at(i);
+            Column &column = _columns[i];
+            column.present.append(value.isValid());
+            if (!value.isValid()) {
+                continue;
+            }
+
+            switch (_channels.at(i).type) {
+            case DataLogChannel::TypeInt64:
+                column.values.append(static_cast<quint64>(value.toLongLong()));
+                break;
+            case DataLogChannel::TypeUInt64:
+                column.values.append(value.toULongLong());
+                break;
+            case DataLogChannel::TypeDouble:
+                column.values.append(doubleBits(value.toDouble()));
+                break;
+            case DataLogChannel::TypeString:
+                column.strings.append(value.toString().toUtf8());
+                break;
+            case DataLogChannel::TypeBool:
+                column.values.append(value.toBool() ? 1 : 0);
+                break;
+            }
+        }
+
+        _buffered++;
+        _recordCount++;
+        return (_buffered == _blockRecords) ? encodeBlock() : QByteArray();
+    }
+
+    QByteArray CompressedLogWriter::encodeBlock()
+    {
+        if (_buffered == 0) {
+            return QByteArray();
+        }
+
+        QByteArray payload, stream;
+        for (int i=0; i < _channels.size(); i++) {
+            Column &column = _columns[i];
+
+            const bool isComplete = (column.present.count(true) == _buffered);
+            payload.append(static_cast<char>(isComplete ? 1 : 0));
+            if (!isComplete) {
+                QByteArray bitmap((_buffered + 7) / 8, '\0');
+                for (int j=0; j < _buffered; j++) {
+                    if (column.present.at(j)) {
+                        bitmap[j / 8] = static_cast<char>(bitmap.at(j / 8) | (1 << (j % 8)));
+                    }
+                }
+                payload.append(bitmap);
+            }
+
+            stream.resize(0);
+            switch (_channels.at(i).type) {
+            case DataLogChannel::TypeInt64:
+            case DataLogChannel::TypeUInt64:
+            case DataLogChannel::TypeBool: {
+                // Differences wrap around, so they're exact for both signed and unsigned columns.
+                quint64 previous = 0;
+                foreach (quint64 value, column.values) {
+                    appendVarint(stream, zigzag(static_cast<qint64>(value - previous)));
+                    previous = value;
+                }
+                break;
+            }
+            case DataLogChannel::TypeDouble:
+                encodeDoubles(column.values, stream);
+                break;
+            case DataLogChannel::TypeString: {
+                // Zero repeats the previous string, anything else is its length plus one.
+                QByteArray previous;
+                foreach (const QByteArray &value, column.strings) {
+                    if (value == previous) {
+                        appendVarint(stream, 0);
+                    } else {
+                        appendVarint(stream, value.size() + 1);
+                        stream.append(value);
+                        previous = value;
+                    }
+                }
+                break;
+            }
+            }
+
+            appendLong(payload, stream.size());
+            payload.append(stream);
+
+            column.values.resize(0);
+            column.strings.resize(0);
+            column.present.resize(0);
+        }
+
+        QByteArray ret(BLOCK_MAGIC, 4);
+        appendLong(ret, _buffered);
+        appendLong(ret, payload.size());
+        ret.append(payload);
+
+        _index.append(qMakePair(_offset, _recordCount - _buffered));
+        _offset += ret.size();
+        _buffered = 0;
+
+        return ret;
+    }
+
+    QByteArray CompressedLogWriter::finish()
+    {
+        QByteArray ret = encodeBlock();
+        const int blockLength = ret.size();
+        const qint64 indexOffset = _offset;
+
+        ret.append(INDEX_MAGIC, 4);
+        appendLong(ret, _index.size());
+        appendLongLong(ret, _recordCount);
+        for (int i=0; i < _index.size(); i++) {
+            appendLongLong(ret, _index.at(i).first);
+            appendLongLong(ret, _index.at(i).second);
+        }
+
+        appendLongLong(ret, indexOffset);
+        ret.append(TRAILER_MAGIC, MAGIC_LENGTH);
+
+        _offset += ret.size() - blockLength;
+        return ret;
+    }
+
+    CompressedLogReader::CompressedLogReader(QIODevice *aDevice) :
+        _device(aDevice), _blockRecords(0), _blockSize(0), _position(0), _dataOffset(0), _indexRead(false), _indexRecords(-1)
+    {
+    }
+
+    bool CompressedLogReader::isCompressedLog(const QString &aPath)
+    {
+        QFile file(aPath);
+        return file.open(QIODevice::ReadOnly) and (file.read(MAGIC_LENGTH) == QByteArray(MAGIC, MAGIC_LENGTH));
+    }
+
+    void CompressedLogReader::open(QIODevice *aDevice)
+    {
+        _device = aDevice;
+        _block.clear();
+        _blockSize = 0;
+        _position = 0;
+        _indexRead = false;
+        _index.clear();
+        _indexRecords = -1;
+
+        QByteArray header, channelData;
+        if (!readExactly(_device, FIXED_HEADER_LENGTH + DATA_LOG_HEADER_LENGTH, header) or !header.startsWith(QByteArray(MAGIC, MAGIC_LENGTH))) {
+            throw std::runtime_error("Not a compressed DPP data log");
+        }
+
+        const uchar *data = reinterpret_cast<const uchar *>(header.constData());
+        _blockRecords = qFromLittleEndian<quint32>(data + MAGIC_LENGTH);
+        const quint32 dataOffset = qFromLittleEndian<quint32>(data + FIXED_HEADER_LENGTH + MAGIC_LENGTH);
+        if ((dataOffset < DATA_LOG_HEADER_LENGTH) or !readExactly(_device, dataOffset - DATA_LOG_HEADER_LENGTH, channelData)) {
+            throw std::runtime_error("Compressed DPP data log header is truncated");
+        }
+
+        header.append(channelData);
+        if (DataLogReader::parseHeader(reinterpret_cast<const uchar *>(header.constData()) + FIXED_HEADER_LENGTH, dataOffset, _channels) < 0) {
+            throw std::runtime_error("Compressed DPP data log header is invalid");
+        }
+
+        _dataOffset = FIXED_HEADER_LENGTH + dataOffset;
+        _block.resize(_channels.size());
+    }
+
+    bool CompressedLogReader::next(QVector<QVariant> &someValues)
+    {
+        if ((_position >= _blockSize) and !readBlock()) {
+            return false;
+        }
+
+        someValues.resize(_channels.size());
+        for (int i=0; i < _channels.size(); i++) {
+            someValues[i] = _block.at(i).at(_position);
+        }
+        _position++;
+        return true;
+    }
+
+    bool CompressedLogReader::readBlock()
+    {
+        _blockSize = 0;
+        _position = 0;
+
+        QByteArray header, payload;
+        if (!_device or !readExactly(_device, BLOCK_HEADER_LENGTH, header) or !header.startsWith(BLOCK_MAGIC)) {
+            // The end of the blocks, either at the index or where the writer was cut off
+            return false;
+        }
+
+        const uchar *headerData = reinterpret_cast<const uchar *>(header.constData());
+        const quint32 count = qFromLittleEndian<quint32>(headerData + 4);
+        const quint32 length = qFromLittleEndian<quint32>(headerData + 8);
+        if ((count == 0) or (count > static_cast<quint32>(_blockRecords)) or !readExactly(_device, length, payload)) {
+            return false;
+        }
+
+        const uchar *data = reinterpret_cast<const uchar *>(payload.constData());
+        const int bitmapLength = (count + 7) / 8;
+        int position = 0;
+        QVector<double> doubles;
+
+        for (int i=0; i < _channels.size(); i++) {
+            QVector<QVariant> &values = _block[i];
+            values.fill(QVariant(), count);
+
+            if (position >= payload.size()) {
+                corrupt();
+            }
+            const bool isComplete = data[position++];
+            const uchar *bitmap = data + position;
+            if (!isComplete) {
+                position += bitmapLength;
+            }
+
+            if (position + 4 > payload.size()) {
+                corrupt();
+            }
+            const int streamLength = qFromLittleEndian<quint32>(data + position);
+            position += 4;
+            if ((streamLength < 0) or (position + streamLength > payload.size())) {
+                corrupt();
+            }
+            const uchar *stream = data + position;
+            position += streamLength;
+
+            QVector<int> rows;
+            rows.reserve(count);
+            for (quint32 j=0; j < count; j++) {
+                if (isComplete or (bitmap[j / 8] & (1 << (j % 8)))) {
+                    rows.append(j);
+                }
+            }
+
+            int streamPosition = 0;
+            switch (_channels.at(i).type) {
+            case DataLogChannel::TypeInt64:
+            case DataLogChannel::TypeUInt64:
+            case DataLogChannel::TypeBool: {
+                quint64 previous = 0, encoded;
+                foreach (int row, rows) {
+                    if (!readVarint(stream, streamLength, streamPosition, encoded)) {
+                        corrupt();
+                    }
+                    previous += static_cast<quint64>(unzigzag(encoded));
+                    if (_channels.at(i).type == DataLogChannel::TypeInt64) {
+                        values[row] = QVariant(static_cast<qint64>(previous));
+                    } else if (_channels.at(i).type == DataLogChannel::TypeBool) {
+                        values[row] = QVariant(previous != 0);
+                    } else {
+                        values[row] = QVariant(previous);
+                    }
+                }
+                break;
+            }
+            case DataLogChannel::TypeDouble:
+                if (!decodeDoubles(stream, streamLength, rows.size(), doubles)) {
+                    corrupt();
+                }
+                for (int j=0; j < rows.size(); j++) {
+                    values[rows.at(j)] = QVariant(doubles.at(j));
+                }
+                break;
+            case DataLogChannel::TypeString: {
+                QString previous;
+                quint64 encoded;
+                foreach (int row, rows) {
+                    if (!readVarint(stream, streamLength, streamPosition, encoded)) {
+                        corrupt();
+                    }
+                    if (encoded > 0) {
+                        if (static_cast<quint64>(streamLength - streamPosition) < encoded - 1) {
+                            corrupt();
+                        }
+                        previous = QString::fromUtf8(reinterpret_cast<const char *>(stream + streamPosition), encoded - 1);
+                        streamPosition += encoded - 1;
+                    }
+                    values[row] = QVariant(previous);
+                }
+                break;
+            }
+            }
+        }
+
+        _blockSize = count;
+        return true;
+    }
+
+    bool CompressedLogReader::readIndex()
+    {
+        if (_indexRead) {
+            return _indexRecords >= 0;
+        }
+        _indexRead = true;
+
+        if (!_device or _device->isSequential()) {
+            return false;
+        }
+
+        const qint64 resumeAt = _device->pos();
+        const qint64 size = _device->size();
+        QByteArray trailer, index;
+
+        if ((size >= _dataOffset + TRAILER_LENGTH) and _device->seek(size - TRAILER_LENGTH) and readExactly(_device, TRAILER_LENGTH, trailer) and
+                (trailer.mid(8) == QByteArray(TRAILER_MAGIC, MAGIC_LENGTH))) {
+            const qint64 indexOffset = qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(trailer.constData()));
+            if ((indexOffset >= _dataOffset) and (indexOffset + 16 <= size - TRAILER_LENGTH) and _device->seek(indexOffset) and
+                    readExactly(_device, 16, index) and index.startsWith(INDEX_MAGIC)) {
+                const uchar *data = reinterpret_cast<const uchar *>(index.constData());
+                const quint32 blocks = qFromLittleEndian<quint32>(data + 4);
+                const qint64 records = qFromLittleEndian<quint64>(data + 8);
+
+                if ((indexOffset + 16 + blocks * Q_INT64_C(16) == size - TRAILER_LENGTH) and readExactly(_device, blocks * 16, index)) {
+                    data = reinterpret_cast<const uchar *>(index.constData());
+                    for (quint32 i=0; i < blocks; i++) {
+                        _index.append(qMakePair<qint64, qint64>(qFromLittleEndian<quint64>(data + i * 16), qFromLittleEndian<quint64>(data + i * 16 + 8)));
+                    }
+                    _indexRecords = records;
+                }
+            }
+        }
+
+        _device->seek(resumeAt);
+        return _indexRecords >= 0;
+    }
+
+    qint64 CompressedLogReader::recordCount()
+    {
+        return readIndex() ? _indexRecords : -1;
+    }
+
+    bool CompressedLogReader::seek(qint64 aRecord)
+    {
+        if (!readIndex() or (aRecord < 0) or (aRecord >= _indexRecords) or _index.isEmpty()) {
+            return false;
+        }
+
+        // The last block starting at or before the record
+        int block = 0;
+        while ((block + 1 < _index.size()) and (_index.at(block + 1).second <= aRecord)) {
+            block++;
+        }
+
+        if (!_device->seek(_index.at(block).first) or !readBlock()) {
+            return false;
+        }
+
+        _position = static_cast<int>(aRecord - _index.at(block).second);
+        return _position < _blockSize;
+    }
+}
@@ -41,6 +41,30 @@
 #include <ds2/controlunit.h>
 #include <ds2/manager.h>
 #include <ds2/dpp_v1_parser.h>
+#include <ds2/trace.h>
+#include <ds2/timeline.h>
+#include <ds2/allocationstats.h>
+
+namespace {
+    /*
+     * True if a short's RPN is N times a constant, optionally plus or minus another, which BatchDecoder's
+     * single precision multiply and add reproduce exactly.  Dividing by a constant isn't the same as
+     * multiplying by its float reciprocal, so those stay on the per-packet path.
+     */
+    bool isFloatMultiplyAdd(const QStringList &someRpn)
+    {
+        if (someRpn.isEmpty()) {
+            return true;
+        }
+        if ((someRpn.size() != 3) and (someRpn.size() != 5)) {
+            return false;
+        }
+        if (((someRpn.at(0) == "N") == (someRpn.at(1) == "N")) or (someRpn.at(2) != "*")) {
+            return false;
+        }
+        return (someRpn.size() == 3) or ((someRpn.at(3) != "N") and ((someRpn.at(4) == "+") or (someRpn.at(4) == "-")));
+    }
+}
 
 namespace DS2PlusPlus {
 
@@ -180,7 +204,7 @@ namespace DS2PlusPlus {
     }
 
     ControlUnit::ControlUnit(const QString &aUuid, Manager *aParent) :
-        QObject(aParent), _protocol(BasePacket::ProtocolDS2), _manager(aParent)
+        QObject(aParent), _expandBitfields(false), _protocol(BasePacket::ProtocolDS2), _manager(aParent)
     {
         if (_manager == NULL) {
             _manager = new Manager();
@@ -193,9 +217,7 @@ namespace DS2PlusPlus {
 
     void ControlUnit::loadByUuid(const QString &aUuid)
     {
-        QTextStream qOut(stdout);
-        QTextStream qErr(stderr);
-
+        AllocationScope ourAllocations(AllocationStats::DefinitionLoad);
         _operations.clear();
 
         QString moduleParent = aUuid;
@@ -261,9 +283,7 @@ namespace DS2PlusPlus {
                 _fileLastModified.setTime_t(mtimeInt);
             }
 
-            if (getenv("DPP_TRACE")) {
-                qErr << "Module: " << moduleParent << " (from: " << aUuid << ")" << endl;
-            }
+            DS2_TRACE(General) << "Module: " << moduleParent << " (from: " << aUuid << ")";
 
             QSqlQuery operationsForModuleQuery(_manager->sqlDatabase());
             operationsForModuleQuery.prepare("SELECT * FROM operations WHERE module_id = :module_id");
@@ -283,10 +303,8 @@ namespace DS2PlusPlus {
                 if (_operations.contains(opName)) {
                     op = _operations.value(opName);
                     if (op->parentId() == opUuid) {
-                        if (getenv("DPP_TRACE")) {
-                            qErr << "\tMerging operation: '" << opName << "' (" << opUuid << ")" << endl;
-                            qErr << "\t\tParent ID: " << op->uuid() << endl;
-                        }
+                        DS2_TRACE(General) << "\tMerging operation: '" << opName << "' (" << opUuid << ")";
+                        DS2_TRACE(General) << "\t\tParent ID: " << op->uuid();
 
                         // If we've not yet set the command from a higher priority operation, use this one.
                         if (op->command().isEmpty()) {
@@ -294,15 +312,11 @@ namespace DS2PlusPlus {
                         }
                     } else
                     {
-                        if (getenv("DPP_TRACE")) {
-                            qErr << "\tSkipping operation: '" << opName << "' (" << opUuid << ")" << endl;
-                        }
+                        DS2_TRACE(General) << "\tSkipping operation: '" << opName << "' (" << opUuid << ")";
                         continue;
                     }
                 } else {
-                    if (getenv("DPP_TRACE")) {
-                        qErr << "\tAdding operation: '" << opName << "' (" << opUuid << ")" << endl;
-                    }
+                    DS2_TRACE(General) << "\tAdding operation: '" << opName << "' (" << opUuid << ")";
                     op = OperationPtr(new Operation(opUuid, _address, opName, opCommand, _protocol));
                     op->setParentId(opParent);
                 }
@@ -311,6 +325,10 @@ namespace DS2PlusPlus {
                 QSqlRecord curOpRecord = opRecord;
 
                 while (!curOpUuid.isEmpty()) {
+                    // The most specific definition to declare a TTL wins
+                    if ((op->cacheTtl() < 0) and !curOpRecord.value("cache_ttl").isNull()) {
+                        op->setCacheTtl(curOpRecord.value("cache_ttl").toDouble());
+                    }
 
                     QSqlQuery resultsForOperationQuery(_manager->sqlDatabase());
                     resultsForOperationQuery.prepare("SELECT * FROM results WHERE operation_id = :operation_id");
@@ -374,13 +392,9 @@ namespace DS2PlusPlus {
                         }
 
                         if (op->results().contains(result.name())) {
-                            if (getenv("DPP_TRACE")) {
-                                qErr << "\t\tSkipping result " << result.name() << " as we've a higher priority implementation" << endl;
-                            }
+                            DS2_TRACE(General) << "\t\tSkipping result " << result.name() << " as we've a higher priority implementation";
                         } else {
-                            if (getenv("DPP_TRACE")) {
-                                qErr << "\t\tAdding result: " << result.name() << endl;
-                            }
+                            DS2_TRACE(General) << "\t\tAdding result: " << result.name();
                             op->insertResult(result.name(), result);
                         }
                     }
@@ -406,23 +420,61 @@ namespace DS2PlusPlus {
 
     PacketResponse ControlUnit::executeOperation(const QString &name)
     {
-        QTextStream qOut(stdout);
-        QTextStream qErr(stderr);
-
         const OperationPtr ourOp(_operations.value(name));
         if (ourOp.isNull()) {
             throw std::invalid_argument(qPrintable(QString("Operation '%1' could not be found in ECU %2").arg(name).arg(_uuid)));
         }
 
-        BasePacketPtr ourOutgoingPacket(ourOp->queryPacket());
+        PacketResponse ret;
+        executeOperation(ourOp, ret);
+        return ret;
+    }
 
-        if (getenv("DPP_TRACE")) {
-            qErr << ">> " << ourOp->name() << ": " << ourOp->command().join(" ") << endl;
+    void ControlUnit::executeOperation(const OperationPtr anOperation, PacketResponse &aResponse)
+    {
+        if (anOperation.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("executeOperation requires a valid operation.")));
+        }
+
+        ResponseCache &ourCache = _manager->responseCache();
+        if (anOperation->isCacheable() and ourCache.find(_address, _uuid, anOperation->name(), aResponse)) {
+            DS2_TRACE(General) << ">> " << anOperation->name() << ": answered from the response cache";
+            return;
         }
 
-        BasePacketPtr ourIncomingPacket(_manager->query(ourOutgoingPacket));
+        Frame ourIncomingFrame;
+        executeOperation(anOperation, aResponse, ourIncomingFrame);
+
+        if (anOperation->isCacheable()) {
+            ourCache.insert(_address, _uuid, anOperation->name(), aResponse, anOperation->cacheTtl());
+        }
+    }
+
+    void ControlUnit::executeOperation(const OperationPtr anOperation, PacketResponse &aResponse, Frame &aReply)
+    {
+        if (anOperation.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("executeOperation requires a valid operation.")));
+        }
+
+        queryOperation(anOperation, aReply);
+        parseOperation(anOperation, aReply, aResponse);
+    }
+
+    void ControlUnit::queryOperation(const OperationPtr anOperation, Frame &aReply)
+    {
+        if (anOperation.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("queryOperation requires a valid operation.")));
+        }
+
+        DS2_TRACE(General) << ">> " << anOperation->name() << ": " << anOperation->command().join(" ");
+        TimelineSpan ourSpan("operation", "ecu", _address, anOperation->name());
+
+        TransactionStatistics *&ourStatistics = _operationStatistics[anOperation->name()];
+        if (!ourStatistics) {
+            ourStatistics = _manager->statistics().forOperation(QString("%1:%2").arg(_family).arg(anOperation->name()));
+        }
 
-        return parseOperation(ourOp, ourIncomingPacket);
+        _manager->queryEncoded(anOperation->encodedRequest(), anOperation->encodedRequestLength(), anOperation->protocol(), aReply, ourStatistics);
     }
 
     PacketResponse ControlUnit::parseOperation(const QString &name, const BasePacketPtr packet)
@@ -442,9 +494,6 @@ namespace DS2PlusPlus {
             throw std::invalid_argument(qPrintable(QString("parseOperation requires a valid operation.")));
         }
 
-        QTextStream qOut(stdout);
-        QTextStream qErr(stderr);
-
         PacketResponse ret;
 
         if (packet->targetAddress() != address()) {
@@ -452,84 +501,293 @@ namespace DS2PlusPlus {
             //qErr << errorString << endl;
         }
 
-        if (getenv("DPP_TRACE")) {
-            qOut << "<< REPLY: " << *packet << endl;
+        DS2_TRACE(General) << "<< REPLY: " << *packet;
+
+        AllocationScope ourAllocations(AllocationStats::Decode);
+        TimelineSpan ourSpan("decode", "ecu", _address, theOp->name());
+        parsePayload(theOp, packet->payload(), ret);
+        return ret;
+    }
+
+    void ControlUnit::parseOperation(const OperationPtr theOp, const Frame &aFrame, PacketResponse &aResponse)
+    {
+        if (theOp.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("parseOperation requires a valid operation.")));
+        }
+
+        DS2_TRACE(General) << "<< REPLY: " << aFrame;
+
+        AllocationScope ourAllocations(AllocationStats::Decode);
+        TimelineSpan ourSpan("decode", "ecu", _address, theOp->name());
+        parsePayload(theOp, aFrame.payload(), aResponse);
+
+        publishSharedValues(theOp, aResponse);
+    }
+
+    void ControlUnit::publishSharedValues(const OperationPtr anOperation, const PacketResponse &aResponse)
+    {
+        const QSharedPointer<SharedValueWriter> ourSharedValues = _manager ? _manager->sharedValues() : QSharedPointer<SharedValueWriter>();
+        if (ourSharedValues.isNull()) {
+            return;
+        }
+
+        if (_sharedChannelsWriter != ourSharedValues) {
+            _sharedChannels.clear();
+            _sharedChannelsWriter = ourSharedValues;
         }
 
+        // Only a result's first publication builds its channel name; after that it's one lookup per result.
+        QHash<QString, int> &ourChannels = _sharedChannels[anOperation.data()];
+        const double ourTimestamp = ResponseCache::now();
+        for (PacketResponse::const_iterator it = aResponse.constBegin(); it != aResponse.constEnd(); ++it) {
+            QHash<QString, int>::const_iterator found = ourChannels.constFind(it.key());
+            if (found == ourChannels.constEnd()) {
+                const QString ourName = QString("%1:%2:%3").arg(_family).arg(anOperation->name()).arg(it.key());
+                found = ourChannels.insert(it.key(), ourSharedValues->channel(ourName, anOperation->results().value(it.key()).units()));
+            }
+            if (found.value() >= 0) {
+                ourSharedValues->publish(found.value(), ourTimestamp, it.value());
+            }
+        }
+    }
+
+    void ControlUnit::parsePayload(const OperationPtr theOp, const PayloadView &payload, PacketResponse &aResponse)
+    {
         foreach(const Result &result, theOp->results()) {
             //qDebug() << "Result: " << result.name;
 
-            if ((result.startPosition() >= packet->data().length() ) || ((result.startPosition() + result.length() - 1) >= packet->data().length())) {
+            if ((result.startPosition() >= payload.length() ) || ((result.startPosition() + result.length() - 1) >= payload.length())) {
                 //qDebug() << "Skipping out of range result (" << result.uuid << "/" << result.name;
                 continue;
             }
-            if (result.isType("byte") || result.isType("signed_byte")) {
-                ret.insert(result.name(), resultByteToVariant(packet, result));
-            } else if (result.isType("short") || result.isType("signed_short")) {
-                ret.insert(result.name(), resultShortToVariant(packet, result));
-            } else if (result.isType("hex_string")) {
-                ret.insert(result.name(), resultHexStringToVariant(packet, result));
-            } else if (result.isType("string")) {
-                QString string;
-                for (int i=0; i < result.length(); i++) {
-                    QChar byte(packet->data().at(result.startPosition() + i));
-                    string.append(byte);
-                }
-                if (result.displayFormat() == "string") {
-                    ret.insert(result.name(), QVariant(string));
-                } else if (result.displayFormat() == "hex_string") {
-                    string.prepend("0x");
-                    ret.insert(result.name(), QVariant(string));
-                } else if (result.displayFormat() == "int") {
-                    ret.insert(result.name(), QVariant(string.toULongLong()) );
+
+            if (_expandBitfields and insertBitfieldSlots(aResponse, payload, result)) {
+                continue;
+            }
+
+            const QVariant value = resultToVariant(payload, result);
+            if (value.isValid()) {
+                aResponse.insert(result.name(), value);
+            }
+        }
+    }
+
+    bool ControlUnit::insertBitfieldSlots(PacketResponse &aResponse, const PayloadView &payload, const Result &result)
+    {
+        if (!(result.isType("byte") or result.isType("signed_byte")) or (result.displayFormat() != "enum") or (result.length() != 1)) {
+            return false;
+        }
+
+        const QStringList keys = result.levelSlotKeys();
+        if (keys.isEmpty()) {
+            return false;
+        }
+
+        unsigned char byte = payload.at(result.startPosition());
+        if (result.mask() != 0) {
+            byte = (byte & result.mask()) & 0xff;
+        }
+
+        const quint8 level = runRpnForResult<qint64>(result, byte);
+        const QVector<quint8> masks = result.levelSlotMasks();
+
+        for (int i=0; i < keys.count(); i++) {
+            aResponse.insert(keys.at(i), QVariant((level & masks.at(i)) > 0));
+        }
+
+        return true;
+    }
+
+    BatchResponse ControlUnit::parseOperationBatch(const QString &name, const QList<BasePacketPtr> &somePackets)
+    {
+        const OperationPtr theOp = (_operations.value(name));
+
+        if (theOp.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("Operation '%1' could not be found in ECU %2").arg(name).arg(_uuid)));
+        }
+
+        int stride = 0;
+        foreach (const BasePacketPtr &packet, somePackets) {
+            stride = qMax(stride, packet->payload().length());
+        }
+
+        // Pack the payloads into a zero padded matrix, one packet per row.
+        QByteArray matrix(stride * somePackets.count(), '\0');
+        QVector<int> lengths(somePackets.count());
+        for (int i=0; i < somePackets.count(); i++) {
+            const PayloadView payload = somePackets.at(i)->payload();
+            memcpy(matrix.data() + (i * stride), payload.constData(), payload.length());
+            lengths[i] = payload.length();
+        }
+
+        return parseOperationBatch(theOp, reinterpret_cast<const quint8 *>(matrix.constData()), stride, lengths.constData(), somePackets.count());
+    }
+
+    BatchResponse ControlUnit::parseOperationBatch(const OperationPtr theOp, const quint8 *somePayloads, int aStride, const int *someLengths, int aCount)
+    {
+        AllocationScope ourAllocations(AllocationStats::Decode);
+        if (theOp.isNull()) {
+            throw std::invalid_argument(qPrintable(QString("parseOperationBatch requires a valid operation.")));
+        }
+
+        BatchResponse ret;
+
+        foreach (const Result &result, theOp->results()) {
+            BatchColumn column;
+            column.name = result.name();
+            column.valid.resize(aCount);
+
+            const int lastPosition = result.startPosition() + result.length() - 1;
+            for (int i=0; i < aCount; i++) {
+                const int rowLength = (someLengths == NULL) ? aStride : someLengths[i];
+                column.valid[i] = ((result.startPosition() < rowLength) and (lastPosition < rowLength)) ? 1 : 0;
+            }
+
+            if (lastPosition >= aStride) {
+                // No payload is long enough to hold this result.
+                column.type = BatchColumn::ColumnVariant;
+                column.variants.resize(aCount);
+                ret.insert(column.name, column);
+                continue;
+            }
+
+            const bool isByte = (result.isType("byte") || result.isType("signed_byte")) and (result.length() == 1);
+            const bool isShort = (result.isType("short") || result.isType("signed_short")) and (result.length() == 2);
+            const bool isSigned = result.isType("signed_byte") || result.isType("signed_short");
+            const bool isUnmasked = (result.mask() == 0) or (result.mask() == 0xff);
+            const bool isIdentity = result.rpnIsAffine() and (result.rpnScale() == 1.0) and (result.rpnOffset() == 0.0);
+            const QString display = result.displayFormat();
+
+            if (isShort and result.rpnIsAffine() and isFloatMultiplyAdd(result.rpn()) and ((display == "float") or (display == "int"))) {
+                column.doubles.resize(aCount);
+                BatchDecoder::decodeShorts(somePayloads, aStride, result.startPosition(), aCount, isSigned, _bigEndian,
+                                           static_cast<float>(result.rpnScale()), static_cast<float>(result.rpnOffset()), column.doubles.data());
+
+                if (display == "int") {
+                    // Truncated the way resultShortToVariant() does; every float is exact as a double
+                    column.type = BatchColumn::ColumnInt64;
+                    column.ints.resize(aCount);
+                    for (int i=0; i < aCount; i++) {
+                        if (isSigned) {
+                            column.ints[i] = static_cast<qint64>(column.doubles.at(i));
+                        } else {
+                            column.ints[i] = static_cast<qint64>(static_cast<quint64>(column.doubles.at(i)));
+                        }
+                    }
+                    column.doubles.clear();
                 } else {
-                    QString errorString = QString("Unknown display type for string type: ").arg(result.displayFormat());
-                    throw std::invalid_argument(qPrintable(errorString));
+                    column.type = BatchColumn::ColumnDouble;
                 }
-            } else if (result.isType("short_vin")) {
-                QString vin;
-                vin.append(packet->data().at(result.startPosition()));
-                vin.append(packet->data().at(result.startPosition() + 1));
-
-                quint32 number_part;
-                memcpy(&number_part, packet->data().mid(result.startPosition() + 1, 4), 4);
-                number_part = qFromBigEndian(number_part);
-                number_part = (number_part & 0x00ffffff) >> 4;
-                vin.append(QString::number(number_part, 16));
-
-                ret.insert(result.name(), vin);
-            } else if (result.isType("6bit-string")) {
-                QByteArray encodedString = packet->data().mid(result.startPosition(), result.length());
-
-                quint16 numBits = result.length() * 8;
-                QString decodedString;
-
-                for (int i=0; i < (numBits / 6); i++) {
-                  int j = ((result.length()* 8) - (6*(i+1))) - 1;
-                  char foo = decode_vin_char(j, encodedString);
-                  decodedString.prepend(QChar(foo));
+            } else if (isByte and isUnmasked and result.rpnIsAffine() and (display == "float")) {
+                column.type = BatchColumn::ColumnDouble;
+                column.doubles.resize(aCount);
+                BatchDecoder::decodeBytes(somePayloads, aStride, result.startPosition(), aCount, isSigned, result.rpnScale(), result.rpnOffset(), column.doubles.data());
+            } else if (isByte and isUnmasked and isIdentity and (display == "raw")) {
+                // Raw bytes use integer RPN math, so only the identity is safe to vectorize.
+                QVector<qint32> raw(aCount);
+                BatchDecoder::extractBytes(somePayloads, aStride, result.startPosition(), aCount, isSigned, raw.data());
+
+                column.type = BatchColumn::ColumnInt64;
+                column.ints.resize(aCount);
+                for (int i=0; i < aCount; i++) {
+                    column.ints[i] = raw.at(i);
                 }
-                ret.insert(result.name(), QVariant(decodedString));
+            } else {
+                column.type = BatchColumn::ColumnVariant;
+                column.variants.resize(aCount);
+                for (int i=0; i < aCount; i++) {
+                    if (!column.valid.at(i)) {
+                        continue;
+                    }
 
-            } else if (result.isType("boolean")) {
-                if (result.length() != 1) {
-                    throw std::invalid_argument("Incorrect length for boolean type encountered");
+                    const int rowLength = (someLengths == NULL) ? aStride : someLengths[i];
+                    column.variants[i] = resultToVariant(PayloadView(somePayloads + (i * aStride), rowLength), result);
                 }
-                unsigned char byte = packet->data().at(result.startPosition());
-                bool condition = ((byte & result.mask()) > 0);
-                if (result.displayFormat() == "string") {
-                    ret.insert(result.name(), QVariant(result.stringForLevel(condition)));
-                } else if (result.displayFormat() == "raw") {
-                    ret.insert(result.name(), QVariant(condition));
+            }
+
+            // Zero out rows that were too short so stale bytes from the padding never leak out.
+            for (int i=0; i < aCount; i++) {
+                if (column.valid.at(i)) {
+                    continue;
+                }
+
+                if (column.type == BatchColumn::ColumnDouble) {
+                    column.doubles[i] = 0.0;
+                } else if (column.type == BatchColumn::ColumnInt64) {
+                    column.ints[i] = 0;
                 }
-            } else {
-                qErr << "Unknown result type: " << result.type() << endl;
             }
+
+            ret.insert(column.name, column);
         }
 
         return ret;
     }
 
+    QVariant ControlUnit::resultToVariant(const PayloadView &payload, const Result &result)
+    {
+        if (result.isType("byte") || result.isType("signed_byte")) {
+            return resultByteToVariant(payload, result);
+        } else if (result.isType("short") || result.isType("signed_short")) {
+            return resultShortToVariant(payload, result);
+        } else if (result.isType("hex_string")) {
+            return resultHexStringToVariant(payload, result);
+        } else if (result.isType("string")) {
+            QString string = QString::fromLatin1(reinterpret_cast<const char *>(payload.constData()) + result.startPosition(), result.length());
+            if (result.displayFormat() == "string") {
+                return QVariant(string);
+            } else if (result.displayFormat() == "hex_string") {
+                string.prepend("0x");
+                return QVariant(string);
+            } else if (result.displayFormat() == "int") {
+                return QVariant(string.toULongLong());
+            } else {
+                QString errorString = QString("Unknown display type for string type: ").arg(result.displayFormat());
+                throw std::invalid_argument(qPrintable(errorString));
+            }
+        } else if (result.isType("short_vin")) {
+            QString vin;
+            vin.append(QLatin1Char(payload.at(result.startPosition())));
+            vin.append(QLatin1Char(payload.at(result.startPosition() + 1)));
+
+            quint32 number_part = qFromBigEndian<quint32>(payload.constData() + result.startPosition() + 1);
+            number_part = (number_part & 0x00ffffff) >> 4;
+            vin.append(QString::number(number_part, 16));
+
+            return vin;
+        } else if (result.isType("6bit-string")) {
+            const quint8 *encodedString = payload.constData() + result.startPosition();
+
+            quint16 numBits = result.length() * 8;
+            QString decodedString;
+
+            for (int i=0; i < (numBits / 6); i++) {
+              int j = ((result.length()* 8) - (6*(i+1))) - 1;
+              char foo = decode_vin_char(j, encodedString);
+              decodedString.prepend(QChar(foo));
+            }
+            return QVariant(decodedString);
+
+        } else if (result.isType("boolean")) {
+            if (result.length() != 1) {
+                throw std::invalid_argument("Incorrect length for boolean type encountered");
+            }
+            unsigned char byte = payload.at(result.startPosition());
+            bool condition = ((byte & result.mask()) > 0);
+            if (result.displayFormat() == "string") {
+                return QVariant(result.stringForLevel(condition));
+            } else if (result.displayFormat() == "raw") {
+                return QVariant(condition);
+            }
+        } else {
+            // Only a broken definition gets here, so the stream isn't made for every decoded result
+            QTextStream qErr(stderr);
+            qErr << "Unknown result type: " << result.type() << endl;
+        }
+
+        return QVariant();
+    }
+
     quint32 ControlUnit::dppVersion() const
     {
         return _dppVersion;
@@ -617,7 +875,17 @@ namespace DS2PlusPlus {
         _matchFlags = someFlags;
     }
 
-    char ControlUnit::decode_vin_char(int start, const QByteArray &bytes)
+    bool ControlUnit::expandBitfields() const
+    {
+        return _expandBitfields;
+    }
+
+    void ControlUnit::setExpandBitfields(bool isEnabled)
+    {
+        _expandBitfields = isEnabled;
+    }
+
+    char ControlUnit::decode_vin_char(int start, const quint8 *bytes)
     {
       quint8 finish = start + 6;
       quint8 start_byte = start / 8;
@@ -653,10 +921,7 @@ namespace DS2PlusPlus {
 
     template <typename T> T ControlUnit::runRpnForResult(const Result &aResult, T aValue)
     {
-        if (getenv("RPN_TRACE")) {
-            qDebug() << "";
-            qDebug() << "RPN IS: " << aResult.rpn() << " " << aValue;
-        }
+        DS2_TRACE(Rpn) << "RPN IS: " << aResult.rpn().join(" ") << " " << aValue;
 
         T ourValue = aValue;
 
@@ -705,18 +970,14 @@ namespace DS2PlusPlus {
                     a = stack.takeLast();
                     b = stack.takeLast();
                     stack.push_back(static_cast<quint64>(b) >> static_cast<quint64>(a));
-                    if (getenv("RPN_TRACE")) {
-                        qDebug() << ">> = " << stack.last();
-                    }
+                    DS2_TRACE(Rpn) << ">> = " << stack.last();
                 } else if (command == "<<") {
                     T a, b;
                     a = stack.takeLast();
                     b = stack.takeLast();
                     stack.push_back(static_cast<quint64>(b) << static_cast<quint64>(a));
                 } else if (command == "N")  {
-                    if (getenv("RPN_TRACE")) {
-                        qDebug() << "N: " << ourValue;
-                    }
+                    DS2_TRACE(Rpn) << "N: " << ourValue;
 
                     stack.push_back(ourValue);
                 } else {
@@ -744,21 +1005,15 @@ namespace DS2PlusPlus {
         return ourValue;
     }
 
-    QVariant ControlUnit::resultShortToVariant(const BasePacketPtr aPacket, const Result &aResult)
+    QVariant ControlUnit::resultShortToVariant(const PayloadView &aPayload, const Result &aResult)
     {
         if (aResult.length() != 2) {
             QString errorString = QString("Length for short data type must be 2.  Length was %1, Result was %2 (%3)").arg(aResult.length()).arg(aResult.name()).arg(aResult.uuid());
             throw std::invalid_argument(qPrintable(errorString));
         }
 
-        quint16 ourNumber;
-        memcpy(&ourNumber, aPacket->data().mid(aResult.startPosition(), aResult.length()), qMin(static_cast<size_t>(aResult.length()), sizeof(quint16)));
-
-        if (_bigEndian) {
-            ourNumber = qFromBigEndian(ourNumber);
-        } else {
-            ourNumber = qFromLittleEndian(ourNumber);
-        }
+        const quint8 *field = aPayload.constData() + aResult.startPosition();
+        const quint16 ourNumber = _bigEndian ? qFromBigEndian<quint16>(field) : qFromLittleEndian<quint16>(field);
 
         if (aResult.displayFormat() == "int") {
             if (aResult.isType("signed_short")) {
@@ -782,14 +1037,14 @@ namespace DS2PlusPlus {
         }
     }
 
-    QVariant ControlUnit::resultByteToVariant(const BasePacketPtr aPacket, const Result &aResult)
+    QVariant ControlUnit::resultByteToVariant(const PayloadView &aPayload, const Result &aResult)
     {
         if (aResult.length() != 1) {
             QString ourError = QObject::tr("Length is not one for a byte data type.  Length is %1").arg(aResult.length());
             throw std::invalid_argument(qPrintable(ourError));
         }
 
-        unsigned char byte = aPacket->data().at(aResult.startPosition());
+        unsigned char byte = aPayload.at(aResult.startPosition());
         if (aResult.mask() != 0) {
             byte = (byte & aResult.mask()) & 0xff;
         }
@@ -833,7 +1088,7 @@ namespace DS2PlusPlus {
         }
     }
 
-    QVariant ControlUnit::resultHexStringToVariant(const BasePacketPtr aPacket, const Result &aResult)
+    QVariant ControlUnit::resultHexStringToVariant(const PayloadView &aPayload, const Result &aResult)
     {
         QString hex;
         bool isChkSum = false;
@@ -858,7 +1113,7 @@ namespace DS2PlusPlus {
         }
 
         for (int i=0; i < aResult.length(); i++) {
-            const unsigned char byte = aPacket->data().at(aResult.startPosition() + i);
+            const unsigned char byte = aPayload.at(aResult.startPosition() + i);
             if ((i == 0) and (isChkSum == false) and (isFull == false)) {
                 hex.append(QString("%1").arg(QString::number(byte & 0x0f, 16)));
             } else if ((i == aResult.length() - 1) and (isChkSum == true)) {
@@ -0,0 +1,338 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+
+#include <QtEndian>
+
+#include <ds2/datalog.h>
+
+namespace {
+    const char MAGIC[] = "DPPLOG01";
+    const int MAGIC_LENGTH = 8;
+    // magic, data offset, record length, channel count
+    const int FIXED_HEADER_LENGTH = MAGIC_LENGTH + 12;
+
+    void appendShort(QByteArray &aBuffer, quint16 aValue)
+    {
+        uchar bytes[2];
+        qToLittleEndian<quint16>(aValue, bytes);
+        aBuffer.append(reinterpret_cast<const char *>(bytes), 2);
+    }
+
+    void appendLong(QByteArray &aBuffer, quint32 aValue)
+    {
+        uchar bytes[4];
+        qToLittleEndian<quint32>(aValue, bytes);
+        aBuffer.append(reinterpret_cast<const char *>(bytes), 4);
+    }
+
+    void appendString(QByteArray &aBuffer, const QString &aString)
+    {
+        const QByteArray utf8 = aString.toUtf8();
+        appendShort(aBuffer, utf8.size());
+        aBuffer.append(utf8);
+    }
+
+    bool readString(const uchar *someData, qint64 aLength, qint64 &aPosition, QString &aString)
+    {
+        if (aPosition + 2 > aLength) {
+            return false;
+        }
+        const quint16 length = qFromLittleEndian<quint16>(someData + aPosition);
+        aPosition += 2;
+        if (aPosition + length > aLength) {
+            return false;
+        }
+        aString = QString::fromUtf8(reinterpret_cast<const char *>(someData + aPosition), length);
+        aPosition += length;
+        return true;
+    }
+}
+
+namespace DS2PlusPlus {
+    DataLogChannel::DataLogChannel(const QString &aName, const QString &someUnits, ChannelType aType, int aWidth) :
+        name(aName), units(someUnits), type(aType), width((aType == TypeString) ? aWidth : 8)
+    {
+    }
+
+    DataLogChannel DataLogChannel::forValue(const QString &aName, const QString &someUnits, const QVariant &aSample, int aStringWidth)
+    {
+        switch (static_cast<QMetaType::Type>(aSample.type())) {
+        case QMetaType::Char:
+        case QMetaType::Short:
+        case QMetaType::Int:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            return DataLogChannel(aName, someUnits, TypeInt64);
+        case QMetaType::Bool:
+            return DataLogChannel(aName, someUnits, TypeBool);
+        case QMetaType::UChar:
+        case QMetaType::UShort:
+        case QMetaType::UInt:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+            return DataLogChannel(aName, someUnits, TypeUInt64);
+        case QMetaType::Float:
+        case QMetaType::Double:
+            return DataLogChannel(aName, someUnits, TypeDouble);
+        default:
+            return DataLogChannel(aName, someUnits, TypeString, qMax(aStringWidth, aSample.toString().toUtf8().size()));
+        }
+    }
+
+    bool DataLogChannel::operator==(const DataLogChannel &aChannel) const
+    {
+        return (name == aChannel.name) and (units == aChannel.units) and (type == aChannel.type) and (width == aChannel.width);
+    }
+
+    DataLogWriter::DataLogWriter(QIODevice *aDevice) :
+        _device(aDevice)
+    {
+    }
+
+    int DataLogWriter::recordLayout(const QVector<DataLogChannel> &someChannels, QVector<int> &someOffsets)
+    {
+        // The validity bitmap comes first, then every value back to back.
+        int position = (someChannels.size() + 7) / 8;
+
+        someOffsets.resize(someChannels.size());
+        for (int i=0; i < someChannels.size(); i++) {
+            someOffsets[i] = position;
+            position += someChannels.at(i).width;
+        }
+
+        return position;
+    }
+
+    QByteArray DataLogWriter::encodeHeader(const QVector<DataLogChannel> &someChannels)
+    {
+        QVector<int> offsets;
+        const int recordLength = recordLayout(someChannels, offsets);
+
+        QByteArray channelData;
+        foreach (const DataLogChannel &channel, someChannels) {
+            channelData.append(static_cast<char>(channel.type));
+            channelData.append('\0');
+            appendShort(channelData, channel.width);
+            appendString(channelData, channel.name);
+            appendString(channelData, channel.units);
+        }
+
+        // Records start on an 8 byte boundary so a mapped log's doubles are never too far out of line.
+        const int dataOffset = ((FIXED_HEADER_LENGTH + channelData.size() + 7) / 8) * 8;
+
+        QByteArray header(MAGIC, MAGIC_LENGTH);
+        appendLong(header, dataOffset);
+        appendLong(header, recordLength);
+        appendLong(header, someChannels.size());
+        header.append(channelData);
+        header.append(QByteArray(dataOffset - header.size(), '\0'));
+
+        return header;
+    }
+
+    void DataLogWriter::setChannels(const QVector<DataLogChannel> &someChannels)
+    {
+        _channels = someChannels;
+        _record.fill('\0', recordLayout(_channels, _offsets));
+    }
+
+    void DataLogWriter::writeHeader(const QVector<DataLogChannel> &someChannels)
+    {
+        setChannels(someChannels);
+        _device->write(encodeHeader(_channels));
+    }
+
+    void DataLogWriter::append(const QVector<QVariant> &someValues)
+    {
+        _device->write(encode(someValues));
+    }
+
+    const QByteArray &DataLogWriter::encode(const QVector<QVariant> &someValues)
+    {
+        if (someValues.size() != _channels.size()) {
+            throw std::invalid_argument(qPrintable(QString("Data log record has %1 values for %2 channels").arg(someValues.size()).arg(_channels.size())));
+        }
+
+        uchar *record = reinterpret_cast<uchar *>(_record.data());
+        memset(record, 0, _record.size());
+
+        for (int i=0; i < _channels.size(); i++) {
+            const QVariant &value = someValues.at(i);
+            if (!value.isValid()) {
+                continue;
+            }
+
+            record[i / 8] |= (1 << (i % 8));
+            uchar *field = record + _offsets.at(i);
+
+            switch (_channels.at(i).type) {
+            case DataLogChannel::TypeInt64:
+                qToLittleEndian<qint64>(value.toLongLong(), field);
+                break;
+            case DataLogChannel::TypeUInt64:
+                qToLittleEndian<quint64>(value.toULongLong(), field);
+                break;
+            case DataLogChannel::TypeDouble: {
+                const double number = value.toDouble();
+                quint64 bits;
+                memcpy(&bits, &number, sizeof(bits));
+                qToLittleEndian<quint64>(bits, field);
+                break;
+            }
+            case DataLogChannel::TypeString: {
+                const QByteArray utf8 = value.toString().toUtf8();
+                memcpy(field, utf8.constData(), qMin(utf8.size(), _channels.at(i).width));
+                break;
+            }
+            case DataLogChannel::TypeBool:
+                qToLittleEndian<quint64>(value.toBool() ? 1 : 0, field);
+                break;
+            }
+        }
+
+        return _record;
+    }
+
+    DataLogReader::DataLogReader() :
+        _records(0), _recordCount(0), _recordLength(0)
+    {
+    }
+
+    qint64 DataLogReader::parseHeader(const uchar *someData, qint64 aLength, QVector<DataLogChannel> &someChannels)
+    {
+        if ((aLength < FIXED_HEADER_LENGTH) or (memcmp(someData, MAGIC, MAGIC_LENGTH) != 0)) {
+            return -1;
+        }
+
+        const quint32 dataOffset = qFromLittleEndian<quint32>(someData + MAGIC_LENGTH);
+        const quint32 recordLength = qFromLittleEndian<quint32>(someData + MAGIC_LENGTH + 4);
+        const quint32 channelCount = qFromLittleEndian<quint32>(someData + MAGIC_LENGTH + 8);
+        if ((dataOffset > aLength) or (channelCount > dataOffset)) {
+            return -1;
+        }
+
+        someChannels.clear();
+        qint64 position = FIXED_HEADER_LENGTH;
+        for (quint32 i=0; i < channelCount; i++) {
+            if (position + 4 > dataOffset) {
+                return -1;
+            }
+
+            DataLogChannel channel;
+            channel.type = static_cast<DataLogChannel::ChannelType>(someData[position]);
+            channel.width = qFromLittleEndian<quint16>(someData + position + 2);
+            position += 4;
+
+            if (!readString(someData, dataOffset, position, channel.name) or !readString(someData, dataOffset, position, channel.units)) {
+                return -1;
+            }
+
+            if ((channel.type < DataLogChannel::TypeInt64) or (channel.type > DataLogChannel::TypeBool) or
+                    ((channel.type != DataLogChannel::TypeString) and (channel.width != 8))) {
+                return -1;
+            }
+
+            someChannels.append(channel);
+        }
+
+        QVector<int> offsets;
+        if (DataLogWriter::recordLayout(someChannels, offsets) != static_cast<int>(recordLength)) {
+            return -1;
+        }
+
+        return dataOffset;
+    }
+
+    void DataLogReader::open(const QString &aPath)
+    {
+        if (_file.isOpen()) {
+            _file.close();
+        }
+        _records = 0;
+        _recordCount = 0;
+
+        _file.setFileName(aPath);
+        if (!_file.open(QIODevice::ReadOnly)) {
+            throw std::runtime_error(qPrintable(QString("Unable to open data log %1: %2").arg(aPath).arg(_file.errorString())));
+        }
+
+        const qint64 size = _file.size();
+        const uchar *data = (size > 0) ? _file.map(0, size) : 0;
+        if (!data) {
+            throw std::runtime_error(qPrintable(QString("Unable to map data log %1").arg(aPath)));
+        }
+
+        const qint64 dataOffset = parseHeader(data, size, _channels);
+        if (dataOffset < 0) {
+            throw std::runtime_error(qPrintable(QString("%1 is not a DPP data log").arg(aPath)));
+        }
+
+        _recordLength = DataLogWriter::recordLayout(_channels, _offsets);
+        _records = data + dataOffset;
+        _recordCount = (_recordLength > 0) ? (size - dataOffset) / _recordLength : 0;
+    }
+
+    bool DataLogReader::isValid(qint64 aRecord, int aChannel) const
+    {
+        if ((aRecord < 0) or (aRecord >= _recordCount) or (aChannel < 0) or (aChannel >= _channels.size())) {
+            return false;
+        }
+
+        const uchar *record = _records + aRecord * _recordLength;
+        return record[aChannel / 8] & (1 << (aChannel % 8));
+    }
+
+    QVariant DataLogReader::value(qint64 aRecord, int aChannel) const
+    {
+        if (!isValid(aRecord, aChannel)) {
+            return QVariant();
+        }
+
+        const uchar *field = _records + aRecord * _recordLength + _offsets.at(aChannel);
+        const DataLogChannel &channel = _channels.at(aChannel);
+
+        switch (channel.type) {
+        case DataLogChannel::TypeInt64:
+            return QVariant(qFromLittleEndian<qint64>(field));
+        case DataLogChannel::TypeUInt64:
+            return QVariant(qFromLittleEndian<quint64>(field));
+        case DataLogChannel::TypeDouble: {
+            const quint64 bits = qFromLittleEndian<quint64>(field);
+            double number;
+            memcpy(&number, &bits, sizeof(number));
+            return QVariant(number);
+        }
+        case DataLogChannel::TypeString: {
+            const char *string = reinterpret_cast<const char *>(field);
+            return QVariant(QString::fromUtf8(string, qstrnlen(string, channel.width)));
+        }
+        case DataLogChannel::TypeBool:
+            return QVariant(qFromLittleEndian<quint64>(field) != 0);
+        }
+
+        return QVariant();
+    }
+}
@@ -0,0 +1,161 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include <QMutexLocker>
+
+#include <ds2/decodepipeline.h>
+#include <ds2/timeline.h>
+
+namespace {
+    // How long next() naps between looks at an empty queue
+    const int IDLE_MSECS = 1;
+    // Activity updates are small and applied every transaction, so this only needs to cover a burst
+    const int ACTIVITY_CAPACITY = 256;
+}
+
+namespace DS2PlusPlus {
+    DecodePipeline::DecodePipeline(const LogScheduler &aScheduler, int aQueueCapacity, QObject *aParent) :
+        QThread(aParent), _scheduler(aScheduler), _samples(aQueueCapacity), _activity(ACTIVITY_CAPACITY), _startTime(0)
+    {
+    }
+
+    DecodePipeline::~DecodePipeline()
+    {
+        stop();
+    }
+
+    double DecodePipeline::now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + (0.000000001 * ts.tv_nsec);
+    }
+
+    int DecodePipeline::addTask(ControlUnitPtr anEcu, OperationPtr anOperation)
+    {
+        if (anEcu.isNull() or anOperation.isNull()) {
+            throw std::invalid_argument("A decode pipeline task needs an ECU and an operation.");
+        }
+        if (_ecus.size() >= _scheduler.tasks().size()) {
+            throw std::invalid_argument(qPrintable(QString("The scheduler only has %1 tasks.").arg(_scheduler.tasks().size())));
+        }
+
+        _ecus.append(anEcu);
+        _operations.append(anOperation);
+        return _ecus.size() - 1;
+    }
+
+    bool DecodePipeline::next(Sample &aSample, PacketResponse &aResponse, int aTimeout)
+    {
+        int waited = 0;
+        while (!_samples.pop(aSample)) {
+            if (waited >= aTimeout) {
+                return false;
+            }
+            QThread::msleep(IDLE_MSECS);
+            waited += IDLE_MSECS;
+        }
+
+        aResponse.clear();
+        _ecus.at(aSample.task)->parseOperation(_operations.at(aSample.task), aSample.reply, aResponse);
+        return true;
+    }
+
+    void DecodePipeline::setActivity(int aTask, double anActivity)
+    {
+        // A lost update is replaced by the next one for the same task
+        _activity.push(ActivityUpdate(aTask, anActivity));
+    }
+
+    void DecodePipeline::stop()
+    {
+        if (isRunning()) {
+            _stopping.storeRelease(1);
+            wait();
+        }
+        _stopping.storeRelease(0);
+    }
+
+    QString DecodePipeline::errorString() const
+    {
+        QMutexLocker locker(&_errorLock);
+        return _errorString;
+    }
+
+    void DecodePipeline::run()
+    {
+        if (_ecus.size() != _scheduler.tasks().size()) {
+            QMutexLocker locker(&_errorLock);
+            _errorString = QString("The decode pipeline has %1 tasks but the scheduler has %2.").arg(_ecus.size()).arg(_scheduler.tasks().size());
+            return;
+        }
+
+        _startTime = now();
+        _scheduler.start(_startTime);
+
+        Sample sample;
+        ActivityUpdate update;
+        try {
+            while (!_stopping.loadAcquire()) {
+                while (_activity.pop(update)) {
+                    _scheduler.setActivity(update.task, update.activity);
+                }
+
+                double wait;
+                const int task = _scheduler.next(now(), wait);
+                if (task < 0) {
+                    break;
+                }
+                if (wait > 0) {
+                    TimelineSpan ourWait("schedule wait", "log", -1, _scheduler.tasks().at(task).name);
+                    usleep(static_cast<useconds_t>(wait * 1000000));
+                }
+
+                sample.task = task;
+                sample.time = now();
+                _ecus.at(task)->queryOperation(_operations.at(task), sample.reply);
+                sample.duration = now() - sample.time;
+                _scheduler.completed(task, sample.time, sample.duration);
+
+                if (!_samples.push(sample)) {
+                    _dropped.ref();
+                    continue;
+                }
+                _queued.ref();
+
+                const int queued = _samples.size();
+                if (queued > _highWaterMark.load()) {
+                    _highWaterMark.storeRelease(queued);
+                }
+            }
+        } catch (std::exception &error) {
+            QMutexLocker locker(&_errorLock);
+            _errorString = QString::fromUtf8(error.what());
+        }
+    }
+}
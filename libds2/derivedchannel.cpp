@@ -0,0 +1,241 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <stdexcept>
+
+#include <QVarLengthArray>
+
+#include <ds2/derivedchannel.h>
+
+namespace DS2PlusPlus {
+    DerivedChannel::DerivedChannel() :
+        _stackDepth(0)
+    {
+    }
+
+    DerivedChannel DerivedChannel::parse(const QString &aDefinition)
+    {
+        const int equals = aDefinition.indexOf('=');
+        if (equals < 0) {
+            throw std::invalid_argument(qPrintable(QString("Invalid derived channel '%1'.  Expected name=expression").arg(aDefinition)));
+        }
+
+        DerivedChannel ret;
+        ret._name = aDefinition.left(equals).trimmed();
+        ret._expression = aDefinition.mid(equals + 1).simplified();
+
+        const int bracket = ret._name.indexOf('[');
+        if ((bracket > 0) and ret._name.endsWith(']')) {
+            ret._units = ret._name.mid(bracket + 1, ret._name.size() - bracket - 2).trimmed();
+            ret._name = ret._name.left(bracket).trimmed();
+        }
+
+        if (ret._name.isEmpty() or ret._expression.isEmpty()) {
+            throw std::invalid_argument(qPrintable(QString("Invalid derived channel '%1'.  Expected name=expression").arg(aDefinition)));
+        }
+
+        return ret;
+    }
+
+    void DerivedChannel::compile(const QStringList &someChannels)
+    {
+        _program.clear();
+        _inputs.clear();
+        _stackDepth = 0;
+
+        int depth = 0;
+        foreach (const QString &token, _expression.split(' ')) {
+            Instruction instruction;
+            int operands = 0;
+
+            if (token == "+") {
+                instruction.op = Add;
+                operands = 2;
+            } else if (token == "-") {
+                instruction.op = Subtract;
+                operands = 2;
+            } else if (token == "*") {
+                instruction.op = Multiply;
+                operands = 2;
+            } else if (token == "/") {
+                instruction.op = Divide;
+                operands = 2;
+            } else if (token == "min") {
+                instruction.op = Minimum;
+                operands = 2;
+            } else if (token == "max") {
+                instruction.op = Maximum;
+                operands = 2;
+            } else if (token == "abs") {
+                instruction.op = Absolute;
+                operands = 1;
+            } else if (token == "neg") {
+                instruction.op = Negate;
+                operands = 1;
+            } else if (token == "sqrt") {
+                instruction.op = SquareRoot;
+                operands = 1;
+            } else {
+                bool ok;
+                if (token.startsWith("0x")) {
+                    instruction.value = token.toULongLong(&ok, 16);
+                } else {
+                    instruction.value = token.toDouble(&ok);
+                }
+
+                if (!ok) {
+                    instruction.op = PushChannel;
+                    instruction.channel = someChannels.indexOf(token);
+                    if (instruction.channel < 0) {
+                        throw std::invalid_argument(qPrintable(QString("Derived channel %1 uses %2, which isn't being logged").arg(_name).arg(token)));
+                    }
+                    if (!_inputs.contains(instruction.channel)) {
+                        _inputs.append(instruction.channel);
+                    }
+                }
+            }
+
+            if (depth < operands) {
+                throw std::invalid_argument(qPrintable(QString("Derived channel %1 has too few operands for %2").arg(_name).arg(token)));
+            }
+            depth += 1 - operands;
+            _stackDepth = qMax(_stackDepth, depth);
+            _program.append(instruction);
+        }
+
+        if (depth != 1) {
+            throw std::invalid_argument(qPrintable(QString("Derived channel %1 must leave exactly one value, not %2").arg(_name).arg(depth)));
+        }
+    }
+
+    QVariant DerivedChannel::evaluate(const QVector<QVariant> &someValues) const
+    {
+        if (_program.isEmpty()) {
+            return QVariant();
+        }
+
+        QVarLengthArray<double, 16> stack(_stackDepth);
+        int top = 0;
+
+        foreach (const Instruction &instruction, _program) {
+            switch (instruction.op) {
+            case PushConstant:
+                stack[top++] = instruction.value;
+                break;
+            case PushChannel: {
+                const QVariant &value = someValues.at(instruction.channel);
+                bool ok = false;
+                const double number = value.isValid() ? value.toDouble(&ok) : 0;
+                if (!ok) {
+                    return QVariant();
+                }
+                stack[top++] = number;
+                break;
+            }
+            case Add:
+                top--;
+                stack[top - 1] += stack[top];
+                break;
+            case Subtract:
+                top--;
+                stack[top - 1] -= stack[top];
+                break;
+            case Multiply:
+                top--;
+                stack[top - 1] *= stack[top];
+                break;
+            case Divide:
+                top--;
+                stack[top - 1] /= stack[top];
+                break;
+            case Minimum:
+                top--;
+                stack[top - 1] = qMin(stack[top - 1], stack[top]);
+                break;
+            case Maximum:
+                top--;
+                stack[top - 1] = qMax(stack[top - 1], stack[top]);
+                break;
+            case Absolute:
+                stack[top - 1] = std::fabs(stack[top - 1]);
+                break;
+            case Negate:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            case SquareRoot:
+                stack[top - 1] = std::sqrt(stack[top - 1]);
+                break;
+            }
+        }
+
+        if (!std::isfinite(stack[0])) {
+            return QVariant();
+        }
+
+        return QVariant(stack[0]);
+    }
+
+    void DerivedChannelSet::add(DerivedChannel aChannel, QStringList &someChannels)
+    {
+        aChannel.compile(someChannels);
+
+        _derivedByColumn.insert(someChannels.size(), _channels.size());
+        _columns.append(someChannels.size());
+        _channels.append(aChannel);
+        _updated.append(false);
+        _changed.append(false);
+        someChannels.append(aChannel.name());
+    }
+
+    int DerivedChannelSet::update(QVector<QVariant> &someValues, int aFirst, int aLast)
+    {
+        int ret = 0;
+
+        // Channels only read earlier ones, so one pass in order sees every update it depends on.
+        for (int i=0; i < _channels.size(); i++) {
+            bool isDirty = false;
+            foreach (int input, _channels.at(i).inputs()) {
+                const int derived = _derivedByColumn.value(input, -1);
+                if ((derived >= 0) ? _updated.at(derived) : ((input >= aFirst) and (input <= aLast))) {
+                    isDirty = true;
+                    break;
+                }
+            }
+
+            _updated[i] = isDirty;
+            _changed[i] = false;
+            if (!isDirty) {
+                continue;
+            }
+
+            QVariant &value = someValues[_columns.at(i)];
+            const QVariant newValue = _channels.at(i).evaluate(someValues);
+            _changed[i] = (newValue != value);
+            value = newValue;
+            ret++;
+        }
+
+        return ret;
+    }
+}
@@ -35,6 +35,7 @@
 
 #include <ds2/manager.h>
 #include <ds2/dpp_v1_parser.h>
+#include <ds2/trace.h>
 
 QString getQStringFromJson(Json::Value &aJsonValue)
 {
@@ -68,7 +69,7 @@ namespace DS2PlusPlus {
         stringTableValueQuery.prepare("INSERT INTO string_values (table_uuid, number, string) VALUES (:table_uuid, :number, :string)");
 
         operationQuery = QSqlQuery(_manager->sqlDatabase());
-        operationQuery.prepare("INSERT INTO operations(uuid, module_id, name, parent_id, command) VALUES(:uuid, :module_id, :name, :parent_id, :command)");
+        operationQuery.prepare("INSERT INTO operations(uuid, module_id, name, parent_id, command, cache_ttl) VALUES(:uuid, :module_id, :name, :parent_id, :command, :cache_ttl)");
 
         resultQuery = QSqlQuery(_manager->sqlDatabase());
         resultQuery.prepare("INSERT INTO results (uuid, operation_id, parent_id, name, type, display, start_pos, mask, rpn, units, length, levels) VALUES (:uuid, :operation_id, :parent_id, :name, :type, :display, :start_pos, :mask, :rpn, :units, :length, :levels)");
@@ -143,9 +144,7 @@ namespace DS2PlusPlus {
 
         QHash<QString, QVariant> oldModule = _manager->findModuleRecordByUuid(uuid);
         if (!oldModule.isEmpty()) {
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "\tModule exists, overwriting " << uuid;
-            }
+            DS2_TRACE(General) << "\tModule exists, overwriting " << uuid;
             _manager->removeModuleByUuid(uuid);
         }
 
@@ -376,9 +375,7 @@ namespace DS2PlusPlus {
 
         QHash<QString, QVariant> oldOperation = _manager->findOperationByUuid(uuid);
         if (!oldOperation.isEmpty()) {
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "Operation exists, overwriting " << uuid;
-            }
+            DS2_TRACE(General) << "Operation exists, overwriting " << uuid;
             _manager->removeOperationByUuid(uuid);
         }
 
@@ -400,6 +397,16 @@ namespace DS2PlusPlus {
 
         operationQuery.bindValue(":command", QVariant(commandByteList));
 
+        if (ourOperation["cache_ttl"].isNumeric()) {
+            const double cacheTtl = ourOperation["cache_ttl"].asDouble();
+            if (cacheTtl < 0) {
+                throw std::invalid_argument(qPrintable(QString("Invalid cache_ttl in operation %1").arg(uuid)));
+            }
+            operationQuery.bindValue(":cache_ttl", cacheTtl);
+        } else {
+            operationQuery.bindValue(":cache_ttl", QVariant(QVariant::Double));
+        }
+
         if (!operationQuery.exec()) {
             qDebug() << "insertOpsRecord failed: " << operationQuery.lastError() << endl;
             return false;
@@ -443,9 +450,7 @@ namespace DS2PlusPlus {
 
         QHash<QString, QVariant> oldResult = _manager->findResultByUuid(uuid);
         if (!oldResult.isEmpty()) {
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "Result exists, overwriting " << uuid;
-            }
+            DS2_TRACE(General) << "Result exists, overwriting " << uuid;
             _manager->removeResultByUuid(uuid);
         }
 
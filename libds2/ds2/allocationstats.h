@@ -0,0 +1,124 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ALLOCATIONSTATS_H
+#define ALLOCATIONSTATS_H
+
+#include <QString>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The AllocationStats class counts heap allocations, and the bytes asked for, by libds2 subsystem.
+     *
+     * Accounting is only compiled in when libds2 is built with qmake CONFIG+=allocstats, which defines
+     * DS2_ALLOCATION_STATS and replaces malloc(), calloc(), realloc() and free() for the whole process so that
+     * Qt's containers are counted along with everything else.  This relies on glibc's __libc_malloc() family
+     * and only works on Linux.  Even then nothing is counted until setEnabled(true).
+     *
+     * Each allocation is charged to the subsystem of the innermost AllocationScope on the calling thread, or
+     * to Unattributed outside any scope.
+     */
+    class AllocationStats
+    {
+    public:
+        typedef enum {
+            Unattributed = 0,
+            PacketIO,
+            Decode,
+            DefinitionLoad,
+            JsonOutput,
+            SubsystemCount
+        } Subsystem;
+
+        /*!
+         * \brief The Snapshot struct holds the counters at one moment.  Subtract two to see what happened in between.
+         */
+        struct Snapshot
+        {
+            Snapshot();
+
+            quint64 allocations[SubsystemCount];
+            quint64 bytes[SubsystemCount];
+            quint64 frees;
+
+            quint64 totalAllocations() const;
+            quint64 totalBytes() const;
+            Snapshot operator-(const Snapshot &anEarlier) const;
+        };
+
+        /*!
+         * \return true if libds2 was built with allocation accounting.
+         */
+        static bool isAvailable();
+
+        static bool isEnabled();
+        static void setEnabled(bool isEnabled);
+
+        static Snapshot snapshot();
+        static void reset();
+
+        static QString subsystemName(Subsystem aSubsystem);
+
+        /*!
+         * \brief enter charges the calling thread's allocations to \a aSubsystem and returns the previous subsystem.
+         */
+        static Subsystem enter(Subsystem aSubsystem);
+        static void leave(Subsystem aPrevious);
+
+        /*!
+         * \brief summary formats \a aSnapshot as a table, with averages per transaction if \a aTransactions is given.
+         */
+        static QString summary(const Snapshot &aSnapshot, quint64 aTransactions = 0);
+
+        /*!
+         * \brief line formats \a aSnapshot on a single line, e.g. for one transaction.
+         */
+        static QString line(const Snapshot &aSnapshot);
+    };
+
+#ifdef DS2_ALLOCATION_STATS
+    /*!
+     * \brief The AllocationScope class charges allocations on this thread to a subsystem until it goes out of scope.
+     */
+    class AllocationScope
+    {
+    public:
+        explicit AllocationScope(AllocationStats::Subsystem aSubsystem) : _previous(AllocationStats::enter(aSubsystem)) {}
+        ~AllocationScope() { AllocationStats::leave(_previous); }
+
+    private:
+        /*! \cond internal */
+        Q_DISABLE_COPY(AllocationScope)
+        AllocationStats::Subsystem _previous;
+        /*! \endcond */
+    };
+#else
+    class AllocationScope
+    {
+    public:
+        explicit AllocationScope(AllocationStats::Subsystem) {}
+    };
+#endif
+}
+
+#endif // ALLOCATIONSTATS_H
@@ -0,0 +1,143 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASYNCLOGWRITER_H
+#define ASYNCLOGWRITER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+
+#include "spscqueue.h"
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The AsyncLogWriter class moves log file I/O onto its own thread.
+     *
+     * The thread that talks to the bus hands finished records to write(), which only pushes them onto a
+     * lock-free queue.  The writer thread drains the queue into the file and flushes and syncs it according
+     * to the configured intervals, so a slow disk or terminal never stretches the sampling interval.  When
+     * the queue fills up, records are either dropped or the producer waits, and either event is counted.
+     *
+     * Typical use is open(), start(), write() as often as needed, then stop().
+     */
+    class AsyncLogWriter : public QThread
+    {
+        Q_OBJECT
+    public:
+        typedef enum {
+            /*! \brief Discard records that don't fit in the queue. */
+            FullDrop,
+            /*! \brief Make write() wait for room in the queue. */
+            FullBlock
+        } FullPolicy;
+
+        explicit AsyncLogWriter(int aQueueCapacity = 4096, QObject *aParent = 0);
+        virtual ~AsyncLogWriter();
+
+        /*!
+         * \brief open opens \a aPath for the writer thread.  Call this before start().
+         */
+        bool open(const QString &aPath, QIODevice::OpenMode aMode = QIODevice::WriteOnly);
+        QString errorString() const { return _file.errorString(); }
+        QString fileName() const { return _file.fileName(); }
+
+        /*!
+         * \brief setFlushInterval sets how often, in milliseconds, buffered records are handed to the OS.  0
+         * flushes every time the queue has been drained.  Defaults to 1000.
+         */
+        void setFlushInterval(int aMilliseconds) { _flushInterval = aMilliseconds; }
+
+        /*!
+         * \brief setSyncInterval sets how often, in milliseconds, the file is synced to storage.  0 (the
+         * default) leaves that to the OS, apart from a final sync in stop().
+         */
+        void setSyncInterval(int aMilliseconds) { _syncInterval = aMilliseconds; }
+
+        /*!
+         * \brief setPreallocation reserves disk space this many bytes ahead of the write position, so the
+         * file system isn't allocating blocks on every flush.  The file's size isn't changed.  Only supported
+         * on Linux; 0 (the default) disables it.
+         */
+        void setPreallocation(qint64 aBytes) { _preallocation = aBytes; }
+
+        void setFullPolicy(FullPolicy aPolicy) { _fullPolicy = aPolicy; }
+
+        /*!
+         * \brief write queues \a aRecord.  Only call this from one thread.  With FullBlock and no writer thread
+         * running, a full queue is written out on the calling thread instead of waiting forever.
+         * \return false if the record was dropped.
+         */
+        bool write(const QByteArray &aRecord);
+
+        /*!
+         * \brief stop writes out everything still queued, flushes, syncs, and closes the file.
+         */
+        void stop();
+
+        /*! \brief The number of records written to the file in full. */
+        int recordsWritten() const { return _written.loadAcquire(); }
+
+        /*! \brief The number of records the file wouldn't take, e.g. because the disk is full. */
+        int recordsFailed() const { return _failed.loadAcquire(); }
+
+        /*!
+         * \brief writeError describes the first write or flush that failed, or is empty if none has.
+         */
+        QString writeError() const;
+
+        /*! \brief The number of records discarded because the queue was full. */
+        int recordsDropped() const { return _dropped.loadAcquire(); }
+
+        /*! \brief The number of times write() had to wait for room in the queue. */
+        int stalls() const { return _stalls.loadAcquire(); }
+
+        /*! \brief The most records that have been waiting in the queue at once. */
+        int highWaterMark() const { return _highWaterMark.loadAcquire(); }
+
+    protected:
+        virtual void run();
+
+        /*! \cond internal */
+        void reserve(qint64 anEnd);
+        void sync();
+        //! Writes out everything in the queue; true if there was anything
+        bool writeQueued();
+
+        SpscQueue<QByteArray> _queue;
+        QFile _file;
+        int _flushInterval, _syncInterval;
+        qint64 _preallocation, _allocated;
+        FullPolicy _fullPolicy;
+        void setWriteError();
+
+        QAtomicInt _stopping, _written, _failed, _dropped, _stalls, _highWaterMark;
+        mutable QMutex _errorLock;
+        QString _writeError;
+        /*! \endcond */
+    };
+}
+
+#endif // ASYNCLOGWRITER_H
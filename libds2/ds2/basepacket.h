@@ -39,6 +39,40 @@ namespace DS2PlusPlus {
      */
     const QString HashToJsonString(const PacketResponse &aResponse, const QString &aRootNode = QString::null);
 
+    /*!
+     * \brief The PayloadView class is a read-only window onto a packet's payload.
+     *
+     * A view is just a pointer and a length; it never copies or allocates.  It is valid for as long as the
+     * packet it came from is alive and its data isn't replaced with BasePacket::setData().
+     */
+    class PayloadView
+    {
+    public:
+        PayloadView() : _data(0), _length(0) {}
+        PayloadView(const quint8 *someData, int aLength) : _data(someData), _length(aLength) {}
+
+        /*! \brief Returns a pointer to the first byte of the payload. */
+        const quint8 *constData() const { return _data; }
+
+        /*! \brief Returns the number of bytes in the payload. */
+        int length() const { return _length; }
+
+        /*! \brief Returns the byte at \a aPosition.  No bounds checking is done. */
+        quint8 at(int aPosition) const { return _data[aPosition]; }
+
+        /*!
+         * \brief Checks if a field is entirely inside the payload.
+         * \return True if the \a aLength bytes starting at \a aPosition can be read.
+         */
+        bool contains(int aPosition, int aLength) const { return (aPosition >= 0) and (aLength >= 0) and (aPosition + aLength <= _length); }
+
+    protected:
+        /*! \cond internal */
+        const quint8 *_data;
+        int _length;
+        /*! \endcond internal */
+    };
+
     /*!
      * \brief The BasePacket class is an abstract class representing a data packet from a ControlUnit.
      */
@@ -108,6 +142,12 @@ namespace DS2PlusPlus {
 
         QByteArray data() const;
         void setData(const QByteArray &someData);
+
+        /*!
+         * \brief payload returns a view of the payload without copying it.
+         * \return A PayloadView valid until this packet is destroyed or setData() is called.
+         */
+        PayloadView payload() const;
         Q_PROPERTY(QByteArray data MEMBER _data READ data WRITE setData)
 
         /*!
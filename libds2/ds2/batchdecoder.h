@@ -0,0 +1,97 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BATCHDECODER_H
+#define BATCHDECODER_H
+
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QVariant>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The BatchColumn class holds every decoded value for a single Result across a batch of packets.
+     *
+     * Only one of the value vectors is populated, depending on \ref type.  Rows whose packet was too short to
+     * contain the result are flagged in \ref valid and hold zero (or an invalid QVariant).
+     */
+    class BatchColumn
+    {
+    public:
+        typedef enum {
+            ColumnInt64,
+            ColumnDouble,
+            ColumnVariant
+        } ColumnType;
+
+        BatchColumn() : type(ColumnVariant) {}
+
+        QString name;
+        ColumnType type;
+        QVector<qint64> ints;
+        QVector<double> doubles;
+        QVector<QVariant> variants;
+        QVector<quint8> valid;
+    };
+
+    /*!
+     * \brief The result of decoding many packets for one operation, keyed by result name.
+     */
+    typedef QHash<QString, BatchColumn> BatchResponse;
+
+    /*!
+     * \brief The BatchDecoder class contains the vectorized kernels used by ControlUnit::parseOperationBatch().
+     *
+     * Payloads are laid out as a matrix, one packet per row, \a aStride bytes apart.  Each kernel pulls the
+     * field at \a aPosition out of every row, sign extends and byte swaps it as needed, then applies
+     * value * \a aScale + \a anOffset.  Bytes are scaled in double precision and shorts in single precision,
+     * matching the RPN arithmetic parseOperation() uses for each.  SSE2, AVX2 (chosen at runtime), and
+     * AArch64 NEON are used where available with a scalar fallback everywhere else.
+     */
+    class BatchDecoder
+    {
+    public:
+        static void decodeBytes(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, double aScale, double anOffset, double *anOutput);
+        static void decodeShorts(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, bool isBigEndian, float aScale, float anOffset, double *anOutput);
+
+        static void extractBytes(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, qint32 *anOutput);
+        static void extractShorts(const quint8 *somePayloads, int aStride, int aPosition, int aCount, bool isSigned, bool isBigEndian, qint32 *anOutput);
+        static void scale(const qint32 *someValues, int aCount, double aScale, double anOffset, double *anOutput);
+        static void scaleFloat(const qint32 *someValues, int aCount, float aScale, float anOffset, double *anOutput);
+
+        /*!
+         * \return The name of the instruction set the kernels will use on this machine.
+         */
+        static const char *instructionSet();
+
+        /*!
+         * \brief setScalarOnly turns the vector kernels off, or back on, for every thread.  Meant for checking
+         * them against the scalar fallback; don't change it while anything is decoding.
+         */
+        static void setScalarOnly(bool isScalarOnly);
+        static bool isScalarOnly();
+    };
+}
+
+#endif // BATCHDECODER_H
@@ -0,0 +1,138 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUSSTATISTICS_H
+#define BUSSTATISTICS_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The LatencyHistogram class counts durations in fixed log-linear buckets, in the style of HdrHistogram.
+     *
+     * Values are microseconds.  Below 32 µs every value has its own bucket; above that each power of two is
+     * split into 16 buckets, so a percentile is never more than 1/16th (6.25%) above the true value.  Values
+     * past about 38 hours land in the last bucket.  Recording is a handful of relaxed atomic adds and never
+     * takes a lock, so any thread may record while another reads.
+     */
+    class LatencyHistogram
+    {
+    public:
+        static const int SUB_BUCKETS = 16;
+        static const int BUCKET_COUNT = 2 * SUB_BUCKETS + 33 * SUB_BUCKETS;
+
+        LatencyHistogram();
+
+        void record(quint64 aMicroseconds);
+
+        quint64 count() const { return _count.load(); }
+        quint64 total() const { return _total.load(); }
+        quint64 minimum() const;
+        quint64 maximum() const { return _maximum.load(); }
+        double mean() const;
+
+        /*!
+         * \brief percentile returns the value that \a aPercent percent of the samples are at or below.
+         *
+         * This is the top of the bucket holding that sample, but never more than maximum().  Zero if nothing
+         * has been recorded.
+         */
+        quint64 percentile(double aPercent) const;
+
+        static int bucketFor(quint64 aMicroseconds);
+        static quint64 bucketUpperBound(int aBucket);
+
+    protected:
+        /*! \cond internal */
+        QAtomicInteger<quint32> _buckets[BUCKET_COUNT];
+        QAtomicInteger<quint64> _count, _total, _minimum, _maximum;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The TransactionStatistics class holds the counters for one ECU address or one operation.
+     */
+    class TransactionStatistics
+    {
+    public:
+        /*!
+         * \brief From reading back the request's echo to the first byte of the reply.  The fixed sleep before
+         * the echo isn't included; a reply that arrived during it shows up as (close to) zero.
+         */
+        LatencyHistogram firstByte;
+        /*! \brief From the start of the request to the end of the reply. */
+        LatencyHistogram transaction;
+
+        QAtomicInteger<quint64> transactions, bytesOut, bytesIn;
+        QAtomicInteger<quint32> timeouts, checksumErrors, echoErrors;
+        /*! \brief Quiet intervals waited out before a byte came, including those in transactions that then timed out. */
+        QAtomicInteger<quint32> retries;
+    };
+
+    /*!
+     * \brief The BusStatistics class collects TransactionStatistics per ECU address and per operation.
+     *
+     * Entries are created on first use and live as long as this object, so a pointer to one can be kept and
+     * recorded into without any further lookups.  Address entries are created without a lock; operation
+     * entries are looked up by name under a lock, which is why ControlUnit resolves them once per operation.
+     */
+    class BusStatistics
+    {
+    public:
+        BusStatistics();
+        ~BusStatistics();
+
+        TransactionStatistics *forAddress(quint8 anAddress);
+        TransactionStatistics *forOperation(const QString &aName);
+
+        /*!
+         * \return Every address that has been used, and its statistics.
+         */
+        QMap<quint8, const TransactionStatistics *> addresses() const;
+
+        /*!
+         * \return Every operation that has been used, by name, and its statistics.
+         */
+        QMap<QString, const TransactionStatistics *> operations() const;
+
+        /*!
+         * \brief summary formats every entry as a table, latencies in milliseconds.
+         */
+        QString summary() const;
+
+    protected:
+        /*! \cond internal */
+        Q_DISABLE_COPY(BusStatistics)
+
+        QAtomicPointer<TransactionStatistics> _addresses[256];
+        mutable QMutex _operationsLock;
+        QMap<QString, TransactionStatistics *> _operations;
+        /*! \endcond */
+    };
+}
+
+#endif // BUSSTATISTICS_H
@@ -0,0 +1,164 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSEDLOG_H
+#define COMPRESSEDLOG_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QVariant>
+#include <QVector>
+
+#include "datalog.h"
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The CompressedLogWriter class encodes data log rows into the compressed DPP log format.
+     *
+     * Rows are gathered into blocks of a fixed number of records and every block is stored column by column,
+     * each column starting from scratch so a block can be decoded without any that came before it:
+     *
+     * \code
+     * header:  "DPPLOGZ1"  quint32 records per block  a DataLogWriter::encodeHeader() header
+     * block:   "DBLK"  quint32 record count  quint32 payload length
+     *          per channel: quint8 flags (1 = every record has a value), else a presence bitmap,
+     *                       quint32 stream length, stream
+     * index:   "DIDX"  quint32 block count  quint64 record count
+     *          per block: quint64 file offset, quint64 first record
+     * trailer: quint64 index offset  "DPPZIDX1"
+     * \endcode
+     *
+     * Integers are stored as zigzag varints of the difference from the previous value in the column.
+     * Doubles are XORed with the previous value and the differing bits are packed as in Facebook's Gorilla,
+     * so a value that doesn't change costs a single bit.  A string that repeats the previous one costs a
+     * byte.  The index and trailer are only written by finish(); a log cut short still decodes up to its
+     * last complete block.
+     */
+    class CompressedLogWriter
+    {
+    public:
+        static const int DEFAULT_BLOCK_RECORDS = 4096;
+
+        explicit CompressedLogWriter(int aBlockRecords = DEFAULT_BLOCK_RECORDS);
+
+        /*!
+         * \brief start sets the channels and returns the file header.  Anything buffered is discarded.
+         */
+        QByteArray start(const QVector<DataLogChannel> &someChannels);
+
+        const QVector<DataLogChannel> &channels() const { return _channels; }
+
+        /*!
+         * \brief encode adds one record, a value per channel.  Invalid values are marked missing.
+         * \return An encoded block once enough records have been added to fill one, otherwise nothing.
+         */
+        QByteArray encode(const QVector<QVariant> &someValues);
+
+        /*!
+         * \brief finish encodes the records in the last, partial block and appends the index.
+         */
+        QByteArray finish();
+
+        qint64 recordCount() const { return _recordCount; }
+        int blockRecords() const { return _blockRecords; }
+
+    protected:
+        /*! \cond internal */
+        class Column
+        {
+        public:
+            QVector<quint64> values;
+            QVector<QByteArray> strings;
+            QVector<bool> present;
+        };
+
+        QByteArray encodeBlock();
+
+        int _blockRecords, _buffered;
+        qint64 _recordCount, _offset;
+        QVector<DataLogChannel> _channels;
+        QVector<Column> _columns;
+        QVector<QPair<qint64, qint64> > _index;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The CompressedLogReader class decodes a compressed DPP log one block at a time.
+     *
+     * Only the current block is held in memory, so logs of any length can be streamed from a pipe or a
+     * file.  On a seekable device with an index, seek() jumps straight to the block holding a record.
+     */
+    class CompressedLogReader
+    {
+    public:
+        explicit CompressedLogReader(QIODevice *aDevice = 0);
+
+        /*!
+         * \brief isCompressedLog checks \a aPath for the compressed log magic.
+         */
+        static bool isCompressedLog(const QString &aPath);
+
+        /*!
+         * \brief open reads the header from \a aDevice, which must be open for reading.  Throws
+         * std::runtime_error if it isn't a compressed log.
+         */
+        void open(QIODevice *aDevice);
+
+        const QVector<DataLogChannel> &channels() const { return _channels; }
+
+        /*!
+         * \brief next decodes the next record into \a someValues.
+         * \return false at the end of the log, including at a block that was cut short.  Throws
+         * std::runtime_error if a block is corrupt.
+         */
+        bool next(QVector<QVariant> &someValues);
+
+        /*!
+         * \brief seek positions the reader so next() returns \a aRecord.
+         * \return false if the device can't seek, the log has no index, or \a aRecord is past the end.
+         */
+        bool seek(qint64 aRecord);
+
+        /*!
+         * \return The number of records according to the index, or -1 if the log doesn't have one.
+         */
+        qint64 recordCount();
+
+    protected:
+        /*! \cond internal */
+        bool readIndex();
+        bool readBlock();
+
+        QIODevice *_device;
+        QVector<DataLogChannel> _channels;
+        QVector<QVector<QVariant> > _block;
+        int _blockRecords, _blockSize, _position;
+        qint64 _dataOffset;
+        bool _indexRead;
+        QVector<QPair<qint64, qint64> > _index;
+        qint64 _indexRecords;
+        /*! \endcond */
+    };
+}
+
+#endif // COMPRESSEDLOG_H
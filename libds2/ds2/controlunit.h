@@ -32,9 +32,13 @@
 
 #include "ds2packet.h"
 #include "operation.h"
+#include "batchdecoder.h"
+#include "frame.h"
 
 namespace DS2PlusPlus {
     class Manager;
+    class SharedValueWriter;
+    class TransactionStatistics;
 
     /*!
      * \brief An arbitrary computer module in a car that can execute operations and return results.
@@ -77,6 +81,32 @@ namespace DS2PlusPlus {
          */
         virtual PacketResponse executeOperation(const QString &aName);
 
+        /*!
+         * \brief Sends an operation to the ECU and parses the response into an existing PacketResponse.
+         *
+         * The request is written straight from the operation's pre-encoded buffer and the reply is read into a
+         * stack allocated Frame, so reusing \a aResponse between calls lets a polling loop run without
+         * allocating a packet per transaction.
+         * \param anOperation The operation to execute.
+         * \param aResponse Results are inserted into (or overwrite values in) this hash.
+         */
+        virtual void executeOperation(const OperationPtr anOperation, PacketResponse &aResponse);
+
+        /*!
+         * \brief Executes an operation as above, also handing back the ECU's raw reply.
+         * \param aReply Overwritten with the reply frame the results were decoded from.
+         */
+        void executeOperation(const OperationPtr anOperation, PacketResponse &aResponse, Frame &aReply);
+
+        /*!
+         * \brief Sends an operation to the ECU and hands back its raw reply without decoding it.
+         *
+         * This is the bus half of executeOperation(); the reply can be decoded later, on another thread, with
+         * parseOperation().  The response cache isn't consulted.
+         * \param aReply Overwritten with the ECU's reply.
+         */
+        void queryOperation(const OperationPtr anOperation, Frame &aReply);
+
         /*!
          * \brief Parses a BasePacket for a given operation.
          *
@@ -96,6 +126,41 @@ namespace DS2PlusPlus {
          */
         virtual PacketResponse parseOperation(const OperationPtr anOperation, const BasePacketPtr aPacket);
 
+        /*!
+         * \brief Parses a Frame for a given operation, inserting the results into \a aResponse.
+         *
+         * When the manager has a SharedValueWriter the results are published to it as well, so only one
+         * thread at a time may parse frames while one is set.
+         * \param anOperation The Operation \a aFrame is a response to.
+         * \param aFrame The frame received from the ControlUnit.
+         * \param aResponse Results are inserted into (or overwrite values in) this hash.
+         */
+        void parseOperation(const OperationPtr anOperation, const Frame &aFrame, PacketResponse &aResponse);
+
+        /*!
+         * \brief Parses many packets for a given operation at once, writing each result into a column.
+         * \param aName The name of an Operation
+         * \param somePackets The packets to decode, typically replayed from a capture.
+         * \return A BatchResponse with one BatchColumn per result, one row per packet.
+         */
+        BatchResponse parseOperationBatch(const QString &aName, const QList<BasePacketPtr> &somePackets);
+
+        /*!
+         * \brief Parses many packet payloads for a given operation at once.
+         *
+         * Numeric results (byte, short, and their signed variants) whose RPN is affine are decoded with the
+         * vectorized kernels in BatchDecoder.  Everything else falls back to the same per-packet decoding
+         * parseOperation() uses.  Short results are scaled in single precision like parseOperation(), and only
+         * vectorized when their RPN is a multiply with an optional add or subtract; a division is decoded per packet.
+         * \param anOperation The Operation the payloads are a response to.
+         * \param somePayloads Payloads laid out one per row, \a aStride bytes apart.
+         * \param aStride The distance between the start of each payload.
+         * \param someLengths The real length of each payload, or NULL if every payload is \a aStride bytes long.
+         * \param aCount The number of payloads.
+         * \return A BatchResponse with one BatchColumn per result, one row per payload.
+         */
+        BatchResponse parseOperationBatch(const OperationPtr anOperation, const quint8 *somePayloads, int aStride, const int *someLengths, int aCount);
+
         /*! \brief Returns the \ref dppVersion property. */
         quint32 dppVersion() const;
 
@@ -202,6 +267,16 @@ namespace DS2PlusPlus {
         void setMatchFlags(quint8 someFlags);
         Q_PROPERTY(quint8 matchFlags MEMBER _matchFlags READ matchFlags WRITE setMatchFlags)
 
+        /*! \brief Returns the \ref expandBitfields property. */
+        bool expandBitfields() const;
+        void setExpandBitfields(bool isEnabled);
+
+        /*!
+         * \brief When true, enum results are returned by parseOperation() as one boolean per level
+         * (ex: "mode.vents.defrost") instead of a single comma delimited string.
+         */
+        Q_PROPERTY(bool expandBitfields MEMBER _expandBitfields READ expandBitfields WRITE setExpandBitfields)
+
     protected:
         /*!
          * \brief resultByteToVariant handles parsing byte and signed_byte data types
@@ -211,7 +286,7 @@ namespace DS2PlusPlus {
          *
          * Types handled include: integers, floats, and strings from a lookup table
          */
-        QVariant resultByteToVariant(const BasePacketPtr aPacket, const Result &aResult);
+        QVariant resultByteToVariant(const PayloadView &aPayload, const Result &aResult);
 
         /*!
          * \brief resultShortToVariant handles parsing two word data types including short and signed_short
@@ -221,13 +296,35 @@ namespace DS2PlusPlus {
          *
          * Types handled include: integers, floats
          */
-        QVariant resultShortToVariant(const BasePacketPtr aPacket, const Result &aResult);
+        QVariant resultShortToVariant(const PayloadView &aPayload, const Result &aResult);
+
+        QVariant resultHexStringToVariant(const PayloadView &aPayload, const Result &aResult);
 
-        QVariant resultHexStringToVariant(const BasePacketPtr aPacket, const Result &aResult);
+        /*!
+         * \brief resultToVariant decodes a single result from a packet.
+         * \return The decoded value, or an invalid QVariant if the result has nothing to report.
+         */
+        QVariant resultToVariant(const PayloadView &aPayload, const Result &aResult);
+
+        /*!
+         * \brief parsePayload decodes every result of an operation that fits in \a aPayload.
+         */
+        void parsePayload(const OperationPtr anOperation, const PayloadView &aPayload, PacketResponse &aResponse);
+
+        /*!
+         * \brief insertBitfieldSlots expands an enum result into one boolean per level.
+         * \return False if the result can't be expanded and should be decoded normally.
+         */
+        bool insertBitfieldSlots(PacketResponse &aResponse, const PayloadView &aPayload, const Result &aResult);
+
+        /*!
+         * \brief publishSharedValues writes \a aResponse to the manager's SharedValueWriter, if it has one.
+         */
+        void publishSharedValues(const OperationPtr anOperation, const PacketResponse &aResponse);
 
         static char getCharFrom6BitInt(quint8 n);
 
-        static char decode_vin_char(int start, const QByteArray &bytes);
+        static char decode_vin_char(int start, const quint8 *bytes);
 
         /*!
          * \brief runRpnForResult runs the RPN calculations listed for a given result.
@@ -248,9 +345,16 @@ namespace DS2PlusPlus {
         quint64 _hardwareNumber, _softwareNumber, _codingIndex;
         bool _bigEndian;
         quint8 _matchFlags;
+        bool _expandBitfields;
         BasePacket::ProtocolType _protocol;
 
         Manager *_manager;
+        //! Per operation statistics, looked up once per operation rather than once per query
+        QHash<QString, TransactionStatistics *> _operationStatistics;
+        //! Shared value channels by operation and result, resolved the first time each result is published
+        QHash<const Operation *, QHash<QString, int> > _sharedChannels;
+        //! The writer _sharedChannels belongs to
+        QWeakPointer<SharedValueWriter> _sharedChannelsWriter;
         static QHash<QString, QList<quint8> > _familyDictionary;
         static QHash<QString, QString> _familyNames;
         static const QChar zeroPadding;
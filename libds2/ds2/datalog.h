@@ -0,0 +1,184 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATALOG_H
+#define DATALOG_H
+
+#include <QFile>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The DataLogChannel class describes one column of a binary data log.
+     */
+    class DataLogChannel
+    {
+    public:
+        typedef enum {
+            TypeInt64 = 1,
+            TypeUInt64 = 2,
+            TypeDouble = 3,
+            TypeString = 4,
+            TypeBool = 5
+        } ChannelType;
+
+        DataLogChannel() : type(TypeDouble), width(8) {}
+        DataLogChannel(const QString &aName, const QString &someUnits, ChannelType aType, int aWidth = 8);
+
+        /*!
+         * \brief forValue picks the storage type for a channel from a sample of the values it will hold.
+         *
+         * Strings are stored in a fixed width field of at least \a aStringWidth bytes (and never shorter than
+         * the sample); longer values are truncated.  Flags get their own type so they read back as bools.
+         * A sample that isn't valid gives a string channel.
+         */
+        static DataLogChannel forValue(const QString &aName, const QString &someUnits, const QVariant &aSample, int aStringWidth = 32);
+
+        bool operator==(const DataLogChannel &aChannel) const;
+
+        QString name;
+        QString units;
+        ChannelType type;
+        /*! \brief Bytes used by this channel in every record. */
+        int width;
+    };
+
+    /*!
+     * \brief The DataLogWriter class writes the binary DPP data log format.
+     *
+     * A log is a self-describing header followed by fixed length records, one per sample:
+     *
+     * \code
+     * header:  "DPPLOG01"  quint32 data offset  quint32 record length  quint32 channel count
+     *          per channel: quint8 type, quint8 0, quint16 width, quint16 + UTF-8 name, quint16 + UTF-8 units
+     *          zero padding up to the data offset (a multiple of 8)
+     * record:  validity bitmap, one bit per channel
+     *          each channel's value in order: little endian qint64, quint64 or double, or a zero padded string
+     * \endcode
+     *
+     * The header doesn't hold a record count, so a log can be appended to by reopening it with
+     * QIODevice::Append and calling setChannels() with the channels DataLogReader found in it.
+     */
+    class DataLogWriter
+    {
+    public:
+        /*!
+         * \brief DataLogWriter
+         * \param aDevice Where append() and writeHeader() write.  May be null if only encode() and
+         * encodeHeader() are used, e.g. to feed an AsyncLogWriter.
+         */
+        explicit DataLogWriter(QIODevice *aDevice = 0);
+
+        /*!
+         * \brief setChannels sets the record layout without writing anything.
+         */
+        void setChannels(const QVector<DataLogChannel> &someChannels);
+        const QVector<DataLogChannel> &channels() const { return _channels; }
+
+        /*!
+         * \brief writeHeader sets the record layout and writes the file header.
+         */
+        void writeHeader(const QVector<DataLogChannel> &someChannels);
+
+        /*!
+         * \brief append encodes one record, a value per channel, and writes it to the device.  Invalid values
+         * are marked missing.
+         */
+        void append(const QVector<QVariant> &someValues);
+
+        /*!
+         * \brief encode builds the record for \a someValues without writing it.  The returned buffer is reused
+         * by the next call.
+         */
+        const QByteArray &encode(const QVector<QVariant> &someValues);
+
+        int recordLength() const { return _record.size(); }
+
+        /*!
+         * \brief encodeHeader returns the header for \a someChannels.
+         */
+        static QByteArray encodeHeader(const QVector<DataLogChannel> &someChannels);
+
+        /*!
+         * \brief recordLayout fills \a someOffsets with where each channel lives in a record and returns the
+         * record length.
+         */
+        static int recordLayout(const QVector<DataLogChannel> &someChannels, QVector<int> &someOffsets);
+
+    protected:
+        /*! \cond internal */
+        QIODevice *_device;
+        QVector<DataLogChannel> _channels;
+        QVector<int> _offsets;
+        QByteArray _record;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The DataLogReader class memory maps a binary data log for random access.
+     *
+     * A trailing partial record, left by a writer that was interrupted, is ignored.
+     */
+    class DataLogReader
+    {
+    public:
+        DataLogReader();
+
+        /*!
+         * \brief open maps \a aPath and parses its header.  Throws std::runtime_error if the file can't be
+         * mapped or isn't a data log.
+         */
+        void open(const QString &aPath);
+
+        const QVector<DataLogChannel> &channels() const { return _channels; }
+        qint64 recordCount() const { return _recordCount; }
+
+        bool isValid(qint64 aRecord, int aChannel) const;
+
+        /*!
+         * \brief value decodes one field as a qint64, quint64, double, or QString.  Missing values are
+         * returned as an invalid QVariant.
+         */
+        QVariant value(qint64 aRecord, int aChannel) const;
+
+        /*!
+         * \brief parseHeader reads the channels from the first \a aLength bytes of a log.
+         * \return The offset of the first record, or -1 if this isn't a (complete) data log header.
+         */
+        static qint64 parseHeader(const uchar *someData, qint64 aLength, QVector<DataLogChannel> &someChannels);
+
+    protected:
+        /*! \cond internal */
+        QFile _file;
+        const uchar *_records;
+        qint64 _recordCount;
+        int _recordLength;
+        QVector<DataLogChannel> _channels;
+        QVector<int> _offsets;
+        /*! \endcond */
+    };
+}
+
+#endif // DATALOG_H
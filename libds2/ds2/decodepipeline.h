@@ -0,0 +1,166 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODEPIPELINE_H
+#define DECODEPIPELINE_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+#include "controlunit.h"
+#include "frame.h"
+#include "logscheduler.h"
+#include "spscqueue.h"
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The DecodePipeline class runs a data log's bus traffic on its own thread.
+     *
+     * The bus thread does nothing but follow the LogScheduler: it waits for the next task, sends the
+     * request, and pushes the raw reply frame and its timestamps onto a lock-free queue.  Decoding and
+     * everything after it happen on the consumer thread, in next(), so slow decoding or formatting delays
+     * samples rather than stretching the sampling interval.  Output is expected to go through an
+     * AsyncLogWriter, a third stage.
+     *
+     * Frames are held inline, so queuing one never allocates.  The bus thread never waits for the consumer:
+     * when the queue is full the reply is dropped and counted.  Activity measured from decoded values goes
+     * back to the scheduler through a second queue, see setActivity().
+     *
+     * Typical use is addTask() for every scheduler task, start(), next() until it returns false and the
+     * thread has finished, then stop().
+     */
+    class DecodePipeline : public QThread
+    {
+        Q_OBJECT
+    public:
+        static const int DEFAULT_CAPACITY = 1024;
+
+        /*!
+         * \brief The Sample class is one reply as the bus thread saw it.
+         */
+        class Sample
+        {
+        public:
+            Sample() : task(-1), time(0), duration(0) {}
+
+            int task;
+            /*! \brief When the request was sent, on the now() clock. */
+            double time;
+            /*! \brief Seconds from sending the request to the end of the reply. */
+            double duration;
+            Frame reply;
+        };
+
+        /*!
+         * \param aScheduler Copied; the bus thread runs its own copy, see scheduler().
+         */
+        explicit DecodePipeline(const LogScheduler &aScheduler, int aQueueCapacity = DEFAULT_CAPACITY, QObject *aParent = 0);
+        virtual ~DecodePipeline();
+
+        /*!
+         * \brief now reads the clock sample times are taken from, CLOCK_MONOTONIC in seconds.
+         */
+        static double now();
+
+        /*!
+         * \brief addTask says which ECU and operation the scheduler's next task is.  Call it once for every
+         * scheduler task, in order, before start().
+         * \return The task's index.
+         */
+        int addTask(ControlUnitPtr anEcu, OperationPtr anOperation);
+
+        /*!
+         * \brief next takes the oldest reply off the queue and decodes it.  Only call this from one thread.
+         * \param aSample Overwritten with the reply and its timestamps.
+         * \param aResponse Cleared, then filled with the decoded results.
+         * \param aTimeout How long to wait for a reply, in milliseconds.
+         * \return false if nothing arrived in time.
+         */
+        bool next(Sample &aSample, PacketResponse &aResponse, int aTimeout);
+
+        /*!
+         * \brief setActivity hands LogScheduler::setActivity() a value for the bus thread to apply before it
+         * next schedules.  Only call this from the thread calling next().
+         */
+        void setActivity(int aTask, double anActivity);
+
+        /*!
+         * \brief stop asks the bus thread to finish after its current transaction and waits for it.  Replies
+         * already queued can still be taken with next().
+         */
+        void stop();
+
+        /*!
+         * \brief The scheduler's start time, on the now() clock.  Valid once a sample has been taken.
+         */
+        double startTime() const { return _startTime; }
+
+        /*!
+         * \brief The bus thread's scheduler, with its measured rates.  Only use this when the thread isn't running.
+         */
+        const LogScheduler &scheduler() const { return _scheduler; }
+
+        /*!
+         * \brief The exception that stopped the bus thread, if any.
+         */
+        QString errorString() const;
+
+        /*! \brief The number of replies queued for decoding. */
+        int samplesQueued() const { return _queued.loadAcquire(); }
+
+        /*! \brief The number of replies discarded because the queue was full. */
+        int samplesDropped() const { return _dropped.loadAcquire(); }
+
+        /*! \brief The most replies that have been waiting in the queue at once. */
+        int highWaterMark() const { return _highWaterMark.loadAcquire(); }
+
+    protected:
+        virtual void run();
+
+        /*! \cond internal */
+        class ActivityUpdate
+        {
+        public:
+            ActivityUpdate() : task(-1), activity(0) {}
+            ActivityUpdate(int aTask, double anActivity) : task(aTask), activity(anActivity) {}
+
+            int task;
+            double activity;
+        };
+
+        LogScheduler _scheduler;
+        QVector<ControlUnitPtr> _ecus;
+        QVector<OperationPtr> _operations;
+        SpscQueue<Sample> _samples;
+        SpscQueue<ActivityUpdate> _activity;
+        double _startTime;
+        QAtomicInt _stopping, _queued, _dropped, _highWaterMark;
+        mutable QMutex _errorLock;
+        QString _errorString;
+        /*! \endcond */
+    };
+}
+
+#endif // DECODEPIPELINE_H
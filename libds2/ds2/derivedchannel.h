@@ -0,0 +1,159 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DERIVEDCHANNEL_H
+#define DERIVEDCHANNEL_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The DerivedChannel class computes a data log channel from other channels.
+     *
+     * A definition reads "name=expression", or "name[units]=expression".  The expression is RPN in the
+     * same style as a result's, except that operands are either numbers or the names of logged channels,
+     * e.g. "lambda=DME:status:afr 14.7 /".  Besides + - * / there are min and max, which take two operands,
+     * and abs, neg, and sqrt, which take one.
+     *
+     * compile() resolves every channel name to a column once, so evaluating is a walk over a flat
+     * instruction list with no string handling.
+     */
+    class DerivedChannel
+    {
+    public:
+        DerivedChannel();
+
+        /*!
+         * \brief parse splits a definition into its name, units, and expression.
+         * \throws std::invalid_argument if \a aDefinition has no name or expression.
+         */
+        static DerivedChannel parse(const QString &aDefinition);
+
+        /*!
+         * \brief compile resolves the expression against the columns of a data log row.
+         * \param someChannels The name of every column, in order.
+         * \throws std::invalid_argument for unknown channels, unknown operators, or an unbalanced expression.
+         */
+        void compile(const QStringList &someChannels);
+
+        /*!
+         * \brief evaluate runs the compiled expression over a row.
+         * \return The value, or an invalid QVariant if an input isn't a number or the result isn't finite.
+         */
+        QVariant evaluate(const QVector<QVariant> &someValues) const;
+
+        QString name() const { return _name; }
+        QString units() const { return _units; }
+        QString expression() const { return _expression; }
+
+        /*!
+         * \return The columns the expression reads, without duplicates.
+         */
+        QVector<int> inputs() const { return _inputs; }
+
+    protected:
+        /*! \cond internal */
+        typedef enum {
+            PushConstant,
+            PushChannel,
+            Add,
+            Subtract,
+            Multiply,
+            Divide,
+            Minimum,
+            Maximum,
+            Absolute,
+            Negate,
+            SquareRoot
+        } OpCode;
+
+        class Instruction
+        {
+        public:
+            Instruction(OpCode anOp = PushConstant, double aValue = 0, int aChannel = -1) : op(anOp), value(aValue), channel(aChannel) {}
+
+            OpCode op;
+            double value;
+            int channel;
+        };
+
+        QString _name, _units, _expression;
+        QVector<Instruction> _program;
+        QVector<int> _inputs;
+        int _stackDepth;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The DerivedChannelSet class keeps derived channels up to date as samples arrive.
+     *
+     * Each derived channel gets its own column after the logged ones.  When a job fills in its columns,
+     * update() evaluates only the derived channels that read one of them, or read another derived channel
+     * that was just updated, so a row costs nothing for channels whose inputs didn't move.
+     */
+    class DerivedChannelSet
+    {
+    public:
+        /*!
+         * \brief add compiles \a aChannel against \a someChannels and appends its name to them.
+         *
+         * Later channels may use earlier ones as inputs.
+         */
+        void add(DerivedChannel aChannel, QStringList &someChannels);
+
+        /*!
+         * \brief update recomputes the derived channels that depend on columns \a aFirst to \a aLast.
+         * \param someValues The row; derived values are written to their own columns.
+         * \return The number of derived channels that were evaluated.
+         */
+        int update(QVector<QVariant> &someValues, int aFirst, int aLast);
+
+        int count() const { return _channels.size(); }
+        const DerivedChannel &at(int anIndex) const { return _channels.at(anIndex); }
+        int column(int anIndex) const { return _columns.at(anIndex); }
+
+        /*!
+         * \return true if the last update() evaluated channel \a anIndex.
+         */
+        bool updated(int anIndex) const { return _updated.at(anIndex); }
+
+        /*!
+         * \return true if the last update() evaluated channel \a anIndex and its value changed.
+         */
+        bool changed(int anIndex) const { return _changed.at(anIndex); }
+
+    protected:
+        /*! \cond internal */
+        QList<DerivedChannel> _channels;
+        QVector<int> _columns;
+        QVector<bool> _updated, _changed;
+        QHash<int, int> _derivedByColumn;
+        /*! \endcond */
+    };
+}
+
+#endif // DERIVEDCHANNEL_H
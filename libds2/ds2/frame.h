@@ -0,0 +1,143 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <QString>
+
+#include "basepacket.h"
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The Frame class is a lightweight, value-type DS2 or KWP packet.
+     *
+     * Unlike BasePacket, a Frame isn't a QObject and keeps its payload in fixed inline storage, so it can live
+     * on the stack and be copied around freely without touching the heap.  It uses the same wire format,
+     * checksum, and byte string formatting as DS2Packet and KWPPacket.  Use toPacket() when an API still
+     * needs a BasePacketPtr.
+     */
+    class Frame
+    {
+    public:
+        /*! \brief The largest payload either protocol can carry. */
+        static const int MAX_PAYLOAD = 255;
+
+        /*! \brief The largest DS2 payload; its length byte also counts the address, itself and the checksum. */
+        static const int MAX_DS2_PAYLOAD = 252;
+
+        /*! \brief The largest KWP payload; its length byte counts only the payload. */
+        static const int MAX_KWP_PAYLOAD = 255;
+
+        /*! \brief The largest serialized frame: KWP magic byte, target, source, length, payload, checksum. */
+        static const int MAX_FRAME = MAX_PAYLOAD + 5;
+
+        Frame(BasePacket::ProtocolType aProtocol = BasePacket::ProtocolDS2, quint8 aTargetAddress = 0, quint8 aSourceAddress = 0xF1);
+        Frame(BasePacket::ProtocolType aProtocol, quint8 aTargetAddress, const quint8 *somePayload, int aLength, quint8 aSourceAddress = 0xF1);
+
+        /*!
+         * \brief fromPacket copies a BasePacket into a Frame.
+         */
+        static Frame fromPacket(const BasePacket &aPacket);
+
+        /*!
+         * \brief toPacket wraps this frame in a newly allocated DS2Packet or KWPPacket.
+         */
+        BasePacketPtr toPacket() const;
+
+        /*!
+         * \brief maxPayload returns the largest payload a frame of \a aProtocol can carry.
+         */
+        static int maxPayload(BasePacket::ProtocolType aProtocol);
+
+        BasePacket::ProtocolType protocol() const { return _protocol; }
+
+        /*!
+         * \brief Changes the protocol.  Throws std::invalid_argument if the payload is too long for it.
+         */
+        void setProtocol(BasePacket::ProtocolType aProtocol);
+
+        quint8 targetAddress() const { return _targetAddress; }
+        void setTargetAddress(quint8 anAddress) { _targetAddress = anAddress; }
+
+        bool hasSourceAddress() const { return _protocol == BasePacket::ProtocolKWP; }
+        quint8 sourceAddress() const { return _sourceAddress; }
+        void setSourceAddress(quint8 anAddress) { _sourceAddress = anAddress; }
+
+        /*! \brief Returns a view of the payload, valid for the lifetime of this Frame. */
+        PayloadView payload() const { return PayloadView(_payload, _length); }
+
+        int length() const { return _length; }
+
+        /*!
+         * \brief Copies \a aLength bytes of \a somePayload into the frame.  Payloads over maxPayload() are an error.
+         */
+        void setPayload(const quint8 *somePayload, int aLength);
+
+        /*!
+         * \brief Returns writable payload storage so callers (ex: a serial read) can fill it in place.
+         */
+        quint8 *payloadData() { return _payload; }
+
+        /*!
+         * \brief Sets the payload length after filling payloadData() directly.
+         */
+        void resize(int aLength);
+
+        /*! \brief Returns the number of bytes the serialized frame occupies. */
+        int frameLength() const;
+
+        /*! \brief Returns the number of header bytes an ECU sends back before its address and length (see BasePacket::expectedHeaderPadding()). */
+        int headerPaddingLength() const;
+
+        /*! \brief Calculates the XOR checksum over the header and payload. */
+        quint8 checksum() const;
+
+        /*!
+         * \brief serialize writes the frame in wire format.
+         * \param aBuffer Destination, at least frameLength() (or MAX_FRAME) bytes long.
+         * \return The number of bytes written.
+         */
+        int serialize(quint8 *aBuffer) const;
+
+        /*! \brief Formats the frame the same way DS2Packet/KWPPacket::toByteString() do. */
+        const QString toByteString() const;
+
+        /*!
+         * \brief Runs an XOR over a block of bytes, starting from \a aSeed.
+         */
+        static quint8 xorBytes(const quint8 *someBytes, int aLength, quint8 aSeed = 0);
+
+    protected:
+        /*! \cond internal */
+        BasePacket::ProtocolType _protocol;
+        quint8 _targetAddress, _sourceAddress;
+        int _length;
+        quint8 _payload[MAX_PAYLOAD];
+        /*! \endcond internal */
+    };
+}
+
+QTextStream &operator << (QTextStream &s, const DS2PlusPlus::Frame &aFrame);
+
+#endif // FRAME_H
@@ -0,0 +1,190 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QVariant>
+
+#include "basepacket.h"
+
+class QIODevice;
+
+namespace DS2PlusPlus {
+    class Operation;
+
+    /*!
+     * \brief The KeyPathTree class is the JSON shape of a set of dotted response keys, worked out ahead of time.
+     *
+     * Each key (ex: "error_code.codes.0.flags") is split once when it's inserted.  Intermediate segments become
+     * objects, or arrays when the following segment is numeric, exactly as ResponseToJson() lays them out.
+     * Member names are stored already quoted and escaped, and children are kept in output order.
+     */
+    class KeyPathTree
+    {
+    public:
+        class Node
+        {
+        public:
+            Node() : parent(-1), index(-1), isArray(false) {}
+
+            int parent;
+            /*! \brief Position in the parent array, or -1 for object members. */
+            int index;
+            bool isArray;
+            /*! \brief The member name in UTF-8, used for ordering. */
+            QByteArray name;
+            /*! \brief The quoted, escaped member name. */
+            QByteArray quotedName;
+            /*! \brief The full response key if a value can be stored at this node. */
+            QString key;
+            QVector<int> children;
+        };
+
+        KeyPathTree();
+        explicit KeyPathTree(const QStringList &someKeys);
+
+        /*!
+         * \brief forOperation builds the tree for every key an Operation's results can produce, including
+         * the expanded bitfield keys from Result::levelSlotKeys().
+         */
+        static KeyPathTree forOperation(const Operation &anOperation);
+
+        void insert(const QString &aKey);
+
+        int nodeCount() const { return _nodes.count(); }
+        const Node &node(int anIndex) const { return _nodes.at(anIndex); }
+
+    protected:
+        int findOrAddChild(int aParent, const QString &aSegment, bool isArray);
+
+        /*! \cond internal */
+        QVector<Node> _nodes;
+        /*! \endcond internal */
+    };
+
+    /*!
+     * \brief The TransactionRecord class describes one request/response exchange for JsonStreamWriter::writeTransaction().
+     */
+    class TransactionRecord
+    {
+    public:
+        TransactionRecord() : timestamp(0.0), latency(0.0) {}
+
+        /*! \brief Seconds on a monotonic clock when the request was sent. */
+        double timestamp;
+        QString ecuUuid;
+        QString operation;
+        /*! \brief Seconds between sending the request and decoding the reply. */
+        double latency;
+    };
+
+    /*!
+     * \brief The JsonStreamWriter class writes PacketResponses as JSON without building a Json::Value tree.
+     *
+     * StylePretty output is byte for byte what Json::StyledWriter produces for the same response, so it can
+     * stand in for ResponseToJsonString().  StyleCompact drops all optional whitespace and the trailing newline.
+     */
+    class JsonStreamWriter
+    {
+    public:
+        typedef enum {
+            StyleCompact,
+            StylePretty
+        } Style;
+
+        /*!
+         * \brief Constructs a writer that writes each document to \a aDevice.
+         */
+        explicit JsonStreamWriter(QIODevice *aDevice, Style aStyle = StylePretty);
+
+        /*!
+         * \brief Constructs a writer that appends each document to \a aBuffer.
+         */
+        explicit JsonStreamWriter(QByteArray *aBuffer, Style aStyle = StylePretty);
+
+        Style style() const { return _style; }
+
+        /*!
+         * \brief write serializes one response.
+         * \param aResponse The values to write.
+         * \param aTree The key layout, typically KeyPathTree::forOperation().  Keys in \a aResponse that aren't in the tree are skipped.
+         * \param aRootNode If set, the response is nested inside an object under this name.
+         */
+        void write(const PacketResponse &aResponse, const KeyPathTree &aTree, const QString &aRootNode = QString::null);
+
+        /*!
+         * \brief write serializes one response, building the key layout from the response itself.
+         */
+        void write(const PacketResponse &aResponse, const QString &aRootNode = QString::null);
+
+        /*!
+         * \brief writeTransaction writes one line of newline delimited JSON, regardless of the writer's style:
+         * {"ts":...,"ecu":"...","operation":"...","latency_ms":...,"values":{...}}
+         *
+         * Nothing is flushed; the line is handed to the device (or buffer) and left to its buffering.
+         */
+        void writeTransaction(const TransactionRecord &aRecord, const PacketResponse &aResponse, const KeyPathTree &aTree);
+
+        /*!
+         * \brief appendQuoted appends \a aString as a quoted, escaped JSON string.
+         */
+        static void appendQuoted(QByteArray &aBuffer, const QByteArray &aString);
+
+        /*!
+         * \brief appendVariant appends a single response value.  Returns false for types JSON can't represent, which are written as null.
+         */
+        static bool appendVariant(QByteArray &aBuffer, const QVariant &aValue);
+
+        /*!
+         * \brief appendDouble appends a number the way Json::StyledWriter formats doubles.
+         */
+        static void appendDouble(QByteArray &aBuffer, double aValue);
+
+    protected:
+        void begin();
+        void prepare(const PacketResponse &aResponse, const KeyPathTree &aTree);
+        void end();
+        void writeNode(const KeyPathTree &aTree, int aNode, int aDepth);
+        void writeArray(const KeyPathTree &aTree, const KeyPathTree::Node &aNode, int aDepth);
+        void writeObject(const KeyPathTree &aTree, const KeyPathTree::Node &aNode, int aDepth);
+        void writeList(const QList<quint8> &aList, int aDepth);
+        void newline(int aDepth);
+
+        /*! \cond internal */
+        QIODevice *_device;
+        QByteArray *_target;
+        QByteArray *_out;
+        QByteArray _buffer;
+        Style _style;
+        QVector<const QVariant *> _values;
+        QVector<quint8> _present;
+        /*! \endcond internal */
+    };
+}
+
+#endif // JSONWRITER_H
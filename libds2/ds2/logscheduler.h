@@ -0,0 +1,203 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOGSCHEDULER_H
+#define LOGSCHEDULER_H
+
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "operation.h"
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The ChannelActivity class follows how much one data log channel is moving.
+     *
+     * Every decoded value is compared to the last value that counted as a change.  Numbers must move by more
+     * than the deadband to count; anything else counts whenever it differs.  The change rate is a moving
+     * average of how often samples change, from 0 (never) to 1 (every sample), and is what
+     * LogScheduler::setActivity() expects.
+     */
+    class ChannelActivity
+    {
+    public:
+        explicit ChannelActivity(double aDeadband = 0);
+
+        /*!
+         * \brief update adds a sample.
+         * \return true if \a aValue counts as a change, which includes the first valid sample.
+         */
+        bool update(const QVariant &aValue);
+
+        double changeRate() const { return _changeRate; }
+        quint64 samples() const { return _samples; }
+
+        void setDeadband(double aDeadband) { _deadband = aDeadband; }
+        double deadband() const { return _deadband; }
+
+    protected:
+        /*! \cond internal */
+        QVariant _reference;
+        double _deadband, _changeRate;
+        quint64 _samples;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The LogScheduler class decides which data log operation goes on the bus next.
+     *
+     * Every task (an operation on an ECU) has a target rate and an estimated cost, the seconds of bus time
+     * one request and reply take.  If the targets add up to more than the bus can carry, every task's rate
+     * is scaled back by the same factor; the result is the planned rate.  Tasks are then run earliest
+     * deadline first at their planned rates.  Measured transaction times replace the estimates as the log
+     * runs, so the plan follows the real bus.
+     *
+     * In adaptive mode (see setAdaptive()) the bus time the targets would use is instead shared out by
+     * activity: every task keeps at least its minimum rate, and the rest goes to the tasks whose channels
+     * are changing, up to their maximum rate.  Stable channels back off and volatile ones speed up without
+     * the total bus load growing.
+     *
+     * All times are seconds on the caller's clock.
+     */
+    class LogScheduler
+    {
+    public:
+        /*! \brief The K-line's data rate. */
+        static const int DEFAULT_BAUD_RATE = 9600;
+
+        /*! \brief Bits on the wire per byte: start, 8 data, even parity, stop. */
+        static const int BITS_PER_BYTE = 11;
+
+        class Task
+        {
+        public:
+            Task() : targetRate(0), cost(0), activity(1), nextDue(0), runs(0), firstRun(-1), lastRun(-1) {}
+
+            QString name;
+            double targetRate;
+            double cost;
+            /*! \brief From 0 (stable) to 1 (changing every sample). */
+            double activity;
+            double nextDue;
+            quint64 runs;
+            double firstRun, lastRun;
+        };
+
+        LogScheduler();
+
+        /*!
+         * \brief addTask adds an operation to the schedule.
+         * \param aTargetRate The desired rate in Hz.
+         * \param aCost The estimated seconds of bus time per run, see estimateCost().
+         * \return The task's index.
+         */
+        int addTask(const QString &aName, double aTargetRate, double aCost);
+
+        /*!
+         * \brief removeTask takes \a aTask out of the schedule.  Later tasks move down an index; the others
+         * keep their history and next run.
+         */
+        void removeTask(int aTask);
+
+        /*!
+         * \brief setTargetRate changes \a aTask's rate without losing its history.  Its next run stays where
+         * it was, so the new rate applies from the one after.
+         */
+        void setTargetRate(int aTask, double aTargetRate);
+
+        const QVector<Task> &tasks() const { return _tasks; }
+
+        /*!
+         * \brief utilization is the fraction of the bus the tasks would use at their target rates.
+         */
+        double utilization() const;
+
+        /*!
+         * \brief plannedRate is the rate \a aTask can actually be given, in Hz.
+         */
+        double plannedRate(int aTask) const;
+
+        /*!
+         * \brief setAdaptive turns on adaptive rates.  Each task's rate is kept between \a aMinimumFactor and
+         * \a aMaximumFactor times its target rate.  The minimum must be above 0, otherwise a stable task would
+         * never be polled again to notice it had started changing.
+         */
+        void setAdaptive(double aMinimumFactor, double aMaximumFactor);
+        bool isAdaptive() const { return _isAdaptive; }
+
+        /*!
+         * \brief setActivity sets how much \a aTask's channels are changing, from 0 to 1.  Only used in
+         * adaptive mode.
+         */
+        void setActivity(int aTask, double anActivity);
+
+        /*!
+         * \brief start makes every task due at \a aNow.
+         */
+        void start(double aNow);
+
+        /*!
+         * \brief next picks the task with the earliest deadline.
+         * \param aWait Set to how long the caller should wait before running it, or 0 if it's already due.
+         * \return The task's index, or -1 if there are no tasks.
+         */
+        int next(double aNow, double &aWait) const;
+
+        /*!
+         * \brief completed records that \a aTask started at \a aStart and took \a aDuration, and schedules
+         * its next run.  A task that has fallen more than a period behind skips the runs it missed rather
+         * than bursting to catch up.
+         */
+        void completed(int aTask, double aStart, double aDuration);
+
+        /*!
+         * \brief achievedRate is how often \a aTask has actually run, in Hz.
+         */
+        double achievedRate(int aTask) const;
+
+        /*!
+         * \brief estimateCost predicts the bus time for one run of \a anOperation: the request frame, a reply
+         * just long enough to hold every result, and \a aTurnaround seconds for the ECU to respond.
+         */
+        static double estimateCost(const Operation &anOperation, double aTurnaround, int aBaudRate = DEFAULT_BAUD_RATE);
+
+        /*!
+         * \brief expectedReplyLength is the length of the smallest reply frame that holds all of \a anOperation's results.
+         */
+        static int expectedReplyLength(const Operation &anOperation);
+
+    protected:
+        /*! \cond internal */
+        void planAdaptive() const;
+
+        QVector<Task> _tasks;
+        bool _isAdaptive;
+        double _minimumFactor, _maximumFactor;
+        mutable QVector<double> _adaptiveRates;
+        mutable bool _adaptiveRatesAreValid;
+        /*! \endcond */
+    };
+}
+
+#endif // LOGSCHEDULER_H
@@ -30,7 +30,11 @@
 
 #include <QSqlDatabase>
 
+#include "busstatistics.h"
 #include "controlunit.h"
+#include "frame.h"
+#include "responsecache.h"
+#include "sharedvalues.h"
 
 class QSerialPort;
 
@@ -94,6 +98,40 @@ namespace DS2PlusPlus
 
         BasePacketPtr query(BasePacketPtr aPacket);
 
+        /*!
+         * \brief Sends a frame to the ECU and reads back its reply without allocating.
+         * \param aRequest The frame to send.
+         * \param aResponse Overwritten with the ECU's reply.  It is left empty if the request couldn't be written.
+         */
+        void query(const Frame &aRequest, Frame &aResponse);
+
+        /*!
+         * \brief Writes an already framed request (see Operation::encodedRequest()) and reads back the reply.
+         * \param aRequest The complete request, including header and checksum.
+         * \param aLength The number of bytes in \a aRequest.
+         * \param aProtocol The protocol \a aRequest is framed in.
+         * \param aResponse Overwritten with the ECU's reply.
+         * \param anOperationStatistics If given, the transaction is counted here as well as against the ECU's address.
+         */
+        void queryEncoded(const quint8 *aRequest, int aLength, BasePacket::ProtocolType aProtocol, Frame &aResponse,
+                          TransactionStatistics *anOperationStatistics = 0);
+
+        /*!
+         * \brief Latency and error counts for every transaction this manager has made, per ECU and per operation.
+         */
+        BusStatistics &statistics() { return _statistics; }
+
+        /*!
+         * \brief Responses to operations that declare a cache_ttl, and identity replies, by ECU address.
+         */
+        ResponseCache &responseCache() { return _responseCache; }
+
+        /*!
+         * \brief The segment decoded results are published to, or null unless --shm was given.
+         */
+        QSharedPointer<SharedValueWriter> sharedValues() const { return _sharedValues; }
+        void setSharedValues(QSharedPointer<SharedValueWriter> aWriter) { _sharedValues = aWriter; }
+
         ControlUnitPtr findModuleAtAddress(quint8 anAddress);
         ControlUnitPtr findModuleByMatchingIdentPacket(const BasePacketPtr packet);
 
@@ -150,6 +188,9 @@ namespace DS2PlusPlus
         QString _dppDir, _dppSourceDir;
         int  _fd;
         QSharedPointer<QCommandLineParser> _cliParser;
+        BusStatistics _statistics;
+        ResponseCache _responseCache;
+        QSharedPointer<SharedValueWriter> _sharedValues;
     };
 
     typedef QSharedPointer<Manager> ManagerPtr;
@@ -30,6 +30,8 @@
 
 #include <ds2/result.h>
 #include <ds2/basepacket.h>
+#include <ds2/frame.h>
+#include <ds2/jsonwriter.h>
 
 namespace DS2PlusPlus {
 
@@ -55,18 +57,71 @@ namespace DS2PlusPlus {
         const QHash<QString, Result> results() const;
         void insertResult(const QString &aName, const Result aResult);
 
+        /*!
+         * \brief keyPathTree returns the JSON layout of this operation's results, built the first time it's needed.
+         */
+        const KeyPathTree &keyPathTree() const;
+
         void setAddress(quint8 anAddress);
 
         BasePacket::ProtocolType protocol() const;
 
+        /*!
+         * \brief cacheTtl is how many seconds a response may be served from the Manager's ResponseCache.
+         *
+         * Negative if the definition didn't say (so a parent operation's value may be used), zero or negative
+         * if responses mustn't be cached.
+         */
+        double cacheTtl() const { return _cacheTtl; }
+        void setCacheTtl(double aTtl) { _cacheTtl = aTtl; }
+        bool isCacheable() const { return _cacheTtl > 0; }
+
         BasePacket *queryPacket() const;
 
+        /*!
+         * \brief queryFrame builds the request for this operation as a Frame, without allocating.
+         */
+        Frame queryFrame() const;
+
+        /*!
+         * \brief encodedRequest returns the request framed and checksummed, ready to be written to the serial port.
+         *
+         * The frame is built once for the operation's address and protocol and rebuilt only when the address or
+         * command changes.
+         */
+        const quint8 *encodedRequest() const;
+
+        /*! \brief Returns the number of bytes in encodedRequest(). */
+        int encodedRequestLength() const;
+
+        /*!
+         * \brief setParameter patches argument bytes (ex: a memory address or channel index) into the command.
+         *
+         * The bytes are written in place into the encoded request and the checksum is updated incrementally, so
+         * stepping through addresses doesn't re-encode the frame.  This modifies the operation, so don't share
+         * a parameterized operation between threads.
+         * \param aPosition Offset into the command (0 is the first command byte).
+         * \param someBytes The argument bytes.
+         * \param aLength The number of argument bytes.
+         */
+        void setParameter(int aPosition, const quint8 *someBytes, int aLength);
+
+        /*! \brief Patches a single argument byte, see setParameter(int, const quint8 *, int). */
+        void setParameter(int aPosition, quint8 aByte);
+
     protected:
+        void encodeRequest();
+
         QString _uuid, _name, _parentId;
         quint8 _controlUnitAddress;
         QByteArray _command;
         QHash<QString, Result> _results;
         BasePacket::ProtocolType _protocol;
+        double _cacheTtl;
+        quint8 _encodedRequest[Frame::MAX_FRAME];
+        int _encodedRequestLength, _commandOffset;
+        mutable KeyPathTree _keyPathTree;
+        mutable bool _keyPathTreeIsValid;
     };
 
     typedef QSharedPointer<Operation> OperationPtr;
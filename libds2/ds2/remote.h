@@ -0,0 +1,175 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+
+#include "basepacket.h"
+
+class QLocalSocket;
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The RemoteMessage class is one request to, or reply from, the ds2r daemon.
+     *
+     * On the wire every message is a frame: a 32 bit big endian length, then the type, the id, and only the
+     * fields that type uses, written with QDataStream.  A reply carries the id of its request, and samples
+     * carry the id of the Subscribe request that asked for them.
+     */
+    class RemoteMessage
+    {
+    public:
+        typedef enum {
+            // Requests
+            RunOperation = 0x01,
+            Probe = 0x02,
+            RawQuery = 0x03,
+            Subscribe = 0x04,
+            Unsubscribe = 0x05,
+            //! Drop cached responses for an ECU, or for every ECU if none is given
+            Invalidate = 0x06,
+
+            // Replies
+            Response = 0x81,
+            ProbeResult = 0x82,
+            RawReply = 0x83,
+            Subscribed = 0x84,
+            Sample = 0x85,
+            Error = 0xff
+        } Type;
+
+        /*! \brief No frame may be longer than this; anything bigger is treated as a corrupt stream. */
+        static const int MAX_FRAME = 1 << 20;
+
+        explicit RemoteMessage(Type aType = Error, quint32 anId = 0);
+
+        Type type;
+        quint32 id;
+
+        /*! \brief A family name, a numerical address ("0x12" or "18"), or a module UUID. */
+        QString ecu;
+        QString operation;
+        /*! \brief Subscribe: the results wanted, or empty for all of them. */
+        QStringList results;
+        /*! \brief Subscribe: the rate in Hz. */
+        double rate;
+        /*! \brief Sample and Response: seconds on the daemon's monotonic clock when the request was sent. */
+        double timestamp;
+        /*! \brief Sample and Response: seconds from sending the request to decoding the reply. */
+        double latency;
+        /*! \brief Sample: how many samples the subscription has lost so far because the client fell behind. */
+        quint64 dropped;
+        /*! \brief RawQuery and RawReply: the packet payload. */
+        QByteArray data;
+        PacketResponse response;
+        QString error;
+
+        /*!
+         * \brief encode returns the message as a complete frame.
+         */
+        QByteArray encode() const;
+
+        static bool isRequest(Type aType) { return aType < Response; }
+
+        /*!
+         * \brief defaultSocketPath is where ds2r listens unless told otherwise: one socket per user in the temp directory.
+         */
+        static QString defaultSocketPath();
+    };
+
+    /*!
+     * \brief The RemoteMessageReader class splits a byte stream back into messages.
+     */
+    class RemoteMessageReader
+    {
+    public:
+        /*!
+         * \brief append adds bytes as they arrive.  They don't need to line up with frames.
+         */
+        void append(const QByteArray &someBytes) { _buffer.append(someBytes); }
+
+        /*!
+         * \brief next takes the next complete message, if there is one.
+         * \throws std::runtime_error if the stream is corrupt.  It can't be recovered; close the connection.
+         */
+        bool next(RemoteMessage &aMessage);
+
+    protected:
+        /*! \cond internal */
+        QByteArray _buffer;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The RemoteClient class talks to ds2r over its socket, waiting for each reply.
+     *
+     * Samples for subscriptions that arrive while waiting for a reply are kept for nextSample().
+     */
+    class RemoteClient
+    {
+    public:
+        RemoteClient();
+        ~RemoteClient();
+
+        /*!
+         * \throws std::runtime_error if nothing is listening at \a aPath.
+         */
+        void connectTo(const QString &aPath = RemoteMessage::defaultSocketPath());
+
+        /*!
+         * \brief request sends \a aRequest and waits for its reply.
+         * \throws std::runtime_error if the connection drops, or the daemon replies with an error.
+         */
+        RemoteMessage request(RemoteMessage aRequest, int aTimeoutMilliseconds = 30000);
+
+        /*!
+         * \brief nextSample waits up to \a aTimeoutMilliseconds (-1 for ever) for a subscription sample.
+         *
+         * A poll that failed on the bus arrives as an Error with the subscription's id; the subscription carries on.
+         * \return false if none arrived in time.
+         */
+        bool nextSample(RemoteMessage &aSample, int aTimeoutMilliseconds = -1);
+
+    protected:
+        /*! \cond internal */
+        Q_DISABLE_COPY(RemoteClient)
+
+        bool readMessage(RemoteMessage &aMessage, int aTimeoutMilliseconds);
+
+        QLocalSocket *_socket;
+        RemoteMessageReader _reader;
+        QList<RemoteMessage> _samples;
+        quint32 _nextId;
+        /*! \endcond */
+    };
+}
+
+Q_DECLARE_METATYPE(DS2PlusPlus::RemoteMessage)
+
+#endif // REMOTE_H
@@ -0,0 +1,94 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <ds2/basepacket.h>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The ResponseCache class keeps responses that can't change while the car is on, for the TTL their
+     * operation declares (cache_ttl in the DPP JSON).
+     *
+     * Entries are keyed by ECU address, module UUID and operation name.  Everything cached for an address is
+     * dropped as soon as that ECU times out, which is what an ignition cycle looks like from the bus.  All
+     * members may be called from any thread.
+     */
+    class ResponseCache
+    {
+    public:
+        ResponseCache();
+
+        /*!
+         * \brief now returns seconds on the monotonic clock the cache uses by default.
+         */
+        static double now();
+
+        /*!
+         * \brief find copies a live entry's response into \a aResponse.
+         * \return false if there's no entry, or it has expired.
+         */
+        bool find(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation, PacketResponse &aResponse, double aNow = now());
+
+        /*!
+         * \brief insert keeps \a aResponse for \a aTtl seconds.  Nothing is kept if \a aTtl isn't positive.
+         */
+        void insert(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation, const PacketResponse &aResponse,
+                    double aTtl, double aNow = now());
+
+        /*!
+         * \brief invalidate drops everything cached for \a anAddress, ex: after writing to it or when it stops answering.
+         */
+        void invalidate(quint8 anAddress);
+        void clear();
+
+        int size() const;
+        quint64 hits() const;
+        quint64 misses() const;
+
+    protected:
+        /*! \cond internal */
+        class Entry
+        {
+        public:
+            quint8 address;
+            PacketResponse response;
+            double expires;
+        };
+
+        static QString keyFor(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation);
+        const Entry *live(const QString &aKey, double aNow);
+
+        mutable QMutex _lock;
+        QHash<QString, Entry> _entries;
+        quint64 _hits, _misses;
+        /*! \endcond */
+    };
+}
+
+#endif // RESPONSECACHE_H
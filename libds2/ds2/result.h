@@ -25,6 +25,9 @@
 #define RESULT_H
 
 #include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
 
 namespace DS2PlusPlus {
     /*!
@@ -33,7 +36,7 @@ namespace DS2PlusPlus {
     class Result
     {
     public:
-        Result () : _startPosition(-1) {}
+        Result () : _startPosition(-1), _rpnIsAffine(true), _rpnScale(1.0), _rpnOffset(0.0), _levelsAreValid(true) {}
 
         void setName(const QString &aName);
         const QString name() const;
@@ -62,13 +65,40 @@ namespace DS2PlusPlus {
         void setRpn(const QString &aRpnString);
         QStringList rpn() const;
 
+        /*!
+         * \brief rpnIsAffine
+         * \return True if the RPN for this result reduces to N * rpnScale() + rpnOffset().  Used by the batch decoder.
+         */
+        bool rpnIsAffine() const;
+        double rpnScale() const;
+        double rpnOffset() const;
+
+        /*!
+         * \brief stringForLevel looks up the level string for a byte value in the precompiled level table.
+         * \param aLevel
+         * \return The matching level string(s), comma delimited, or a null string if none match.
+         */
         const QString stringForLevel(quint8 aLevel) const;
         void setLevels(QHash<QString, QString> someLevels);
 
+        /*!
+         * \brief levelSlotKeys
+         * \return The keys (result name + "." + level string) used when a bitfield is expanded into booleans, ordered by mask.
+         */
+        const QStringList levelSlotKeys() const;
+
+        /*!
+         * \brief levelSlotMasks
+         * \return The bitmask for each entry in levelSlotKeys().
+         */
+        const QVector<quint8> levelSlotMasks() const;
+
         const QString units() const;
         void setUnits(const QString &aUnit);
 
     protected:
+        void compileLevels();
+
         QString _uuid;
         QString _name;
         QString _type;
@@ -77,7 +107,13 @@ namespace DS2PlusPlus {
         int _length;
         int _mask;
         QStringList _rpn;
+        bool _rpnIsAffine;
+        double _rpnScale, _rpnOffset;
         QHash<QString, QString> _levels;
+        QVector<QString> _levelTable;
+        QStringList _levelSlotKeys;
+        QVector<quint8> _levelSlotMasks;
+        bool _levelsAreValid;
         QString _units;
     };
 }
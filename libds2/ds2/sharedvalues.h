@@ -0,0 +1,217 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHAREDVALUES_H
+#define SHAREDVALUES_H
+
+#include <QBasicAtomicInteger>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The layout of the shared memory segment written by SharedValueWriter.
+     *
+     * The segment is a Header, then a directory of Header::capacity Channel entries, then as many Slots.
+     * Everything is in host byte order and the layout is fixed, so a reader doesn't need libds2; the structs
+     * below are all it needs to know.  Channels are only ever added.  A channel's directory entry is written
+     * before Header::channelCount is raised past it.
+     *
+     * Each Slot is guarded by a sequence lock.  The writer makes Slot::sequence odd, writes the value, then
+     * makes it even again.  A reader copies the slot between two reads of the sequence and retries if the
+     * reads differ or are odd.  Reading takes no lock and no system call, and never holds up the writer.
+     */
+    namespace SharedValues {
+        static const char MAGIC[8] = { 'D', 'P', 'P', 'S', 'H', 'M', '0', '1' };
+        static const int NAME_LENGTH = 96;
+        static const int UNITS_LENGTH = 32;
+        static const int TEXT_LENGTH = 40;
+
+        typedef enum {
+            TypeNone = 0,
+            TypeDouble,
+            TypeInt,
+            TypeUInt,
+            TypeBool,
+            TypeString
+        } Type;
+
+        struct Header {
+            char magic[8];
+            quint32 capacity;
+            //! Written last when a channel is added; read with acquire semantics
+            QBasicAtomicInteger<quint32> channelCount;
+            //! Cleared when the writer closes the segment
+            QBasicAtomicInteger<quint32> isLive;
+            quint32 writerPid;
+            char padding[40];
+        };
+
+        struct Channel {
+            char name[NAME_LENGTH];
+            char units[UNITS_LENGTH];
+        };
+
+        struct Slot {
+            //! Zero until the first value is written, odd while one is being written
+            QBasicAtomicInteger<quint32> sequence;
+            quint32 type;
+            //! Seconds on the writer's monotonic clock
+            double timestamp;
+            union {
+                double asDouble;
+                qint64 asInt;
+                quint64 asUInt;
+            } value;
+            //! TypeString values, truncated and always nul terminated
+            char text[TEXT_LENGTH];
+        };
+
+        /*!
+         * \brief The Value class is a consistent copy of one slot.
+         */
+        class Value
+        {
+        public:
+            Value() : type(TypeNone), timestamp(0.0) { number.asUInt = 0; text[0] = '\0'; }
+
+            QVariant toVariant() const;
+
+            quint32 type;
+            double timestamp;
+            union {
+                double asDouble;
+                qint64 asInt;
+                quint64 asUInt;
+            } number;
+            char text[TEXT_LENGTH];
+        };
+
+        /*!
+         * \brief segmentSize returns the bytes needed for \a aCapacity channels.
+         */
+        size_t segmentSize(quint32 aCapacity);
+
+        /*!
+         * \brief segmentName turns \a aName into a POSIX shared memory name, adding the leading slash if needed.
+         */
+        QByteArray segmentName(const QString &aName);
+    }
+
+    /*!
+     * \brief The SharedValueWriter class publishes the latest value of each result into a shared memory segment.
+     *
+     * Only one writer may have a segment open at a time.  The segment is created when the writer is, and
+     * unlinked again when it's destroyed.  A segment left behind by a writer that is no longer running is
+     * replaced; one whose writer is still running can't be opened.  Readers that already have it mapped keep
+     * it until they close it; SharedValueReader::isLive() tells them the writer has gone, cleanly or not.
+     */
+    class SharedValueWriter
+    {
+    public:
+        static const quint32 DEFAULT_CAPACITY = 1024;
+
+        /*!
+         * \throws std::runtime_error if the segment can't be created or mapped, or another writer has it open.
+         */
+        explicit SharedValueWriter(const QString &aName, quint32 aCapacity = DEFAULT_CAPACITY);
+        ~SharedValueWriter();
+
+        QString name() const { return _name; }
+
+        /*!
+         * \brief channel returns the slot for \a aName, adding it to the directory the first time.
+         * \return -1 if the directory is full.
+         */
+        int channel(const QString &aName, const QString &someUnits = QString::null);
+
+        /*!
+         * \brief publish writes \a aValue into a slot.  Values JSON can't represent are published as TypeNone.
+         */
+        void publish(int aChannel, double aTimestamp, const QVariant &aValue);
+
+    protected:
+        /*! \cond internal */
+        QString _name;
+        uchar *_segment;
+        size_t _size;
+        SharedValues::Header *_header;
+        SharedValues::Channel *_channels;
+        SharedValues::Slot *_slots;
+        QHash<QString, int> _channelIndexes;
+        /*! \endcond */
+
+    private:
+        Q_DISABLE_COPY(SharedValueWriter)
+    };
+
+    /*!
+     * \brief The SharedValueReader class maps a SharedValueWriter's segment read only.
+     *
+     * Nothing here allocates or makes a system call once the segment is open, except the lookups by name.
+     */
+    class SharedValueReader
+    {
+    public:
+        /*!
+         * \throws std::runtime_error if there's no such segment, or it isn't one of ours.
+         */
+        explicit SharedValueReader(const QString &aName);
+        ~SharedValueReader();
+
+        /*!
+         * \brief isLive is true while the writer has the segment open and its process is still running.
+         */
+        bool isLive() const;
+        int channelCount() const;
+        QString channelName(int aChannel) const;
+        QString channelUnits(int aChannel) const;
+
+        /*!
+         * \return The channel called \a aName, or -1.
+         */
+        int indexOf(const QString &aName) const;
+
+        /*!
+         * \brief read copies the latest value of \a aChannel.
+         * \return false if nothing has been written to it yet, or it couldn't be read consistently after many
+         * tries (the writer died half way through writing it).
+         */
+        bool read(int aChannel, SharedValues::Value &aValue) const;
+
+    protected:
+        /*! \cond internal */
+        const uchar *_segment;
+        size_t _size;
+        const SharedValues::Header *_header;
+        const SharedValues::Channel *_channels;
+        const SharedValues::Slot *_slots;
+        /*! \endcond */
+
+    private:
+        Q_DISABLE_COPY(SharedValueReader)
+    };
+}
+
+#endif // SHAREDVALUES_H
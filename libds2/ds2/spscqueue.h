@@ -0,0 +1,116 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInteger>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The SpscQueue class is a fixed size, lock-free queue for exactly one producer thread and one
+     * consumer thread.
+     *
+     * Neither push() nor pop() ever blocks or allocates; push() fails when the queue is full and pop() fails
+     * when it's empty.  The capacity is rounded up to a power of two.
+     */
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(int aCapacity) :
+            _head(0), _tail(0)
+        {
+            _capacity = 1;
+            while (_capacity < static_cast<quint32>(qMax(aCapacity, 1))) {
+                _capacity <<= 1;
+            }
+            _slots = new T[_capacity];
+        }
+
+        ~SpscQueue()
+        {
+            delete[] _slots;
+        }
+
+        /*!
+         * \brief push adds \a aValue to the queue.  Only call this from the producer thread.
+         * \return false if the queue is full.
+         */
+        bool push(const T &aValue)
+        {
+            const quint32 tail = _tail.load();
+            if ((tail - _head.loadAcquire()) >= _capacity) {
+                return false;
+            }
+
+            _slots[tail & (_capacity - 1)] = aValue;
+            _tail.storeRelease(tail + 1);
+            return true;
+        }
+
+        /*!
+         * \brief pop takes the oldest value off the queue.  Only call this from the consumer thread.
+         * \return false if the queue is empty.
+         */
+        bool pop(T &aValue)
+        {
+            const quint32 head = _head.load();
+            if (head == _tail.loadAcquire()) {
+                return false;
+            }
+
+            T &slot = _slots[head & (_capacity - 1)];
+            aValue = slot;
+            // Don't hang on to anything (e.g. a QByteArray's data) until the slot is reused
+            slot = T();
+            _head.storeRelease(head + 1);
+            return true;
+        }
+
+        /*!
+         * \brief size is exact from either thread when the other is idle, and a snapshot otherwise.
+         */
+        int size() const
+        {
+            return static_cast<int>(_tail.loadAcquire() - _head.loadAcquire());
+        }
+
+        bool isEmpty() const { return size() == 0; }
+        int capacity() const { return static_cast<int>(_capacity); }
+
+    protected:
+        /*! \cond internal */
+        Q_DISABLE_COPY(SpscQueue)
+
+        T *_slots;
+        quint32 _capacity;
+        // Keep the consumer's and producer's counters on separate cache lines
+        QAtomicInteger<quint32> _head;
+        char _padding[64 - sizeof(QAtomicInteger<quint32>)];
+        QAtomicInteger<quint32> _tail;
+        /*! \endcond */
+    };
+}
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,180 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SUBSCRIPTIONHUB_H
+#define SUBSCRIPTIONHUB_H
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QStringList>
+
+#include <ds2/basepacket.h>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The SubscriptionHub class lets any number of consumers share one poll of each ECU operation.
+     *
+     * Consumers subscribe to an (ECU, operation, results) at a rate.  Subscriptions to the same ECU and
+     * operation are merged into a single Poll at the fastest rate any of them asked for, so a second consumer
+     * only costs bus time if it wants samples more often than the first.  Each response is published once and
+     * fanned out to every subscriber, thinned to its own rate and cut down to its own results.
+     *
+     * Every subscriber has a bounded queue.  One that doesn't keep up loses its oldest samples; it never holds
+     * up the bus or the other subscribers.  All members may be called from any thread.
+     */
+    class SubscriptionHub
+    {
+    public:
+        /*! \brief Samples each subscriber may have waiting before the oldest are dropped. */
+        static const int DEFAULT_QUEUE_LENGTH = 64;
+
+        /*!
+         * \brief The Poll class is one operation that needs running, on behalf of every subscriber to it.
+         */
+        class Poll
+        {
+        public:
+            QString ecu;
+            QString operation;
+            /*! \brief Every result a subscriber asked for, or empty if any of them wants them all. */
+            QStringList results;
+            /*! \brief The fastest rate asked for, in Hz. */
+            double rate;
+            int subscribers;
+        };
+
+        /*!
+         * \brief The Sample class is one response, or one failed poll, as delivered to a subscriber.
+         */
+        class Sample
+        {
+        public:
+            Sample() : tag(0), timestamp(0.0), latency(0.0), dropped(0) {}
+
+            bool isError() const { return !error.isEmpty(); }
+
+            /*! \brief The tag the subscription was made with. */
+            quint32 tag;
+            QString ecu;
+            QString operation;
+            double timestamp;
+            double latency;
+            PacketResponse response;
+            QString error;
+            /*! \brief How many samples the subscription had lost to a full queue when this one was taken. */
+            quint64 dropped;
+        };
+
+        SubscriptionHub();
+        ~SubscriptionHub();
+
+        /*!
+         * \brief subscribe registers interest in \a anOperation on \a anEcu.
+         * \param anOwner Whatever the caller uses to tell consumers apart, e.g. a connection.
+         * \param aTag Identifies the subscription within its owner, and comes back with every sample.
+         * \param someResults The results wanted, or empty for all of them.
+         * \param aRate The most samples a second this subscriber wants.
+         * \throws std::invalid_argument if the rate or queue length aren't positive, or the tag is already in use.
+         */
+        void subscribe(quint64 anOwner, quint32 aTag, const QString &anEcu, const QString &anOperation,
+                       const QStringList &someResults, double aRate, int aQueueLength = DEFAULT_QUEUE_LENGTH);
+
+        bool unsubscribe(quint64 anOwner, quint32 aTag);
+        void unsubscribeAll(quint64 anOwner);
+
+        /*!
+         * \brief polls returns the merged polling schedule, sorted by ECU and operation.
+         */
+        QList<Poll> polls() const;
+
+        /*!
+         * \brief generation changes whenever polls() would return something different.
+         */
+        quint64 generation() const;
+
+        /*!
+         * \brief publish fans a response out to every subscriber of \a anEcu and \a anOperation that is due one.
+         * \return The owners that have new samples waiting.
+         */
+        QList<quint64> publish(const QString &anEcu, const QString &anOperation, double aTimestamp, double aLatency,
+                               const PacketResponse &aResponse);
+
+        /*!
+         * \brief publishError tells every subscriber of \a anEcu and \a anOperation that a poll failed.
+         * \return The owners that have new samples waiting.
+         */
+        QList<quint64> publishError(const QString &anEcu, const QString &anOperation, double aTimestamp, const QString &anError);
+
+        /*!
+         * \brief take removes the oldest sample waiting for any of \a anOwner's subscriptions, along with the
+         * subscription's dropped() count at that moment.
+         * \return false if there are none.
+         */
+        bool take(quint64 anOwner, Sample &aSample);
+
+        int queued(quint64 anOwner) const;
+
+        /*!
+         * \brief dropped returns how many samples a subscription has lost to a full queue.
+         */
+        quint64 dropped(quint64 anOwner, quint32 aTag) const;
+
+    protected:
+        /*! \cond internal */
+        class Subscriber
+        {
+        public:
+            quint64 owner;
+            quint32 tag;
+            QString ecu;
+            QString operation;
+            QString key;
+            QStringList results;
+            double rate;
+            int queueLength;
+            double lastDelivered;
+            quint64 dropped;
+            QQueue<Sample> queue;
+        };
+
+        static QString keyFor(const QString &anEcu, const QString &anOperation);
+        QList<quint64> deliver(const QString &anEcu, const QString &anOperation, const Sample &aSample);
+        Subscriber *find(quint64 anOwner, quint32 aTag);
+        void removeAt(int anIndex);
+
+        mutable QMutex _lock;
+        QList<Subscriber *> _subscribers;
+        //! Subscribers by ECU and operation
+        QMap<QString, QList<Subscriber *> > _byKey;
+        quint64 _generation;
+        /*! \endcond */
+
+    private:
+        Q_DISABLE_COPY(SubscriptionHub)
+    };
+}
+
+#endif // SUBSCRIPTIONHUB_H
@@ -0,0 +1,128 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <QAtomicInt>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The TimelineEvent struct is one finished span: what ran, on which thread, from when and for how long.
+     */
+    struct TimelineEvent
+    {
+        const char *name;
+        const char *category;
+        //! Nanoseconds on the monotonic clock
+        qint64 start, duration;
+        quintptr thread;
+        //! The ECU address the span was talking to, or -1
+        int ecu;
+        QString detail;
+    };
+
+    /*!
+     * \brief The Timeline class records spans of time for export in the Chrome trace event format.
+     *
+     * Nothing is recorded until start() is called.  Spans go into a buffer allocated up front, each one
+     * claiming its slot with a single atomic add, and once the buffer is full further spans are counted
+     * as dropped rather than recorded.  start() and stop() must not race with spans being recorded.
+     *
+     * The JSON written by writeJson() opens in chrome://tracing or https://ui.perfetto.dev, with one row per
+     * thread; gaps between spans on the bus thread are time the K-line sat idle.
+     */
+    class Timeline
+    {
+    public:
+        static const int DEFAULT_CAPACITY = 1 << 18;
+
+        static bool isEnabled() { return ourEnabled.load(); }
+
+        /*!
+         * \brief start clears any earlier spans and begins recording up to \a aCapacity of them.
+         */
+        static void start(int aCapacity = DEFAULT_CAPACITY);
+        static void stop();
+
+        /*!
+         * \return Nanoseconds on a clock that never jumps.
+         */
+        static qint64 now();
+
+        static void record(const char *aName, const char *aCategory, qint64 aStart, qint64 anEnd, int anEcu = -1,
+                           const QString &aDetail = QString());
+
+        static int count();
+        static int dropped() { return ourDropped.load(); }
+
+        /*!
+         * \return The spans recorded so far, in the order they finished.  Only call once recording has stopped.
+         */
+        static QVector<TimelineEvent> events();
+
+        /*!
+         * \brief writeJson writes every recorded span as a trace event document to \a aDevice.
+         */
+        static void writeJson(QIODevice *aDevice);
+
+    protected:
+        /*! \cond internal */
+        static QAtomicInt ourEnabled, ourNext, ourDropped;
+        static QVector<TimelineEvent> ourEvents;
+        static qint64 ourOrigin;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The TimelineSpan class records the time from its construction to its destruction, or to finish().
+     *
+     * next() ends the current span and starts another straight away, which keeps the phases of a transaction
+     * back to back.  When the timeline isn't recording a span costs one atomic load.
+     */
+    class TimelineSpan
+    {
+    public:
+        TimelineSpan(const char *aName, const char *aCategory, int anEcu = -1, const QString &aDetail = QString());
+        ~TimelineSpan() { finish(); }
+
+        void next(const char *aName);
+        void finish();
+
+    private:
+        /*! \cond internal */
+        Q_DISABLE_COPY(TimelineSpan)
+
+        const char *_name;
+        const char *_category;
+        qint64 _start;
+        int _ecu;
+        QString _detail;
+        /*! \endcond */
+    };
+}
+
+#endif // TIMELINE_H
@@ -0,0 +1,178 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QIODevice>
+#include <QString>
+#include <QTextStream>
+
+namespace DS2PlusPlus {
+    class TraceSink;
+
+    /*!
+     * \brief The Trace class holds which trace categories are switched on and where their messages go.
+     *
+     * The categories are read from the environment once, when the library loads: DPP_TRACE turns on General,
+     * DPP_TRACE_QUERY Query, RPN_TRACE Rpn, and DPP_DEBUG_CONVERSION Conversion, as they always have.
+     * DPP_TRACE_CATEGORIES takes a comma separated list of category names (or "all"), and
+     * DPP_TRACE_FORMAT=json switches the default sink to JSON lines.  Categories can be changed at any time
+     * afterwards with setEnabled() or enable().
+     *
+     * Checking a category is a single relaxed load, so tracing that is switched off costs a test and a
+     * branch.  Use DS2_TRACE() rather than calling write() directly; building libds2 with DS2_NO_TRACE
+     * defined (qmake CONFIG+=notrace) removes every trace statement from the binary.
+     */
+    class Trace
+    {
+    public:
+        typedef enum {
+            General = 0x01,
+            Query = 0x02,
+            Rpn = 0x04,
+            Conversion = 0x08,
+            All = 0x0f
+        } Category;
+
+        static bool isEnabled(Category aCategory) { return ourCategories.load() & aCategory; }
+        static void setEnabled(Category aCategory, bool isEnabled = true);
+
+        static int categories() { return ourCategories.load(); }
+        static void setCategories(int someCategories) { ourCategories.store(someCategories); }
+
+        /*!
+         * \brief enable switches on the categories in a comma separated list of names, e.g. "query,rpn".
+         * \throws std::invalid_argument for a name that isn't a category.
+         */
+        static void enable(const QString &someNames);
+
+        static QString categoryName(Category aCategory);
+
+        /*!
+         * \brief readEnvironment sets the categories and sink from the environment.  Called once at load.
+         */
+        static void readEnvironment();
+
+        /*!
+         * \brief setSink sends messages to \a aSink, which must outlive its use.  Null restores the text sink.
+         */
+        static void setSink(TraceSink *aSink);
+
+        /*!
+         * \brief write hands a message to the sink, one message at a time.
+         */
+        static void write(Category aCategory, const QString &aMessage);
+
+    protected:
+        /*! \cond internal */
+        static QAtomicInt ourCategories;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The TraceSink class receives trace messages.  Calls are serialized by Trace::write().
+     */
+    class TraceSink
+    {
+    public:
+        virtual ~TraceSink() {}
+        virtual void write(Trace::Category aCategory, const QString &aMessage) = 0;
+    };
+
+    /*!
+     * \brief The TextTraceSink class writes each message as a line of text, the way tracing always has.
+     */
+    class TextTraceSink : public TraceSink
+    {
+    public:
+        /*!
+         * \param aDevice Where lines go.  Null means stderr.
+         */
+        explicit TextTraceSink(QIODevice *aDevice = 0);
+        virtual void write(Trace::Category aCategory, const QString &aMessage);
+
+    protected:
+        /*! \cond internal */
+        QTextStream _stream;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The JsonTraceSink class writes each message as one line of JSON:
+     * {"ts":...,"category":"query","message":"..."}, with a monotonic timestamp in seconds.
+     */
+    class JsonTraceSink : public TraceSink
+    {
+    public:
+        /*!
+         * \param aDevice Where lines go.  Null means stderr.
+         */
+        explicit JsonTraceSink(QIODevice *aDevice = 0);
+        virtual ~JsonTraceSink();
+        virtual void write(Trace::Category aCategory, const QString &aMessage);
+
+    protected:
+        /*! \cond internal */
+        QIODevice *_device;
+        bool _ownsDevice;
+        QByteArray _line;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The TraceMessage class collects one message and writes it when it goes out of scope.
+     */
+    class TraceMessage
+    {
+    public:
+        explicit TraceMessage(Trace::Category aCategory) : _category(aCategory), _stream(&_text) {}
+        ~TraceMessage() { _stream.flush(); Trace::write(_category, _text); }
+
+        QTextStream &stream() { return _stream; }
+
+    private:
+        /*! \cond internal */
+        Trace::Category _category;
+        QString _text;
+        QTextStream _stream;
+        /*! \endcond */
+    };
+}
+
+#ifdef DS2_NO_TRACE
+#define DS2_TRACE_ENABLED(aCategory) false
+#else
+#define DS2_TRACE_ENABLED(aCategory) (DS2PlusPlus::Trace::isEnabled(DS2PlusPlus::Trace::aCategory))
+#endif
+
+/*!
+ * \brief Streams a trace message in a category, e.g. DS2_TRACE(Query) << "Returning: " << aFrame;
+ *
+ * Nothing after the macro is evaluated unless the category is switched on.
+ */
+#define DS2_TRACE(aCategory) \
+    if (!DS2_TRACE_ENABLED(aCategory)) {} else DS2PlusPlus::TraceMessage(DS2PlusPlus::Trace::aCategory).stream()
+
+#endif // TRACE_H
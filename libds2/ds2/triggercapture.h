@@ -0,0 +1,150 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRIGGERCAPTURE_H
+#define TRIGGERCAPTURE_H
+
+#include <QByteArray>
+#include <QContiguousCache>
+#include <QList>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The Trigger class is a condition on one data log channel, e.g. "DME:status:rpm > 6000".
+     *
+     * Comparisons (>, >=, <, <=, ==, !=) fire when the condition goes from false to true, so a threshold
+     * fires once per crossing rather than on every sample above it.  "<channel> changes" fires every time
+     * the value differs from the previous sample, which suits counters such as the number of stored DTCs.
+     */
+    class Trigger
+    {
+    public:
+        typedef enum {
+            Greater,
+            GreaterOrEqual,
+            Less,
+            LessOrEqual,
+            Equal,
+            NotEqual,
+            Changes
+        } Condition;
+
+        Trigger();
+
+        /*!
+         * \brief parse builds a trigger from an expression.  Throws std::invalid_argument if it can't be parsed.
+         */
+        static Trigger parse(const QString &anExpression);
+
+        /*!
+         * \brief evaluate feeds the channel's latest value to the trigger.
+         * \return true if the trigger fires on this value.
+         */
+        bool evaluate(const QVariant &aValue);
+
+        QString expression() const { return _expression; }
+        QString channel() const { return _channel; }
+        Condition condition() const { return _condition; }
+
+    protected:
+        /*! \cond internal */
+        bool isTrue(const QVariant &aValue) const;
+
+        QString _expression, _channel, _thresholdText;
+        Condition _condition;
+        double _threshold;
+        bool _thresholdIsNumeric, _wasTrue;
+        QVariant _last;
+        /*! \endcond */
+    };
+
+    /*!
+     * \brief The CapturedSample class is one data log row held by TriggerCapture.
+     */
+    class CapturedSample
+    {
+    public:
+        CapturedSample() : time(0), task(-1) {}
+
+        double time;
+        /*! \brief The job that produced this row, or -1. */
+        int task;
+        QVector<QVariant> values;
+        /*! \brief The raw reply the row was decoded from, if frames are being captured. */
+        QByteArray frame;
+    };
+
+    /*!
+     * \brief The TriggerCapture class keeps the last few seconds of a data log in memory and only lets it
+     * through when a trigger fires.
+     *
+     * Samples go into a ring buffer as they arrive.  When a trigger fires, everything in the buffer from the
+     * last \a aPreTrigger seconds is released, followed by every sample for the next \a aPostTrigger seconds.
+     * A trigger that fires during a post-trigger window extends it.  Released samples are collected with
+     * takeReady(); the rest are eventually overwritten.
+     */
+    class TriggerCapture
+    {
+    public:
+        /*!
+         * \param aCapacity The most samples the ring buffer holds.  It should cover \a aPreTrigger seconds
+         * at the expected sample rate; older samples are lost first if it doesn't.
+         */
+        TriggerCapture(double aPreTrigger, double aPostTrigger, int aCapacity);
+
+        /*!
+         * \brief addTrigger adds \a aTrigger, watching the channel of the same name in \a someChannels, the
+         * names of the values passed to add().  Throws std::invalid_argument for an unknown channel.
+         */
+        void addTrigger(const Trigger &aTrigger, const QStringList &someChannels);
+
+        /*!
+         * \brief add evaluates the triggers against \a aSample and either buffers or releases it.
+         * \return The triggers that fired on this sample.
+         */
+        QStringList add(const CapturedSample &aSample);
+
+        /*!
+         * \brief takeReady returns the samples released so far, oldest first, and forgets them.
+         */
+        QList<CapturedSample> takeReady();
+
+        bool isCapturing(double aTime) const { return aTime <= _postTriggerEnd; }
+        int buffered() const { return _buffer.count(); }
+        int capacity() const { return _buffer.capacity(); }
+
+    protected:
+        /*! \cond internal */
+        double _preTrigger, _postTrigger, _postTriggerEnd;
+        QContiguousCache<CapturedSample> _buffer;
+        QList<CapturedSample> _ready;
+        QList<Trigger> _triggers;
+        QList<int> _triggerChannels;
+        /*! \endcond */
+    };
+}
+
+#endif // TRIGGERCAPTURE_H
@@ -0,0 +1,106 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WINDOWAGGREGATOR_H
+#define WINDOWAGGREGATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+namespace DS2PlusPlus {
+    /*!
+     * \brief The WindowAggregator class reduces data log samples to one row per fixed time window.
+     *
+     * For each aggregated column the minimum, maximum, mean, sample count, and last value seen in the window
+     * are kept; only numeric samples count towards the minimum, maximum, and mean.  Windows are aligned to
+     * multiples of the window length.  Memory use is fixed by the number of columns, however many samples
+     * arrive.
+     */
+    class WindowAggregator
+    {
+    public:
+        /*!
+         * \param aWindow The window length in seconds.
+         * \param someColumns The columns of a data log row to aggregate.
+         */
+        WindowAggregator(double aWindow, const QVector<int> &someColumns);
+
+        /*!
+         * \return "Window Start", then name:min, name:max, name:mean, name:count, and name:last for every
+         * aggregated column, in the order row() fills them in.
+         */
+        QStringList headers(const QStringList &someChannels) const;
+
+        /*!
+         * \brief advance moves time forward to \a aTime.
+         * \return true if that closed a window with samples in it, in which case row() holds it.
+         */
+        bool advance(double aTime);
+
+        /*!
+         * \brief add counts fresh samples for the aggregated columns between \a aFirst and \a aLast.
+         */
+        void add(const QVector<QVariant> &someValues, int aFirst, int aLast);
+
+        /*!
+         * \brief flush closes the current window early, e.g. when logging stops.
+         * \return true if the window had samples in it, in which case row() holds it.
+         */
+        bool flush();
+
+        /*!
+         * \return The last closed window.  The vector is reused by the next window.
+         */
+        const QVector<QVariant> &row() const { return _row; }
+
+        double window() const { return _window; }
+        int columnCount() const { return _columns.size(); }
+
+        static const int VALUES_PER_COLUMN = 5;
+
+    protected:
+        /*! \cond internal */
+        class Statistics
+        {
+        public:
+            Statistics() : minimum(0), maximum(0), sum(0), numeric(0), count(0) {}
+
+            double minimum, maximum, sum;
+            quint64 numeric, count;
+            QVariant last;
+        };
+
+        void close();
+
+        double _window, _windowStart;
+        QVector<int> _columns, _slotByColumn;
+        QVector<Statistics> _statistics;
+        QVector<QVariant> _row;
+        bool _hasSamples;
+        /*! \endcond */
+    };
+}
+
+#endif // WINDOWAGGREGATOR_H
@@ -0,0 +1,168 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <string.h>
+
+#include <QStringList>
+
+#include <ds2/frame.h>
+#include <ds2/ds2packet.h>
+#include <ds2/kwppacket.h>
+
+namespace DS2PlusPlus {
+    Frame::Frame(BasePacket::ProtocolType aProtocol, quint8 aTargetAddress, quint8 aSourceAddress) :
+        _protocol(aProtocol), _targetAddress(aTargetAddress), _sourceAddress(aSourceAddress), _length(0)
+    {
+    }
+
+    Frame::Frame(BasePacket::ProtocolType aProtocol, quint8 aTargetAddress, const quint8 *somePayload, int aLength, quint8 aSourceAddress) :
+        _protocol(aProtocol), _targetAddress(aTargetAddress), _sourceAddress(aSourceAddress), _length(0)
+    {
+        setPayload(somePayload, aLength);
+    }
+
+    Frame Frame::fromPacket(const BasePacket &aPacket)
+    {
+        const PayloadView payload = aPacket.payload();
+        Frame ret(aPacket.protocol(), aPacket.targetAddress(), payload.constData(), payload.length());
+
+        if (aPacket.hasSourceAddress()) {
+            ret.setSourceAddress(aPacket.sourceAddress());
+        }
+
+        return ret;
+    }
+
+    BasePacketPtr Frame::toPacket() const
+    {
+        const QByteArray ourData(reinterpret_cast<const char *>(_payload), _length);
+
+        switch (_protocol) {
+        case BasePacket::ProtocolDS2:
+            return BasePacketPtr(new DS2Packet(_targetAddress, ourData));
+        case BasePacket::ProtocolKWP:
+            return BasePacketPtr(new KWPPacket(_targetAddress, _sourceAddress, ourData));
+        default:
+            throw std::invalid_argument("Unrecognized protocol type.");
+        }
+    }
+
+    int Frame::maxPayload(BasePacket::ProtocolType aProtocol)
+    {
+        return (aProtocol == BasePacket::ProtocolKWP) ? MAX_KWP_PAYLOAD : MAX_DS2_PAYLOAD;
+    }
+
+    void Frame::setProtocol(BasePacket::ProtocolType aProtocol)
+    {
+        if (_length > maxPayload(aProtocol)) {
+            QString errorString = QString("Payload of %1 bytes doesn't fit in a frame of that protocol.").arg(_length);
+            throw std::invalid_argument(qPrintable(errorString));
+        }
+
+        _protocol = aProtocol;
+    }
+
+    void Frame::setPayload(const quint8 *somePayload, int aLength)
+    {
+        resize(aLength);
+        if (aLength > 0) {
+            memcpy(_payload, somePayload, aLength);
+        }
+    }
+
+    void Frame::resize(int aLength)
+    {
+        if ((aLength < 0) or (aLength > maxPayload(_protocol))) {
+            QString errorString = QString("Payload of %1 bytes doesn't fit in a frame.").arg(aLength);
+            throw std::invalid_argument(qPrintable(errorString));
+        }
+
+        _length = aLength;
+    }
+
+    int Frame::frameLength() const
+    {
+        return (_protocol == BasePacket::ProtocolKWP) ? (_length + 5) : (_length + 3);
+    }
+
+    int Frame::headerPaddingLength() const
+    {
+        return (_protocol == BasePacket::ProtocolKWP) ? 2 : 0;
+    }
+
+    quint8 Frame::xorBytes(const quint8 *someBytes, int aLength, quint8 aSeed)
+    {
+        quint8 ret = aSeed;
+        for (int i=0; i < aLength; i++) {
+            ret ^= someBytes[i];
+        }
+        return ret;
+    }
+
+    quint8 Frame::checksum() const
+    {
+        quint8 ret;
+
+        if (_protocol == BasePacket::ProtocolKWP) {
+            ret = KWPPacket::KWP_MAGIC_BYTE ^ _targetAddress ^ _sourceAddress ^ static_cast<quint8>(_length);
+        } else {
+            ret = _targetAddress ^ static_cast<quint8>(_length + 3);
+        }
+
+        return xorBytes(_payload, _length, ret);
+    }
+
+    int Frame::serialize(quint8 *aBuffer) const
+    {
+        int i = 0;
+
+        if (_protocol == BasePacket::ProtocolKWP) {
+            aBuffer[i++] = KWPPacket::KWP_MAGIC_BYTE;
+            aBuffer[i++] = _targetAddress;
+            aBuffer[i++] = _sourceAddress;
+            aBuffer[i++] = _length;
+        } else {
+            aBuffer[i++] = _targetAddress;
+            aBuffer[i++] = _length + 3;
+        }
+
+        memcpy(aBuffer + i, _payload, _length);
+        i += _length;
+
+        aBuffer[i] = xorBytes(aBuffer, i);
+        return i + 1;
+    }
+
+    const QString Frame::toByteString() const
+    {
+        // Formatting is only used for tracing, so just borrow the packet classes' implementation.
+        return toPacket()->toByteString();
+    }
+}
+
+QTextStream &operator << (QTextStream &s, const DS2PlusPlus::Frame &aFrame)
+{
+    s << aFrame.toByteString();
+    return s;
+}
@@ -0,0 +1,513 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+#include <QIODevice>
+#include <QDebug>
+
+#include <ds2/jsonwriter.h>
+#include <ds2/operation.h>
+#include <ds2/allocationstats.h>
+
+namespace {
+    // Json::StyledWriter's layout constants
+    const int INDENT_SIZE = 3;
+    const int RIGHT_MARGIN = 74;
+
+    inline bool isControlCharacter(char ch)
+    {
+        return (ch > 0) and (ch <= 0x1F);
+    }
+
+    int digitCount(quint8 aValue)
+    {
+        return (aValue >= 100) ? 3 : ((aValue >= 10) ? 2 : 1);
+    }
+}
+
+namespace DS2PlusPlus {
+    KeyPathTree::KeyPathTree()
+    {
+        // Node 0 is always the root object
+        _nodes.append(Node());
+    }
+
+    KeyPathTree::KeyPathTree(const QStringList &someKeys)
+    {
+        _nodes.append(Node());
+
+        foreach (const QString &key, someKeys) {
+            insert(key);
+        }
+    }
+
+    KeyPathTree KeyPathTree::forOperation(const Operation &anOperation)
+    {
+        KeyPathTree ret;
+
+        foreach (const Result &result, anOperation.results()) {
+            ret.insert(result.name());
+
+            foreach (const QString &key, result.levelSlotKeys()) {
+                ret.insert(key);
+            }
+        }
+
+        return ret;
+    }
+
+    void KeyPathTree::insert(const QString &aKey)
+    {
+        const QStringList segments = aKey.split(".");
+        int current = 0;
+
+        for (int i=0; (i < segments.count() - 1) and (current >= 0); i++) {
+            // Same rule as ResponseToJson(): a container is an array if the segment after it is a number, unless
+            // that segment is the last container before the value.
+            bool nextIsNumber = false;
+            if (i < (segments.count() - 2)) {
+                segments.at(i+1).toUInt(&nextIsNumber);
+            }
+
+            current = findOrAddChild(current, segments.at(i), nextIsNumber);
+        }
+
+        if ((current < 0) or _nodes.at(current).isArray) {
+            // Values can't be stored directly in an array
+            return;
+        }
+
+        const int leaf = findOrAddChild(current, segments.last(), false);
+        if (leaf >= 0) {
+            _nodes[leaf].key = aKey;
+        }
+    }
+
+    int KeyPathTree::findOrAddChild(int aParent, const QString &aSegment, bool isArray)
+    {
+        const bool parentIsArray = _nodes.at(aParent).isArray;
+
+        Node child;
+        child.parent = aParent;
+        child.isArray = isArray;
+
+        if (parentIsArray) {
+            // Like Json::Value, anything that isn't a number ends up at index 0.
+            child.index = aSegment.toUInt();
+        } else {
+            child.name = aSegment.toUtf8();
+            JsonStreamWriter::appendQuoted(child.quotedName, child.name);
+        }
+
+        // Keep children in output order: by index for arrays, by name for objects.
+        const QVector<int> &children = _nodes.at(aParent).children;
+        int position = 0;
+        for (; position < children.count(); position++) {
+            const Node &sibling = _nodes.at(children.at(position));
+
+            if (parentIsArray ? (sibling.index == child.index) : (sibling.name == child.name)) {
+                return children.at(position);
+            }
+
+            if (parentIsArray ? (child.index < sibling.index) : (child.name < sibling.name)) {
+                break;
+            }
+        }
+
+        _nodes.append(child);
+        const int ret = _nodes.count() - 1;
+        _nodes[aParent].children.insert(position, ret);
+
+        return ret;
+    }
+
+    JsonStreamWriter::JsonStreamWriter(QIODevice *aDevice, Style aStyle) :
+        _device(aDevice), _target(0), _out(&_buffer), _style(aStyle)
+    {
+        _buffer.reserve(4096);
+    }
+
+    JsonStreamWriter::JsonStreamWriter(QByteArray *aBuffer, Style aStyle) :
+        _device(0), _target(aBuffer), _out(aBuffer), _style(aStyle)
+    {
+    }
+
+    void JsonStreamWriter::write(const PacketResponse &aResponse, const QString &aRootNode)
+    {
+        write(aResponse, KeyPathTree(aResponse.keys()), aRootNode);
+    }
+
+    void JsonStreamWriter::begin()
+    {
+        if (_device) {
+            _buffer.resize(0);
+        }
+    }
+
+    void JsonStreamWriter::end()
+    {
+        if (_device) {
+            _device->write(_buffer);
+        }
+    }
+
+    void JsonStreamWriter::prepare(const PacketResponse &aResponse, const KeyPathTree &aTree)
+    {
+        // Find which nodes have something to write so empty containers are left out, just like they would be
+        // if the response was built into a Json::Value.
+        const int count = aTree.nodeCount();
+        _values.resize(count);
+        _present.fill(0, count);
+
+        for (int i=count - 1; i >= 0; i--) {
+            const KeyPathTree::Node &node = aTree.node(i);
+
+            _values[i] = 0;
+            if (!node.key.isEmpty()) {
+                PacketResponse::const_iterator it = aResponse.constFind(node.key);
+                if (it != aResponse.constEnd()) {
+                    _values[i] = &it.value();
+                    _present[i] = 1;
+                }
+            }
+
+            if (_present.at(i) and (node.parent >= 0)) {
+                _present[node.parent] = 1;
+            }
+        }
+    }
+
+    void JsonStreamWriter::write(const PacketResponse &aResponse, const KeyPathTree &aTree, const QString &aRootNode)
+    {
+        begin();
+        prepare(aResponse, aTree);
+
+        const bool isPretty = (_style == StylePretty);
+        int depth = 0;
+
+        if (!aRootNode.isNull()) {
+            _out->append('{');
+            newline(1);
+            appendQuoted(*_out, aRootNode.toUtf8());
+            _out->append(isPretty ? " : " : ":");
+            depth = 1;
+        }
+
+        if (_present.at(0)) {
+            writeNode(aTree, 0, depth);
+        } else {
+            _out->append("null");
+        }
+
+        if (!aRootNode.isNull()) {
+            newline(0);
+            _out->append('}');
+        }
+
+        if (isPretty) {
+            _out->append('\n');
+        }
+
+        end();
+    }
+
+    void JsonStreamWriter::writeTransaction(const TransactionRecord &aRecord, const PacketResponse &aResponse, const KeyPathTree &aTree)
+    {
+        AllocationScope ourAllocations(AllocationStats::JsonOutput);
+        const Style ourStyle = _style;
+        _style = StyleCompact;
+
+        begin();
+        prepare(aResponse, aTree);
+
+        _out->append("{\"ts\":");
+        appendDouble(*_out, aRecord.timestamp);
+        _out->append(",\"ecu\":");
+        appendQuoted(*_out, aRecord.ecuUuid.toUtf8());
+        _out->append(",\"operation\":");
+        appendQuoted(*_out, aRecord.operation.toUtf8());
+        _out->append(",\"latency_ms\":");
+        appendDouble(*_out, aRecord.latency * 1000.0);
+        _out->append(",\"values\":");
+
+        if (_present.at(0)) {
+            writeNode(aTree, 0, 0);
+        } else {
+            _out->append("{}");
+        }
+
+        _out->append("}\n");
+        end();
+
+        _style = ourStyle;
+    }
+
+    void JsonStreamWriter::newline(int aDepth)
+    {
+        if (_style == StylePretty) {
+            _out->append('\n');
+            _out->append(QByteArray(aDepth * INDENT_SIZE, ' '));
+        }
+    }
+
+    void JsonStreamWriter::writeNode(const KeyPathTree &aTree, int aNode, int aDepth)
+    {
+        const QVariant *value = _values.at(aNode);
+
+        if (value) {
+            if (strcmp(value->typeName(), "QList<uchar>") == 0) {
+                writeList(value->value<QList<quint8> >(), aDepth);
+            } else {
+                appendVariant(*_out, *value);
+            }
+        } else if (aTree.node(aNode).isArray) {
+            writeArray(aTree, aTree.node(aNode), aDepth);
+        } else {
+            writeObject(aTree, aTree.node(aNode), aDepth);
+        }
+    }
+
+    void JsonStreamWriter::writeObject(const KeyPathTree &aTree, const KeyPathTree::Node &aNode, int aDepth)
+    {
+        bool isFirst = true;
+
+        foreach (const int child, aNode.children) {
+            if (!_present.at(child)) {
+                continue;
+            }
+
+            _out->append(isFirst ? '{' : ',');
+            isFirst = false;
+
+            newline(aDepth + 1);
+            _out->append(aTree.node(child).quotedName);
+            _out->append((_style == StylePretty) ? " : " : ":");
+            writeNode(aTree, child, aDepth + 1);
+        }
+
+        if (isFirst) {
+            _out->append("{}");
+        } else {
+            newline(aDepth);
+            _out->append('}');
+        }
+    }
+
+    void JsonStreamWriter::writeArray(const KeyPathTree &aTree, const KeyPathTree::Node &aNode, int aDepth)
+    {
+        // Every element of an array is a non-empty object, so StyledWriter always puts them on their own lines.
+        // Gaps in the indexes are filled with null.
+        int nextIndex = 0;
+
+        foreach (const int child, aNode.children) {
+            if (!_present.at(child)) {
+                continue;
+            }
+
+            const int index = aTree.node(child).index;
+            for (; nextIndex <= index; nextIndex++) {
+                _out->append((nextIndex == 0) ? '[' : ',');
+                newline(aDepth + 1);
+
+                if (nextIndex == index) {
+                    writeNode(aTree, child, aDepth + 1);
+                } else {
+                    _out->append("null");
+                }
+            }
+        }
+
+        if (nextIndex == 0) {
+            _out->append("[]");
+        } else {
+            newline(aDepth);
+            _out->append(']');
+        }
+    }
+
+    void JsonStreamWriter::writeList(const QList<quint8> &aList, int aDepth)
+    {
+        if (aList.isEmpty()) {
+            _out->append("[]");
+            return;
+        }
+
+        bool isMultiLine = false;
+        if (_style == StylePretty) {
+            isMultiLine = (aList.count() * 3 >= RIGHT_MARGIN);
+
+            int lineLength = 4 + (aList.count() - 1) * 2;
+            foreach (const quint8 value, aList) {
+                lineLength += digitCount(value);
+            }
+            isMultiLine = isMultiLine or (lineLength >= RIGHT_MARGIN);
+        }
+
+        char number[8];
+        for (int i=0; i < aList.count(); i++) {
+            if (i == 0) {
+                _out->append(((_style == StylePretty) and !isMultiLine) ? "[ " : "[");
+            } else {
+                _out->append(((_style == StylePretty) and !isMultiLine) ? ", " : ",");
+            }
+
+            if (isMultiLine) {
+                newline(aDepth + 1);
+            }
+
+            snprintf(number, sizeof(number), "%u", static_cast<unsigned int>(aList.at(i)));
+            _out->append(number);
+        }
+
+        if (isMultiLine) {
+            newline(aDepth);
+            _out->append(']');
+        } else {
+            _out->append((_style == StylePretty) ? " ]" : "]");
+        }
+    }
+
+    void JsonStreamWriter::appendQuoted(QByteArray &aBuffer, const QByteArray &aString)
+    {
+        aBuffer.append('"');
+
+        const char *string = aString.constData();
+        const int length = aString.length();
+
+        for (int i=0; i < length; i++) {
+            const char c = string[i];
+            switch (c) {
+            case '\"':
+                aBuffer.append("\\\"");
+                break;
+            case '\\':
+                aBuffer.append("\\\\");
+                break;
+            case '\b':
+                aBuffer.append("\\b");
+                break;
+            case '\f':
+                aBuffer.append("\\f");
+                break;
+            case '\n':
+                aBuffer.append("\\n");
+                break;
+            case '\r':
+                aBuffer.append("\\r");
+                break;
+            case '\t':
+                aBuffer.append("\\t");
+                break;
+            default:
+                if (isControlCharacter(c)) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04X", static_cast<int>(c));
+                    aBuffer.append(escaped);
+                } else {
+                    aBuffer.append(c);
+                }
+                break;
+            }
+        }
+
+        aBuffer.append('"');
+    }
+
+    void JsonStreamWriter::appendDouble(QByteArray &aBuffer, double aValue)
+    {
+        if (std::isnan(aValue)) {
+            aBuffer.append("null");
+        } else if (std::isinf(aValue)) {
+            aBuffer.append((aValue < 0) ? "-1e+9999" : "1e+9999");
+        } else {
+            char number[32];
+            snprintf(number, sizeof(number), "%.16g", aValue);
+            for (char *c = number; *c; c++) {
+                // Some locales use a comma as the decimal separator
+                if (*c == ',') {
+                    *c = '.';
+                }
+            }
+            aBuffer.append(number);
+        }
+    }
+
+    bool JsonStreamWriter::appendVariant(QByteArray &aBuffer, const QVariant &aValue)
+    {
+        char number[32];
+
+        switch (static_cast<int>(aValue.type())) {
+        case QMetaType::QString: {
+            const QString ourString = aValue.toString();
+            if (ourString.isEmpty()) {
+                aBuffer.append("null");
+            } else {
+                appendQuoted(aBuffer, ourString.toUtf8());
+            }
+            return true;
+        }
+        case QMetaType::Int:
+        case QMetaType::Long:
+        case QMetaType::LongLong:
+            snprintf(number, sizeof(number), "%lld", static_cast<long long>(aValue.toLongLong()));
+            aBuffer.append(number);
+            return true;
+        case QMetaType::UInt:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+            snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(aValue.toULongLong()));
+            aBuffer.append(number);
+            return true;
+        case QMetaType::Double:
+        case QMetaType::Float:
+            appendDouble(aBuffer, aValue.toDouble());
+            return true;
+        case QMetaType::Bool:
+            aBuffer.append(aValue.toBool() ? "true" : "false");
+            return true;
+        default:
+            break;
+        }
+
+        if (strcmp(aValue.typeName(), "QList<uchar>") == 0) {
+            const QList<quint8> ourList = aValue.value<QList<quint8> >();
+            aBuffer.append('[');
+            for (int i=0; i < ourList.count(); i++) {
+                if (i > 0) {
+                    aBuffer.append(',');
+                }
+                snprintf(number, sizeof(number), "%u", static_cast<unsigned int>(ourList.at(i)));
+                aBuffer.append(number);
+            }
+            aBuffer.append(']');
+            return true;
+        }
+
+        qDebug() << "Uknown variant type: " << aValue.typeName();
+        aBuffer.append("null");
+        return false;
+    }
+}
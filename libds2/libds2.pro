@@ -7,7 +7,7 @@
 VERSION = 0.8.0
 
 QT -= gui
-QT += sql
+QT += sql network
 
 CONFIG   += c++11
 
@@ -16,6 +16,12 @@ TEMPLATE = lib
 
 DEFINES += LIBDS2_LIBRARY LIBDS2_VERSION=\\\"$$VERSION\\\"
 
+# qmake CONFIG+=notrace removes every DS2_TRACE() statement from the library
+notrace: DEFINES += DS2_NO_TRACE
+
+# qmake CONFIG+=allocstats counts heap allocations per subsystem (see ds2/allocationstats.h); Linux only
+allocstats: DEFINES += DS2_ALLOCATION_STATS
+
 SOURCES += \
            ds2packet.cpp \
            controlunit.cpp \
@@ -24,7 +30,26 @@ SOURCES += \
            manager.cpp \
            dpp_v1_parser.cpp \
            basepacket.cpp \
-           kwppacket.cpp
+           kwppacket.cpp \
+           batchdecoder.cpp \
+           frame.cpp \
+           jsonwriter.cpp \
+           datalog.cpp \
+           asynclogwriter.cpp \
+           logscheduler.cpp \
+           triggercapture.cpp \
+           derivedchannel.cpp \
+           windowaggregator.cpp \
+           compressedlog.cpp \
+           trace.cpp \
+           busstatistics.cpp \
+           timeline.cpp \
+           allocationstats.cpp \
+           remote.cpp \
+           subscriptionhub.cpp \
+           responsecache.cpp \
+           sharedvalues.cpp \
+           decodepipeline.cpp
 
 HEADERS +=\
            ds2/ds2packet.h \
@@ -35,13 +60,36 @@ HEADERS +=\
            ds2/dpp_v1_parser.h \
            ds2/exceptions.h \
            ds2/basepacket.h \
-           ds2/kwppacket.h
+           ds2/kwppacket.h \
+           ds2/batchdecoder.h \
+           ds2/frame.h \
+           ds2/jsonwriter.h \
+           ds2/datalog.h \
+           ds2/spscqueue.h \
+           ds2/asynclogwriter.h \
+           ds2/logscheduler.h \
+           ds2/triggercapture.h \
+           ds2/derivedchannel.h \
+           ds2/windowaggregator.h \
+           ds2/compressedlog.h \
+           ds2/trace.h \
+           ds2/busstatistics.h \
+           ds2/timeline.h \
+           ds2/allocationstats.h \
+           ds2/remote.h \
+           ds2/subscriptionhub.h \
+           ds2/responsecache.h \
+           ds2/sharedvalues.h \
+           ds2/decodepipeline.h
 
 unix {
     target.path = /usr/lib
     INSTALLS += target
 }
 
+# shm_open lives in librt before glibc 2.17
+unix:!macx: LIBS += -lrt
+
 win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../jsoncpp/ -ljsoncpp
 else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../jsoncpp/ -ljsoncppd
 else:unix: LIBS += -L$$OUT_PWD/../jsoncpp/ -ljsoncpp
@@ -0,0 +1,298 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include <ds2/logscheduler.h>
+#include <ds2/frame.h>
+
+namespace {
+    // How much each measured transaction moves a task's cost estimate
+    const double COST_SMOOTHING = 0.2;
+
+    // How much each sample moves a channel's change rate
+    const double ACTIVITY_SMOOTHING = 0.2;
+
+    bool isNumeric(const QVariant &aValue)
+    {
+        switch (static_cast<QMetaType::Type>(aValue.type())) {
+        case QMetaType::Bool:
+        case QMetaType::Char:
+        case QMetaType::UChar:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::ULong:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Float:
+        case QMetaType::Double:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+namespace DS2PlusPlus {
+    ChannelActivity::ChannelActivity(double aDeadband) :
+        _deadband(aDeadband), _changeRate(1), _samples(0)
+    {
+    }
+
+    bool ChannelActivity::update(const QVariant &aValue)
+    {
+        if (!aValue.isValid()) {
+            return false;
+        }
+
+        bool isChanged;
+        if (!_reference.isValid()) {
+            isChanged = true;
+        } else if (isNumeric(aValue) and isNumeric(_reference)) {
+            isChanged = qAbs(aValue.toDouble() - _reference.toDouble()) > _deadband;
+        } else {
+            isChanged = (aValue != _reference);
+        }
+
+        // The first sample says nothing about how much the channel moves
+        if (_samples > 0) {
+            _changeRate += ACTIVITY_SMOOTHING * ((isChanged ? 1.0 : 0.0) - _changeRate);
+        }
+        _samples++;
+
+        if (isChanged) {
+            _reference = aValue;
+        }
+        return isChanged;
+    }
+
+    LogScheduler::LogScheduler() :
+        _isAdaptive(false), _minimumFactor(1), _maximumFactor(1), _adaptiveRatesAreValid(false)
+    {
+    }
+
+    int LogScheduler::addTask(const QString &aName, double aTargetRate, double aCost)
+    {
+        Task task;
+        task.name = aName;
+        task.targetRate = aTargetRate;
+        task.cost = aCost;
+
+        _tasks.append(task);
+        _adaptiveRatesAreValid = false;
+        return _tasks.size() - 1;
+    }
+
+    void LogScheduler::removeTask(int aTask)
+    {
+        _tasks.remove(aTask);
+        _adaptiveRatesAreValid = false;
+    }
+
+    void LogScheduler::setTargetRate(int aTask, double aTargetRate)
+    {
+        _tasks[aTask].targetRate = aTargetRate;
+        _adaptiveRatesAreValid = false;
+    }
+
+    void LogScheduler::setAdaptive(double aMinimumFactor, double aMaximumFactor)
+    {
+        if (aMinimumFactor <= 0) {
+            throw std::invalid_argument("The adaptive minimum rate factor must be greater than zero.");
+        }
+
+        _isAdaptive = true;
+        _minimumFactor = aMinimumFactor;
+        _maximumFactor = qMax(aMinimumFactor, aMaximumFactor);
+        _adaptiveRatesAreValid = false;
+    }
+
+    void LogScheduler::setActivity(int aTask, double anActivity)
+    {
+        _tasks[aTask].activity = qBound(0.0, anActivity, 1.0);
+        _adaptiveRatesAreValid = false;
+    }
+
+    void LogScheduler::planAdaptive() const
+    {
+        const int count = _tasks.size();
+        _adaptiveRates.resize(count);
+        _adaptiveRatesAreValid = true;
+
+        // Share out the bus time the targets would have used, never more than the whole bus.
+        double budget = qMin(1.0, utilization());
+        double base = 0;
+        for (int i=0; i < count; i++) {
+            _adaptiveRates[i] = _tasks.at(i).targetRate * _minimumFactor;
+            base += _adaptiveRates.at(i) * _tasks.at(i).cost;
+        }
+
+        if (base >= budget) {
+            const double scale = (base > 0) ? (budget / base) : 1;
+            for (int i=0; i < count; i++) {
+                _adaptiveRates[i] *= scale;
+            }
+            return;
+        }
+
+        // Fill the remaining time by activity, capping tasks at their maximum and handing what they
+        // couldn't use to the others.
+        double remaining = budget - base;
+        QVector<int> active;
+        for (int i=0; i < count; i++) {
+            if ((_tasks.at(i).activity > 0) and (_tasks.at(i).cost > 0) and (_maximumFactor > _minimumFactor)) {
+                active.append(i);
+            }
+        }
+
+        while (!active.isEmpty() and (remaining > 0)) {
+            double totalWeight = 0;
+            foreach (int i, active) {
+                totalWeight += _tasks.at(i).activity * _tasks.at(i).targetRate * _tasks.at(i).cost;
+            }
+            if (totalWeight <= 0) {
+                break;
+            }
+
+            QVector<int> stillActive;
+            double spent = 0;
+            foreach (int i, active) {
+                const Task &task = _tasks.at(i);
+                const double maximum = task.targetRate * _maximumFactor;
+                const double share = remaining * (task.activity * task.targetRate * task.cost) / totalWeight;
+
+                if (_adaptiveRates.at(i) + (share / task.cost) >= maximum) {
+                    spent += (maximum - _adaptiveRates.at(i)) * task.cost;
+                    _adaptiveRates[i] = maximum;
+                } else {
+                    stillActive.append(i);
+                }
+            }
+
+            if (stillActive.size() == active.size()) {
+                // Nobody hit their cap, so everyone takes their full share.
+                foreach (int i, active) {
+                    const Task &task = _tasks.at(i);
+                    _adaptiveRates[i] += remaining * (task.activity * task.targetRate * task.cost) / totalWeight / task.cost;
+                }
+                break;
+            }
+
+            remaining -= spent;
+            active = stillActive;
+        }
+    }
+
+    double LogScheduler::utilization() const
+    {
+        double ret = 0;
+        foreach (const Task &task, _tasks) {
+            ret += task.targetRate * task.cost;
+        }
+        return ret;
+    }
+
+    double LogScheduler::plannedRate(int aTask) const
+    {
+        if (_isAdaptive) {
+            if (!_adaptiveRatesAreValid) {
+                planAdaptive();
+            }
+            return _adaptiveRates.at(aTask);
+        }
+
+        return _tasks.at(aTask).targetRate / qMax(1.0, utilization());
+    }
+
+    void LogScheduler::start(double aNow)
+    {
+        for (int i=0; i < _tasks.size(); i++) {
+            _tasks[i].nextDue = aNow;
+        }
+    }
+
+    int LogScheduler::next(double aNow, double &aWait) const
+    {
+        int ret = -1;
+        for (int i=0; i < _tasks.size(); i++) {
+            if ((plannedRate(i) > 0) and ((ret < 0) or (_tasks.at(i).nextDue < _tasks.at(ret).nextDue))) {
+                ret = i;
+            }
+        }
+
+        aWait = (ret < 0) ? 0 : qMax(0.0, _tasks.at(ret).nextDue - aNow);
+        return ret;
+    }
+
+    void LogScheduler::completed(int aTask, double aStart, double aDuration)
+    {
+        Task &task = _tasks[aTask];
+
+        task.cost += COST_SMOOTHING * (aDuration - task.cost);
+        _adaptiveRatesAreValid = false;
+        task.runs++;
+        if (task.firstRun < 0) {
+            task.firstRun = aStart;
+        }
+        task.lastRun = aStart;
+
+        // Plan with the updated cost so the other tasks see it too
+        const double period = 1.0 / plannedRate(aTask);
+        task.nextDue += period;
+        if (task.nextDue < aStart) {
+            task.nextDue = aStart + period;
+        }
+    }
+
+    double LogScheduler::achievedRate(int aTask) const
+    {
+        const Task &task = _tasks.at(aTask);
+        if ((task.runs < 2) or (task.lastRun <= task.firstRun)) {
+            return 0;
+        }
+        return (task.runs - 1) / (task.lastRun - task.firstRun);
+    }
+
+    int LogScheduler::expectedReplyLength(const Operation &anOperation)
+    {
+        int payloadLength = 0;
+        foreach (const Result &result, anOperation.results()) {
+            payloadLength = qMax(payloadLength, result.startPosition() + result.length());
+        }
+
+        Frame reply(anOperation.protocol());
+        reply.resize(qMin(payloadLength, Frame::maxPayload(anOperation.protocol())));
+        return reply.frameLength() + reply.headerPaddingLength();
+    }
+
+    double LogScheduler::estimateCost(const Operation &anOperation, double aTurnaround, int aBaudRate)
+    {
+        // A request we can't frame still takes at least as long as the smallest one
+        const int requestLength = qMax(anOperation.encodedRequestLength(), 4);
+        const int bytes = requestLength + expectedReplyLength(anOperation);
+        return (static_cast<double>(bytes) * BITS_PER_BYTE / aBaudRate) + aTurnaround;
+    }
+}
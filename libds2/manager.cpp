@@ -27,6 +27,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <iostream>
@@ -36,6 +37,7 @@
 #include <QSharedPointer>
 #include <QCommandLineParser>
 #include <QUuid>
+#include <QElapsedTimer>
 
 #include <QPluginLoader>
 #include <QSqlDriverPlugin>
@@ -51,21 +53,31 @@
 #include <ds2/manager.h>
 #include <ds2/dpp_v1_parser.h>
 #include <ds2/kwppacket.h>
+#include <ds2/frame.h>
+#include <ds2/trace.h>
+#include <ds2/timeline.h>
+#include <ds2/allocationstats.h>
 
-QByteArray readBytes(int fd, int length)
+/*
+ * Reads exactly aLength bytes into aBuffer, timing out after a few quiet intervals.  Doesn't allocate,
+ * so it can be used from the Frame based query path.  Every quiet interval that is waited out and tried
+ * again is added to aRetries, if given.
+ */
+int readInto(int fd, quint8 *aBuffer, int aLength, int *aRetries = 0)
 {
-    QByteArray ret;
     fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
-
     struct timeval tv;
     tv.tv_sec = 0;
     tv.tv_usec = 500000;
 
     int remainingTimeouts = 5;
+    int ret = 0;
+
+    while (ret < aLength) {
+        // select() leaves only the ready descriptors in the set, so a timeout empties it
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
 
-    while (ret.length() < length) {
         switch(select(fd+1, &fds, NULL, NULL, &tv)) {
         case 0:
             // reset timeout
@@ -74,6 +86,9 @@ QByteArray readBytes(int fd, int length)
             if (--remainingTimeouts == 0) {
                 throw DS2PlusPlus::TimeoutException();
             }
+            if (aRetries) {
+                (*aRetries)++;
+            }
             break;
         case -1:
             throw std::runtime_error(strerror(errno));
@@ -85,7 +100,7 @@ QByteArray readBytes(int fd, int length)
                 QString errorString = QString("Didn't read the byte we were expecting.  Error: %1").arg(strerror(errno));
                 throw std::runtime_error(qPrintable(errorString));
             }
-            ret.append(byte);
+            aBuffer[ret++] = byte;
             break;
         }
 
@@ -98,6 +113,29 @@ bool fd_is_valid(int fd)
     return fcntl(fd, F_GETFD) != -1 || errno != EBADF;
 }
 
+/*
+ * Adds aValue to the same counter in each of the (up to two) statistics given: the ECU address's and,
+ * when the caller passed one, the operation's.
+ */
+template <typename T>
+void countInto(DS2PlusPlus::TransactionStatistics *const someStatistics[2], QAtomicInteger<T> DS2PlusPlus::TransactionStatistics::*aCounter, T aValue)
+{
+    for (int i=0; i < 2; i++) {
+        if (someStatistics[i]) {
+            (someStatistics[i]->*aCounter).fetchAndAddRelaxed(aValue);
+        }
+    }
+}
+
+void recordInto(DS2PlusPlus::TransactionStatistics *const someStatistics[2], DS2PlusPlus::LatencyHistogram DS2PlusPlus::TransactionStatistics::*aHistogram, qint64 aNanoseconds)
+{
+    for (int i=0; i < 2; i++) {
+        if (someStatistics[i]) {
+            (someStatistics[i]->*aHistogram).record(aNanoseconds / 1000);
+        }
+    }
+}
+
 namespace DS2PlusPlus {
     QTextStream qOut(stdout);
     QTextStream qErr(stderr);
@@ -137,6 +175,11 @@ namespace DS2PlusPlus {
                       "device");
             aParser->addOption(devicePathOption);
 
+            QCommandLineOption sharedValuesOption("shm",
+                      "Publish the latest decoded results to the named POSIX shared memory segment.",
+                      "name");
+            aParser->addOption(sharedValuesOption);
+
         } else {
             initializeManager();
         }
@@ -176,6 +219,10 @@ namespace DS2PlusPlus {
             this->_dppSourceDir = _cliParser->value("dpp-source-dir");
         }
 
+        if (!_cliParser.isNull() and _cliParser->isSet("shm")) {
+            _sharedValues = QSharedPointer<SharedValueWriter>(new SharedValueWriter(_cliParser->value("shm")));
+        }
+
         QString dppDbPath = QString("%1%2%3").arg(dppDir()).arg(QDir::separator()).arg(DPP_DB_PATH);
         _db.setDatabaseName(expandTilde(dppDbPath));
 
@@ -278,102 +325,148 @@ namespace DS2PlusPlus {
 
     BasePacketPtr Manager::query(BasePacketPtr aPacket)
     {
-        // TODO: Move this into the schema so we can set timing per ECU
-        bool slowEcu = (aPacket->targetAddress() == 0xA4); // Slow down even more for the air bag control unit.  UGH.
-
-        if (!fd_is_valid(_fd)) {
-            throw std::ios_base::failure("Serial port is not open.");
-        }
-
-        BasePacketPtr ret;
+        AllocationScope ourAllocations(AllocationStats::PacketIO);
         switch (aPacket->protocol()) {
         case BasePacket::ProtocolDS2:
-            ret = BasePacketPtr(new DS2Packet);
-            break;
         case BasePacket::ProtocolKWP:
-            ret = BasePacketPtr(new KWPPacket);
             break;
         default:
             throw std::invalid_argument("Unrecognized protocol type.");
         }
 
-        // Send query to the ECU
-        QByteArray ourBA = static_cast<QByteArray>(*aPacket);
+        Frame ourResponse;
+        query(Frame::fromPacket(*aPacket), ourResponse);
 
-        int written = write(_fd, ourBA.data(), ourBA.size());
-        if (written != ourBA.size()) {
-            qDebug() << "Didn't write all " << written << " vs " << ourBA.size() << " Error: " << strerror(errno);
-            return ret;
+        return ourResponse.toPacket();
+    }
+
+    void Manager::query(const Frame &aRequest, Frame &aResponse)
+    {
+        quint8 ourRequest[Frame::MAX_FRAME];
+        const int ourLength = aRequest.serialize(ourRequest);
+
+        queryEncoded(ourRequest, ourLength, aRequest.protocol(), aResponse);
+    }
+
+    void Manager::queryEncoded(const quint8 *aRequest, int aLength, BasePacket::ProtocolType aProtocol, Frame &aResponse, TransactionStatistics *anOperationStatistics)
+    {
+        const bool hasSourceAddress = (aProtocol == BasePacket::ProtocolKWP);
+        const quint8 targetAddress = hasSourceAddress ? aRequest[1] : aRequest[0];
+        const quint8 sourceAddress = hasSourceAddress ? aRequest[2] : 0xF1;
+
+        // TODO: Move this into the schema so we can set timing per ECU
+        bool slowEcu = (targetAddress == 0xA4); // Slow down even more for the air bag control unit.  UGH.
+
+        if (!fd_is_valid(_fd)) {
+            throw std::ios_base::failure("Serial port is not open.");
         }
 
-        // Read the echo back.  We should check to see if it matches, maybe...
-        usleep(slowEcu ? 250000 : 80000);
-        if (readBytes(_fd, ourBA.size()).size() != ourBA.size()) {
-            throw std::ios_base::failure("Error reading the echo echo echo echo...");
+        if (aLength > Frame::MAX_FRAME) {
+            throw std::invalid_argument("Request is longer than the largest possible frame.");
         }
 
-        // Read the initial header
-        quint8 ecuAddress;
-        quint8 length;
+        aResponse = Frame(aProtocol);
 
-        QByteArray inputArray, expectedInput = aPacket->expectedHeaderPadding();
+        AllocationScope ourAllocations(AllocationStats::PacketIO);
+        TransactionStatistics *const ourStatistics[2] = { _statistics.forAddress(targetAddress), anOperationStatistics };
+        countInto<quint64>(ourStatistics, &TransactionStatistics::transactions, 1);
 
-        if (!expectedInput.isEmpty()) {
-            inputArray = readBytes(_fd, expectedInput.length());
-            usleep(slowEcu ? 250000 : 12500);
-            if (expectedInput != inputArray) {
-                qDebug() << "Got unexpected input";
-            }
-            // Should be reading in 0xB8 as our header and F1 as our target address
-        }
+        QElapsedTimer ourTimer;
+        ourTimer.start();
+        int ourRetries = 0;
 
-        inputArray = readBytes(_fd, 2);
-        usleep(slowEcu ? 250000 : 12500);
+        // One span per phase, back to back, so gaps in a timeline are time spent outside the query.
+        TimelineSpan ourPhase("write", "bus", targetAddress);
 
-        if (inputArray.length() != 2) {
-            QString errorString = QString("Wanted length 2, got: %1").arg(inputArray.length());
-            throw std::ios_base::failure(qPrintable(errorString));
-        }
+        try {
+            // Send query to the ECU
+            quint8 ourBuffer[Frame::MAX_FRAME];
 
-        ecuAddress = inputArray.at(0);
-        ret->setTargetAddress(ecuAddress);
-        length = inputArray.at(1);
+            int written = write(_fd, aRequest, aLength);
+            if (written != aLength) {
+                qDebug() << "Didn't write all " << written << " vs " << aLength << " Error: " << strerror(errno);
+                return;
+            }
+            countInto<quint64>(ourStatistics, &TransactionStatistics::bytesOut, written);
+
+            // Read the echo back.  A mismatch is only counted, the reply that follows is still read.
+            ourPhase.next("echo sleep");
+            usleep(slowEcu ? 250000 : 80000);
+            ourPhase.next("echo read");
+            if (readInto(_fd, ourBuffer, aLength, &ourRetries) != aLength) {
+                throw std::ios_base::failure("Error reading the echo echo echo echo...");
+            }
+            if (memcmp(ourBuffer, aRequest, aLength) != 0) {
+                countInto<quint32>(ourStatistics, &TransactionStatistics::echoErrors, 1);
+            }
 
-        if ((length < 4) && (!aPacket->hasSourceAddress())) {
-            QString errorString = QString("Ack. Got garbage data, length must be >= 4.  Got ECU: %1, LEN: %2").arg(QString::number(ecuAddress, 16)).arg(QString::number(length, 16));
-            throw std::ios_base::failure(qPrintable(errorString));
-        }
+            // The fixed echo sleep would swamp the ECU's own turnaround, so the first byte is timed from here
+            QElapsedTimer ourReplyTimer;
+            ourReplyTimer.start();
+
+            // Read the initial header
+            quint8 ecuAddress;
+            quint8 length;
+
+            const int expectedPadding = aResponse.headerPaddingLength();
+            if (expectedPadding > 0) {
+                // Should be reading in 0xB8 as our header and F1 as our target address
+                ourPhase.next("header wait");
+                readInto(_fd, ourBuffer, expectedPadding, &ourRetries);
+                recordInto(ourStatistics, &TransactionStatistics::firstByte, ourReplyTimer.nsecsElapsed());
+                ourPhase.next("header sleep");
+                usleep(slowEcu ? 250000 : 12500);
+                if ((ourBuffer[0] != KWPPacket::KWP_MAGIC_BYTE) or (ourBuffer[1] != sourceAddress)) {
+                    qDebug() << "Got unexpected input";
+                }
+            }
 
-        if (aPacket->hasSourceAddress()) {
-            inputArray = readBytes(_fd, length + 1);
-            if (inputArray.length() != (length + 1 )) {
-                qDebug() << "Packet specified length, but we read back a different amount of data.";
+            ourPhase.next("header wait");
+            readInto(_fd, ourBuffer, 2, &ourRetries);
+            if (expectedPadding <= 0) {
+                recordInto(ourStatistics, &TransactionStatistics::firstByte, ourReplyTimer.nsecsElapsed());
             }
-        } else {
-            inputArray = readBytes(_fd, length - 2);
-            if (inputArray.length() != (length - 2)) {
-                qDebug() << "Packet specified length, but we read back a different amount of data.";
+            ourPhase.next("header sleep");
+            usleep(slowEcu ? 250000 : 12500);
+
+            ecuAddress = ourBuffer[0];
+            aResponse.setTargetAddress(ecuAddress);
+            length = ourBuffer[1];
+
+            if ((length < 4) && (!hasSourceAddress)) {
+                QString errorString = QString("Ack. Got garbage data, length must be >= 4.  Got ECU: %1, LEN: %2").arg(QString::number(ecuAddress, 16)).arg(QString::number(length, 16));
+                throw std::ios_base::failure(qPrintable(errorString));
             }
-        }
 
-        // Copy in all but the checksum.
-        ret->setData(inputArray.mid(0, inputArray.length() - 1));
+            // Whatever is left is the payload followed by the checksum.
+            const int remaining = hasSourceAddress ? (length + 1) : (length - 2);
+            ourPhase.next("body read");
+            readInto(_fd, ourBuffer, remaining, &ourRetries);
 
-        // Verify the checksum
-        unsigned char realChecksum = inputArray.at(inputArray.length() - 1);
-#if 0
-        qDebug() << QString("Checksum A: 0x%1").arg(ret->checksum(), 2, 16, QChar('0'));
-        qDebug() << QString("Checksum B: 0x%1").arg(realChecksum, 2, 16, QChar('0'));
-#endif
+            recordInto(ourStatistics, &TransactionStatistics::transaction, ourTimer.nsecsElapsed());
+            countInto<quint64>(ourStatistics, &TransactionStatistics::bytesIn, qMax(expectedPadding, 0) + 2 + remaining);
+            countInto<quint32>(ourStatistics, &TransactionStatistics::retries, ourRetries);
 
-        if (ret->checksum() != realChecksum) {
-            qDebug() << QString("Checksum mismatch at ECU: %1").arg(ecuAddress, 2, 16, QChar('0'));
-        }
+            // Copy in all but the checksum.
+            ourPhase.next("checksum");
+            aResponse.setPayload(ourBuffer, remaining - 1);
 
-        if (getenv("DPP_TRACE_QUERY")) {
-            qErr << "Returning: " << ret << endl;
+            // Verify the checksum
+            unsigned char realChecksum = ourBuffer[remaining - 1];
+
+            if (aResponse.checksum() != realChecksum) {
+                countInto<quint32>(ourStatistics, &TransactionStatistics::checksumErrors, 1);
+                qDebug() << QString("Checksum mismatch at ECU: %1").arg(ecuAddress, 2, 16, QChar('0'));
+            }
+        } catch (TimeoutException) {
+            countInto<quint32>(ourStatistics, &TransactionStatistics::timeouts, 1);
+            countInto<quint32>(ourStatistics, &TransactionStatistics::retries, ourRetries);
+            // An ECU that stops answering has most likely been switched off; it may come back as something else.
+            _responseCache.invalidate(targetAddress);
+            throw;
         }
-        return ret;
+
+        DS2_TRACE(Query) << "Returning: " << aResponse;
     }
 
     QSqlDatabase Manager::sqlDatabase() const {
@@ -381,85 +474,82 @@ namespace DS2PlusPlus {
     }
 
     ControlUnitPtr Manager::findModuleAtAddress(quint8 anAddress) {
-        if (getenv("DPP_TRACE")) {
-            qDebug() << "ControlUnitPtr Manager::findModuleAtAddress(" << anAddress << ")";
+        AllocationScope ourAllocations(AllocationStats::DefinitionLoad);
+        DS2_TRACE(General) << "ControlUnitPtr Manager::findModuleAtAddress(" << anAddress << ")";
+
+        // Which module answered at this address, as long as its identify operation allows
+        PacketResponse ourIdentity;
+        if (_responseCache.find(anAddress, QString::null, "identify", ourIdentity)) {
+            DS2_TRACE(General) << "-- Identified from the response cache";
+            ControlUnitPtr ret(new ControlUnit(ourIdentity.value("uuid").toString(), this));
+            ret->setMatchFlags(ourIdentity.value("match_flags").toUInt());
+            return ret;
         }
 
         BasePacketPtr ourSentPacket(new DS2Packet(anAddress, QByteArray((int)1, static_cast<quint8>(0x00))));
-        if (getenv("DPP_TRACE")) {
-            qDebug() << ">> QUERY: " << *ourSentPacket;
-        }
+        DS2_TRACE(General) << ">> QUERY: " << *ourSentPacket;
 
         BasePacketPtr ourReceivedPacket;
         try {
             ourReceivedPacket = query(ourSentPacket);
         } catch (TimeoutException) {
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "-- Timeout reading DS2";
-            }
+            DS2_TRACE(General) << "-- Timeout reading DS2";
         }
 
         if (ourReceivedPacket.isNull()) {
             // TODO: Scan the database for KWP ECUs at this address.
             if ((anAddress == 0x12) || (anAddress = 0x29)) {
-                if (getenv("DPP_TRACE")) {
-                    qDebug() << "-- Let's try KWP-2000";
-                }
+                DS2_TRACE(General) << "-- Let's try KWP-2000";
 
                 ourSentPacket = BasePacketPtr(new KWPPacket(anAddress, static_cast<unsigned char>(0xF1) /* laptop fixed addy*/, QByteArray((int)1, static_cast<unsigned char>(0xA2))));
                 try {
                     ourReceivedPacket = query(ourSentPacket);
                 } catch (TimeoutException) {
-                    if (getenv("DPP_TRACE")) {
-                        qDebug() << "-- Timeout with KWP.";
-                    }
+                    DS2_TRACE(General) << "-- Timeout with KWP.";
                 }
             }
         }
 
         if (ourReceivedPacket.isNull()) {
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "Read null";
-            }
+            DS2_TRACE(General) << "Read null";
             return ControlUnitPtr();
         }
 
-        if (getenv("DPP_TRACE")) {
-            qDebug() << "<< IDENT: " << *ourReceivedPacket;
-        }
+        DS2_TRACE(General) << "<< IDENT: " << *ourReceivedPacket;
 
-        return findModuleByMatchingIdentPacket(ourReceivedPacket);
+        ControlUnitPtr ret = findModuleByMatchingIdentPacket(ourReceivedPacket);
+        if (!ret.isNull() and ret->operations().contains("identify")) {
+            ourIdentity.insert("uuid", ret->uuid());
+            ourIdentity.insert("match_flags", static_cast<uint>(ret->matchFlags()));
+            _responseCache.insert(anAddress, QString::null, "identify", ourIdentity, ret->operations().value("identify")->cacheTtl());
+        }
+        return ret;
     }
 
     ControlUnitPtr Manager::findModuleByMatchingIdentPacket(const BasePacketPtr aPacket) {
+        AllocationScope ourAllocations(AllocationStats::DefinitionLoad);
         ControlUnitPtr ret;
         QHash<QString, ControlUnitPtr> modules;
         QHash<QString, ControlUnitPtr>::Iterator moduleIt;
         quint8 fullMatch = ControlUnit::MatchNone;
         QString ourKey;
 
-        if (getenv("DPP_TRACE")) {
-            qDebug() << "Here";
-        }
+        DS2_TRACE(General) << "Here";
         modules = findAllModulesByAddress(aPacket->targetAddress());
         for (moduleIt = modules.begin(); moduleIt != modules.end(); ++moduleIt) {
             ControlUnitPtr ecu(moduleIt.value());
 
             if (ecu->partNumbers().isEmpty() and ecu->diagIndexes().isEmpty()) {
-                if (getenv("DPP_TRACE")) {
-                    qDebug() << "Skipping " << ecu->name() << " because there are no part numbers or diag indexes";
-                }
+                DS2_TRACE(General) << "Skipping " << ecu->name() << " because there are no part numbers or diag indexes";
                 continue;
             }
 
             PacketResponse response(ecu->parseOperation("identify", aPacket));
-            if (getenv("DPP_TRACE")) {
-                qDebug() << "Checking " << ecu->name();
-            }
+            DS2_TRACE(General) << "Checking " << ecu->name();
 
             bool pnMatch = ecu->partNumbers().contains(response.value("part_number").toULongLong());
 
-            if (!pnMatch and getenv("DPP_TRACE")) {
+            if (!pnMatch and DS2_TRACE_ENABLED(General)) {
                 QStringList acceptableList;
                 foreach (quint64 acceptable_pn, ecu->partNumbers()) {
                     acceptableList.append(QString::number(acceptable_pn));
@@ -469,7 +559,7 @@ namespace DS2PlusPlus {
                 QString matchString = QString("Part number mismatch. Got %1, needed %2")
                                         .arg(response.value("part_number").toULongLong())
                                         .arg(acceptableList.join(", "));
-                qDebug() << matchString;
+                DS2_TRACE(General) << matchString;
             }
 
             quint64 diag_index = 0;
@@ -478,7 +568,7 @@ namespace DS2PlusPlus {
             }
 
             bool diMatch = ((response.contains("diag_index") and !ecu->diagIndexes().isEmpty() and ecu->diagIndexes().contains(diag_index)) or (pnMatch and ecu->diagIndexes().isEmpty()));
-            if (!diMatch and getenv("DPP_TRACE")) {
+            if (!diMatch and DS2_TRACE_ENABLED(General)) {
                 QStringList acceptableList;
                 foreach (quint64 acceptable_di, ecu->diagIndexes()) {
                     acceptableList.append(QString::number(acceptable_di));
@@ -488,7 +578,7 @@ namespace DS2PlusPlus {
                 QString matchString = QString("Diag index mismatch. Got %1, needed %2")
                                         .arg(diag_index)
                                         .arg(acceptableList.join(", "));
-                qDebug() << matchString;
+                DS2_TRACE(General) << matchString;
             }
 
             quint64 reportedSW = response.value("software_number").toString().toULongLong(NULL, 16);
@@ -508,9 +598,7 @@ namespace DS2PlusPlus {
                     QString matchString = QString("SW version mismatch %1 != expected 0x%2")
                                             .arg(response.value("software_number").toString())
                                             .arg(ecu->softwareNumber(), 2, 16, QChar('0'));
-                    if (getenv("DPP_TRACE")) {
-                        qDebug() << matchString;
-                    }
+                    DS2_TRACE(General) << matchString;
                 }
 
                 quint64 actualHW = response.value("hardware_number").toString().toULongLong(NULL, 16);
@@ -746,6 +834,7 @@ namespace DS2PlusPlus {
 
     void Manager::initializeDatabase()
     {
+        AllocationScope ourAllocations(AllocationStats::DefinitionLoad);
         if (!_db.tables().contains("modules")) {
             qDebug() << "Need to create modules table";
             QSqlQuery query(_db);
@@ -817,6 +906,7 @@ namespace DS2PlusPlus {
                                       "name      VARCHAR NOT NULL,\n"                    \
                                       "command   BLOB,\n"                                \
                                       "parent_id BLOB,\n"                                \
+                                      "cache_ttl REAL,\n"                                \
                                       "UNIQUE (module_id, name),\n"                      \
                                       "CHECK ((CASE WHEN command IS NOT NULL THEN 1 ELSE 0 END + CASE WHEN parent_id IS NOT NULL THEN 1 ELSE 0 END) >= 1)," \
                                       "CHECK (uuid <> '')\n"                             \
@@ -826,6 +916,13 @@ namespace DS2PlusPlus {
                 QString errorString = QString("Problem creating the operations table: %1").arg(query.lastError().driverText());
                 throw std::runtime_error(qPrintable(errorString));
             }
+        } else if (_db.record("operations").indexOf("cache_ttl") < 0) {
+            // Databases built before operations could declare a TTL
+            QSqlQuery query(_db);
+            if (!query.exec("ALTER TABLE operations ADD COLUMN cache_ttl REAL")) {
+                QString errorString = QString("Problem adding cache_ttl to the operations table: %1").arg(query.lastError().driverText());
+                throw std::runtime_error(qPrintable(errorString));
+            }
         }
 
         if (!_db.tables().contains("results")) {
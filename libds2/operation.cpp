@@ -31,8 +31,9 @@
 namespace DS2PlusPlus {
 
     Operation::Operation (const QString &aUuid, quint8 aControlUnitAddress, const QString &aName, const QByteArray &aCommand, BasePacket::ProtocolType aProtocol)
-        : _uuid(aUuid), _name(aName), _controlUnitAddress(aControlUnitAddress), _command(aCommand), _protocol(aProtocol)
+        : _uuid(aUuid), _name(aName), _controlUnitAddress(aControlUnitAddress), _command(aCommand), _protocol(aProtocol), _cacheTtl(-1), _encodedRequestLength(0), _commandOffset(0), _keyPathTreeIsValid(false)
     {
+        encodeRequest();
     }
 
     const QString Operation::uuid() const
@@ -69,6 +70,7 @@ namespace DS2PlusPlus {
     void Operation::setCommand(const QByteArray &aCommand)
     {
         _command = aCommand;
+        encodeRequest();
     }
 
     const QHash<QString, Result> Operation::results() const
@@ -79,6 +81,17 @@ namespace DS2PlusPlus {
     void Operation::insertResult(const QString &aName, const Result aResult)
     {
         _results.insert(aName, aResult);
+        _keyPathTreeIsValid = false;
+    }
+
+    const KeyPathTree &Operation::keyPathTree() const
+    {
+        if (!_keyPathTreeIsValid) {
+            _keyPathTree = KeyPathTree::forOperation(*this);
+            _keyPathTreeIsValid = true;
+        }
+
+        return _keyPathTree;
     }
 
     BasePacket::ProtocolType Operation::protocol() const
@@ -101,8 +114,73 @@ namespace DS2PlusPlus {
         }
     }
 
+    Frame Operation::queryFrame() const
+    {
+        switch (_protocol) {
+        case BasePacket::ProtocolDS2:
+        case BasePacket::ProtocolKWP:
+            return Frame(_protocol, _controlUnitAddress, reinterpret_cast<const quint8 *>(_command.constData()), _command.length(), 0xF1);
+        default:
+            throw std::invalid_argument("Invalid protocol.");
+        }
+    }
+
     void Operation::setAddress(quint8 anAddress)
     {
         _controlUnitAddress = anAddress;
+        encodeRequest();
+    }
+
+    void Operation::encodeRequest()
+    {
+        _encodedRequestLength = 0;
+        _commandOffset = 0;
+
+        if (((_protocol != BasePacket::ProtocolDS2) and (_protocol != BasePacket::ProtocolKWP)) or (_command.length() > Frame::maxPayload(_protocol))) {
+            // queryFrame() will complain if anyone actually tries to use this operation.
+            return;
+        }
+
+        const Frame ourFrame = queryFrame();
+        _encodedRequestLength = ourFrame.serialize(_encodedRequest);
+        _commandOffset = _encodedRequestLength - _command.length() - 1;
+    }
+
+    const quint8 *Operation::encodedRequest() const
+    {
+        if (_encodedRequestLength == 0) {
+            throw std::invalid_argument(qPrintable(QString("Operation '%1' can't be encoded.").arg(_name)));
+        }
+
+        return _encodedRequest;
+    }
+
+    int Operation::encodedRequestLength() const
+    {
+        return _encodedRequestLength;
+    }
+
+    void Operation::setParameter(int aPosition, const quint8 *someBytes, int aLength)
+    {
+        if ((aPosition < 0) or (aLength < 0) or (aPosition + aLength > _command.length())) {
+            QString errorString = QString("Parameter at %1 (%2 bytes) doesn't fit in the %3 byte command for '%4'").arg(aPosition).arg(aLength).arg(_command.length()).arg(_name);
+            throw std::out_of_range(qPrintable(errorString));
+        }
+
+        encodedRequest();
+
+        quint8 &ourChecksum = _encodedRequest[_encodedRequestLength - 1];
+        quint8 *ourArguments = _encodedRequest + _commandOffset + aPosition;
+
+        for (int i=0; i < aLength; i++) {
+            ourChecksum ^= ourArguments[i] ^ someBytes[i];
+            ourArguments[i] = someBytes[i];
+            _command[aPosition + i] = someBytes[i];
+        }
+    }
+
+    void Operation::setParameter(int aPosition, quint8 aByte)
+    {
+        setParameter(aPosition, &aByte, 1);
     }
 }
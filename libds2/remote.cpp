@@ -0,0 +1,243 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+#include <unistd.h>
+
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+
+#include <ds2/remote.h>
+
+namespace DS2PlusPlus {
+    RemoteMessage::RemoteMessage(Type aType, quint32 anId) :
+        type(aType), id(anId), rate(0), timestamp(0), latency(0), dropped(0)
+    {
+    }
+
+    QString RemoteMessage::defaultSocketPath()
+    {
+        return QString("%1/ds2r-%2.sock").arg(QDir::tempPath()).arg(getuid());
+    }
+
+    QByteArray RemoteMessage::encode() const
+    {
+        QByteArray ret;
+        QDataStream stream(&ret, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_0);
+
+        // The length is filled in once the body is written
+        stream << quint32(0) << quint8(type) << id;
+
+        switch (type) {
+        case RunOperation:
+            stream << ecu << operation;
+            break;
+        case Probe:
+        case Invalidate:
+            stream << ecu;
+            break;
+        case RawQuery:
+        case RawReply:
+            stream << ecu << data;
+            break;
+        case Subscribe:
+            stream << ecu << operation << results << rate;
+            break;
+        case Unsubscribe:
+        case Subscribed:
+            break;
+        case Response:
+            stream << ecu << operation << timestamp << latency << response;
+            break;
+        case Sample:
+            stream << ecu << operation << timestamp << latency << response << dropped;
+            break;
+        case ProbeResult:
+            stream << ecu << response;
+            break;
+        case Error:
+            stream << error;
+            break;
+        }
+
+        if (ret.size() > MAX_FRAME) {
+            throw std::runtime_error("Remote message is too long.");
+        }
+
+        const quint32 length = ret.size() - sizeof(quint32);
+        ret[0] = static_cast<char>(length >> 24);
+        ret[1] = static_cast<char>(length >> 16);
+        ret[2] = static_cast<char>(length >> 8);
+        ret[3] = static_cast<char>(length);
+        return ret;
+    }
+
+    bool RemoteMessageReader::next(RemoteMessage &aMessage)
+    {
+        if (_buffer.size() < static_cast<int>(sizeof(quint32))) {
+            return false;
+        }
+
+        const uchar *bytes = reinterpret_cast<const uchar *>(_buffer.constData());
+        const quint32 length = (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16) | (quint32(bytes[2]) << 8) | bytes[3];
+        if ((length < sizeof(quint8) + sizeof(quint32)) or (length > RemoteMessage::MAX_FRAME)) {
+            throw std::runtime_error(qPrintable(QString("Remote message has an invalid length of %1 bytes.").arg(length)));
+        }
+        if (static_cast<quint32>(_buffer.size()) < sizeof(quint32) + length) {
+            return false;
+        }
+
+        const QByteArray frame = _buffer.mid(sizeof(quint32), length);
+        _buffer.remove(0, sizeof(quint32) + length);
+
+        QDataStream stream(frame);
+        stream.setVersion(QDataStream::Qt_5_0);
+
+        quint8 type;
+        stream >> type >> aMessage.id;
+        aMessage.type = static_cast<RemoteMessage::Type>(type);
+
+        switch (aMessage.type) {
+        case RemoteMessage::RunOperation:
+            stream >> aMessage.ecu >> aMessage.operation;
+            break;
+        case RemoteMessage::Probe:
+        case RemoteMessage::Invalidate:
+            stream >> aMessage.ecu;
+            break;
+        case RemoteMessage::RawQuery:
+        case RemoteMessage::RawReply:
+            stream >> aMessage.ecu >> aMessage.data;
+            break;
+        case RemoteMessage::Subscribe:
+            stream >> aMessage.ecu >> aMessage.operation >> aMessage.results >> aMessage.rate;
+            break;
+        case RemoteMessage::Unsubscribe:
+        case RemoteMessage::Subscribed:
+            break;
+        case RemoteMessage::Response:
+            stream >> aMessage.ecu >> aMessage.operation >> aMessage.timestamp >> aMessage.latency >> aMessage.response;
+            break;
+        case RemoteMessage::Sample:
+            stream >> aMessage.ecu >> aMessage.operation >> aMessage.timestamp >> aMessage.latency >> aMessage.response
+                   >> aMessage.dropped;
+            break;
+        case RemoteMessage::ProbeResult:
+            stream >> aMessage.ecu >> aMessage.response;
+            break;
+        case RemoteMessage::Error:
+            stream >> aMessage.error;
+            break;
+        default:
+            throw std::runtime_error(qPrintable(QString("Unknown remote message type 0x%1.").arg(type, 2, 16, QChar('0'))));
+        }
+
+        if (stream.status() != QDataStream::Ok) {
+            throw std::runtime_error("Remote message is truncated.");
+        }
+        return true;
+    }
+
+    RemoteClient::RemoteClient() :
+        _socket(new QLocalSocket), _nextId(1)
+    {
+    }
+
+    RemoteClient::~RemoteClient()
+    {
+        delete _socket;
+    }
+
+    void RemoteClient::connectTo(const QString &aPath)
+    {
+        _socket->connectToServer(aPath);
+        if (!_socket->waitForConnected(5000)) {
+            throw std::runtime_error(qPrintable(QString("Could not connect to ds2r at %1: %2").arg(aPath).arg(_socket->errorString())));
+        }
+    }
+
+    RemoteMessage RemoteClient::request(RemoteMessage aRequest, int aTimeoutMilliseconds)
+    {
+        aRequest.id = _nextId++;
+        _socket->write(aRequest.encode());
+        _socket->flush();
+
+        QElapsedTimer ourTimer;
+        ourTimer.start();
+
+        RemoteMessage ret;
+        forever {
+            const int remaining = aTimeoutMilliseconds - ourTimer.elapsed();
+            if ((remaining <= 0) or !readMessage(ret, remaining)) {
+                throw std::runtime_error("Timed out waiting for ds2r to reply.");
+            }
+
+            if (ret.id != aRequest.id) {
+                // Failed polls come back as errors carrying the subscription's id
+                if ((ret.type == RemoteMessage::Sample) or (ret.type == RemoteMessage::Error)) {
+                    _samples.append(ret);
+                }
+                continue;
+            }
+            if (ret.type == RemoteMessage::Error) {
+                throw std::runtime_error(qPrintable(ret.error));
+            }
+            return ret;
+        }
+    }
+
+    bool RemoteClient::nextSample(RemoteMessage &aSample, int aTimeoutMilliseconds)
+    {
+        if (!_samples.isEmpty()) {
+            aSample = _samples.takeFirst();
+            return true;
+        }
+
+        while (readMessage(aSample, aTimeoutMilliseconds)) {
+            if ((aSample.type == RemoteMessage::Sample) or (aSample.type == RemoteMessage::Error)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RemoteClient::readMessage(RemoteMessage &aMessage, int aTimeoutMilliseconds)
+    {
+        while (!_reader.next(aMessage)) {
+            if (_socket->state() != QLocalSocket::ConnectedState) {
+                throw std::runtime_error("The connection to ds2r was closed.");
+            }
+            if (!_socket->bytesAvailable() and !_socket->waitForReadyRead(aTimeoutMilliseconds)) {
+                if (_socket->state() != QLocalSocket::ConnectedState) {
+                    throw std::runtime_error("The connection to ds2r was closed.");
+                }
+                return false;
+            }
+            _reader.append(_socket->readAll());
+        }
+        return true;
+    }
+}
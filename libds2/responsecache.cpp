@@ -0,0 +1,126 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include <ds2/responsecache.h>
+
+namespace DS2PlusPlus {
+    ResponseCache::ResponseCache() :
+        _hits(0), _misses(0)
+    {
+    }
+
+    double ResponseCache::now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + (0.000000001 * ts.tv_nsec);
+    }
+
+    QString ResponseCache::keyFor(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation)
+    {
+        return QString("%1/%2/%3").arg(anAddress, 2, 16, QChar('0')).arg(aModuleUuid).arg(anOperation);
+    }
+
+    const ResponseCache::Entry *ResponseCache::live(const QString &aKey, double aNow)
+    {
+        QHash<QString, Entry>::iterator it = _entries.find(aKey);
+        if (it == _entries.end()) {
+            _misses++;
+            return 0;
+        }
+        if (it.value().expires <= aNow) {
+            _entries.erase(it);
+            _misses++;
+            return 0;
+        }
+        return &it.value();
+    }
+
+    bool ResponseCache::find(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation, PacketResponse &aResponse, double aNow)
+    {
+        QMutexLocker locker(&_lock);
+        const Entry *ourEntry = live(keyFor(anAddress, aModuleUuid, anOperation), aNow);
+        if (!ourEntry) {
+            return false;
+        }
+
+        _hits++;
+        aResponse = ourEntry->response;
+        return true;
+    }
+
+    void ResponseCache::insert(quint8 anAddress, const QString &aModuleUuid, const QString &anOperation, const PacketResponse &aResponse,
+                               double aTtl, double aNow)
+    {
+        if (aTtl <= 0) {
+            return;
+        }
+
+        Entry ourEntry;
+        ourEntry.address = anAddress;
+        ourEntry.response = aResponse;
+        ourEntry.expires = aNow + aTtl;
+
+        QMutexLocker locker(&_lock);
+        _entries.insert(keyFor(anAddress, aModuleUuid, anOperation), ourEntry);
+    }
+
+    void ResponseCache::invalidate(quint8 anAddress)
+    {
+        QMutexLocker locker(&_lock);
+        QHash<QString, Entry>::iterator it = _entries.begin();
+        while (it != _entries.end()) {
+            if (it.value().address == anAddress) {
+                it = _entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void ResponseCache::clear()
+    {
+        QMutexLocker locker(&_lock);
+        _entries.clear();
+    }
+
+    int ResponseCache::size() const
+    {
+        QMutexLocker locker(&_lock);
+        return _entries.size();
+    }
+
+    quint64 ResponseCache::hits() const
+    {
+        QMutexLocker locker(&_lock);
+        return _hits;
+    }
+
+    quint64 ResponseCache::misses() const
+    {
+        QMutexLocker locker(&_lock);
+        return _misses;
+    }
+}
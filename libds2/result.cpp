@@ -24,6 +24,8 @@
 #include <stdexcept>
 
 #include <QDebug>
+#include <QPair>
+#include <QMap>
 
 #include <ds2/result.h>
 
@@ -41,6 +43,7 @@ namespace DS2PlusPlus {
     void Result::setName(const QString &aName)
     {
         _name = aName;
+        compileLevels();
     }
 
     const QString Result::name() const
@@ -116,6 +119,71 @@ namespace DS2PlusPlus {
         if (!aRpnString.isEmpty()) {
             _rpn = aRpnString.split(" ");
         }
+
+        // Reduce the RPN to N * scale + offset when we can.  Each stack entry is
+        // tracked as a (scale, offset) pair; anything other than scaling by or
+        // adding a constant makes the result non-affine.
+        _rpnIsAffine = true;
+        _rpnScale = 1.0;
+        _rpnOffset = 0.0;
+
+        if (_rpn.isEmpty()) {
+            return;
+        }
+
+        QList<QPair<double, double> > stack;
+        foreach (const QString &command, _rpn) {
+            if (command == "N") {
+                stack.push_back(qMakePair(1.0, 0.0));
+            } else if ((command == "+") or (command == "-") or (command == "*") or (command == "/")) {
+                if (stack.count() < 2) {
+                    _rpnIsAffine = false;
+                    return;
+                }
+
+                const QPair<double, double> a = stack.takeLast();
+                const QPair<double, double> b = stack.takeLast();
+
+                if (command == "+") {
+                    stack.push_back(qMakePair(b.first + a.first, b.second + a.second));
+                } else if (command == "-") {
+                    stack.push_back(qMakePair(b.first - a.first, b.second - a.second));
+                } else if ((command == "*") and (a.first == 0.0)) {
+                    stack.push_back(qMakePair(b.first * a.second, b.second * a.second));
+                } else if ((command == "*") and (b.first == 0.0)) {
+                    stack.push_back(qMakePair(a.first * b.second, a.second * b.second));
+                } else if ((command == "/") and (a.first == 0.0) and (a.second != 0.0)) {
+                    stack.push_back(qMakePair(b.first / a.second, b.second / a.second));
+                } else {
+                    _rpnIsAffine = false;
+                    return;
+                }
+            } else {
+                bool ok;
+                double theNum;
+                if (command.startsWith("0x")) {
+                    theNum = command.toULongLong(&ok, 16);
+                } else {
+                    theNum = command.toDouble(&ok);
+                }
+
+                if (!ok) {
+                    // Shifts, masks, and anything else we don't understand.
+                    _rpnIsAffine = false;
+                    return;
+                }
+
+                stack.push_back(qMakePair(0.0, theNum));
+            }
+        }
+
+        if (stack.isEmpty()) {
+            _rpnIsAffine = false;
+            return;
+        }
+
+        _rpnScale = stack.first().first;
+        _rpnOffset = stack.first().second;
     }
 
     QStringList Result::rpn() const
@@ -123,9 +191,25 @@ namespace DS2PlusPlus {
         return _rpn;
     }
 
+    bool Result::rpnIsAffine() const
+    {
+        return _rpnIsAffine;
+    }
+
+    double Result::rpnScale() const
+    {
+        return _rpnScale;
+    }
+
+    double Result::rpnOffset() const
+    {
+        return _rpnOffset;
+    }
+
     void Result::setLevels(QHash<QString, QString> someLevels)
     {
         _levels = someLevels;
+        compileLevels();
     }
 
     const QString Result::units() const
@@ -138,47 +222,105 @@ namespace DS2PlusPlus {
         _units = aUnit;
     }
 
-    const QString Result::stringForLevel(quint8 aLevel) const
+    void Result::compileLevels()
     {
+        _levelTable.clear();
+        _levelSlotKeys.clear();
+        _levelSlotMasks.clear();
+        _levelsAreValid = true;
+
+        if (_levels.isEmpty()) {
+            return;
+        }
+
+        // Every byte value maps to one of a handful of strings, so intern them.
+        QHash<QString, QString> interned;
+        _levelTable.resize(256);
+
         // Boolean
         if (_levels.contains("yes") and _levels.contains("no") and _levels.count() == 2) {
-            return (aLevel == true) ? _levels.value("yes") : _levels.value("no");
+            const QString yes = _levels.value("yes");
+            const QString no = _levels.value("no");
+            for (int level=0; level < 256; level++) {
+                _levelTable[level] = (level == true) ? yes : no;
+            }
+            return;
         }
 
-        qint32 ourLevelCount = 0;
-        QStringList ourLevels;
-
+        QMap<quint8, QString> masks;
         for (QHash<QString, QString>::const_iterator it = _levels.begin(); it != _levels.end(); ++it) {
             if ((it.key() == "else") or (it.key() == "all")) {
                 continue;
             }
 
-            ourLevelCount++;
-
             bool ok;
             quint8 mask = it.key().toUShort(&ok, 16);
 
             if (!ok) {
-                throw std::invalid_argument("Invalid mask found");
+                // Keep loading, but complain as soon as anyone tries to use this result.
+                _levelsAreValid = false;
+                return;
+            }
+
+            masks.insertMulti(mask, it.value());
+        }
+
+        for (QMap<quint8, QString>::const_iterator it = masks.begin(); it != masks.end(); ++it) {
+            _levelSlotMasks.append(it.key());
+            _levelSlotKeys.append(QString("%1.%2").arg(_name).arg(it.value()));
+        }
+
+        for (int level=0; level < 256; level++) {
+            QStringList ourLevels;
+
+            for (QMap<quint8, QString>::const_iterator it = masks.begin(); it != masks.end(); ++it) {
+                if ((level & it.key()) > 0) {
+                    ourLevels.append(it.value());
+                }
+            }
+
+            QString ourString;
+            if (ourLevels.isEmpty() and _levels.contains("else")) {
+                ourString = _levels.value("else");
+            } else if (ourLevels.isEmpty()) {
+                ourString = QString::null;
+            } else if ((ourLevels.count() == masks.count()) and _levels.contains("all")) {
+                ourString = _levels.value("all");
+            } else {
+                ourString = ourLevels.join(",");
             }
 
-            if ((aLevel & mask) > 0) {
-                ourLevels.append(it.value());
+            if (!ourString.isNull()) {
+                if (!interned.contains(ourString)) {
+                    interned.insert(ourString, ourString);
+                }
+                ourString = interned.value(ourString);
             }
+
+            _levelTable[level] = ourString;
         }
+    }
 
-        if ((ourLevels.isEmpty()) and (_levels.contains("else"))) {
-            return _levels.value("else");
+    const QString Result::stringForLevel(quint8 aLevel) const
+    {
+        if (!_levelsAreValid) {
+            throw std::invalid_argument("Invalid mask found");
         }
 
-        if (ourLevels.isEmpty()) {
+        if (_levelTable.isEmpty()) {
             return QString::null;
         }
 
-        if ((ourLevels.count() == ourLevelCount) and _levels.contains("all")) {
-            return _levels.value("all");
-        }
+        return _levelTable.at(aLevel);
+    }
 
-        return ourLevels.join(",");
+    const QStringList Result::levelSlotKeys() const
+    {
+        return _levelSlotKeys;
+    }
+
+    const QVector<quint8> Result::levelSlotMasks() const
+    {
+        return _levelSlotMasks;
     }
 }
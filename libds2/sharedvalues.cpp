@@ -0,0 +1,358 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+
+#include <atomic>
+#include <stdexcept>
+
+#include <ds2/sharedvalues.h>
+
+namespace DS2PlusPlus {
+    namespace SharedValues {
+        // A reader that sees the sequence change this many times in a row gives up rather than spin forever
+        static const int MAX_READ_ATTEMPTS = 64;
+
+        Q_STATIC_ASSERT(sizeof(Header) == 64);
+        Q_STATIC_ASSERT(sizeof(Channel) == 128);
+        Q_STATIC_ASSERT(sizeof(Slot) == 64);
+
+        size_t segmentSize(quint32 aCapacity)
+        {
+            return sizeof(Header) + aCapacity * (sizeof(Channel) + sizeof(Slot));
+        }
+
+        QByteArray segmentName(const QString &aName)
+        {
+            QByteArray ret = aName.toLocal8Bit();
+            if (!ret.startsWith('/')) {
+                ret.prepend('/');
+            }
+            return ret;
+        }
+
+        static void copyString(char *aDestination, const QString &aSource, int aLength)
+        {
+            const QByteArray bytes = aSource.toUtf8();
+            const int length = qMin(bytes.size(), aLength - 1);
+            memcpy(aDestination, bytes.constData(), length);
+            memset(aDestination + length, 0, aLength - length);
+        }
+
+        static QString readString(const char *aSource, int aLength)
+        {
+            return QString::fromUtf8(aSource, qstrnlen(aSource, aLength));
+        }
+
+        static bool isProcessRunning(quint32 aPid)
+        {
+            // EPERM means it exists but belongs to someone else
+            return (aPid != 0) and ((kill(static_cast<pid_t>(aPid), 0) == 0) or (errno == EPERM));
+        }
+
+        /*
+         * Returns the pid of the running writer of the existing segment \a aName, or 0 if there is none.
+         */
+        static qint64 liveWriter(const QByteArray &aName)
+        {
+            const int fd = shm_open(aName.constData(), O_RDONLY, 0);
+            if (fd < 0) {
+                return 0;
+            }
+
+            struct stat info;
+            qint64 ret = 0;
+            if ((fstat(fd, &info) == 0) and (static_cast<size_t>(info.st_size) >= sizeof(Header))) {
+                void *segment = mmap(NULL, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+                if (segment != MAP_FAILED) {
+                    const Header *header = static_cast<const Header *>(segment);
+                    if ((memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0) and header->isLive.loadAcquire() and isProcessRunning(header->writerPid)) {
+                        ret = header->writerPid;
+                    }
+                    munmap(segment, sizeof(Header));
+                }
+            }
+            ::close(fd);
+            return ret;
+        }
+
+        QVariant Value::toVariant() const
+        {
+            switch (type) {
+            case TypeDouble:
+                return QVariant(number.asDouble);
+            case TypeInt:
+                return QVariant(number.asInt);
+            case TypeUInt:
+                return QVariant(number.asUInt);
+            case TypeBool:
+                return QVariant(number.asUInt != 0);
+            case TypeString:
+                return QVariant(readString(text, TEXT_LENGTH));
+            default:
+                return QVariant();
+            }
+        }
+    }
+
+    using namespace SharedValues;
+
+    SharedValueWriter::SharedValueWriter(const QString &aName, quint32 aCapacity) :
+        _name(aName), _segment(NULL), _size(segmentSize(aCapacity)), _header(NULL), _channels(NULL), _slots(NULL)
+    {
+        if (aCapacity == 0) {
+            throw std::invalid_argument("A shared value segment needs room for at least one channel.");
+        }
+
+        const QByteArray name = segmentName(aName);
+        int fd = shm_open(name.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if ((fd < 0) and (errno == EEXIST)) {
+            // Left behind by a writer that crashed or was killed?  Take it over, unless its writer is still running.
+            const qint64 otherWriter = liveWriter(name);
+            if (otherWriter > 0) {
+                throw std::runtime_error(qPrintable(QString("Shared memory segment %1 already has a writer (pid %2).").arg(QString(name)).arg(otherWriter)));
+            }
+            shm_unlink(name.constData());
+            fd = shm_open(name.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        }
+        if (fd < 0) {
+            throw std::runtime_error(qPrintable(QString("Unable to create shared memory segment %1: %2").arg(QString(name)).arg(strerror(errno))));
+        }
+
+        if (ftruncate(fd, _size) != 0) {
+            const int error = errno;
+            ::close(fd);
+            shm_unlink(name.constData());
+            throw std::runtime_error(qPrintable(QString("Unable to size shared memory segment %1: %2").arg(QString(name)).arg(strerror(error))));
+        }
+
+        void *segment = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (segment == MAP_FAILED) {
+            const int error = errno;
+            shm_unlink(name.constData());
+            throw std::runtime_error(qPrintable(QString("Unable to map shared memory segment %1: %2").arg(QString(name)).arg(strerror(error))));
+        }
+
+        _segment = static_cast<uchar *>(segment);
+        _header = reinterpret_cast<Header *>(_segment);
+        _channels = reinterpret_cast<Channel *>(_segment + sizeof(Header));
+        _slots = reinterpret_cast<Slot *>(_segment + sizeof(Header) + aCapacity * sizeof(Channel));
+
+        // Hide the segment from readers while it's being reset
+        memset(_header->magic, 0, sizeof(_header->magic));
+        std::atomic_thread_fence(std::memory_order_release);
+        memset(_segment + sizeof(_header->magic), 0, _size - sizeof(_header->magic));
+
+        _header->capacity = aCapacity;
+        _header->writerPid = getpid();
+        _header->isLive.storeRelease(1);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(_header->magic, MAGIC, sizeof(MAGIC));
+    }
+
+    SharedValueWriter::~SharedValueWriter()
+    {
+        _header->isLive.storeRelease(0);
+        munmap(_segment, _size);
+        shm_unlink(segmentName(_name).constData());
+    }
+
+    int SharedValueWriter::channel(const QString &aName, const QString &someUnits)
+    {
+        QHash<QString, int>::const_iterator found = _channelIndexes.constFind(aName);
+        if (found != _channelIndexes.constEnd()) {
+            return found.value();
+        }
+
+        const quint32 index = _header->channelCount.load();
+        if (index >= _header->capacity) {
+            return -1;
+        }
+
+        copyString(_channels[index].name, aName, NAME_LENGTH);
+        copyString(_channels[index].units, someUnits, UNITS_LENGTH);
+        _header->channelCount.storeRelease(index + 1);
+
+        _channelIndexes.insert(aName, index);
+        return index;
+    }
+
+    void SharedValueWriter::publish(int aChannel, double aTimestamp, const QVariant &aValue)
+    {
+        if (aChannel < 0 or static_cast<quint32>(aChannel) >= _header->channelCount.load()) {
+            throw std::out_of_range(qPrintable(QString("No shared value channel %1").arg(aChannel)));
+        }
+
+        Slot &slot = _slots[aChannel];
+        const quint32 sequence = slot.sequence.load();
+        slot.sequence.store(sequence + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.timestamp = aTimestamp;
+        slot.value.asUInt = 0;
+        switch (aValue.type()) {
+        case QVariant::Double:
+            slot.type = TypeDouble;
+            slot.value.asDouble = aValue.toDouble();
+            break;
+        case QVariant::Int:
+        case QVariant::LongLong:
+            slot.type = TypeInt;
+            slot.value.asInt = aValue.toLongLong();
+            break;
+        case QVariant::UInt:
+        case QVariant::ULongLong:
+            slot.type = TypeUInt;
+            slot.value.asUInt = aValue.toULongLong();
+            break;
+        case QVariant::Bool:
+            slot.type = TypeBool;
+            slot.value.asUInt = aValue.toBool() ? 1 : 0;
+            break;
+        case QVariant::String:
+        case QVariant::ByteArray:
+            slot.type = TypeString;
+            copyString(slot.text, aValue.toString(), TEXT_LENGTH);
+            break;
+        default:
+            slot.type = TypeNone;
+            break;
+        }
+
+        slot.sequence.storeRelease(sequence + 2);
+    }
+
+    SharedValueReader::SharedValueReader(const QString &aName) :
+        _segment(NULL), _size(0), _header(NULL), _channels(NULL), _slots(NULL)
+    {
+        const QByteArray name = segmentName(aName);
+        int fd = shm_open(name.constData(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error(qPrintable(QString("Unable to open shared memory segment %1: %2").arg(QString(name)).arg(strerror(errno))));
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 or static_cast<size_t>(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error(qPrintable(QString("%1 is not a shared value segment.").arg(QString(name))));
+        }
+
+        _size = info.st_size;
+        void *segment = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (segment == MAP_FAILED) {
+            throw std::runtime_error(qPrintable(QString("Unable to map shared memory segment %1: %2").arg(QString(name)).arg(strerror(errno))));
+        }
+
+        _segment = static_cast<const uchar *>(segment);
+        _header = reinterpret_cast<const Header *>(_segment);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (memcmp(_header->magic, MAGIC, sizeof(MAGIC)) != 0 or _size < segmentSize(_header->capacity)) {
+            munmap(const_cast<uchar *>(_segment), _size);
+            throw std::runtime_error(qPrintable(QString("%1 is not a shared value segment.").arg(QString(name))));
+        }
+
+        _channels = reinterpret_cast<const Channel *>(_segment + sizeof(Header));
+        _slots = reinterpret_cast<const Slot *>(_segment + sizeof(Header) + _header->capacity * sizeof(Channel));
+    }
+
+    SharedValueReader::~SharedValueReader()
+    {
+        munmap(const_cast<uchar *>(_segment), _size);
+    }
+
+    bool SharedValueReader::isLive() const
+    {
+        return (_header->isLive.loadAcquire() != 0) and isProcessRunning(_header->writerPid);
+    }
+
+    int SharedValueReader::channelCount() const
+    {
+        return _header->channelCount.loadAcquire();
+    }
+
+    QString SharedValueReader::channelName(int aChannel) const
+    {
+        if (aChannel < 0 or aChannel >= channelCount()) {
+            return QString::null;
+        }
+        return readString(_channels[aChannel].name, NAME_LENGTH);
+    }
+
+    QString SharedValueReader::channelUnits(int aChannel) const
+    {
+        if (aChannel < 0 or aChannel >= channelCount()) {
+            return QString::null;
+        }
+        return readString(_channels[aChannel].units, UNITS_LENGTH);
+    }
+
+    int SharedValueReader::indexOf(const QString &aName) const
+    {
+        const QByteArray name = aName.toUtf8();
+        const int count = channelCount();
+        for (int i=0; i < count; i++) {
+            if (qstrncmp(_channels[i].name, name.constData(), NAME_LENGTH) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool SharedValueReader::read(int aChannel, Value &aValue) const
+    {
+        if (aChannel < 0 or aChannel >= channelCount()) {
+            return false;
+        }
+
+        const Slot &slot = _slots[aChannel];
+        for (int attempt=0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+            const quint32 before = slot.sequence.loadAcquire();
+            if (before == 0) {
+                return false;
+            }
+            if (before & 1) {
+                continue;
+            }
+
+            aValue.type = slot.type;
+            aValue.timestamp = slot.timestamp;
+            aValue.number.asUInt = slot.value.asUInt;
+            memcpy(aValue.text, slot.text, TEXT_LENGTH);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load() == before) {
+                aValue.text[TEXT_LENGTH - 1] = '\0';
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include <ds2/subscriptionhub.h>
+
+namespace {
+    // A sample this much of a period early still counts as on time, so jitter in the poll doesn't halve a subscriber's rate.
+    const double EARLY_FRACTION = 0.25;
+}
+
+namespace DS2PlusPlus {
+    SubscriptionHub::SubscriptionHub() :
+        _generation(0)
+    {
+    }
+
+    SubscriptionHub::~SubscriptionHub()
+    {
+        qDeleteAll(_subscribers);
+    }
+
+    QString SubscriptionHub::keyFor(const QString &anEcu, const QString &anOperation)
+    {
+        return QString("%1:%2").arg(anEcu).arg(anOperation);
+    }
+
+    void SubscriptionHub::subscribe(quint64 anOwner, quint32 aTag, const QString &anEcu, const QString &anOperation,
+                                    const QStringList &someResults, double aRate, int aQueueLength)
+    {
+        if (aRate <= 0) {
+            throw std::invalid_argument("A subscription needs a rate above 0 Hz.");
+        }
+        if (aQueueLength < 1) {
+            throw std::invalid_argument("A subscription needs room for at least one sample.");
+        }
+
+        QMutexLocker locker(&_lock);
+        if (find(anOwner, aTag)) {
+            throw std::invalid_argument(qPrintable(QString("Subscription %1 is already in use.").arg(aTag)));
+        }
+
+        Subscriber *ourSubscriber = new Subscriber;
+        ourSubscriber->owner = anOwner;
+        ourSubscriber->tag = aTag;
+        ourSubscriber->ecu = anEcu;
+        ourSubscriber->operation = anOperation;
+        ourSubscriber->key = keyFor(anEcu, anOperation);
+        ourSubscriber->results = someResults;
+        ourSubscriber->rate = aRate;
+        ourSubscriber->queueLength = aQueueLength;
+        ourSubscriber->lastDelivered = -1;
+        ourSubscriber->dropped = 0;
+
+        _subscribers.append(ourSubscriber);
+        _byKey[ourSubscriber->key].append(ourSubscriber);
+        _generation++;
+    }
+
+    SubscriptionHub::Subscriber *SubscriptionHub::find(quint64 anOwner, quint32 aTag)
+    {
+        foreach (Subscriber *subscriber, _subscribers) {
+            if ((subscriber->owner == anOwner) and (subscriber->tag == aTag)) {
+                return subscriber;
+            }
+        }
+        return 0;
+    }
+
+    void SubscriptionHub::removeAt(int anIndex)
+    {
+        Subscriber *ourSubscriber = _subscribers.takeAt(anIndex);
+
+        QList<Subscriber *> &siblings = _byKey[ourSubscriber->key];
+        siblings.removeOne(ourSubscriber);
+        if (siblings.isEmpty()) {
+            _byKey.remove(ourSubscriber->key);
+        }
+
+        delete ourSubscriber;
+        _generation++;
+    }
+
+    bool SubscriptionHub::unsubscribe(quint64 anOwner, quint32 aTag)
+    {
+        QMutexLocker locker(&_lock);
+        for (int i=0; i < _subscribers.size(); i++) {
+            if ((_subscribers.at(i)->owner == anOwner) and (_subscribers.at(i)->tag == aTag)) {
+                removeAt(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void SubscriptionHub::unsubscribeAll(quint64 anOwner)
+    {
+        QMutexLocker locker(&_lock);
+        for (int i=_subscribers.size() - 1; i >= 0; i--) {
+            if (_subscribers.at(i)->owner == anOwner) {
+                removeAt(i);
+            }
+        }
+    }
+
+    QList<SubscriptionHub::Poll> SubscriptionHub::polls() const
+    {
+        QMutexLocker locker(&_lock);
+
+        QList<Poll> ret;
+        QMap<QString, QList<Subscriber *> >::const_iterator it;
+        for (it = _byKey.constBegin(); it != _byKey.constEnd(); it++) {
+            Poll ourPoll;
+            ourPoll.ecu = it.value().first()->ecu;
+            ourPoll.operation = it.value().first()->operation;
+            ourPoll.rate = 0;
+            ourPoll.subscribers = it.value().size();
+
+            bool isEverything = false;
+            foreach (const Subscriber *subscriber, it.value()) {
+                ourPoll.rate = qMax(ourPoll.rate, subscriber->rate);
+                isEverything = isEverything or subscriber->results.isEmpty();
+                foreach (const QString &result, subscriber->results) {
+                    if (!ourPoll.results.contains(result)) {
+                        ourPoll.results.append(result);
+                    }
+                }
+            }
+            if (isEverything) {
+                ourPoll.results.clear();
+            }
+
+            ret.append(ourPoll);
+        }
+        return ret;
+    }
+
+    quint64 SubscriptionHub::generation() const
+    {
+        QMutexLocker locker(&_lock);
+        return _generation;
+    }
+
+    QList<quint64> SubscriptionHub::publish(const QString &anEcu, const QString &anOperation, double aTimestamp, double aLatency,
+                                            const PacketResponse &aResponse)
+    {
+        Sample ourSample;
+        ourSample.timestamp = aTimestamp;
+        ourSample.latency = aLatency;
+        ourSample.response = aResponse;
+        return deliver(anEcu, anOperation, ourSample);
+    }
+
+    QList<quint64> SubscriptionHub::publishError(const QString &anEcu, const QString &anOperation, double aTimestamp, const QString &anError)
+    {
+        Sample ourSample;
+        ourSample.timestamp = aTimestamp;
+        ourSample.error = anError;
+        return deliver(anEcu, anOperation, ourSample);
+    }
+
+    QList<quint64> SubscriptionHub::deliver(const QString &anEcu, const QString &anOperation, const Sample &aSample)
+    {
+        QMutexLocker locker(&_lock);
+
+        QList<quint64> ret;
+        foreach (Subscriber *subscriber, _byKey.value(keyFor(anEcu, anOperation))) {
+            // Thin the shared poll down to the rate this subscriber asked for; errors always go through.
+            if (!aSample.isError() and (subscriber->lastDelivered >= 0) and
+                ((aSample.timestamp - subscriber->lastDelivered) < (1.0 - EARLY_FRACTION) / subscriber->rate)) {
+                continue;
+            }
+
+            Sample ourSample;
+            ourSample.tag = subscriber->tag;
+            ourSample.ecu = anEcu;
+            ourSample.operation = anOperation;
+            ourSample.timestamp = aSample.timestamp;
+            ourSample.latency = aSample.latency;
+            ourSample.error = aSample.error;
+            if (subscriber->results.isEmpty()) {
+                ourSample.response = aSample.response;
+            } else {
+                foreach (const QString &result, subscriber->results) {
+                    PacketResponse::const_iterator value = aSample.response.constFind(result);
+                    if (value != aSample.response.constEnd()) {
+                        ourSample.response.insert(result, value.value());
+                    }
+                }
+            }
+
+            if (!aSample.isError()) {
+                subscriber->lastDelivered = aSample.timestamp;
+            }
+            if (subscriber->queue.size() >= subscriber->queueLength) {
+                subscriber->queue.dequeue();
+                subscriber->dropped++;
+            }
+            subscriber->queue.enqueue(ourSample);
+
+            if (!ret.contains(subscriber->owner)) {
+                ret.append(subscriber->owner);
+            }
+        }
+        return ret;
+    }
+
+    bool SubscriptionHub::take(quint64 anOwner, Sample &aSample)
+    {
+        QMutexLocker locker(&_lock);
+
+        Subscriber *oldest = 0;
+        foreach (Subscriber *subscriber, _subscribers) {
+            if ((subscriber->owner != anOwner) or subscriber->queue.isEmpty()) {
+                continue;
+            }
+            if (!oldest or (subscriber->queue.head().timestamp < oldest->queue.head().timestamp)) {
+                oldest = subscriber;
+            }
+        }
+
+        if (!oldest) {
+            return false;
+        }
+        aSample = oldest->queue.dequeue();
+        aSample.dropped = oldest->dropped;
+        return true;
+    }
+
+    int SubscriptionHub::queued(quint64 anOwner) const
+    {
+        QMutexLocker locker(&_lock);
+
+        int ret = 0;
+        foreach (const Subscriber *subscriber, _subscribers) {
+            if (subscriber->owner == anOwner) {
+                ret += subscriber->queue.size();
+            }
+        }
+        return ret;
+    }
+
+    quint64 SubscriptionHub::dropped(quint64 anOwner, quint32 aTag) const
+    {
+        QMutexLocker locker(&_lock);
+        foreach (const Subscriber *subscriber, _subscribers) {
+            if ((subscriber->owner == anOwner) and (subscriber->tag == aTag)) {
+                return subscriber->dropped;
+            }
+        }
+        return 0;
+    }
+}
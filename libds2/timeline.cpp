@@ -0,0 +1,180 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include <QHash>
+#include <QThread>
+
+#include <ds2/timeline.h>
+#include <ds2/jsonwriter.h>
+
+namespace DS2PlusPlus {
+    QAtomicInt Timeline::ourEnabled(0);
+    QAtomicInt Timeline::ourNext(0);
+    QAtomicInt Timeline::ourDropped(0);
+    QVector<TimelineEvent> Timeline::ourEvents;
+    qint64 Timeline::ourOrigin = 0;
+
+    void Timeline::start(int aCapacity)
+    {
+        ourEnabled.store(0);
+        ourEvents = QVector<TimelineEvent>(qMax(aCapacity, 1));
+        ourNext.store(0);
+        ourDropped.store(0);
+        ourOrigin = now();
+        ourEnabled.store(1);
+    }
+
+    void Timeline::stop()
+    {
+        ourEnabled.store(0);
+    }
+
+    qint64 Timeline::now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return Q_INT64_C(1000000000) * ts.tv_sec + ts.tv_nsec;
+    }
+
+    void Timeline::record(const char *aName, const char *aCategory, qint64 aStart, qint64 anEnd, int anEcu, const QString &aDetail)
+    {
+        if (!isEnabled()) {
+            return;
+        }
+
+        // Claim a slot without counting past the end, so a long log can't wrap the counter negative
+        int slot;
+        do {
+            slot = ourNext.loadAcquire();
+            if (slot >= ourEvents.size()) {
+                ourDropped.fetchAndAddRelaxed(1);
+                return;
+            }
+        } while (!ourNext.testAndSetRelaxed(slot, slot + 1));
+
+        // The vector was sized by start(), so writing through data() never reallocates.
+        TimelineEvent &event = ourEvents.data()[slot];
+        event.name = aName;
+        event.category = aCategory;
+        event.start = aStart;
+        event.duration = anEnd - aStart;
+        event.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+        event.ecu = anEcu;
+        event.detail = aDetail;
+    }
+
+    int Timeline::count()
+    {
+        return qMin(ourNext.load(), ourEvents.size());
+    }
+
+    QVector<TimelineEvent> Timeline::events()
+    {
+        return ourEvents.mid(0, count());
+    }
+
+    void Timeline::writeJson(QIODevice *aDevice)
+    {
+        const QVector<TimelineEvent> ourRecorded = events();
+
+        // Thread ids become small numbers, in the order each thread first shows up.
+        QHash<quintptr, int> threads;
+
+        QByteArray ourBuffer;
+        ourBuffer.append("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":");
+        ourBuffer.append(QByteArray::number(dropped()));
+        ourBuffer.append("},\"traceEvents\":[\n");
+
+        for (int i=0; i < ourRecorded.size(); i++) {
+            const TimelineEvent &event = ourRecorded.at(i);
+            if (!threads.contains(event.thread)) {
+                threads.insert(event.thread, threads.size() + 1);
+            }
+
+            ourBuffer.append("{\"name\":");
+            JsonStreamWriter::appendQuoted(ourBuffer, event.name);
+            ourBuffer.append(",\"cat\":");
+            JsonStreamWriter::appendQuoted(ourBuffer, event.category);
+            ourBuffer.append(",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            ourBuffer.append(QByteArray::number(threads.value(event.thread)));
+            // Trace event times are in microseconds
+            ourBuffer.append(",\"ts\":");
+            JsonStreamWriter::appendDouble(ourBuffer, (event.start - ourOrigin) / 1000.0);
+            ourBuffer.append(",\"dur\":");
+            JsonStreamWriter::appendDouble(ourBuffer, event.duration / 1000.0);
+            if ((event.ecu >= 0) or !event.detail.isEmpty()) {
+                ourBuffer.append(",\"args\":{");
+                if (event.ecu >= 0) {
+                    ourBuffer.append(QString("\"ecu\":\"0x%1\"").arg(event.ecu, 2, 16, QChar('0')).toLatin1());
+                }
+                if (!event.detail.isEmpty()) {
+                    ourBuffer.append((event.ecu >= 0) ? ",\"detail\":" : "\"detail\":");
+                    JsonStreamWriter::appendQuoted(ourBuffer, event.detail.toUtf8());
+                }
+                ourBuffer.append('}');
+            }
+            ourBuffer.append((i + 1 < ourRecorded.size()) ? "},\n" : "}\n");
+
+            if (ourBuffer.size() > 65536) {
+                aDevice->write(ourBuffer);
+                ourBuffer.resize(0);
+            }
+        }
+
+        ourBuffer.append("]}\n");
+        aDevice->write(ourBuffer);
+    }
+
+    TimelineSpan::TimelineSpan(const char *aName, const char *aCategory, int anEcu, const QString &aDetail) :
+        _name(aName), _category(aCategory), _start(-1), _ecu(anEcu)
+    {
+        if (Timeline::isEnabled()) {
+            _detail = aDetail;
+            _start = Timeline::now();
+        }
+    }
+
+    void TimelineSpan::next(const char *aName)
+    {
+        if (_start < 0) {
+            return;
+        }
+
+        const qint64 ourNow = Timeline::now();
+        Timeline::record(_name, _category, _start, ourNow, _ecu, _detail);
+        _name = aName;
+        _start = ourNow;
+    }
+
+    void TimelineSpan::finish()
+    {
+        if (_start < 0) {
+            return;
+        }
+
+        Timeline::record(_name, _category, _start, Timeline::now(), _ecu, _detail);
+        _start = -1;
+    }
+}
@@ -0,0 +1,193 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <time.h>
+
+#include <QFile>
+#include <QMutex>
+#include <QStringList>
+
+#include <ds2/trace.h>
+#include <ds2/jsonwriter.h>
+
+namespace {
+    QMutex ourSinkLock;
+    DS2PlusPlus::TraceSink *ourSink = 0;
+
+    DS2PlusPlus::TraceSink *textSink()
+    {
+        static DS2PlusPlus::TextTraceSink ret;
+        return &ret;
+    }
+
+    DS2PlusPlus::TraceSink *jsonSink()
+    {
+        static DS2PlusPlus::JsonTraceSink ret;
+        return &ret;
+    }
+
+    // The environment is read once, as the library loads, rather than on every check.
+    const bool ourEnvironmentRead = (DS2PlusPlus::Trace::readEnvironment(), true);
+}
+
+namespace DS2PlusPlus {
+    QAtomicInt Trace::ourCategories(0);
+
+    void Trace::setEnabled(Category aCategory, bool isEnabled)
+    {
+        int current;
+        do {
+            current = ourCategories.load();
+        } while (!ourCategories.testAndSetOrdered(current, isEnabled ? (current | aCategory) : (current & ~aCategory)));
+    }
+
+    QString Trace::categoryName(Category aCategory)
+    {
+        switch (aCategory) {
+        case General:
+            return "general";
+        case Query:
+            return "query";
+        case Rpn:
+            return "rpn";
+        case Conversion:
+            return "conversion";
+        default:
+            return "all";
+        }
+    }
+
+    void Trace::enable(const QString &someNames)
+    {
+        const Category categories[] = { General, Query, Rpn, Conversion, All };
+
+        foreach (const QString &name, someNames.split(',', QString::SkipEmptyParts)) {
+            bool isKnown = false;
+            for (size_t i=0; i < sizeof(categories) / sizeof(categories[0]); i++) {
+                if (name.trimmed().toLower() == categoryName(categories[i])) {
+                    setEnabled(categories[i]);
+                    isKnown = true;
+                    break;
+                }
+            }
+
+            if (!isKnown) {
+                throw std::invalid_argument(qPrintable(QString("Unknown trace category '%1'.  Expected general, query, rpn, conversion, or all").arg(name)));
+            }
+        }
+    }
+
+    void Trace::readEnvironment()
+    {
+        int categories = 0;
+        if (getenv("DPP_TRACE")) {
+            categories |= General;
+        }
+        if (getenv("DPP_TRACE_QUERY")) {
+            categories |= Query;
+        }
+        if (getenv("RPN_TRACE")) {
+            categories |= Rpn;
+        }
+        if (getenv("DPP_DEBUG_CONVERSION")) {
+            categories |= Conversion;
+        }
+        setCategories(categories);
+
+        if (const char *names = getenv("DPP_TRACE_CATEGORIES")) {
+            try {
+                enable(QString::fromLocal8Bit(names));
+            } catch (std::invalid_argument &error) {
+                fprintf(stderr, "%s\n", error.what());
+            }
+        }
+
+        const char *format = getenv("DPP_TRACE_FORMAT");
+        if (format and (qstrcmp(format, "json") == 0)) {
+            setSink(jsonSink());
+        }
+    }
+
+    void Trace::setSink(TraceSink *aSink)
+    {
+        QMutexLocker locker(&ourSinkLock);
+        ourSink = aSink;
+    }
+
+    void Trace::write(Category aCategory, const QString &aMessage)
+    {
+        QMutexLocker locker(&ourSinkLock);
+        (ourSink ? ourSink : textSink())->write(aCategory, aMessage);
+    }
+
+    TextTraceSink::TextTraceSink(QIODevice *aDevice) :
+        _stream(stderr)
+    {
+        if (aDevice) {
+            _stream.setDevice(aDevice);
+        }
+    }
+
+    void TextTraceSink::write(Trace::Category, const QString &aMessage)
+    {
+        _stream << aMessage << endl;
+    }
+
+    JsonTraceSink::JsonTraceSink(QIODevice *aDevice) :
+        _device(aDevice), _ownsDevice(false)
+    {
+        if (!_device) {
+            QFile *file = new QFile;
+            file->open(stderr, QIODevice::WriteOnly | QIODevice::Unbuffered);
+            _device = file;
+            _ownsDevice = true;
+        }
+    }
+
+    JsonTraceSink::~JsonTraceSink()
+    {
+        if (_ownsDevice) {
+            delete _device;
+        }
+    }
+
+    void JsonTraceSink::write(Trace::Category aCategory, const QString &aMessage)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        _line.resize(0);
+        _line.append("{\"ts\":");
+        JsonStreamWriter::appendDouble(_line, ts.tv_sec + (0.000000001 * ts.tv_nsec));
+        _line.append(",\"category\":\"");
+        _line.append(Trace::categoryName(aCategory).toLatin1());
+        _line.append("\",\"message\":");
+        JsonStreamWriter::appendQuoted(_line, aMessage.trimmed().toUtf8());
+        _line.append("}\n");
+
+        _device->write(_line);
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+#include <stdexcept>
+
+#include <QRegularExpression>
+
+#include <ds2/triggercapture.h>
+
+namespace DS2PlusPlus {
+    Trigger::Trigger() :
+        _condition(Changes), _threshold(0), _thresholdIsNumeric(false), _wasTrue(false)
+    {
+    }
+
+    Trigger Trigger::parse(const QString &anExpression)
+    {
+        Trigger ret;
+        ret._expression = anExpression.trimmed();
+
+        static const QRegularExpression changesPattern("^(\\S+)\\s+changes$");
+        static const QRegularExpression comparisonPattern("^(\\S+?)\\s*(>=|<=|==|!=|>|<)\\s*(\\S+)$");
+
+        QRegularExpressionMatch match = changesPattern.match(ret._expression);
+        if (match.hasMatch()) {
+            ret._channel = match.captured(1);
+            ret._condition = Changes;
+            return ret;
+        }
+
+        match = comparisonPattern.match(ret._expression);
+        if (!match.hasMatch()) {
+            throw std::invalid_argument(qPrintable(QString("Invalid trigger '%1'.  Expected <channel> <op> <value> or <channel> changes").arg(anExpression)));
+        }
+
+        ret._channel = match.captured(1);
+        const QString op = match.captured(2);
+        if (op == ">") {
+            ret._condition = Greater;
+        } else if (op == ">=") {
+            ret._condition = GreaterOrEqual;
+        } else if (op == "<") {
+            ret._condition = Less;
+        } else if (op == "<=") {
+            ret._condition = LessOrEqual;
+        } else if (op == "==") {
+            ret._condition = Equal;
+        } else {
+            ret._condition = NotEqual;
+        }
+
+        ret._thresholdText = match.captured(3);
+        ret._threshold = ret._thresholdText.toDouble(&ret._thresholdIsNumeric);
+        if (!ret._thresholdIsNumeric and (ret._condition != Equal) and (ret._condition != NotEqual)) {
+            throw std::invalid_argument(qPrintable(QString("Invalid trigger '%1'.  Only == and != compare text").arg(anExpression)));
+        }
+
+        return ret;
+    }
+
+    bool Trigger::isTrue(const QVariant &aValue) const
+    {
+        if (!_thresholdIsNumeric) {
+            const bool isEqual = (aValue.toString() == _thresholdText);
+            return (_condition == Equal) ? isEqual : !isEqual;
+        }
+
+        bool ok;
+        const double value = aValue.toDouble(&ok);
+        if (!ok) {
+            return false;
+        }
+
+        switch (_condition) {
+        case Greater:
+            return value > _threshold;
+        case GreaterOrEqual:
+            return value >= _threshold;
+        case Less:
+            return value < _threshold;
+        case LessOrEqual:
+            return value <= _threshold;
+        case Equal:
+            return value == _threshold;
+        case NotEqual:
+            return value != _threshold;
+        default:
+            return false;
+        }
+    }
+
+    bool Trigger::evaluate(const QVariant &aValue)
+    {
+        if (!aValue.isValid()) {
+            return false;
+        }
+
+        if (_condition == Changes) {
+            const bool ret = _last.isValid() and (aValue != _last);
+            _last = aValue;
+            return ret;
+        }
+
+        const bool isNowTrue = isTrue(aValue);
+        const bool ret = isNowTrue and !_wasTrue;
+        _wasTrue = isNowTrue;
+        return ret;
+    }
+
+    TriggerCapture::TriggerCapture(double aPreTrigger, double aPostTrigger, int aCapacity) :
+        _preTrigger(aPreTrigger), _postTrigger(aPostTrigger), _postTriggerEnd(-std::numeric_limits<double>::infinity()), _buffer(qMax(aCapacity, 1))
+    {
+    }
+
+    void TriggerCapture::addTrigger(const Trigger &aTrigger, const QStringList &someChannels)
+    {
+        const int channel = someChannels.indexOf(aTrigger.channel());
+        if (channel < 0) {
+            throw std::invalid_argument(qPrintable(QString("Trigger '%1' watches %2, which isn't being logged").arg(aTrigger.expression()).arg(aTrigger.channel())));
+        }
+
+        _triggers.append(aTrigger);
+        _triggerChannels.append(channel);
+    }
+
+    QStringList TriggerCapture::add(const CapturedSample &aSample)
+    {
+        QStringList ret;
+        for (int i=0; i < _triggers.size(); i++) {
+            if (_triggers[i].evaluate(aSample.values.value(_triggerChannels.at(i)))) {
+                ret << _triggers.at(i).expression();
+            }
+        }
+
+        if (!ret.isEmpty()) {
+            // Release the pre-trigger window, oldest first
+            while (!_buffer.isEmpty()) {
+                const CapturedSample sample = _buffer.takeFirst();
+                if (sample.time >= aSample.time - _preTrigger) {
+                    _ready.append(sample);
+                }
+            }
+            _postTriggerEnd = aSample.time + _postTrigger;
+        }
+
+        if (isCapturing(aSample.time)) {
+            _ready.append(aSample);
+        } else {
+            while (!_buffer.isEmpty() and (_buffer.first().time < aSample.time - _preTrigger)) {
+                _buffer.removeFirst();
+            }
+            _buffer.append(aSample);
+        }
+
+        return ret;
+    }
+
+    QList<CapturedSample> TriggerCapture::takeReady()
+    {
+        QList<CapturedSample> ret;
+        ret.swap(_ready);
+        return ret;
+    }
+}
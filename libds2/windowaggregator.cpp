@@ -0,0 +1,142 @@
+/*
+ * This file is part of libds2
+ * Copyright (C) 2014
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to:
+ * Free Software Foundation, Inc.
+ * 51 Franklin Street, Fifth Floor
+ * Boston, MA  02110-1301 USA
+ *
+ * Or see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <ds2/windowaggregator.h>
+
+namespace DS2PlusPlus {
+    WindowAggregator::WindowAggregator(double aWindow, const QVector<int> &someColumns) :
+        _window(aWindow), _windowStart(-std::numeric_limits<double>::infinity()), _columns(someColumns),
+        _statistics(someColumns.size()), _row(1 + VALUES_PER_COLUMN * someColumns.size()), _hasSamples(false)
+    {
+        if (aWindow <= 0) {
+            throw std::invalid_argument("The aggregation window must be longer than zero seconds");
+        }
+
+        int lastColumn = -1;
+        foreach (int column, someColumns) {
+            lastColumn = qMax(lastColumn, column);
+        }
+        _slotByColumn.fill(-1, lastColumn + 1);
+        for (int i=0; i < someColumns.size(); i++) {
+            _slotByColumn[someColumns.at(i)] = i;
+        }
+    }
+
+    QStringList WindowAggregator::headers(const QStringList &someChannels) const
+    {
+        QStringList ret;
+        ret << "Window Start";
+        foreach (int column, _columns) {
+            const QString &name = someChannels.at(column);
+            ret << name + ":min" << name + ":max" << name + ":mean" << name + ":count" << name + ":last";
+        }
+        return ret;
+    }
+
+    bool WindowAggregator::advance(double aTime)
+    {
+        if (aTime < _windowStart + _window) {
+            return false;
+        }
+
+        const bool ret = _hasSamples;
+        if (ret) {
+            close();
+        }
+        _windowStart = std::floor(aTime / _window) * _window;
+        return ret;
+    }
+
+    void WindowAggregator::add(const QVector<QVariant> &someValues, int aFirst, int aLast)
+    {
+        for (int column=qMax(aFirst, 0); (column <= aLast) and (column < _slotByColumn.size()); column++) {
+            const int slot = _slotByColumn.at(column);
+            const QVariant &value = someValues.at(column);
+            if ((slot < 0) or !value.isValid()) {
+                continue;
+            }
+
+            Statistics &statistics = _statistics[slot];
+            statistics.count++;
+            statistics.last = value;
+            _hasSamples = true;
+
+            bool ok;
+            const double number = value.toDouble(&ok);
+            if (!ok or !std::isfinite(number)) {
+                continue;
+            }
+
+            if (statistics.numeric == 0) {
+                statistics.minimum = number;
+                statistics.maximum = number;
+            } else {
+                statistics.minimum = qMin(statistics.minimum, number);
+                statistics.maximum = qMax(statistics.maximum, number);
+            }
+            statistics.sum += number;
+            statistics.numeric++;
+        }
+    }
+
+    bool WindowAggregator::flush()
+    {
+        const bool ret = _hasSamples;
+        if (ret) {
+            close();
+        }
+        return ret;
+    }
+
+    void WindowAggregator::close()
+    {
+        int column = 0;
+        _row[column++] = _windowStart;
+
+        for (int i=0; i < _statistics.size(); i++) {
+            Statistics &statistics = _statistics[i];
+            if (statistics.numeric > 0) {
+                _row[column++] = statistics.minimum;
+                _row[column++] = statistics.maximum;
+                _row[column++] = statistics.sum / statistics.numeric;
+            } else {
+                _row[column++] = QVariant();
+                _row[column++] = QVariant();
+                _row[column++] = QVariant();
+            }
+            _row[column++] = statistics.count;
+            // The last value carries over into windows that saw no samples.
+            _row[column++] = statistics.last;
+
+            statistics.sum = 0;
+            statistics.numeric = 0;
+            statistics.count = 0;
+        }
+
+        _hasSamples = false;
+    }
+}
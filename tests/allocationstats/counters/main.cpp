@@ -0,0 +1,124 @@
+#include <QTest>
+
+#include <stdlib.h>
+
+#include <ds2/allocationstats.h>
+
+namespace Test_AllocationStats {
+    class Counters : public QObject
+    {
+        Q_OBJECT
+    public:
+        Counters();
+    private Q_SLOTS:
+        void cleanup();
+        void snapshotDifference();
+        void nestedScopes();
+        void countsPerSubsystem();
+        void disabledCountsNothing();
+        void summary();
+    };
+
+    Counters::Counters()
+      : QObject(0)
+    {
+    }
+
+    void Counters::cleanup()
+    {
+        DS2PlusPlus::AllocationStats::setEnabled(false);
+        DS2PlusPlus::AllocationStats::reset();
+    }
+
+    void Counters::snapshotDifference()
+    {
+        using namespace DS2PlusPlus;
+        AllocationStats::Snapshot earlier, later;
+        earlier.allocations[AllocationStats::Decode] = 5;
+        earlier.bytes[AllocationStats::Decode] = 100;
+        later.allocations[AllocationStats::Decode] = 8;
+        later.bytes[AllocationStats::Decode] = 160;
+        later.allocations[AllocationStats::JsonOutput] = 2;
+        later.bytes[AllocationStats::JsonOutput] = 64;
+        later.frees = 3;
+
+        const AllocationStats::Snapshot used = later - earlier;
+        QCOMPARE(used.allocations[AllocationStats::Decode], Q_UINT64_C(3));
+        QCOMPARE(used.totalAllocations(), Q_UINT64_C(5));
+        QCOMPARE(used.totalBytes(), Q_UINT64_C(124));
+        QCOMPARE(used.frees, Q_UINT64_C(3));
+    }
+
+    void Counters::nestedScopes()
+    {
+        using namespace DS2PlusPlus;
+        const AllocationStats::Subsystem outer = AllocationStats::enter(AllocationStats::PacketIO);
+        QCOMPARE(outer, AllocationStats::Unattributed);
+
+        const AllocationStats::Subsystem inner = AllocationStats::enter(AllocationStats::Decode);
+        QCOMPARE(inner, AllocationStats::PacketIO);
+        AllocationStats::leave(inner);
+
+        QCOMPARE(AllocationStats::enter(AllocationStats::Unattributed), AllocationStats::PacketIO);
+        AllocationStats::leave(outer);
+    }
+
+    void Counters::countsPerSubsystem()
+    {
+        using namespace DS2PlusPlus;
+        if (!AllocationStats::isAvailable()) {
+            QSKIP("libds2 was built without CONFIG+=allocstats");
+        }
+
+        AllocationStats::setEnabled(true);
+        const AllocationStats::Snapshot before = AllocationStats::snapshot();
+        const AllocationStats::Subsystem previous = AllocationStats::enter(AllocationStats::Decode);
+        void *volatile block = malloc(1000);
+        free(block);
+        AllocationStats::leave(previous);
+        const AllocationStats::Snapshot used = AllocationStats::snapshot() - before;
+        AllocationStats::setEnabled(false);
+
+        QCOMPARE(used.allocations[AllocationStats::Decode], Q_UINT64_C(1));
+        QCOMPARE(used.bytes[AllocationStats::Decode], Q_UINT64_C(1000));
+        QVERIFY(used.frees >= 1);
+    }
+
+    void Counters::disabledCountsNothing()
+    {
+        using namespace DS2PlusPlus;
+        const AllocationStats::Snapshot before = AllocationStats::snapshot();
+        void *volatile block = malloc(1000);
+        free(block);
+        QCOMPARE((AllocationStats::snapshot() - before).totalAllocations(), Q_UINT64_C(0));
+
+        // Switching it on does nothing when the accounting wasn't built in
+        AllocationStats::setEnabled(true);
+        QCOMPARE(AllocationStats::isEnabled(), AllocationStats::isAvailable());
+    }
+
+    void Counters::summary()
+    {
+        using namespace DS2PlusPlus;
+        AllocationStats::Snapshot used;
+        used.allocations[AllocationStats::Decode] = 40;
+        used.bytes[AllocationStats::Decode] = 4000;
+
+        const QStringList lines = AllocationStats::summary(used, 10).split('\n', QString::SkipEmptyParts);
+        QCOMPARE(lines.size(), AllocationStats::SubsystemCount + 3);
+        QVERIFY(lines.at(3).startsWith("decode"));
+        QVERIFY(lines.at(3).contains("4.0"));
+        QVERIFY(lines.at(AllocationStats::SubsystemCount + 1).startsWith("total"));
+
+        QCOMPARE(AllocationStats::line(used), QString("40 allocations, 4000 B: decode 40 (4000 B)"));
+        QCOMPARE(AllocationStats::line(AllocationStats::Snapshot()), QString("0 allocations, 0 B: none"));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_AllocationStats::Counters tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
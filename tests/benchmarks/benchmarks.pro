@@ -0,0 +1,2 @@
+TEMPLATE = subdirs
+SUBDIRS += decode database
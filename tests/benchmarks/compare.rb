@@ -0,0 +1,40 @@
+#!/usr/bin/env ruby
+
+# Compares two QTest XML benchmark results and fails if any case got slower than the threshold allows.
+
+require 'optparse'
+require 'rexml/document'
+
+threshold = 10.0
+OptionParser.new do |opts|
+  opts.banner = "Usage: compare.rb [--threshold percent] baseline.xml current.xml"
+  opts.on("-t", "--threshold PERCENT", Float, "Allowed slowdown in percent (default 10)") { |t| threshold = t }
+end.parse!
+
+abort("Need a baseline and a current result file") unless ARGV.length == 2
+
+def results(path)
+  ret = {}
+  REXML::Document.new(File.read(path)).elements.each("//TestFunction") do |function|
+    function.elements.each("BenchmarkResult") do |result|
+      name = [function.attributes["name"], result.attributes["tag"]].reject { |x| x.nil? || x.empty? }.join(":")
+      # QTest already divides by the number of iterations
+      ret[name] = result.attributes["value"].to_f
+    end
+  end
+  ret
+end
+
+baseline = results(ARGV[0])
+current = results(ARGV[1])
+regressions = 0
+
+current.keys.sort.each do |name|
+  next unless baseline.key?(name) and baseline[name] > 0
+  change = (current[name] - baseline[name]) / baseline[name] * 100
+  marker = change > threshold ? " REGRESSION" : ""
+  regressions += 1 unless marker.empty?
+  printf("%-70s %12.4f %12.4f %+7.1f%%%s\n", name, baseline[name], current[name], change, marker)
+end
+
+exit(regressions > 0 ? 1 : 0)
@@ -0,0 +1,18 @@
+CONFIG += testcase benchmark
+
+QT       -= gui
+QT       += testlib sql
+
+TARGET = tst_benchmarks_database
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+LIBS += -lds2
+INCLUDEPATH += ../../../libds2
+LIBPATH += ../../../libds2
+
+SOURCES += main.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+OTHER_FILES +=
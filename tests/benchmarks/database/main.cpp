@@ -0,0 +1,119 @@
+#include <QTest>
+#include <QTemporaryDir>
+
+#include <ds2/ds2packet.h>
+#include <ds2/manager.h>
+#include <ds2/controlunit.h>
+
+namespace Test_Benchmarks {
+    /*
+     * Database benchmarks.  Every case works on a database built from the dpp-json in this tree, in a
+     * temporary directory, so the results don't depend on whatever is installed in ~/.dpp.
+     */
+    class Database : public QObject
+    {
+        Q_OBJECT
+    public:
+        Database();
+    private Q_SLOTS:
+        void initTestCase();
+        void buildDatabase();
+        void reloadUnchanged();
+        void loadByUuid_data();
+        void loadByUuid();
+        void findModuleByMatchingIdentPacket();
+    protected:
+        DS2PlusPlus::ManagerPtr createManager(const QString &aDppDir);
+
+        static const char dme_ident[];
+        QTemporaryDir dppDir;
+        QSharedPointer<QCommandLineParser> parser;
+        DS2PlusPlus::ManagerPtr manager;
+    };
+
+    const char Database::dme_ident[] = {0xa0, 0x37, 0x35, 0x30, 0x30, 0x32, 0x35, 0x35, 0x31, 0x35, 0x30, 0x30, 0x43, 0x30, 0x36, 0x30, 0x32, 0x37, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x31, 0x32, 0x45, 0x33, 0x30, 0x30, 0x00, 0x30, 0x32, 0x35, 0x35, 0x30, 0x32, 0x32, 0x30};
+
+    Database::Database()
+      : QObject(0)
+    {
+    }
+
+    DS2PlusPlus::ManagerPtr Database::createManager(const QString &aDppDir)
+    {
+        using namespace DS2PlusPlus;
+        parser = QSharedPointer<QCommandLineParser>(new QCommandLineParser);
+        ManagerPtr ret(new Manager(parser));
+        parser->parse(QStringList() << "benchmark" << "--dpp-dir" << aDppDir << "--dpp-source-dir" << QString(SRCDIR "../../../dpp-json"));
+        ret->initializeManager();
+        return ret;
+    }
+
+    void Database::initTestCase()
+    {
+        QVERIFY(dppDir.isValid());
+        manager = createManager(dppDir.path());
+        manager->initializeDatabase();
+        QVERIFY(!manager->findAllModules().isEmpty());
+    }
+
+    void Database::buildDatabase()
+    {
+        // Each pass starts from nothing, so this is the full build a fresh install does.
+        QBENCHMARK {
+            QTemporaryDir ourDir;
+            DS2PlusPlus::ManagerPtr ourManager = createManager(ourDir.path());
+            ourManager->initializeDatabase();
+        }
+    }
+
+    void Database::reloadUnchanged()
+    {
+        // Nothing has changed since initTestCase(), so this is the cost of checking every file.
+        QBENCHMARK {
+            manager->initializeDatabase();
+        }
+    }
+
+    void Database::loadByUuid_data()
+    {
+        QTest::addColumn<QString>("uuid");
+
+        QHash<QString, DS2PlusPlus::ControlUnitPtr> modules = manager->findAllModules();
+        QStringList uuids = modules.keys();
+        uuids.sort();
+        foreach (const QString &uuid, uuids) {
+            const DS2PlusPlus::ControlUnitPtr ecu = modules.value(uuid);
+            QTest::newRow(qPrintable(QString("%1 %2").arg(ecu->family()).arg(ecu->name()))) << uuid;
+        }
+    }
+
+    void Database::loadByUuid()
+    {
+        QFETCH(QString, uuid);
+
+        QBENCHMARK {
+            DS2PlusPlus::ControlUnit ecu(uuid, manager.data());
+        }
+    }
+
+    void Database::findModuleByMatchingIdentPacket()
+    {
+        using namespace DS2PlusPlus;
+        const BasePacketPtr packet(PACKET_FROM_CHARS(ControlUnit::addressForFamily("DME").first(), dme_ident));
+
+        ControlUnitPtr ecu;
+        QBENCHMARK {
+            ecu = manager->findModuleByMatchingIdentPacket(packet);
+        }
+        QVERIFY(!ecu.isNull());
+        QCOMPARE(ecu->uuid(), QString("12000000-0001-0000-0000-000000000000"));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Benchmarks::Database tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
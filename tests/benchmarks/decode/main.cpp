@@ -0,0 +1,212 @@
+#include <QTest>
+
+#include <ds2/ds2packet.h>
+#include <ds2/manager.h>
+#include <ds2/controlunit.h>
+#include <ds2/allocationstats.h>
+
+namespace Test_Benchmarks {
+    /*
+     * Decoding benchmarks.  Run with -o results.xml,xml (or csv) for output that can be compared between
+     * releases; see ../README.md.
+     */
+    class Decode : public QObject
+    {
+        Q_OBJECT
+    public:
+        Decode();
+    private Q_SLOTS:
+        void initTestCase();
+        void parseOperation_data();
+        void parseOperation();
+        void parseRecorded_data();
+        void parseRecorded();
+        void responseToJson();
+        void packetFromString();
+        void allocations_data();
+        void allocations();
+    protected:
+        static QByteArray replyFor(const DS2PlusPlus::Operation &anOperation, quint32 aSeed);
+
+        static const char dme_status[];
+        static const char dme_ident[];
+        DS2PlusPlus::Manager *manager;
+        QHash<QString, DS2PlusPlus::ControlUnitPtr> modules;
+    };
+
+    // Replies recorded from an MS42 DME, the same ones the parse_operation tests check
+    const char Decode::dme_status[] = {0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7d, 0x7c, 0x72, 0x6c, 0xb0, 0x00, 0x00, 0x1b, 0xfc, 0x90, 0x58, 0xa0, 0x78, 0x75, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x07, 0x00, 0xb9};
+    const char Decode::dme_ident[] = {0xa0, 0x37, 0x35, 0x30, 0x30, 0x32, 0x35, 0x35, 0x31, 0x35, 0x30, 0x30, 0x43, 0x30, 0x36, 0x30, 0x32, 0x37, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x31, 0x32, 0x45, 0x33, 0x30, 0x30, 0x00, 0x30, 0x32, 0x35, 0x35, 0x30, 0x32, 0x32, 0x30};
+
+    Decode::Decode()
+      : QObject(0), manager(0)
+    {
+    }
+
+    void Decode::initTestCase()
+    {
+        manager = new DS2PlusPlus::Manager();
+        modules = manager->findAllModules();
+        QVERIFY(!modules.isEmpty());
+    }
+
+    QByteArray Decode::replyFor(const DS2PlusPlus::Operation &anOperation, quint32 aSeed)
+    {
+        // Long enough to cover every result, filled with the same pseudo-random bytes on every run
+        int length = 1;
+        foreach (const DS2PlusPlus::Result &result, anOperation.results()) {
+            length = qMax(length, result.startPosition() + result.length());
+        }
+
+        QByteArray ret(qMin(length, DS2PlusPlus::Frame::maxPayload(anOperation.protocol())), 0);
+        ret[0] = static_cast<char>(0xa0);
+        for (int i=1; i < ret.size(); i++) {
+            aSeed = aSeed * 1664525 + 1013904223;
+            ret[i] = static_cast<char>(aSeed >> 24);
+        }
+        return ret;
+    }
+
+    void Decode::parseOperation_data()
+    {
+        using namespace DS2PlusPlus;
+        QTest::addColumn<QString>("uuid");
+        QTest::addColumn<QString>("operation");
+
+        QStringList uuids = modules.keys();
+        uuids.sort();
+        foreach (const QString &uuid, uuids) {
+            const ControlUnitPtr ecu = modules.value(uuid);
+            QStringList operations = ecu->operations().keys();
+            operations.sort();
+            foreach (const QString &operation, operations) {
+                QTest::newRow(qPrintable(QString("%1 %2 %3").arg(ecu->family()).arg(ecu->name()).arg(operation))) << uuid << operation;
+            }
+        }
+    }
+
+    void Decode::parseOperation()
+    {
+        using namespace DS2PlusPlus;
+        QFETCH(QString, uuid);
+        QFETCH(QString, operation);
+
+        const ControlUnitPtr ecu = modules.value(uuid);
+        const OperationPtr ourOperation = ecu->operations().value(operation);
+        const QByteArray payload = replyFor(*ourOperation, qHash(uuid + operation));
+        const Frame reply(ourOperation->protocol(), ecu->address(), reinterpret_cast<const quint8 *>(payload.constData()), payload.size());
+
+        PacketResponse response;
+        QBENCHMARK {
+            response.clear();
+            ecu->parseOperation(ourOperation, reply, response);
+        }
+    }
+
+    void Decode::parseRecorded_data()
+    {
+        QTest::addColumn<QString>("operation");
+        QTest::addColumn<QByteArray>("payload");
+
+        QTest::newRow("DME MS42 status") << "status" << QByteArray(dme_status, sizeof(dme_status));
+        QTest::newRow("DME MS42 identify") << "identify" << QByteArray(dme_ident, sizeof(dme_ident));
+    }
+
+    void Decode::parseRecorded()
+    {
+        using namespace DS2PlusPlus;
+        QFETCH(QString, operation);
+        QFETCH(QByteArray, payload);
+
+        ControlUnit ecu("12000000-0001-0000-0000-000000000000", manager);
+        const OperationPtr ourOperation = ecu.operations().value(operation);
+        QVERIFY(!ourOperation.isNull());
+        const Frame reply(ourOperation->protocol(), ecu.address(), reinterpret_cast<const quint8 *>(payload.constData()), payload.size());
+
+        PacketResponse response;
+        QBENCHMARK {
+            response.clear();
+            ecu.parseOperation(ourOperation, reply, response);
+        }
+        QVERIFY(!response.isEmpty());
+    }
+
+    void Decode::responseToJson()
+    {
+        using namespace DS2PlusPlus;
+        ControlUnit ecu("12000000-0001-0000-0000-000000000000", manager);
+        const PacketResponse response = ecu.parseOperation("status", BasePacketPtr(PACKET_FROM_CHARS(ecu.address(), dme_status)));
+
+        QString json;
+        QBENCHMARK {
+            json = ResponseToJsonString(response);
+        }
+        QVERIFY(!json.isEmpty());
+    }
+
+    void Decode::packetFromString()
+    {
+        using namespace DS2PlusPlus;
+        const QString packetString("12 26 a0 00 00 00 00 00 00 00 7d 7c 72 6c b0 00 00 1b fc 90 58 a0 78 75 80 00 80 00 00 00 00 00 00 00 07 07 00 b9");
+
+        QBENCHMARK {
+            DS2Packet packet(packetString);
+        }
+    }
+
+    void Decode::allocations_data()
+    {
+        QTest::addColumn<QString>("operation");
+        QTest::addColumn<QByteArray>("payload");
+        QTest::addColumn<bool>("isJson");
+
+        QTest::newRow("decode DME MS42 status") << "status" << QByteArray(dme_status, sizeof(dme_status)) << false;
+        QTest::newRow("decode DME MS42 identify") << "identify" << QByteArray(dme_ident, sizeof(dme_ident)) << false;
+        QTest::newRow("JSON DME MS42 status") << "status" << QByteArray(dme_status, sizeof(dme_status)) << true;
+    }
+
+    void Decode::allocations()
+    {
+        using namespace DS2PlusPlus;
+        if (!AllocationStats::isAvailable()) {
+            QSKIP("libds2 was built without CONFIG+=allocstats");
+        }
+
+        QFETCH(QString, operation);
+        QFETCH(QByteArray, payload);
+        QFETCH(bool, isJson);
+
+        ControlUnit ecu("12000000-0001-0000-0000-000000000000", manager);
+        const OperationPtr ourOperation = ecu.operations().value(operation);
+        const Frame reply(ourOperation->protocol(), ecu.address(), reinterpret_cast<const quint8 *>(payload.constData()), payload.size());
+
+        PacketResponse response;
+        ecu.parseOperation(ourOperation, reply, response);
+
+        // Reported as events: allocations per call, the number to drive down
+        const int calls = 100;
+        AllocationStats::setEnabled(true);
+        const AllocationStats::Snapshot before = AllocationStats::snapshot();
+        for (int i=0; i < calls; i++) {
+            if (isJson) {
+                ResponseToJsonString(response);
+            } else {
+                PacketResponse ourResponse;
+                ecu.parseOperation(ourOperation, reply, ourResponse);
+            }
+        }
+        const AllocationStats::Snapshot used = AllocationStats::snapshot() - before;
+        AllocationStats::setEnabled(false);
+
+        qDebug() << qPrintable(AllocationStats::line(used));
+        QTest::setBenchmarkResult(static_cast<qreal>(used.totalAllocations()) / calls, QTest::Events);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Benchmarks::Decode tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
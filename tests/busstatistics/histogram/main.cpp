@@ -0,0 +1,140 @@
+#include <QTest>
+
+#include <ds2/busstatistics.h>
+
+namespace Test_BusStatistics {
+    class Histogram : public QObject
+    {
+        Q_OBJECT
+    public:
+        Histogram();
+    private Q_SLOTS:
+        void bucketBounds();
+        void empty();
+        void percentiles();
+        void relativeError();
+        void largeValues();
+        void perAddressAndOperation();
+        void summary();
+    };
+
+    Histogram::Histogram()
+      : QObject(0)
+    {
+    }
+
+    void Histogram::bucketBounds()
+    {
+        using namespace DS2PlusPlus;
+        // Small values are exact
+        for (quint64 i=0; i < 32; i++) {
+            QCOMPARE(LatencyHistogram::bucketFor(i), static_cast<int>(i));
+            QCOMPARE(LatencyHistogram::bucketUpperBound(i), i);
+        }
+
+        // Every value lands in the bucket whose range covers it
+        for (quint64 i=32; i < 200000; i += 7) {
+            const int bucket = LatencyHistogram::bucketFor(i);
+            QVERIFY(LatencyHistogram::bucketUpperBound(bucket) >= i);
+            QVERIFY(LatencyHistogram::bucketUpperBound(bucket - 1) < i);
+        }
+    }
+
+    void Histogram::empty()
+    {
+        using namespace DS2PlusPlus;
+        LatencyHistogram histogram;
+        QCOMPARE(histogram.count(), Q_UINT64_C(0));
+        QCOMPARE(histogram.minimum(), Q_UINT64_C(0));
+        QCOMPARE(histogram.percentile(99), Q_UINT64_C(0));
+        QCOMPARE(histogram.mean(), 0.0);
+    }
+
+    void Histogram::percentiles()
+    {
+        using namespace DS2PlusPlus;
+        LatencyHistogram histogram;
+        // Values below 32 µs have a bucket each, so these percentiles are exact
+        for (quint64 i=1; i <= 20; i++) {
+            histogram.record(i);
+        }
+
+        QCOMPARE(histogram.count(), Q_UINT64_C(20));
+        QCOMPARE(histogram.minimum(), Q_UINT64_C(1));
+        QCOMPARE(histogram.maximum(), Q_UINT64_C(20));
+        QCOMPARE(histogram.mean(), 10.5);
+        QCOMPARE(histogram.percentile(50), Q_UINT64_C(10));
+        QCOMPARE(histogram.percentile(95), Q_UINT64_C(19));
+        QCOMPARE(histogram.percentile(100), Q_UINT64_C(20));
+        QCOMPARE(histogram.percentile(0), Q_UINT64_C(1));
+    }
+
+    void Histogram::relativeError()
+    {
+        using namespace DS2PlusPlus;
+        LatencyHistogram histogram;
+        // A typical DS2 transaction: 80 ms of echo delay plus a few tens of ms for the reply
+        for (int i=0; i < 1000; i++) {
+            histogram.record(80000 + i * 50);
+        }
+
+        const quint64 p50 = histogram.percentile(50);
+        const quint64 p99 = histogram.percentile(99);
+        QVERIFY(p50 >= 80000 + 499 * 50);
+        QVERIFY(p50 <= (80000 + 499 * 50) * 17 / 16);
+        QVERIFY(p99 >= 80000 + 989 * 50);
+        QVERIFY(p99 <= histogram.maximum());
+    }
+
+    void Histogram::largeValues()
+    {
+        using namespace DS2PlusPlus;
+        LatencyHistogram histogram;
+        histogram.record(Q_UINT64_C(0xffffffffffffffff));
+        QCOMPARE(LatencyHistogram::bucketFor(Q_UINT64_C(0xffffffffffffffff)), LatencyHistogram::BUCKET_COUNT - 1);
+        QCOMPARE(histogram.percentile(50), Q_UINT64_C(0xffffffffffffffff));
+    }
+
+    void Histogram::perAddressAndOperation()
+    {
+        using namespace DS2PlusPlus;
+        BusStatistics statistics;
+        QVERIFY(statistics.addresses().isEmpty());
+
+        TransactionStatistics *dme = statistics.forAddress(0x12);
+        QVERIFY(dme == statistics.forAddress(0x12));
+        dme->timeouts.fetchAndAddRelaxed(2);
+
+        TransactionStatistics *status = statistics.forOperation("DME:status");
+        QVERIFY(status == statistics.forOperation("DME:status"));
+        status->transaction.record(95000);
+
+        QCOMPARE(statistics.addresses().keys(), QList<quint8>() << 0x12);
+        QCOMPARE(statistics.addresses().value(0x12)->timeouts.load(), quint32(2));
+        QCOMPARE(statistics.operations().keys(), QStringList() << "DME:status");
+        QCOMPARE(statistics.operations().value("DME:status")->transaction.count(), Q_UINT64_C(1));
+    }
+
+    void Histogram::summary()
+    {
+        using namespace DS2PlusPlus;
+        BusStatistics statistics;
+        statistics.forAddress(0x12)->transactions.fetchAndAddRelaxed(3);
+        statistics.forOperation("DME:status")->checksumErrors.fetchAndAddRelaxed(1);
+
+        const QStringList lines = statistics.summary().split('\n', QString::SkipEmptyParts);
+        QCOMPARE(lines.size(), 3);
+        QVERIFY(lines.at(0).startsWith("ECU / operation"));
+        QVERIFY(lines.at(1).startsWith("0x12 "));
+        QVERIFY(lines.at(2).startsWith("DME:status"));
+        QCOMPARE(lines.at(1).size(), lines.at(0).size());
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_BusStatistics::Histogram tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
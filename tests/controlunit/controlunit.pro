@@ -1,2 +1,3 @@
 TEMPLATE = subdirs
-SUBDIRS += parse_operation
+SUBDIRS += parse_operation \
+    parse_operation_batch
@@ -0,0 +1,211 @@
+#include "dme_ms420_status_batch.h"
+
+namespace {
+    DS2PlusPlus::Result shortResult(const QString &aName, const QString &aType, int aPosition, const QString &anRpn, const QString &aDisplay)
+    {
+        DS2PlusPlus::Result ret;
+        ret.setName(aName);
+        ret.setType(aType);
+        ret.setStartPosition(aPosition);
+        ret.setLength(2);
+        ret.setRpn(anRpn);
+        ret.setDisplayFormat(aDisplay);
+        return ret;
+    }
+}
+
+namespace Test_ControlUnit {
+    namespace ParseOperationBatch {
+
+        const char DME_MS420_Status_Batch::dme_status[] = {0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7d, 0x7c, 0x72, 0x6c, 0xb0, 0x00, 0x00, 0x1b, 0xfc, 0x90, 0x58, 0xa0, 0x78, 0x75, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x07, 0x00, 0xb9};
+
+        DME_MS420_Status_Batch::DME_MS420_Status_Batch()
+        {
+            using namespace DS2PlusPlus;
+            const quint8 address = ControlUnit::addressForFamily("DME").first();
+
+            // Vary every byte so each row decodes to something different.
+            for (int i=0; i < PACKET_COUNT; i++) {
+                QByteArray payload(dme_status, sizeof(dme_status) / sizeof(char));
+                for (int j=1; j < payload.length(); j++) {
+                    payload[j] = static_cast<char>(payload.at(j) + (i * 7));
+                }
+                packets.append(BasePacketPtr(new DS2Packet(address, payload)));
+            }
+
+            // One truncated packet at the end to exercise the validity mask.
+            packets.append(BasePacketPtr(new DS2Packet(address, QByteArray(dme_status, 4))));
+
+            ecu = ControlUnitPtr(new DS2PlusPlus::ControlUnit);
+            ecu->loadByUuid("12000000-0001-0000-0000-000000000000");
+            results = ecu->parseOperationBatch("status", packets);
+        }
+
+        void DME_MS420_Status_Batch::compareColumn(const QString &aResultName, const DS2PlusPlus::BatchResponse &someResults)
+        {
+            using namespace DS2PlusPlus;
+
+            QVERIFY(someResults.contains(aResultName));
+            const BatchColumn column = someResults.value(aResultName);
+
+            for (int i=0; i < packets.count(); i++) {
+                const PacketResponse scalar = ecu->parseOperation("status", packets.at(i));
+
+                QCOMPARE(static_cast<bool>(column.valid.at(i)), scalar.contains(aResultName));
+                if (!scalar.contains(aResultName)) {
+                    continue;
+                }
+
+                switch (column.type) {
+                case BatchColumn::ColumnDouble:
+                    QCOMPARE(column.doubles.at(i), scalar.value(aResultName).toDouble());
+                    break;
+                case BatchColumn::ColumnInt64:
+                    QCOMPARE(column.ints.at(i), scalar.value(aResultName).toLongLong());
+                    break;
+                case BatchColumn::ColumnVariant:
+                    QCOMPARE(column.variants.at(i), scalar.value(aResultName));
+                    break;
+                }
+            }
+        }
+
+        void DME_MS420_Status_Batch::oilTemp()
+        {
+            compareColumn("temp.motor_oil", results);
+        }
+
+        void DME_MS420_Status_Batch::coolantTemp()
+        {
+            compareColumn("temp.coolant", results);
+        }
+
+        void DME_MS420_Status_Batch::intakeTemp()
+        {
+            compareColumn("temp.intake_air", results);
+        }
+
+        void DME_MS420_Status_Batch::batteryVoltage()
+        {
+            compareColumn("voltage.battery", results);
+        }
+
+        void DME_MS420_Status_Batch::allColumns()
+        {
+            foreach (const QString &resultName, results.keys()) {
+                compareColumn(resultName, results);
+            }
+        }
+
+        void DME_MS420_Status_Batch::shortPacket()
+        {
+            const DS2PlusPlus::BatchColumn column = results.value("temp.coolant");
+            QCOMPARE(column.valid.count(), packets.count());
+            QCOMPARE(static_cast<int>(column.valid.last()), 0);
+        }
+
+
+        void DME_MS420_Status_Batch::scalarFallback()
+        {
+            using namespace DS2PlusPlus;
+
+            BatchDecoder::setScalarOnly(true);
+            QCOMPARE(QString(BatchDecoder::instructionSet()), QString("scalar"));
+            const BatchResponse scalarResults = ecu->parseOperationBatch("status", packets);
+            BatchDecoder::setScalarOnly(false);
+
+            foreach (const QString &resultName, results.keys()) {
+                compareColumn(resultName, scalarResults);
+            }
+        }
+
+        void DME_MS420_Status_Batch::shortResults()
+        {
+            using namespace DS2PlusPlus;
+
+            // The shapes short results take in the DPP files, including a division that has to stay per packet
+            OperationPtr op(new Operation("", ecu->address(), "shorts", QByteArray("\x0b\x03", 2)));
+            op->insertResult("temp", shortResult("temp", "signed_short", 1, "N 0.1 * 40 -", "float"));
+            op->insertResult("voltage", shortResult("voltage", "short", 3, "N 0.004887 *", "float"));
+            op->insertResult("load", shortResult("load", "short", 5, "N 0.25 *", "int"));
+            op->insertResult("offset", shortResult("offset", "signed_short", 7, "N 0.01 * 5 +", "int"));
+            op->insertResult("divided", shortResult("divided", "short", 9, "N 16 /", "int"));
+            op->insertResult("raw", shortResult("raw", "short", 11, "", "float"));
+
+            const int rows = 61, stride = 13;
+            QByteArray matrix(rows * stride, 0);
+            QList<BasePacketPtr> shortPackets;
+            for (int i=0; i < rows; i++) {
+                for (int j=0; j < stride; j++) {
+                    matrix[(i * stride) + j] = static_cast<char>((i * 53) + (j * 29) + 0x7f);
+                }
+                shortPackets.append(BasePacketPtr(new DS2Packet(ecu->address(), matrix.mid(i * stride, stride))));
+            }
+
+            for (int pass=0; pass < 2; pass++) {
+                BatchDecoder::setScalarOnly(pass == 1);
+                const BatchResponse batch = ecu->parseOperationBatch(op, reinterpret_cast<const quint8 *>(matrix.constData()), stride, NULL, rows);
+                BatchDecoder::setScalarOnly(false);
+
+                QCOMPARE(batch.value("load").type, BatchColumn::ColumnInt64);
+                QCOMPARE(batch.value("offset").type, BatchColumn::ColumnInt64);
+                QCOMPARE(batch.value("divided").type, BatchColumn::ColumnVariant);
+
+                for (int i=0; i < rows; i++) {
+                    const PacketResponse scalar = ecu->parseOperation(op, shortPackets.at(i));
+                    foreach (const QString &resultName, scalar.keys()) {
+                        const BatchColumn column = batch.value(resultName);
+                        const QVariant expected = scalar.value(resultName);
+                        switch (column.type) {
+                        case BatchColumn::ColumnDouble:
+                            // Both are the same float widened, so they must match exactly
+                            QVERIFY(column.doubles.at(i) == expected.toDouble());
+                            break;
+                        case BatchColumn::ColumnInt64:
+                            QCOMPARE(column.ints.at(i), expected.toLongLong());
+                            break;
+                        case BatchColumn::ColumnVariant:
+                            QCOMPARE(column.variants.at(i), expected);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        void DME_MS420_Status_Batch::kernels()
+        {
+            using namespace DS2PlusPlus;
+
+            // Enough rows for full vectors and a tail, three bytes apart so fields straddle word boundaries.
+            const int rows = 29, stride = 3;
+            QByteArray matrix(rows * stride, 0);
+            for (int i=0; i < matrix.size(); i++) {
+                matrix[i] = static_cast<char>((i * 37) + 0x81);
+            }
+            const quint8 *payloads = reinterpret_cast<const quint8 *>(matrix.constData());
+
+            for (int pass=0; pass < 2; pass++) {
+                BatchDecoder::setScalarOnly(pass == 1);
+
+                QVector<double> bytes(rows), shorts(rows);
+                BatchDecoder::decodeBytes(payloads, stride, 1, rows, true, 0.5, -3, bytes.data());
+                BatchDecoder::decodeShorts(payloads, stride, 1, rows, false, true, 0.1f, 10.0f, shorts.data());
+
+                for (int i=0; i < rows; i++) {
+                    const quint8 *field = payloads + (i * stride) + 1;
+                    QCOMPARE(bytes.at(i), static_cast<qint8>(field[0]) * 0.5 - 3);
+                    const float product = static_cast<quint16>((field[0] << 8) | field[1]) * 0.1f;
+                    QCOMPARE(shorts.at(i), static_cast<double>(product + 10.0f));
+                }
+            }
+            BatchDecoder::setScalarOnly(false);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_ControlUnit::ParseOperationBatch::DME_MS420_Status_Batch tc;
+  return QTest::qExec(&tc, argc, argv);
+}
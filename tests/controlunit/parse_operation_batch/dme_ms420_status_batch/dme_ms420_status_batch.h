@@ -0,0 +1,45 @@
+#ifndef DME_MS420_STATUS_BATCH_H
+#define DME_MS420_STATUS_BATCH_H
+
+#include <QObject>
+#include <QString>
+#include <QTest>
+
+#include <ds2/ds2packet.h>
+#include <ds2/manager.h>
+#include <ds2/controlunit.h>
+
+namespace Test_ControlUnit {
+    namespace ParseOperationBatch {
+
+        class DME_MS420_Status_Batch : public QObject
+        {
+            Q_OBJECT
+        public:
+            DME_MS420_Status_Batch();
+
+        protected:
+            void compareColumn(const QString &aResultName, const DS2PlusPlus::BatchResponse &someResults);
+
+            static const char dme_status[];
+            static const int PACKET_COUNT = 37;
+            QList<DS2PlusPlus::BasePacketPtr> packets;
+            DS2PlusPlus::ControlUnitPtr ecu;
+            DS2PlusPlus::BatchResponse results;
+
+        private Q_SLOTS:
+            void oilTemp();
+            void coolantTemp();
+            void intakeTemp();
+            void batteryVoltage();
+            void allColumns();
+            void shortPacket();
+            void scalarFallback();
+            void shortResults();
+            void kernels();
+        };
+
+    }
+}
+
+#endif // DME_MS420_STATUS_BATCH_H
@@ -0,0 +1,3 @@
+TEMPLATE = subdirs
+SUBDIRS +=                  \
+    dme_ms420_status_batch
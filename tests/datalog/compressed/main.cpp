@@ -0,0 +1,164 @@
+#include <QTest>
+#include <QBuffer>
+
+#include <stdexcept>
+
+#include <ds2/compressedlog.h>
+
+namespace Test_DataLog {
+    class Compressed : public QObject
+    {
+        Q_OBJECT
+    public:
+        Compressed();
+    private Q_SLOTS:
+        void roundTrip();
+        void smallerThanBinary();
+        void seek();
+        void truncated();
+        void badHeader();
+    protected:
+        QVector<QVariant> record(int aRecord) const;
+        QByteArray encode(int aRecords, int aBlockRecords, bool isFinished = true) const;
+
+        QVector<DS2PlusPlus::DataLogChannel> channels;
+    };
+
+    Compressed::Compressed()
+      : QObject(0)
+    {
+        using namespace DS2PlusPlus;
+        channels << DataLogChannel("DME:status Time", "s", DataLogChannel::TypeDouble)
+                 << DataLogChannel("DME:status:rpm", "rpm", DataLogChannel::TypeUInt64)
+                 << DataLogChannel("DME:status:timing", "deg", DataLogChannel::TypeInt64)
+                 << DataLogChannel("DME:status:coolant", "C", DataLogChannel::TypeDouble)
+                 << DataLogChannel("DME:status:mode", "", DataLogChannel::TypeString, 8);
+    }
+
+    QVector<QVariant> Compressed::record(int aRecord) const
+    {
+        QVector<QVariant> ret;
+        ret << QVariant(aRecord * 0.1)
+            << QVariant(static_cast<quint64>(800 + (aRecord % 50) * 3))
+            << QVariant(static_cast<qint64>((aRecord % 7) - 3))
+            // Missing in every fifth record
+            << ((aRecord % 5) ? QVariant(90.5 + (aRecord / 100)) : QVariant())
+            << QVariant(QString((aRecord / 20) % 2 ? "idle" : "part"));
+        return ret;
+    }
+
+    QByteArray Compressed::encode(int aRecords, int aBlockRecords, bool isFinished) const
+    {
+        using namespace DS2PlusPlus;
+        CompressedLogWriter writer(aBlockRecords);
+        QByteArray ret = writer.start(channels);
+        for (int i=0; i < aRecords; i++) {
+            ret.append(writer.encode(record(i)));
+        }
+        if (isFinished) {
+            ret.append(writer.finish());
+        }
+        return ret;
+    }
+
+    void Compressed::roundTrip()
+    {
+        using namespace DS2PlusPlus;
+        QByteArray data = encode(1000, 128);
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        CompressedLogReader reader;
+        reader.open(&buffer);
+        QVERIFY(reader.channels() == channels);
+        QCOMPARE(reader.recordCount(), Q_INT64_C(1000));
+
+        QVector<QVariant> values;
+        for (int i=0; i < 1000; i++) {
+            QVERIFY(reader.next(values));
+            const QVector<QVariant> expected = record(i);
+            QCOMPARE(values.at(0).toDouble(), expected.at(0).toDouble());
+            QCOMPARE(values.at(1).toULongLong(), expected.at(1).toULongLong());
+            QCOMPARE(values.at(2).toLongLong(), expected.at(2).toLongLong());
+            QCOMPARE(values.at(3).isValid(), expected.at(3).isValid());
+            QCOMPARE(values.at(3).toDouble(), expected.at(3).toDouble());
+            QCOMPARE(values.at(4).toString(), expected.at(4).toString());
+        }
+        QVERIFY(!reader.next(values));
+    }
+
+    void Compressed::smallerThanBinary()
+    {
+        using namespace DS2PlusPlus;
+        DataLogWriter binary;
+        binary.setChannels(channels);
+        const qint64 binaryLength = DataLogWriter::encodeHeader(channels).size() + Q_INT64_C(10000) * binary.recordLength();
+
+        QVERIFY(encode(10000, CompressedLogWriter::DEFAULT_BLOCK_RECORDS).size() * 3 < binaryLength);
+    }
+
+    void Compressed::seek()
+    {
+        using namespace DS2PlusPlus;
+        QByteArray data = encode(1000, 128);
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        CompressedLogReader reader;
+        reader.open(&buffer);
+
+        QVector<QVariant> values;
+        QVERIFY(reader.seek(700));
+        QVERIFY(reader.next(values));
+        QCOMPARE(values.at(1).toULongLong(), record(700).at(1).toULongLong());
+        QVERIFY(reader.next(values));
+        QCOMPARE(values.at(0).toDouble(), record(701).at(0).toDouble());
+
+        QVERIFY(reader.seek(0));
+        QVERIFY(reader.next(values));
+        QCOMPARE(values.at(4).toString(), QString("part"));
+
+        QVERIFY(!reader.seek(1000));
+    }
+
+    void Compressed::truncated()
+    {
+        using namespace DS2PlusPlus;
+        // No index, the records after the last full block never written, and the last block cut short
+        QByteArray data = encode(1000, 128, false);
+        data.chop(100);
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        CompressedLogReader reader;
+        reader.open(&buffer);
+        QCOMPARE(reader.recordCount(), Q_INT64_C(-1));
+        QVERIFY(!reader.seek(10));
+
+        QVector<QVariant> values;
+        int records = 0;
+        while (reader.next(values)) {
+            records++;
+        }
+        QCOMPARE(records, 768);
+    }
+
+    void Compressed::badHeader()
+    {
+        using namespace DS2PlusPlus;
+        QByteArray data("DPPLOG01 but not compressed");
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        CompressedLogReader reader;
+        QVERIFY_EXCEPTION_THROWN(reader.open(&buffer), std::runtime_error);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_DataLog::Compressed tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
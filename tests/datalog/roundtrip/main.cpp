@@ -0,0 +1,169 @@
+#include <QTest>
+#include <QTemporaryFile>
+
+#include <stdexcept>
+
+#include <ds2/datalog.h>
+
+namespace Test_DataLog {
+    class RoundTrip : public QObject
+    {
+        Q_OBJECT
+    public:
+        RoundTrip();
+    private Q_SLOTS:
+        void channelTypes();
+        void writeAndRead();
+        void flags();
+        void partialRecord();
+        void append();
+        void badHeader();
+    protected:
+        QVector<DS2PlusPlus::DataLogChannel> channels;
+    };
+
+    RoundTrip::RoundTrip()
+      : QObject(0)
+    {
+        using namespace DS2PlusPlus;
+        channels << DataLogChannel("DME:status Time", "s", DataLogChannel::TypeDouble)
+                 << DataLogChannel("DME:status:rpm", "rpm", DataLogChannel::TypeUInt64)
+                 << DataLogChannel("DME:status:timing", "deg", DataLogChannel::TypeInt64)
+                 << DataLogChannel("DME:status:mode", "", DataLogChannel::TypeString, 4);
+    }
+
+    void RoundTrip::channelTypes()
+    {
+        using namespace DS2PlusPlus;
+        QCOMPARE(DataLogChannel::forValue("a", "", QVariant(static_cast<qint16>(-1))).type, DataLogChannel::TypeInt64);
+        QCOMPARE(DataLogChannel::forValue("a", "", QVariant(static_cast<quint32>(1))).type, DataLogChannel::TypeUInt64);
+        QCOMPARE(DataLogChannel::forValue("a", "", QVariant(1.5)).type, DataLogChannel::TypeDouble);
+        QCOMPARE(DataLogChannel::forValue("a", "", QVariant(true)).type, DataLogChannel::TypeBool);
+
+        const DataLogChannel string = DataLogChannel::forValue("a", "", QVariant(QString("0123456789")), 8);
+        QCOMPARE(string.type, DataLogChannel::TypeString);
+        QCOMPARE(string.width, 10);
+
+        QCOMPARE(DataLogChannel::forValue("a", "", QVariant()).type, DataLogChannel::TypeString);
+    }
+
+    void RoundTrip::writeAndRead()
+    {
+        using namespace DS2PlusPlus;
+        QTemporaryFile file;
+        QVERIFY(file.open());
+
+        DataLogWriter writer(&file);
+        writer.writeHeader(channels);
+        QCOMPARE(writer.recordLength(), 1 + 8 + 8 + 8 + 4);
+
+        writer.append(QVector<QVariant>() << QVariant(0.25) << QVariant(static_cast<quint64>(850)) << QVariant(-12) << QVariant(QString("limp home")));
+        writer.append(QVector<QVariant>() << QVariant(1.25) << QVariant() << QVariant(3) << QVariant(QString("ok")));
+        file.flush();
+
+        DataLogReader reader;
+        reader.open(file.fileName());
+
+        QCOMPARE(reader.channels(), channels);
+        QCOMPARE(reader.recordCount(), static_cast<qint64>(2));
+
+        QCOMPARE(reader.value(0, 0), QVariant(0.25));
+        QCOMPARE(reader.value(0, 1), QVariant(static_cast<quint64>(850)));
+        QCOMPARE(reader.value(0, 2), QVariant(static_cast<qint64>(-12)));
+        QCOMPARE(reader.value(0, 3), QVariant(QString("limp")));
+
+        QVERIFY(!reader.isValid(1, 1));
+        QVERIFY(!reader.value(1, 1).isValid());
+        QCOMPARE(reader.value(1, 3), QVariant(QString("ok")));
+
+        QVERIFY(!reader.isValid(2, 0));
+        QVERIFY(!reader.isValid(0, 4));
+    }
+
+    void RoundTrip::flags()
+    {
+        using namespace DS2PlusPlus;
+        QTemporaryFile file;
+        QVERIFY(file.open());
+
+        const QVector<DataLogChannel> flagChannels = QVector<DataLogChannel>() << DataLogChannel("DME:status:ac", "", DataLogChannel::TypeBool);
+        DataLogWriter writer(&file);
+        writer.writeHeader(flagChannels);
+        writer.append(QVector<QVariant>() << QVariant(true));
+        writer.append(QVector<QVariant>() << QVariant(false));
+        file.flush();
+
+        DataLogReader reader;
+        reader.open(file.fileName());
+
+        QCOMPARE(reader.channels(), flagChannels);
+        QCOMPARE(reader.value(0, 0), QVariant(true));
+        QCOMPARE(reader.value(1, 0), QVariant(false));
+    }
+
+    void RoundTrip::partialRecord()
+    {
+        using namespace DS2PlusPlus;
+        QTemporaryFile file;
+        QVERIFY(file.open());
+
+        DataLogWriter writer(&file);
+        writer.writeHeader(channels);
+        writer.append(QVector<QVariant>() << QVariant(0.25) << QVariant(1u) << QVariant(2) << QVariant(QString("a")));
+        file.write("\x0f\x00\x00", 3);
+        file.flush();
+
+        DataLogReader reader;
+        reader.open(file.fileName());
+        QCOMPARE(reader.recordCount(), static_cast<qint64>(1));
+    }
+
+    void RoundTrip::append()
+    {
+        using namespace DS2PlusPlus;
+        QTemporaryFile file;
+        QVERIFY(file.open());
+
+        DataLogWriter writer(&file);
+        writer.writeHeader(channels);
+        writer.append(QVector<QVariant>() << QVariant(0.25) << QVariant(1u) << QVariant(2) << QVariant(QString("a")));
+        file.close();
+
+        DataLogReader reader;
+        reader.open(file.fileName());
+
+        QFile appendFile(file.fileName());
+        QVERIFY(appendFile.open(QIODevice::WriteOnly | QIODevice::Append));
+        DataLogWriter appender(&appendFile);
+        appender.setChannels(reader.channels());
+        appender.append(QVector<QVariant>() << QVariant(0.5) << QVariant(3u) << QVariant(4) << QVariant(QString("b")));
+        appendFile.close();
+
+        reader.open(file.fileName());
+        QCOMPARE(reader.recordCount(), static_cast<qint64>(2));
+        QCOMPARE(reader.value(1, 1), QVariant(static_cast<quint64>(3)));
+        QCOMPARE(reader.value(1, 3), QVariant(QString("b")));
+
+        QVERIFY_EXCEPTION_THROWN(appender.append(QVector<QVariant>() << QVariant(1.0)), std::invalid_argument);
+    }
+
+    void RoundTrip::badHeader()
+    {
+        using namespace DS2PlusPlus;
+        QTemporaryFile file;
+        QVERIFY(file.open());
+        file.write("DME:status Time\ts\n");
+        file.flush();
+
+        DataLogReader reader;
+        QVERIFY_EXCEPTION_THROWN(reader.open(file.fileName()), std::runtime_error);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_DataLog::RoundTrip tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -0,0 +1,18 @@
+CONFIG += testcase
+
+QT       -= gui
+QT       += testlib sql
+
+TARGET = tst_datalog_roundtrip
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+LIBS += -lds2
+INCLUDEPATH += ../../../libds2
+LIBPATH += ../../../libds2
+
+SOURCES += main.cpp
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+OTHER_FILES +=
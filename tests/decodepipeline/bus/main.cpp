@@ -0,0 +1,197 @@
+#include <QTest>
+#include <QThread>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <ds2/decodepipeline.h>
+#include <ds2/manager.h>
+
+namespace Test_DecodePipeline {
+    /*
+     * Plays a DME on one end of a socket pair: echoes each request, then sends back a canned status reply.
+     */
+    class FakeEcu : public QThread
+    {
+    public:
+        explicit FakeEcu(int aFd) : _fd(aFd) {}
+
+    protected:
+        virtual void run();
+
+        int _fd;
+    };
+
+    static const quint8 dme_status[] = {0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7d, 0x7c, 0x72, 0x6c, 0xb0, 0x00, 0x00, 0x1b, 0xfc, 0x90, 0x58, 0xa0, 0x78, 0x75, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x07, 0x00, 0xb9};
+
+    static bool readFully(int aFd, quint8 *aBuffer, int aLength)
+    {
+        while (aLength > 0) {
+            const ssize_t bytesRead = read(aFd, aBuffer, aLength);
+            if (bytesRead <= 0) {
+                return false;
+            }
+            aBuffer += bytesRead;
+            aLength -= bytesRead;
+        }
+        return true;
+    }
+
+    void FakeEcu::run()
+    {
+        using namespace DS2PlusPlus;
+        const Frame reply(BasePacket::ProtocolDS2, 0x12, dme_status, sizeof(dme_status));
+        quint8 replyBytes[Frame::MAX_FRAME];
+        const int replyLength = reply.serialize(replyBytes);
+
+        quint8 request[Frame::MAX_FRAME];
+        while (readFully(_fd, request, 2) and (request[1] >= 3) and readFully(_fd, request + 2, request[1] - 2)) {
+            if ((write(_fd, request, request[1]) != request[1]) or (write(_fd, replyBytes, replyLength) != replyLength)) {
+                break;
+            }
+        }
+    }
+
+    class Bus : public QObject
+    {
+        Q_OBJECT
+    public:
+        Bus();
+    private Q_SLOTS:
+        void init();
+        void cleanup();
+
+        void decodesOffTheBusThread();
+        void dropsWhenFull();
+        void stopsOnBusError();
+        void tooManyTasks();
+    protected:
+        DS2PlusPlus::LogScheduler schedule() const;
+
+        int fds[2];
+        FakeEcu *ecuThread;
+        DS2PlusPlus::Manager *manager;
+        DS2PlusPlus::ControlUnitPtr ecu;
+        DS2PlusPlus::OperationPtr status;
+    };
+
+    Bus::Bus()
+      : QObject(0), ecuThread(0), manager(0)
+    {
+    }
+
+    void Bus::init()
+    {
+        using namespace DS2PlusPlus;
+        QCOMPARE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        ecuThread = new FakeEcu(fds[1]);
+        ecuThread->start();
+
+        manager = new Manager(QSharedPointer<QCommandLineParser>(), fds[0]);
+        ecu = ControlUnitPtr(new ControlUnit("12000000-0001-0000-0000-000000000000", manager));
+        status = ecu->operations().value("status");
+        QVERIFY(!status.isNull());
+    }
+
+    void Bus::cleanup()
+    {
+        status.clear();
+        ecu.clear();
+        delete manager;
+        manager = 0;
+
+        // The fake ECU sees the end of its requests and finishes
+        close(fds[0]);
+        ecuThread->wait();
+        close(fds[1]);
+        delete ecuThread;
+        ecuThread = 0;
+    }
+
+    DS2PlusPlus::LogScheduler Bus::schedule() const
+    {
+        DS2PlusPlus::LogScheduler ret;
+        ret.addTask("DME:status", 100, 0.01);
+        return ret;
+    }
+
+    void Bus::decodesOffTheBusThread()
+    {
+        using namespace DS2PlusPlus;
+        DecodePipeline pipeline(schedule());
+        QCOMPARE(pipeline.addTask(ecu, status), 0);
+        pipeline.start();
+
+        DecodePipeline::Sample sample;
+        PacketResponse response;
+        for (int i=0; i < 3; i++) {
+            QVERIFY(pipeline.next(sample, response, 5000));
+            QCOMPARE(sample.task, 0);
+            QVERIFY(sample.time >= pipeline.startTime());
+            QVERIFY(sample.duration > 0);
+            QCOMPARE(sample.reply.length(), static_cast<int>(sizeof(dme_status)));
+            QVERIFY(response.contains("temp.coolant"));
+        }
+
+        pipeline.stop();
+        QVERIFY(pipeline.errorString().isEmpty());
+        QVERIFY(pipeline.scheduler().tasks().at(0).runs >= 3);
+
+        // Whatever was still queued can be taken after the bus thread has stopped
+        int remaining = 0;
+        while (pipeline.next(sample, response, 0)) {
+            remaining++;
+        }
+        QCOMPARE(3 + remaining, pipeline.samplesQueued());
+        QVERIFY(!pipeline.next(sample, response, 0));
+    }
+
+    void Bus::dropsWhenFull()
+    {
+        using namespace DS2PlusPlus;
+        DecodePipeline pipeline(schedule(), 1);
+        pipeline.addTask(ecu, status);
+        pipeline.start();
+
+        // Nothing is taken, so after the first reply every one is dropped rather than holding up the bus
+        QTRY_VERIFY_WITH_TIMEOUT(pipeline.samplesDropped() >= 2, 5000);
+        pipeline.stop();
+        QCOMPARE(pipeline.samplesQueued(), 1);
+        QCOMPARE(pipeline.highWaterMark(), 1);
+        QVERIFY(pipeline.scheduler().tasks().at(0).runs >= 3);
+    }
+
+    void Bus::stopsOnBusError()
+    {
+        using namespace DS2PlusPlus;
+        manager->setFd(-1);
+
+        DecodePipeline pipeline(schedule());
+        pipeline.addTask(ecu, status);
+        pipeline.start();
+        QVERIFY(pipeline.wait(5000));
+        QVERIFY(!pipeline.errorString().isEmpty());
+
+        DecodePipeline::Sample sample;
+        PacketResponse response;
+        QVERIFY(!pipeline.next(sample, response, 0));
+    }
+
+    void Bus::tooManyTasks()
+    {
+        using namespace DS2PlusPlus;
+        DecodePipeline pipeline(schedule());
+        pipeline.addTask(ecu, status);
+        QVERIFY_EXCEPTION_THROWN(pipeline.addTask(ecu, status), std::invalid_argument);
+        QVERIFY_EXCEPTION_THROWN(pipeline.addTask(ecu, OperationPtr()), std::invalid_argument);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_DecodePipeline::Bus tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
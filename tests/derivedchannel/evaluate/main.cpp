@@ -0,0 +1,144 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/derivedchannel.h>
+
+namespace Test_DerivedChannel {
+    class Evaluate : public QObject
+    {
+        Q_OBJECT
+    public:
+        Evaluate();
+    private Q_SLOTS:
+        void parse();
+        void arithmetic();
+        void functions();
+        void invalidInputs();
+        void compileErrors();
+        void incrementalUpdate();
+    };
+
+    Evaluate::Evaluate()
+      : QObject(0)
+    {
+    }
+
+    static QStringList channels()
+    {
+        return QStringList() << "DME:status Time" << "DME:status:rpm" << "DME:status:maf" << "EGS:status Time" << "EGS:status:gear";
+    }
+
+    void Evaluate::parse()
+    {
+        using namespace DS2PlusPlus;
+        DerivedChannel channel = DerivedChannel::parse("maf_per_rev[g]=DME:status:maf DME:status:rpm /");
+        QCOMPARE(channel.name(), QString("maf_per_rev"));
+        QCOMPARE(channel.units(), QString("g"));
+        QCOMPARE(channel.expression(), QString("DME:status:maf DME:status:rpm /"));
+
+        channel = DerivedChannel::parse(" double_rpm = DME:status:rpm  2 * ");
+        QCOMPARE(channel.name(), QString("double_rpm"));
+        QCOMPARE(channel.units(), QString());
+        QCOMPARE(channel.expression(), QString("DME:status:rpm 2 *"));
+
+        QVERIFY_EXCEPTION_THROWN(DerivedChannel::parse("DME:status:rpm 2 *"), std::invalid_argument);
+        QVERIFY_EXCEPTION_THROWN(DerivedChannel::parse("=DME:status:rpm"), std::invalid_argument);
+    }
+
+    void Evaluate::arithmetic()
+    {
+        using namespace DS2PlusPlus;
+        DerivedChannel channel = DerivedChannel::parse("x=DME:status:maf 60 * DME:status:rpm / 0x2 -");
+        channel.compile(channels());
+        QCOMPARE(channel.inputs(), QVector<int>() << 2 << 1);
+
+        QVector<QVariant> row(5);
+        row[1] = 3000;
+        row[2] = 100.0;
+        QCOMPARE(channel.evaluate(row).toDouble(), 100.0 * 60 / 3000 - 2);
+    }
+
+    void Evaluate::functions()
+    {
+        using namespace DS2PlusPlus;
+        QVector<QVariant> row(5);
+        row[1] = -16;
+        row[2] = 9;
+
+        DerivedChannel channel = DerivedChannel::parse("x=DME:status:rpm abs sqrt DME:status:maf min");
+        channel.compile(channels());
+        QCOMPARE(channel.evaluate(row).toDouble(), 4.0);
+
+        channel = DerivedChannel::parse("x=DME:status:rpm neg DME:status:maf max");
+        channel.compile(channels());
+        QCOMPARE(channel.evaluate(row).toDouble(), 16.0);
+    }
+
+    void Evaluate::invalidInputs()
+    {
+        using namespace DS2PlusPlus;
+        DerivedChannel channel = DerivedChannel::parse("x=DME:status:maf DME:status:rpm /");
+        channel.compile(channels());
+
+        QVector<QVariant> row(5);
+        row[2] = 10;
+        QVERIFY(!channel.evaluate(row).isValid());
+
+        row[1] = QString("off");
+        QVERIFY(!channel.evaluate(row).isValid());
+
+        row[1] = 0;
+        QVERIFY(!channel.evaluate(row).isValid());
+    }
+
+    void Evaluate::compileErrors()
+    {
+        using namespace DS2PlusPlus;
+        DerivedChannel channel = DerivedChannel::parse("x=DME:status:boost 2 *");
+        QVERIFY_EXCEPTION_THROWN(channel.compile(channels()), std::invalid_argument);
+
+        channel = DerivedChannel::parse("x=DME:status:rpm *");
+        QVERIFY_EXCEPTION_THROWN(channel.compile(channels()), std::invalid_argument);
+
+        channel = DerivedChannel::parse("x=DME:status:rpm 2");
+        QVERIFY_EXCEPTION_THROWN(channel.compile(channels()), std::invalid_argument);
+    }
+
+    void Evaluate::incrementalUpdate()
+    {
+        using namespace DS2PlusPlus;
+        QStringList columns = channels();
+        DerivedChannelSet set;
+        set.add(DerivedChannel::parse("rps=DME:status:rpm 60 /"), columns);
+        set.add(DerivedChannel::parse("ratio=rps EGS:status:gear /"), columns);
+        QCOMPARE(columns.size(), 7);
+        QCOMPARE(set.column(0), 5);
+        QCOMPARE(set.column(1), 6);
+
+        QVector<QVariant> row(columns.size());
+        row[1] = 1200;
+        QCOMPARE(set.update(row, 0, 2), 2);
+        QCOMPARE(row.at(5).toDouble(), 20.0);
+        QVERIFY(!row.at(6).isValid());
+
+        // Only the gear job ran, so the rpm based channel is left alone.
+        row[4] = 4;
+        QCOMPARE(set.update(row, 3, 4), 1);
+        QCOMPARE(row.at(6).toDouble(), 5.0);
+        QVERIFY(!set.changed(0));
+        QVERIFY(set.changed(1));
+
+        // The same rpm again updates both but changes neither.
+        QCOMPARE(set.update(row, 0, 2), 2);
+        QVERIFY(!set.changed(0));
+        QVERIFY(!set.changed(1));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_DerivedChannel::Evaluate tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
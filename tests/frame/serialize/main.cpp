@@ -0,0 +1,105 @@
+#include <QTest>
+#include <stdexcept>
+#include <string.h>
+
+#include <ds2/frame.h>
+#include <ds2/ds2packet.h>
+#include <ds2/kwppacket.h>
+
+namespace Test_Frame {
+    class Serialize : public QObject
+    {
+        Q_OBJECT
+    public:
+        Serialize();
+    private Q_SLOTS:
+        void ds2MatchesPacket();
+        void kwpMatchesPacket();
+        void roundTrip();
+        void maximumPayload();
+    };
+
+    Serialize::Serialize()
+      : QObject(0)
+    {
+    }
+
+    void Serialize::ds2MatchesPacket()
+    {
+        using namespace DS2PlusPlus;
+        DS2Packet packet(0x12, QByteArray("\x0b\x03", 2));
+        Frame frame = Frame::fromPacket(packet);
+
+        quint8 buffer[Frame::MAX_FRAME];
+        const int length = frame.serialize(buffer);
+
+        QCOMPARE(QByteArray(reinterpret_cast<const char *>(buffer), length), static_cast<QByteArray>(packet));
+        QCOMPARE(static_cast<quint16>(frame.checksum()), static_cast<quint16>(packet.checksum()));
+        QCOMPARE(frame.frameLength(), length);
+    }
+
+    void Serialize::kwpMatchesPacket()
+    {
+        using namespace DS2PlusPlus;
+        KWPPacket packet(0x12, 0xF1, QByteArray("\x1a\x80", 2));
+        Frame frame = Frame::fromPacket(packet);
+
+        quint8 buffer[Frame::MAX_FRAME];
+        const int length = frame.serialize(buffer);
+
+        QCOMPARE(QByteArray(reinterpret_cast<const char *>(buffer), length), static_cast<QByteArray>(packet));
+        QCOMPARE(static_cast<quint16>(frame.checksum()), static_cast<quint16>(packet.checksum()));
+        QCOMPARE(frame.headerPaddingLength(), packet.expectedHeaderPadding().length());
+    }
+
+    void Serialize::roundTrip()
+    {
+        using namespace DS2PlusPlus;
+        const quint8 payload[] = {0xa0, 0x01, 0x02, 0x03};
+        Frame frame(BasePacket::ProtocolDS2, 0x12, payload, sizeof(payload));
+
+        BasePacketPtr packet = frame.toPacket();
+        QCOMPARE(packet->protocol(), BasePacket::ProtocolDS2);
+        QCOMPARE(packet->targetAddress(), static_cast<quint8>(0x12));
+        QCOMPARE(packet->data(), QByteArray(reinterpret_cast<const char *>(payload), sizeof(payload)));
+
+        Frame copy = frame;
+        QCOMPARE(copy.toByteString(), packet->toByteString());
+    }
+
+    void Serialize::maximumPayload()
+    {
+        using namespace DS2PlusPlus;
+        quint8 payload[Frame::MAX_PAYLOAD];
+        memset(payload, 0x5a, sizeof(payload));
+        quint8 buffer[Frame::MAX_FRAME];
+
+        // The DS2 length byte covers the address, itself and the checksum as well as the payload
+        Frame ds2(BasePacket::ProtocolDS2, 0x12, payload, Frame::MAX_DS2_PAYLOAD);
+        QCOMPARE(ds2.serialize(buffer), 255);
+        QCOMPARE(buffer[1], static_cast<quint8>(255));
+        QCOMPARE(buffer[254], Frame::xorBytes(buffer, 254));
+        QCOMPARE(ds2.checksum(), buffer[254]);
+
+        QVERIFY_EXCEPTION_THROWN(Frame(BasePacket::ProtocolDS2, 0x12, payload, Frame::MAX_DS2_PAYLOAD + 1), std::invalid_argument);
+        QVERIFY_EXCEPTION_THROWN(ds2.resize(Frame::MAX_DS2_PAYLOAD + 1), std::invalid_argument);
+        QCOMPARE(ds2.length(), Frame::MAX_DS2_PAYLOAD);
+
+        Frame kwp(BasePacket::ProtocolKWP, 0x12, payload, Frame::MAX_KWP_PAYLOAD);
+        QCOMPARE(kwp.serialize(buffer), Frame::MAX_FRAME);
+        QCOMPARE(buffer[3], static_cast<quint8>(255));
+        QCOMPARE(kwp.checksum(), buffer[Frame::MAX_FRAME - 1]);
+
+        // A KWP payload that's too long for DS2 can't be switched over
+        QVERIFY_EXCEPTION_THROWN(kwp.setProtocol(BasePacket::ProtocolDS2), std::invalid_argument);
+        QCOMPARE(kwp.protocol(), BasePacket::ProtocolKWP);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Frame::Serialize tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
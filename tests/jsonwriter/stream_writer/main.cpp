@@ -0,0 +1,162 @@
+#include <QTest>
+#include <QBuffer>
+
+#include <ds2/jsonwriter.h>
+
+namespace Test_JsonWriter {
+    class StreamWriter : public QObject
+    {
+        Q_OBJECT
+    public:
+        StreamWriter();
+    private Q_SLOTS:
+        void pretty();
+        void compact();
+        void rootNode();
+        void emptyResponse();
+        void skipsMissingKeys();
+        void device();
+        void transaction();
+    protected:
+        DS2PlusPlus::PacketResponse response;
+    };
+
+    StreamWriter::StreamWriter()
+      : QObject(0)
+    {
+        response.insert("temp.coolant", QVariant(45.75));
+        response.insert("error_code.codes.1.flags", QVariant(QString("static")));
+        response.insert("error_code.count", QVariant(static_cast<quint64>(2)));
+        response.insert("mode.vents.defrost", QVariant(true));
+        response.insert("part_number", QVariant(QString()));
+    }
+
+    void StreamWriter::pretty()
+    {
+        using namespace DS2PlusPlus;
+        QByteArray json;
+        JsonStreamWriter writer(&json);
+        writer.write(response);
+
+        const QByteArray expected(
+            "{\n"
+            "   \"error_code\" : {\n"
+            "      \"codes\" : [\n"
+            "         null,\n"
+            "         {\n"
+            "            \"flags\" : \"static\"\n"
+            "         }\n"
+            "      ],\n"
+            "      \"count\" : 2\n"
+            "   },\n"
+            "   \"mode\" : {\n"
+            "      \"vents\" : {\n"
+            "         \"defrost\" : true\n"
+            "      }\n"
+            "   },\n"
+            "   \"part_number\" : null,\n"
+            "   \"temp\" : {\n"
+            "      \"coolant\" : 45.75\n"
+            "   }\n"
+            "}\n");
+
+        QCOMPARE(json, expected);
+        QCOMPARE(ResponseToJsonString(response), QString::fromUtf8(expected));
+    }
+
+    void StreamWriter::compact()
+    {
+        using namespace DS2PlusPlus;
+        QByteArray json;
+        JsonStreamWriter writer(&json, JsonStreamWriter::StyleCompact);
+        writer.write(response);
+
+        QCOMPARE(json, QByteArray("{\"error_code\":{\"codes\":[null,{\"flags\":\"static\"}],\"count\":2},\"mode\":{\"vents\":{\"defrost\":true}},\"part_number\":null,\"temp\":{\"coolant\":45.75}}"));
+    }
+
+    void StreamWriter::rootNode()
+    {
+        using namespace DS2PlusPlus;
+        PacketResponse families;
+        QVariant addresses;
+        addresses.setValue<QList<quint8> >(QList<quint8>() << 0x12 << 0x13);
+        families.insert("DME", addresses);
+
+        QCOMPARE(HashToJsonString(families, "families"), QString("{\n   \"families\" : {\n      \"DME\" : [ 18, 19 ]\n   }\n}\n"));
+    }
+
+    void StreamWriter::emptyResponse()
+    {
+        using namespace DS2PlusPlus;
+        QCOMPARE(ResponseToJsonString(PacketResponse()), QString("null\n"));
+    }
+
+    void StreamWriter::skipsMissingKeys()
+    {
+        using namespace DS2PlusPlus;
+        const KeyPathTree tree(QStringList() << "temp.coolant" << "temp.oil" << "voltage.battery");
+
+        PacketResponse partial;
+        partial.insert("temp.coolant", QVariant(45.75));
+
+        QByteArray json;
+        JsonStreamWriter writer(&json, JsonStreamWriter::StyleCompact);
+        writer.write(partial, tree);
+
+        QCOMPARE(json, QByteArray("{\"temp\":{\"coolant\":45.75}}"));
+    }
+
+    void StreamWriter::device()
+    {
+        using namespace DS2PlusPlus;
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+
+        JsonStreamWriter writer(&buffer, JsonStreamWriter::StyleCompact);
+        const KeyPathTree tree(response.keys());
+        writer.write(response, tree);
+        writer.write(response, tree);
+
+        QByteArray single;
+        JsonStreamWriter singleWriter(&single, JsonStreamWriter::StyleCompact);
+        singleWriter.write(response);
+
+        QCOMPARE(buffer.data(), single + single);
+    }
+
+    void StreamWriter::transaction()
+    {
+        using namespace DS2PlusPlus;
+        const KeyPathTree tree(QStringList() << "temp.coolant" << "temp.oil");
+
+        PacketResponse partial;
+        partial.insert("temp.coolant", QVariant(45.75));
+
+        TransactionRecord record;
+        record.timestamp = 12.5;
+        record.ecuUuid = "abc";
+        record.operation = "status";
+        record.latency = 0.5;
+
+        // Records are always compact and newline terminated, even from a pretty writer
+        QByteArray json;
+        JsonStreamWriter writer(&json, JsonStreamWriter::StylePretty);
+        writer.writeTransaction(record, partial, tree);
+        writer.writeTransaction(record, PacketResponse(), tree);
+
+        QCOMPARE(json, QByteArray("{\"ts\":12.5,\"ecu\":\"abc\",\"operation\":\"status\",\"latency_ms\":500,\"values\":{\"temp\":{\"coolant\":45.75}}}\n"
+                                  "{\"ts\":12.5,\"ecu\":\"abc\",\"operation\":\"status\",\"latency_ms\":500,\"values\":{}}\n"));
+
+        json.resize(0);
+        writer.write(partial, tree);
+        QCOMPARE(json, QByteArray("{\n   \"temp\" : {\n      \"coolant\" : 45.75\n   }\n}\n"));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_JsonWriter::StreamWriter tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -0,0 +1,227 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/logscheduler.h>
+
+namespace Test_LogScheduler {
+    class Planner : public QObject
+    {
+        Q_OBJECT
+    public:
+        Planner();
+    private Q_SLOTS:
+        void estimateCost();
+        void scalesOverload();
+        void earliestDeadlineFirst();
+        void skipsMissedRuns();
+        void achievedRate();
+        void changesKeepHistory();
+        void channelActivity();
+        void adaptiveSharesByActivity();
+        void adaptiveCapsAtMaximum();
+        void adaptiveSaturated();
+    };
+
+    Planner::Planner()
+      : QObject(0)
+    {
+    }
+
+    void Planner::estimateCost()
+    {
+        using namespace DS2PlusPlus;
+        Operation op("", 0x12, "status", QByteArray("\x0b\x03", 2));
+
+        Result rpm;
+        rpm.setStartPosition(3);
+        rpm.setLength(2);
+        op.insertResult("rpm", rpm);
+
+        Result coolant;
+        coolant.setStartPosition(10);
+        coolant.setLength(1);
+        op.insertResult("coolant", coolant);
+
+        // Address, length, 11 bytes of payload, checksum
+        QCOMPARE(LogScheduler::expectedReplyLength(op), 14);
+
+        // 5 byte request plus 14 byte reply at 11 bits a byte, plus the turnaround
+        QVERIFY(qFuzzyCompare(LogScheduler::estimateCost(op, 0.05), (19.0 * 11 / 9600) + 0.05));
+        QVERIFY(qFuzzyCompare(LogScheduler::estimateCost(op, 0, 19200), 19.0 * 11 / 19200));
+    }
+
+    void Planner::scalesOverload()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:status", 10, 0.05);
+        scheduler.addTask("EGS:status", 10, 0.1);
+
+        QVERIFY(qFuzzyCompare(scheduler.utilization(), 1.5));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(0), 10 / 1.5));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(1), 10 / 1.5));
+
+        LogScheduler light;
+        light.addTask("DME:status", 2, 0.05);
+        QVERIFY(qFuzzyCompare(light.plannedRate(0), 2.0));
+    }
+
+    void Planner::earliestDeadlineFirst()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:status", 10, 0.05);
+        scheduler.addTask("EGS:status", 10, 0.1);
+        scheduler.start(0);
+
+        double wait;
+        QCOMPARE(scheduler.next(0, wait), 0);
+        QCOMPARE(wait, 0.0);
+        scheduler.completed(0, 0, 0.05);
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 0.15));
+
+        QCOMPARE(scheduler.next(0.05, wait), 1);
+        QCOMPARE(wait, 0.0);
+        scheduler.completed(1, 0.05, 0.1);
+
+        QCOMPARE(scheduler.next(0.15, wait), 0);
+        QCOMPARE(scheduler.next(0.10, wait), 0);
+        QVERIFY(qFuzzyCompare(wait, 0.05));
+
+        QCOMPARE(LogScheduler().next(0, wait), -1);
+    }
+
+    void Planner::skipsMissedRuns()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:status", 10, 0.01);
+        scheduler.start(0);
+
+        scheduler.completed(0, 5.0, 0.01);
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 5.1));
+    }
+
+    void Planner::achievedRate()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:status", 10, 0.01);
+        scheduler.start(0);
+
+        QCOMPARE(scheduler.achievedRate(0), 0.0);
+        scheduler.completed(0, 0.0, 0.01);
+        scheduler.completed(0, 0.1, 0.01);
+        scheduler.completed(0, 0.2, 0.01);
+        QVERIFY(qFuzzyCompare(scheduler.achievedRate(0), 10.0));
+    }
+
+    void Planner::changesKeepHistory()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:status", 10, 0.01);
+        scheduler.addTask("EGS:status", 10, 0.01);
+        scheduler.start(0);
+        scheduler.completed(0, 0.0, 0.01);
+        scheduler.completed(1, 0.01, 0.01);
+
+        // Dropping the first task leaves the second's next run and history alone
+        scheduler.removeTask(0);
+        QCOMPARE(scheduler.tasks().size(), 1);
+        QCOMPARE(scheduler.tasks().at(0).name, QString("EGS:status"));
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 0.1));
+        QCOMPARE(scheduler.tasks().at(0).runs, Q_UINT64_C(1));
+
+        // A new rate applies from the run after the one already planned
+        scheduler.setTargetRate(0, 5);
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 0.1));
+        scheduler.completed(0, 0.1, 0.01);
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 0.3));
+
+        // A task added later is due straight away, without pulling the others forward
+        scheduler.addTask("DME:status", 10, 0.01);
+        double wait;
+        QCOMPARE(scheduler.next(0.2, wait), 1);
+        QCOMPARE(wait, 0.0);
+        QVERIFY(qFuzzyCompare(scheduler.tasks().at(0).nextDue, 0.3));
+    }
+
+    void Planner::channelActivity()
+    {
+        using namespace DS2PlusPlus;
+        ChannelActivity coolant(0.5);
+
+        QVERIFY(!coolant.update(QVariant()));
+        QVERIFY(coolant.update(QVariant(90.0)));
+        QVERIFY(!coolant.update(QVariant(90.4)));
+        QVERIFY(coolant.update(QVariant(90.6)));
+        QVERIFY(!coolant.update(QVariant(90.9)));
+        QCOMPARE(coolant.samples(), static_cast<quint64>(4));
+
+        for (int i=0; i < 50; i++) {
+            coolant.update(QVariant(90.6));
+        }
+        QVERIFY(coolant.changeRate() < 0.01);
+
+        ChannelActivity mode;
+        QVERIFY(mode.update(QVariant(QString("idle"))));
+        QVERIFY(!mode.update(QVariant(QString("idle"))));
+        QVERIFY(mode.update(QVariant(QString("cruise"))));
+    }
+
+    void Planner::adaptiveSharesByActivity()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:temps", 10, 0.01);
+        scheduler.addTask("DME:rpm", 10, 0.01);
+        scheduler.setAdaptive(0.1, 4);
+
+        // Until something is known about the channels, adaptive mode plans the target rates.
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(0), 10.0));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(1), 10.0));
+
+        // The stable task drops to its minimum and the other gets the bus time it freed.
+        scheduler.setActivity(0, 0);
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(0), 1.0));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(1), 19.0));
+
+        QVERIFY_EXCEPTION_THROWN(scheduler.setAdaptive(0, 4), std::invalid_argument);
+    }
+
+    void Planner::adaptiveCapsAtMaximum()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:temps", 10, 0.01);
+        scheduler.addTask("DME:rpm", 10, 0.01);
+        scheduler.setAdaptive(0.1, 1.5);
+
+        scheduler.setActivity(0, 0);
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(0), 1.0));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(1), 15.0));
+    }
+
+    void Planner::adaptiveSaturated()
+    {
+        using namespace DS2PlusPlus;
+        LogScheduler scheduler;
+        scheduler.addTask("DME:temps", 100, 0.05);
+        scheduler.addTask("DME:rpm", 100, 0.05);
+        scheduler.setAdaptive(0.2, 4);
+
+        // The minimums alone need the whole bus, so they're scaled back together.
+        scheduler.setActivity(0, 0);
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(0), 10.0));
+        QVERIFY(qFuzzyCompare(scheduler.plannedRate(1), 10.0));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_LogScheduler::Planner tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
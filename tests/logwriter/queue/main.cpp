@@ -0,0 +1,125 @@
+#include <QTest>
+#include <QThread>
+
+#include <ds2/spscqueue.h>
+
+namespace Test_LogWriter {
+    class Consumer : public QThread
+    {
+    public:
+        Consumer(DS2PlusPlus::SpscQueue<int> *aQueue, int aCount) : queue(aQueue), count(aCount), outOfOrder(0) {}
+
+        DS2PlusPlus::SpscQueue<int> *queue;
+        int count, outOfOrder;
+
+    protected:
+        void run()
+        {
+            int expected = 0, value;
+            while (expected < count) {
+                if (queue->pop(value)) {
+                    if (value != expected) {
+                        outOfOrder++;
+                    }
+                    expected++;
+                } else {
+                    QThread::yieldCurrentThread();
+                }
+            }
+        }
+    };
+
+    class Queue : public QObject
+    {
+        Q_OBJECT
+    public:
+        Queue();
+    private Q_SLOTS:
+        void capacity();
+        void wrapAround();
+        void releasesValues();
+        void twoThreads();
+    };
+
+    Queue::Queue()
+      : QObject(0)
+    {
+    }
+
+    void Queue::capacity()
+    {
+        DS2PlusPlus::SpscQueue<int> queue(5);
+        QCOMPARE(queue.capacity(), 8);
+        QVERIFY(queue.isEmpty());
+
+        for (int i=0; i < 8; i++) {
+            QVERIFY(queue.push(i));
+        }
+        QVERIFY(!queue.push(8));
+        QCOMPARE(queue.size(), 8);
+
+        int value;
+        QVERIFY(queue.pop(value));
+        QCOMPARE(value, 0);
+        QVERIFY(queue.push(8));
+    }
+
+    void Queue::wrapAround()
+    {
+        DS2PlusPlus::SpscQueue<int> queue(4);
+        int value;
+
+        for (int i=0; i < 1000; i++) {
+            QVERIFY(queue.push(i));
+            QVERIFY(queue.push(-i));
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, i);
+            QVERIFY(queue.pop(value));
+            QCOMPARE(value, -i);
+        }
+
+        QVERIFY(!queue.pop(value));
+    }
+
+    void Queue::releasesValues()
+    {
+        DS2PlusPlus::SpscQueue<QByteArray> queue(4);
+        QByteArray record("sample");
+
+        QVERIFY(queue.push(record));
+        QVERIFY(!record.isDetached());
+
+        QByteArray popped;
+        QVERIFY(queue.pop(popped));
+        popped.clear();
+        QVERIFY(record.isDetached());
+    }
+
+    void Queue::twoThreads()
+    {
+        const int count = 200000;
+        DS2PlusPlus::SpscQueue<int> queue(64);
+        Consumer consumer(&queue, count);
+        consumer.start();
+
+        for (int i=0; i < count; ) {
+            if (queue.push(i)) {
+                i++;
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        }
+
+        QVERIFY(consumer.wait(30000));
+        QCOMPARE(consumer.outOfOrder, 0);
+        QVERIFY(queue.isEmpty());
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_LogWriter::Queue tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
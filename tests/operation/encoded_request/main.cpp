@@ -0,0 +1,108 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/operation.h>
+#include <ds2/ds2packet.h>
+#include <ds2/kwppacket.h>
+
+namespace Test_Operation {
+    class EncodedRequest : public QObject
+    {
+        Q_OBJECT
+    public:
+        EncodedRequest();
+    private Q_SLOTS:
+        void ds2MatchesPacket();
+        void kwpMatchesPacket();
+        void followsAddress();
+        void parameterChecksum();
+        void parameterOutOfRange();
+        void longestCommand();
+    protected:
+        static QByteArray encoded(const DS2PlusPlus::Operation &anOperation);
+    };
+
+    EncodedRequest::EncodedRequest()
+      : QObject(0)
+    {
+    }
+
+    QByteArray EncodedRequest::encoded(const DS2PlusPlus::Operation &anOperation)
+    {
+        return QByteArray(reinterpret_cast<const char *>(anOperation.encodedRequest()), anOperation.encodedRequestLength());
+    }
+
+    void EncodedRequest::ds2MatchesPacket()
+    {
+        using namespace DS2PlusPlus;
+        const QByteArray command("\x0b\x03", 2);
+        Operation op("", 0x12, "status", command);
+
+        QCOMPARE(encoded(op), static_cast<QByteArray>(DS2Packet(0x12, command)));
+    }
+
+    void EncodedRequest::kwpMatchesPacket()
+    {
+        using namespace DS2PlusPlus;
+        const QByteArray command("\x1a\x80", 2);
+        Operation op("", 0x12, "ident", command, BasePacket::ProtocolKWP);
+
+        QCOMPARE(encoded(op), static_cast<QByteArray>(KWPPacket(0x12, 0xF1, command)));
+    }
+
+    void EncodedRequest::followsAddress()
+    {
+        using namespace DS2PlusPlus;
+        const QByteArray command("\x00", 1);
+        Operation op("", 0x12, "ident", command);
+        op.setAddress(0x32);
+
+        QCOMPARE(encoded(op), static_cast<QByteArray>(DS2Packet(0x32, command)));
+    }
+
+    void EncodedRequest::parameterChecksum()
+    {
+        using namespace DS2PlusPlus;
+        Operation op("", 0x12, "read_memory", QByteArray("\x06\x00\x00\x00\x10", 5));
+
+        const quint8 address[] = {0x01, 0x7f, 0xe0};
+        op.setParameter(1, address, sizeof(address));
+        QCOMPARE(encoded(op), static_cast<QByteArray>(DS2Packet(0x12, QByteArray("\x06\x01\x7f\xe0\x10", 5))));
+
+        op.setParameter(4, 0x20);
+        QCOMPARE(encoded(op), static_cast<QByteArray>(DS2Packet(0x12, QByteArray("\x06\x01\x7f\xe0\x20", 5))));
+        QCOMPARE(op.command().last(), QString("0x20"));
+    }
+
+    void EncodedRequest::parameterOutOfRange()
+    {
+        using namespace DS2PlusPlus;
+        Operation op("", 0x12, "read_memory", QByteArray("\x06\x00", 2));
+
+        QVERIFY_EXCEPTION_THROWN(op.setParameter(2, 0x01), std::out_of_range);
+    }
+
+    void EncodedRequest::longestCommand()
+    {
+        using namespace DS2PlusPlus;
+        Operation longest("", 0x12, "write_memory", QByteArray(Frame::MAX_DS2_PAYLOAD, '\x01'));
+        QCOMPARE(longest.encodedRequestLength(), 255);
+        QCOMPARE(static_cast<quint8>(longest.encodedRequest()[1]), static_cast<quint8>(255));
+
+        // One byte more would wrap the DS2 length byte
+        Operation tooLong("", 0x12, "write_memory", QByteArray(Frame::MAX_DS2_PAYLOAD + 1, '\x01'));
+        QCOMPARE(tooLong.encodedRequestLength(), 0);
+        QVERIFY_EXCEPTION_THROWN(tooLong.encodedRequest(), std::invalid_argument);
+
+        Operation kwp("", 0x12, "write_memory", QByteArray(Frame::MAX_KWP_PAYLOAD, '\x01'), BasePacket::ProtocolKWP);
+        QCOMPARE(kwp.encodedRequestLength(), Frame::MAX_KWP_PAYLOAD + 5);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Operation::EncodedRequest tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
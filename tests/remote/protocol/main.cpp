@@ -0,0 +1,156 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/remote.h>
+
+namespace Test_Remote {
+    class Protocol : public QObject
+    {
+        Q_OBJECT
+    public:
+        Protocol();
+    private Q_SLOTS:
+        void roundTrip();
+        void partialFrames();
+        void severalFrames();
+        void invalidLength();
+        void unknownType();
+        void truncated();
+    };
+
+    Protocol::Protocol()
+      : QObject(0)
+    {
+    }
+
+    void Protocol::roundTrip()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessage sample(RemoteMessage::Sample, 42);
+        sample.ecu = "4cc8bc1c-3a5f-4c1c-9d44-1d0b8f2ee7d1";
+        sample.operation = "status";
+        sample.timestamp = 1234.5;
+        sample.latency = 0.125;
+        sample.dropped = 3;
+        sample.response.insert("rpm", 800);
+        sample.response.insert("mode", QString("idle"));
+
+        RemoteMessageReader reader;
+        reader.append(sample.encode());
+
+        RemoteMessage decoded;
+        QVERIFY(reader.next(decoded));
+        QCOMPARE(decoded.type, RemoteMessage::Sample);
+        QCOMPARE(decoded.id, quint32(42));
+        QCOMPARE(decoded.ecu, sample.ecu);
+        QCOMPARE(decoded.operation, sample.operation);
+        QCOMPARE(decoded.timestamp, 1234.5);
+        QCOMPARE(decoded.latency, 0.125);
+        QCOMPARE(decoded.response, sample.response);
+        QCOMPARE(decoded.dropped, Q_UINT64_C(3));
+        QVERIFY(!reader.next(decoded));
+
+        RemoteMessage subscribe(RemoteMessage::Subscribe, 7);
+        subscribe.ecu = "DME";
+        subscribe.operation = "status";
+        subscribe.results << "rpm" << "coolant_temp";
+        subscribe.rate = 10;
+        reader.append(subscribe.encode());
+        QVERIFY(reader.next(decoded));
+        QCOMPARE(decoded.type, RemoteMessage::Subscribe);
+        QCOMPARE(decoded.results, subscribe.results);
+        QCOMPARE(decoded.rate, 10.0);
+        QVERIFY(RemoteMessage::isRequest(decoded.type));
+        QVERIFY(!RemoteMessage::isRequest(RemoteMessage::Sample));
+    }
+
+    void Protocol::partialFrames()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessage query(RemoteMessage::RawQuery, 3);
+        query.ecu = "0x12";
+        query.data = QByteArray("\x0b\x03", 2);
+        const QByteArray frame = query.encode();
+
+        // A byte at a time, as a slow socket might deliver it
+        RemoteMessageReader reader;
+        RemoteMessage decoded;
+        for (int i=0; i < frame.size() - 1; i++) {
+            reader.append(frame.mid(i, 1));
+            QVERIFY(!reader.next(decoded));
+        }
+        reader.append(frame.right(1));
+        QVERIFY(reader.next(decoded));
+        QCOMPARE(decoded.ecu, QString("0x12"));
+        QCOMPARE(decoded.data, query.data);
+    }
+
+    void Protocol::severalFrames()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessage error(RemoteMessage::Error, 9);
+        error.error = "Timed out waiting for the ECU.";
+
+        RemoteMessageReader reader;
+        reader.append(RemoteMessage(RemoteMessage::Subscribed, 8).encode() + error.encode());
+
+        RemoteMessage decoded;
+        QVERIFY(reader.next(decoded));
+        QCOMPARE(decoded.type, RemoteMessage::Subscribed);
+        QCOMPARE(decoded.id, quint32(8));
+        QVERIFY(reader.next(decoded));
+        QCOMPARE(decoded.type, RemoteMessage::Error);
+        QCOMPARE(decoded.error, error.error);
+        QVERIFY(!reader.next(decoded));
+    }
+
+    void Protocol::invalidLength()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessage decoded;
+
+        RemoteMessageReader tooLong;
+        tooLong.append(QByteArray("\x7f\xff\xff\xff", 4));
+        QVERIFY_EXCEPTION_THROWN(tooLong.next(decoded), std::runtime_error);
+
+        RemoteMessageReader tooShort;
+        tooShort.append(QByteArray("\x00\x00\x00\x01\x01", 5));
+        QVERIFY_EXCEPTION_THROWN(tooShort.next(decoded), std::runtime_error);
+    }
+
+    void Protocol::unknownType()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessageReader reader;
+        reader.append(QByteArray("\x00\x00\x00\x05\x40\x00\x00\x00\x01", 9));
+
+        RemoteMessage decoded;
+        QVERIFY_EXCEPTION_THROWN(reader.next(decoded), std::runtime_error);
+    }
+
+    void Protocol::truncated()
+    {
+        using namespace DS2PlusPlus;
+        RemoteMessage run(RemoteMessage::RunOperation, 1);
+        run.ecu = "DME";
+        run.operation = "status";
+        QByteArray frame = run.encode();
+
+        // Claim a shorter frame than the fields need
+        frame.chop(4);
+        frame[3] = static_cast<char>(frame.size() - 4);
+
+        RemoteMessageReader reader;
+        reader.append(frame);
+        RemoteMessage decoded;
+        QVERIFY_EXCEPTION_THROWN(reader.next(decoded), std::runtime_error);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Remote::Protocol tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
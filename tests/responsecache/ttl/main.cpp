@@ -0,0 +1,94 @@
+#include <QTest>
+
+#include <ds2/responsecache.h>
+
+namespace Test_ResponseCache {
+    class Ttl : public QObject
+    {
+        Q_OBJECT
+    public:
+        Ttl();
+    private Q_SLOTS:
+        void hitUntilExpired();
+        void keyedByAddressModuleAndOperation();
+        void nonPositiveTtl();
+        void invalidate();
+    };
+
+    Ttl::Ttl()
+      : QObject(0)
+    {
+    }
+
+    static DS2PlusPlus::PacketResponse vin()
+    {
+        DS2PlusPlus::PacketResponse ret;
+        ret.insert("short_vin", QString("GH12345"));
+        return ret;
+    }
+
+    void Ttl::hitUntilExpired()
+    {
+        using namespace DS2PlusPlus;
+        ResponseCache cache;
+        PacketResponse response;
+        QVERIFY(!cache.find(0x80, "kombi", "vehicle_id_short", response, 0));
+
+        cache.insert(0x80, "kombi", "vehicle_id_short", vin(), 60, 100);
+        QVERIFY(cache.find(0x80, "kombi", "vehicle_id_short", response, 159.9));
+        QCOMPARE(response, vin());
+        QCOMPARE(cache.hits(), Q_UINT64_C(1));
+
+        QVERIFY(!cache.find(0x80, "kombi", "vehicle_id_short", response, 160));
+        QCOMPARE(cache.size(), 0);
+        QCOMPARE(cache.misses(), Q_UINT64_C(2));
+    }
+
+    void Ttl::keyedByAddressModuleAndOperation()
+    {
+        using namespace DS2PlusPlus;
+        ResponseCache cache;
+        cache.insert(0x80, "kombi", "vehicle_id_short", vin(), 60, 0);
+
+        PacketResponse response;
+        QVERIFY(!cache.find(0x81, "kombi", "vehicle_id_short", response, 1));
+        QVERIFY(!cache.find(0x80, "other", "vehicle_id_short", response, 1));
+        QVERIFY(!cache.find(0x80, "kombi", "identify", response, 1));
+        QVERIFY(cache.find(0x80, "kombi", "vehicle_id_short", response, 1));
+    }
+
+    void Ttl::nonPositiveTtl()
+    {
+        using namespace DS2PlusPlus;
+        ResponseCache cache;
+        cache.insert(0x12, "dme", "status", vin(), 0, 0);
+        cache.insert(0x12, "dme", "status", vin(), -1, 0);
+        QCOMPARE(cache.size(), 0);
+    }
+
+    void Ttl::invalidate()
+    {
+        using namespace DS2PlusPlus;
+        ResponseCache cache;
+        cache.insert(0x12, "dme", "identify", vin(), 60, 0);
+        cache.insert(0x12, QString::null, "identify", vin(), 60, 0);
+        cache.insert(0x80, "kombi", "identify", vin(), 60, 0);
+
+        cache.invalidate(0x12);
+        QCOMPARE(cache.size(), 1);
+
+        PacketResponse response;
+        QVERIFY(cache.find(0x80, "kombi", "identify", response, 1));
+
+        cache.clear();
+        QCOMPARE(cache.size(), 0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_ResponseCache::Ttl tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
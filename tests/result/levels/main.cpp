@@ -0,0 +1,106 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/result.h>
+
+namespace Test_Result {
+    class Levels : public QObject
+    {
+        Q_OBJECT
+    public:
+        Levels();
+    private Q_SLOTS:
+        void boolean();
+        void bitmask();
+        void elseAndAll();
+        void slotKeys();
+        void invalidMask();
+    };
+
+    Levels::Levels()
+      : QObject(0)
+    {
+    }
+
+    void Levels::boolean()
+    {
+        using namespace DS2PlusPlus;
+        Result result;
+        QHash<QString, QString> levels;
+        levels.insert("yes", "on");
+        levels.insert("no", "off");
+        result.setLevels(levels);
+
+        QCOMPARE(result.stringForLevel(true), QString("on"));
+        QCOMPARE(result.stringForLevel(false), QString("off"));
+    }
+
+    void Levels::bitmask()
+    {
+        using namespace DS2PlusPlus;
+        Result result;
+        QHash<QString, QString> levels;
+        levels.insert("0x08", "auto");
+        levels.insert("0x01", "defrost");
+        levels.insert("0x04", "floor");
+        levels.insert("0x02", "dash");
+        result.setLevels(levels);
+
+        QCOMPARE(result.stringForLevel(0x01), QString("defrost"));
+        QCOMPARE(result.stringForLevel(0x05), QString("defrost,floor"));
+        QCOMPARE(result.stringForLevel(0x1A), QString("dash,auto"));
+        QVERIFY(result.stringForLevel(0x00).isNull());
+        QVERIFY(result.stringForLevel(0xF0).isNull());
+    }
+
+    void Levels::elseAndAll()
+    {
+        using namespace DS2PlusPlus;
+        Result result;
+        QHash<QString, QString> levels;
+        levels.insert("0x04", "D");
+        levels.insert("0x08", "S/M");
+        levels.insert("else", "Unknown");
+        levels.insert("all", "Both");
+        result.setLevels(levels);
+
+        QCOMPARE(result.stringForLevel(0x04), QString("D"));
+        QCOMPARE(result.stringForLevel(0x00), QString("Unknown"));
+        QCOMPARE(result.stringForLevel(0x0C), QString("Both"));
+    }
+
+    void Levels::slotKeys()
+    {
+        using namespace DS2PlusPlus;
+        Result result;
+        result.setName("mode.vents");
+        QHash<QString, QString> levels;
+        levels.insert("0x02", "dash");
+        levels.insert("0x01", "defrost");
+        levels.insert("else", "off");
+        result.setLevels(levels);
+
+        QCOMPARE(result.levelSlotKeys(), QStringList() << "mode.vents.defrost" << "mode.vents.dash");
+        QCOMPARE(result.levelSlotMasks(), QVector<quint8>() << 0x01 << 0x02);
+    }
+
+    void Levels::invalidMask()
+    {
+        using namespace DS2PlusPlus;
+        Result result;
+        QHash<QString, QString> levels;
+        levels.insert("0x01", "ok");
+        levels.insert("bogus", "bad");
+        result.setLevels(levels);
+
+        QVERIFY_EXCEPTION_THROWN(result.stringForLevel(0x01), std::invalid_argument);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Result::Levels tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -0,0 +1,219 @@
+#include <QTest>
+#include <QCoreApplication>
+#include <stdexcept>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ds2/sharedvalues.h>
+
+namespace Test_SharedValues {
+    class Seqlock : public QObject
+    {
+        Q_OBJECT
+    public:
+        Seqlock();
+    private Q_SLOTS:
+        void directory();
+        void types();
+        void truncatesText();
+        void channelsAddedLater();
+        void fullDirectory();
+        void writerGoesAway();
+        void oneWriterAtATime();
+        void writerKilled();
+        void missingSegment();
+    protected:
+        QString segment() const;
+    };
+
+    Seqlock::Seqlock()
+      : QObject(0)
+    {
+    }
+
+    QString Seqlock::segment() const
+    {
+        return QString("dpp-test-%1").arg(QCoreApplication::applicationPid());
+    }
+
+    void Seqlock::directory()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer(segment());
+        QCOMPARE(writer.channel("DME:status:rpm", "rpm"), 0);
+        QCOMPARE(writer.channel("DME:status:coolant", "C"), 1);
+        QCOMPARE(writer.channel("DME:status:rpm"), 0);
+
+        SharedValueReader reader(segment());
+        QVERIFY(reader.isLive());
+        QCOMPARE(reader.channelCount(), 2);
+        QCOMPARE(reader.channelName(1), QString("DME:status:coolant"));
+        QCOMPARE(reader.channelUnits(0), QString("rpm"));
+        QCOMPARE(reader.indexOf("DME:status:coolant"), 1);
+        QCOMPARE(reader.indexOf("DME:status:boost"), -1);
+        QCOMPARE(reader.channelName(2), QString());
+
+        // Nothing has been published yet
+        SharedValues::Value value;
+        QVERIFY(!reader.read(0, value));
+        QVERIFY(!reader.read(2, value));
+    }
+
+    void Seqlock::types()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer("/" + segment());
+        SharedValueReader reader(segment());
+
+        writer.publish(writer.channel("double"), 1.5, QVariant(90.25));
+        writer.publish(writer.channel("int"), 2.5, QVariant(-3));
+        writer.publish(writer.channel("uint"), 3.5, QVariant(Q_UINT64_C(4000000000)));
+        writer.publish(writer.channel("bool"), 4.5, QVariant(true));
+        writer.publish(writer.channel("string"), 5.5, QVariant(QString("idle")));
+        writer.publish(writer.channel("none"), 6.5, QVariant());
+
+        SharedValues::Value value;
+        QVERIFY(reader.read(reader.indexOf("double"), value));
+        QCOMPARE(value.type, static_cast<quint32>(SharedValues::TypeDouble));
+        QCOMPARE(value.timestamp, 1.5);
+        QCOMPARE(value.toVariant().toDouble(), 90.25);
+
+        QVERIFY(reader.read(reader.indexOf("int"), value));
+        QCOMPARE(value.toVariant().toLongLong(), Q_INT64_C(-3));
+
+        QVERIFY(reader.read(reader.indexOf("uint"), value));
+        QCOMPARE(value.toVariant().toULongLong(), Q_UINT64_C(4000000000));
+
+        QVERIFY(reader.read(reader.indexOf("bool"), value));
+        QCOMPARE(value.toVariant(), QVariant(true));
+
+        QVERIFY(reader.read(reader.indexOf("string"), value));
+        QCOMPARE(value.toVariant().toString(), QString("idle"));
+
+        QVERIFY(reader.read(reader.indexOf("none"), value));
+        QVERIFY(!value.toVariant().isValid());
+
+        // The latest value replaces the last one
+        writer.publish(0, 7.5, QVariant(91.0));
+        QVERIFY(reader.read(0, value));
+        QCOMPARE(value.timestamp, 7.5);
+        QCOMPARE(value.toVariant().toDouble(), 91.0);
+    }
+
+    void Seqlock::truncatesText()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer(segment());
+        SharedValueReader reader(segment());
+
+        const QString longText(100, QChar('x'));
+        writer.publish(writer.channel(QString(200, QChar('n')), QString(50, QChar('u'))), 1.0, QVariant(longText));
+
+        SharedValues::Value value;
+        QVERIFY(reader.read(0, value));
+        QCOMPARE(value.toVariant().toString(), longText.left(SharedValues::TEXT_LENGTH - 1));
+        QCOMPARE(reader.channelName(0).size(), SharedValues::NAME_LENGTH - 1);
+        QCOMPARE(reader.channelUnits(0).size(), SharedValues::UNITS_LENGTH - 1);
+    }
+
+    void Seqlock::channelsAddedLater()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer(segment());
+        SharedValueReader reader(segment());
+        QCOMPARE(reader.channelCount(), 0);
+
+        writer.publish(writer.channel("EGS:status:gear"), 1.0, QVariant(QString("D")));
+        QCOMPARE(reader.channelCount(), 1);
+
+        SharedValues::Value value;
+        QVERIFY(reader.read(reader.indexOf("EGS:status:gear"), value));
+        QCOMPARE(value.toVariant().toString(), QString("D"));
+    }
+
+    void Seqlock::fullDirectory()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer(segment(), 2);
+        QCOMPARE(writer.channel("a"), 0);
+        QCOMPARE(writer.channel("b"), 1);
+        QCOMPARE(writer.channel("c"), -1);
+        QVERIFY_EXCEPTION_THROWN(writer.publish(2, 1.0, QVariant(1)), std::out_of_range);
+
+        QVERIFY_EXCEPTION_THROWN(SharedValueWriter(segment(), 0), std::invalid_argument);
+    }
+
+    void Seqlock::writerGoesAway()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter *writer = new SharedValueWriter(segment());
+        writer->publish(writer->channel("DME:status:rpm"), 1.0, QVariant(800));
+        SharedValueReader reader(segment());
+        delete writer;
+
+        // The reader keeps its mapping, but can tell nobody is updating it
+        QVERIFY(!reader.isLive());
+        SharedValues::Value value;
+        QVERIFY(reader.read(0, value));
+        QCOMPARE(value.toVariant().toInt(), 800);
+
+        QVERIFY_EXCEPTION_THROWN(SharedValueReader another(segment()), std::runtime_error);
+    }
+
+    void Seqlock::oneWriterAtATime()
+    {
+        using namespace DS2PlusPlus;
+        SharedValueWriter writer(segment());
+        QVERIFY_EXCEPTION_THROWN(SharedValueWriter another(segment()), std::runtime_error);
+
+        // The refused writer left the first one's segment alone
+        SharedValueReader reader(segment());
+        QVERIFY(reader.isLive());
+    }
+
+    void Seqlock::writerKilled()
+    {
+        using namespace DS2PlusPlus;
+        const pid_t child = fork();
+        QVERIFY(child >= 0);
+        if (child == 0) {
+            // Never destroyed, as though the writer had crashed
+            SharedValueWriter *writer = new SharedValueWriter(segment());
+            writer->publish(writer->channel("DME:status:rpm"), 1.0, QVariant(800));
+            _exit(0);
+        }
+
+        int status;
+        QCOMPARE(waitpid(child, &status, 0), child);
+        QVERIFY(WIFEXITED(status) and (WEXITSTATUS(status) == 0));
+
+        {
+            SharedValueReader reader(segment());
+            QVERIFY(!reader.isLive());
+            SharedValues::Value value;
+            QVERIFY(reader.read(0, value));
+            QCOMPARE(value.toVariant().toInt(), 800);
+        }
+
+        // The abandoned segment is replaced rather than refused
+        SharedValueWriter writer(segment());
+        SharedValueReader reader(segment());
+        QVERIFY(reader.isLive());
+        QCOMPARE(reader.channelCount(), 0);
+    }
+
+    void Seqlock::missingSegment()
+    {
+        using namespace DS2PlusPlus;
+        QVERIFY_EXCEPTION_THROWN(SharedValueReader reader("dpp-test-does-not-exist"), std::runtime_error);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_SharedValues::Seqlock tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -0,0 +1,197 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/subscriptionhub.h>
+
+namespace Test_SubscriptionHub {
+    class Fanout : public QObject
+    {
+        Q_OBJECT
+    public:
+        Fanout();
+    private Q_SLOTS:
+        void mergesPolls();
+        void fansOut();
+        void thinsToRate();
+        void boundedQueue();
+        void errors();
+        void unsubscribe();
+        void invalidSubscriptions();
+    };
+
+    Fanout::Fanout()
+      : QObject(0)
+    {
+    }
+
+    static DS2PlusPlus::PacketResponse status(int anRpm)
+    {
+        DS2PlusPlus::PacketResponse ret;
+        ret.insert("rpm", anRpm);
+        ret.insert("coolant_temp", 90);
+        ret.insert("battery_voltage", 13.8);
+        return ret;
+    }
+
+    void Fanout::mergesPolls()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 1, "DME", "status", QStringList() << "rpm", 5);
+        hub.subscribe(2, 1, "DME", "status", QStringList() << "coolant_temp" << "rpm", 10);
+        hub.subscribe(2, 2, "EGS", "status", QStringList() << "gear", 2);
+
+        QList<SubscriptionHub::Poll> polls = hub.polls();
+        QCOMPARE(polls.size(), 2);
+        QCOMPARE(polls.at(0).ecu, QString("DME"));
+        QCOMPARE(polls.at(0).rate, 10.0);
+        QCOMPARE(polls.at(0).subscribers, 2);
+        QCOMPARE(polls.at(0).results, QStringList() << "rpm" << "coolant_temp");
+        QCOMPARE(polls.at(1).ecu, QString("EGS"));
+
+        // Anyone wanting everything means the poll does too
+        hub.subscribe(3, 1, "DME", "status", QStringList(), 1);
+        QVERIFY(hub.polls().at(0).results.isEmpty());
+        QCOMPARE(hub.polls().at(0).rate, 10.0);
+    }
+
+    void Fanout::fansOut()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 7, "DME", "status", QStringList() << "rpm", 10);
+        hub.subscribe(2, 3, "DME", "status", QStringList(), 10);
+        hub.subscribe(2, 4, "EGS", "status", QStringList(), 10);
+
+        QCOMPARE(hub.publish("DME", "status", 1.0, 0.05, status(800)).size(), 2);
+
+        SubscriptionHub::Sample sample;
+        QVERIFY(hub.take(1, sample));
+        QCOMPARE(sample.tag, quint32(7));
+        QCOMPARE(sample.response.keys(), QStringList() << "rpm");
+        QCOMPARE(sample.response.value("rpm").toInt(), 800);
+        QCOMPARE(sample.latency, 0.05);
+        QVERIFY(!hub.take(1, sample));
+
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.tag, quint32(3));
+        QCOMPARE(sample.response.size(), 3);
+        QVERIFY(!hub.take(2, sample));
+
+        // Samples come out oldest first across an owner's subscriptions
+        hub.publish("EGS", "status", 2.0, 0.05, PacketResponse());
+        hub.publish("DME", "status", 3.0, 0.05, status(900));
+        QCOMPARE(hub.queued(2), 2);
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.tag, quint32(4));
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.tag, quint32(3));
+
+        QVERIFY(hub.publish("KOMBI", "status", 4.0, 0.05, status(0)).isEmpty());
+    }
+
+    void Fanout::thinsToRate()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 1, "DME", "status", QStringList(), 10);
+        hub.subscribe(2, 1, "DME", "status", QStringList(), 2);
+
+        // A second of polls at 10 Hz, a little early now and then
+        for (int i=0; i < 10; i++) {
+            hub.publish("DME", "status", i * 0.1 - ((i % 3) ? 0.01 : 0), 0.05, status(800 + i));
+        }
+        QCOMPARE(hub.queued(1), 10);
+        QCOMPARE(hub.queued(2), 3);
+
+        SubscriptionHub::Sample sample;
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.response.value("rpm").toInt(), 800);
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.response.value("rpm").toInt(), 804);
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.response.value("rpm").toInt(), 808);
+    }
+
+    void Fanout::boundedQueue()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 1, "DME", "status", QStringList(), 10, 4);
+        hub.subscribe(2, 1, "DME", "status", QStringList(), 10);
+
+        for (int i=0; i < 10; i++) {
+            hub.publish("DME", "status", i * 0.1, 0.05, status(800 + i));
+        }
+
+        // The slow subscriber keeps its newest samples, and the other loses nothing
+        QCOMPARE(hub.queued(1), 4);
+        QCOMPARE(hub.dropped(1, 1), Q_UINT64_C(6));
+        QCOMPARE(hub.queued(2), 10);
+        QCOMPARE(hub.dropped(2, 1), Q_UINT64_C(0));
+
+        SubscriptionHub::Sample sample;
+        QVERIFY(hub.take(1, sample));
+        QCOMPARE(sample.response.value("rpm").toInt(), 806);
+        QCOMPARE(sample.dropped, Q_UINT64_C(6));
+        QVERIFY(hub.take(2, sample));
+        QCOMPARE(sample.dropped, Q_UINT64_C(0));
+    }
+
+    void Fanout::errors()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 1, "DME", "status", QStringList(), 1);
+
+        hub.publish("DME", "status", 0.0, 0.05, status(800));
+        // Errors aren't thinned
+        QCOMPARE(hub.publishError("DME", "status", 0.1, "Timed out waiting for the ECU.").size(), 1);
+
+        SubscriptionHub::Sample sample;
+        QVERIFY(hub.take(1, sample));
+        QVERIFY(!sample.isError());
+        QVERIFY(hub.take(1, sample));
+        QVERIFY(sample.isError());
+        QCOMPARE(sample.error, QString("Timed out waiting for the ECU."));
+    }
+
+    void Fanout::unsubscribe()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        hub.subscribe(1, 1, "DME", "status", QStringList(), 10);
+        hub.subscribe(1, 2, "EGS", "status", QStringList(), 10);
+        hub.subscribe(2, 1, "DME", "status", QStringList(), 1);
+        const quint64 generation = hub.generation();
+
+        QVERIFY(hub.unsubscribe(1, 1));
+        QVERIFY(!hub.unsubscribe(1, 1));
+        QVERIFY(hub.generation() != generation);
+        QCOMPARE(hub.polls().at(0).rate, 1.0);
+
+        hub.unsubscribeAll(1);
+        QCOMPARE(hub.polls().size(), 1);
+        hub.unsubscribeAll(2);
+        QVERIFY(hub.polls().isEmpty());
+    }
+
+    void Fanout::invalidSubscriptions()
+    {
+        using namespace DS2PlusPlus;
+        SubscriptionHub hub;
+        QVERIFY_EXCEPTION_THROWN(hub.subscribe(1, 1, "DME", "status", QStringList(), 0), std::invalid_argument);
+        QVERIFY_EXCEPTION_THROWN(hub.subscribe(1, 1, "DME", "status", QStringList(), 1, 0), std::invalid_argument);
+
+        hub.subscribe(1, 1, "DME", "status", QStringList(), 1);
+        QVERIFY_EXCEPTION_THROWN(hub.subscribe(1, 1, "EGS", "status", QStringList(), 1), std::invalid_argument);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_SubscriptionHub::Fanout tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
-SUBDIRS += controlunit ds2packet \
+SUBDIRS += allocationstats benchmarks busstatistics controlunit datalog decodepipeline derivedchannel ds2packet frame jsonwriter logscheduler logwriter operation remote responsecache result sharedvalues subscriptionhub timeline trace triggercapture windowaggregator \
     kwppacket/initialization
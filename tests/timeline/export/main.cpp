@@ -0,0 +1,147 @@
+#include <QTest>
+#include <QBuffer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <ds2/timeline.h>
+
+namespace Test_Timeline {
+    class Export : public QObject
+    {
+        Q_OBJECT
+    public:
+        Export();
+    private Q_SLOTS:
+        void cleanup();
+        void disabled();
+        void spans();
+        void backToBack();
+        void dropsWhenFull();
+        void json();
+    };
+
+    Export::Export()
+      : QObject(0)
+    {
+    }
+
+    void Export::cleanup()
+    {
+        DS2PlusPlus::Timeline::stop();
+    }
+
+    void Export::disabled()
+    {
+        using namespace DS2PlusPlus;
+        Timeline::start(16);
+        Timeline::stop();
+        {
+            TimelineSpan span("write", "bus", 0x12);
+        }
+        QCOMPARE(Timeline::count(), 0);
+    }
+
+    void Export::spans()
+    {
+        using namespace DS2PlusPlus;
+        Timeline::start(16);
+        {
+            TimelineSpan outer("operation", "ecu", 0x12, "status");
+            {
+                TimelineSpan inner("decode", "ecu", 0x12);
+            }
+        }
+        Timeline::stop();
+
+        const QVector<TimelineEvent> events = Timeline::events();
+        QCOMPARE(events.size(), 2);
+        QCOMPARE(QString(events.at(0).name), QString("decode"));
+        QCOMPARE(QString(events.at(1).name), QString("operation"));
+        QCOMPARE(events.at(1).detail, QString("status"));
+        QCOMPARE(events.at(1).ecu, 0x12);
+        QVERIFY(events.at(1).start <= events.at(0).start);
+        QVERIFY(events.at(1).start + events.at(1).duration >= events.at(0).start + events.at(0).duration);
+    }
+
+    void Export::backToBack()
+    {
+        using namespace DS2PlusPlus;
+        Timeline::start(16);
+        {
+            TimelineSpan phase("write", "bus", 0x12);
+            phase.next("echo sleep");
+            phase.next("echo read");
+            phase.finish();
+            phase.next("ignored");
+        }
+        Timeline::stop();
+
+        const QVector<TimelineEvent> events = Timeline::events();
+        QCOMPARE(events.size(), 3);
+        QCOMPARE(QString(events.at(2).name), QString("echo read"));
+        for (int i=1; i < events.size(); i++) {
+            QCOMPARE(events.at(i).start, events.at(i - 1).start + events.at(i - 1).duration);
+        }
+    }
+
+    void Export::dropsWhenFull()
+    {
+        using namespace DS2PlusPlus;
+        Timeline::start(4);
+        for (int i=0; i < 10; i++) {
+            Timeline::record("write", "bus", i, i + 1);
+        }
+        Timeline::stop();
+
+        QCOMPARE(Timeline::count(), 4);
+        QCOMPARE(Timeline::dropped(), 6);
+
+        // Starting again clears the earlier run
+        Timeline::start(4);
+        QCOMPARE(Timeline::count(), 0);
+        QCOMPARE(Timeline::dropped(), 0);
+    }
+
+    void Export::json()
+    {
+        using namespace DS2PlusPlus;
+        Timeline::start(16);
+        const qint64 start = Timeline::now();
+        Timeline::record("body read", "bus", start, start + 2500, 0x12);
+        Timeline::record("output", "log", start + 2500, start + 3000, -1, "DME:\"status\"");
+        Timeline::stop();
+
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        Timeline::writeJson(&buffer);
+
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(data, &error);
+        QCOMPARE(error.error, QJsonParseError::NoError);
+
+        const QJsonArray events = document.object().value("traceEvents").toArray();
+        QCOMPARE(events.size(), 2);
+
+        const QJsonObject read = events.at(0).toObject();
+        QCOMPARE(read.value("name").toString(), QString("body read"));
+        QCOMPARE(read.value("ph").toString(), QString("X"));
+        QCOMPARE(read.value("dur").toDouble(), 2.5);
+        QCOMPARE(read.value("tid").toInt(), 1);
+        QCOMPARE(read.value("args").toObject().value("ecu").toString(), QString("0x12"));
+
+        const QJsonObject output = events.at(1).toObject();
+        QVERIFY(qAbs(output.value("ts").toDouble() - read.value("ts").toDouble() - 2.5) < 0.001);
+        QCOMPARE(output.value("args").toObject().value("detail").toString(), QString("DME:\"status\""));
+        QVERIFY(!output.value("args").toObject().contains("ecu"));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Timeline::Export tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
@@ -0,0 +1,128 @@
+#include <QTest>
+#include <QBuffer>
+#include <stdexcept>
+
+#include <ds2/trace.h>
+
+namespace Test_Trace {
+    class RecordingSink : public DS2PlusPlus::TraceSink
+    {
+    public:
+        virtual void write(DS2PlusPlus::Trace::Category aCategory, const QString &aMessage)
+        {
+            categories << aCategory;
+            messages << aMessage;
+        }
+
+        QList<DS2PlusPlus::Trace::Category> categories;
+        QStringList messages;
+    };
+
+    class Categories : public QObject
+    {
+        Q_OBJECT
+    public:
+        Categories();
+    private Q_SLOTS:
+        void init();
+        void cleanup();
+        void enable();
+        void unknownCategory();
+        void skipsDisabled();
+        void routesToSink();
+        void jsonSink();
+    };
+
+    Categories::Categories()
+      : QObject(0)
+    {
+    }
+
+    void Categories::init()
+    {
+        DS2PlusPlus::Trace::setCategories(0);
+    }
+
+    void Categories::cleanup()
+    {
+        DS2PlusPlus::Trace::setSink(0);
+    }
+
+    void Categories::enable()
+    {
+        using namespace DS2PlusPlus;
+        Trace::enable("query, RPN");
+        QVERIFY(Trace::isEnabled(Trace::Query));
+        QVERIFY(Trace::isEnabled(Trace::Rpn));
+        QVERIFY(!Trace::isEnabled(Trace::General));
+
+        Trace::setEnabled(Trace::Query, false);
+        QCOMPARE(Trace::categories(), static_cast<int>(Trace::Rpn));
+
+        Trace::enable("all");
+        QCOMPARE(Trace::categories(), static_cast<int>(Trace::All));
+    }
+
+    void Categories::unknownCategory()
+    {
+        using namespace DS2PlusPlus;
+        QVERIFY_EXCEPTION_THROWN(Trace::enable("general,packets"), std::invalid_argument);
+    }
+
+    static int ourEvaluations = 0;
+
+    static int evaluated()
+    {
+        return ++ourEvaluations;
+    }
+
+    void Categories::skipsDisabled()
+    {
+        using namespace DS2PlusPlus;
+        RecordingSink sink;
+        Trace::setSink(&sink);
+
+        ourEvaluations = 0;
+        DS2_TRACE(General) << "never built " << evaluated();
+        QCOMPARE(ourEvaluations, 0);
+        QVERIFY(sink.messages.isEmpty());
+    }
+
+    void Categories::routesToSink()
+    {
+        using namespace DS2PlusPlus;
+        RecordingSink sink;
+        Trace::setSink(&sink);
+        Trace::setEnabled(Trace::Query);
+
+        DS2_TRACE(Query) << "Returning: " << 42 << " bytes";
+        DS2_TRACE(Rpn) << "not switched on";
+
+        QCOMPARE(sink.messages, QStringList() << "Returning: 42 bytes");
+        QCOMPARE(sink.categories.first(), Trace::Query);
+    }
+
+    void Categories::jsonSink()
+    {
+        using namespace DS2PlusPlus;
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        JsonTraceSink sink(&buffer);
+        Trace::setSink(&sink);
+        Trace::setEnabled(Trace::Rpn);
+
+        DS2_TRACE(Rpn) << "N: \"" << 7 << "\"";
+
+        const QByteArray line = buffer.data();
+        QVERIFY(line.startsWith("{\"ts\":"));
+        QVERIFY(line.endsWith(",\"category\":\"rpn\",\"message\":\"N: \\\"7\\\"\"}\n"));
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_Trace::Categories tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
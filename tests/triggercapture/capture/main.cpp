@@ -0,0 +1,142 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/triggercapture.h>
+
+namespace Test_TriggerCapture {
+    class Capture : public QObject
+    {
+        Q_OBJECT
+    public:
+        Capture();
+    private Q_SLOTS:
+        void parse();
+        void parseInvalid();
+        void firesOnRisingEdge();
+        void firesOnChange();
+        void preAndPostWindows();
+        void extendsPostWindow();
+        void unknownChannel();
+    };
+
+    Capture::Capture()
+      : QObject(0)
+    {
+    }
+
+    static DS2PlusPlus::CapturedSample sample(double aTime, const QVariant &aValue)
+    {
+        DS2PlusPlus::CapturedSample ret;
+        ret.time = aTime;
+        ret.task = 0;
+        ret.values << aValue;
+        return ret;
+    }
+
+    void Capture::parse()
+    {
+        using namespace DS2PlusPlus;
+        Trigger trigger = Trigger::parse("DME:status:rpm > 6000");
+        QCOMPARE(trigger.channel(), QString("DME:status:rpm"));
+        QCOMPARE(trigger.condition(), Trigger::Greater);
+
+        trigger = Trigger::parse("DME:status:rpm<=800");
+        QCOMPARE(trigger.channel(), QString("DME:status:rpm"));
+        QCOMPARE(trigger.condition(), Trigger::LessOrEqual);
+
+        trigger = Trigger::parse("EGS:status:gear == R");
+        QCOMPARE(trigger.condition(), Trigger::Equal);
+
+        trigger = Trigger::parse("DME:errors:count changes");
+        QCOMPARE(trigger.channel(), QString("DME:errors:count"));
+        QCOMPARE(trigger.condition(), Trigger::Changes);
+    }
+
+    void Capture::parseInvalid()
+    {
+        using namespace DS2PlusPlus;
+        QVERIFY_EXCEPTION_THROWN(Trigger::parse("DME:status:rpm"), std::invalid_argument);
+        QVERIFY_EXCEPTION_THROWN(Trigger::parse("DME:status:rpm > fast"), std::invalid_argument);
+    }
+
+    void Capture::firesOnRisingEdge()
+    {
+        using namespace DS2PlusPlus;
+        Trigger trigger = Trigger::parse("rpm > 6000");
+        QVERIFY(!trigger.evaluate(5000));
+        QVERIFY(trigger.evaluate(6500));
+        QVERIFY(!trigger.evaluate(7000));
+        QVERIFY(!trigger.evaluate(5500));
+        QVERIFY(trigger.evaluate(6100));
+        QVERIFY(!trigger.evaluate(QVariant()));
+    }
+
+    void Capture::firesOnChange()
+    {
+        using namespace DS2PlusPlus;
+        Trigger trigger = Trigger::parse("count changes");
+        QVERIFY(!trigger.evaluate(0));
+        QVERIFY(!trigger.evaluate(0));
+        QVERIFY(trigger.evaluate(1));
+        QVERIFY(!trigger.evaluate(1));
+    }
+
+    void Capture::preAndPostWindows()
+    {
+        using namespace DS2PlusPlus;
+        TriggerCapture capture(2, 1, 64);
+        capture.addTrigger(Trigger::parse("rpm > 6000"), QStringList() << "rpm");
+
+        // Ten samples a second; nothing is written out until the trigger fires.
+        for (int i=0; i < 50; i++) {
+            QVERIFY(capture.add(sample(i * 0.1, 1000)).isEmpty());
+        }
+        QVERIFY(capture.takeReady().isEmpty());
+        QVERIFY(capture.buffered() <= 21);
+
+        QCOMPARE(capture.add(sample(5.0, 6500)), QStringList() << "rpm > 6000");
+        QList<CapturedSample> ready = capture.takeReady();
+        QCOMPARE(ready.size(), 21);
+        QVERIFY(qFuzzyCompare(ready.first().time, 3.0));
+        QVERIFY(qFuzzyCompare(ready.last().time, 5.0));
+        QCOMPARE(capture.buffered(), 0);
+
+        // Samples within the post-trigger window go straight out, then buffering resumes.
+        for (int i=1; i <= 20; i++) {
+            capture.add(sample(5.0 + i * 0.1, 7000));
+        }
+        ready = capture.takeReady();
+        QCOMPARE(ready.size(), 10);
+        QVERIFY(!capture.isCapturing(7.0));
+        QCOMPARE(capture.buffered(), 10);
+    }
+
+    void Capture::extendsPostWindow()
+    {
+        using namespace DS2PlusPlus;
+        TriggerCapture capture(0, 1, 16);
+        capture.addTrigger(Trigger::parse("count changes"), QStringList() << "count");
+
+        capture.add(sample(0, 0));
+        QCOMPARE(capture.add(sample(1, 1)).size(), 1);
+        QVERIFY(capture.isCapturing(1.9));
+        QCOMPARE(capture.add(sample(1.5, 2)).size(), 1);
+        QVERIFY(capture.isCapturing(2.4));
+        QVERIFY(!capture.isCapturing(2.6));
+    }
+
+    void Capture::unknownChannel()
+    {
+        using namespace DS2PlusPlus;
+        TriggerCapture capture(1, 1, 16);
+        QVERIFY_EXCEPTION_THROWN(capture.addTrigger(Trigger::parse("boost > 1"), QStringList() << "rpm"), std::invalid_argument);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_TriggerCapture::Capture tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"
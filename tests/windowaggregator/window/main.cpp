@@ -0,0 +1,128 @@
+#include <QTest>
+#include <stdexcept>
+
+#include <ds2/windowaggregator.h>
+
+namespace Test_WindowAggregator {
+    class Window : public QObject
+    {
+        Q_OBJECT
+    public:
+        Window();
+    private Q_SLOTS:
+        void headers();
+        void statistics();
+        void onlyAddsRequestedColumns();
+        void skipsEmptyWindows();
+        void flush();
+        void invalidWindow();
+    };
+
+    Window::Window()
+      : QObject(0)
+    {
+    }
+
+    static QVector<QVariant> row(const QVariant &aTime, const QVariant &anRpm, const QVariant &aGear)
+    {
+        return QVector<QVariant>() << aTime << anRpm << aGear;
+    }
+
+    void Window::headers()
+    {
+        using namespace DS2PlusPlus;
+        WindowAggregator aggregator(1, QVector<int>() << 1);
+        QCOMPARE(aggregator.headers(QStringList() << "DME:status Time" << "DME:status:rpm"),
+                 QStringList() << "Window Start" << "DME:status:rpm:min" << "DME:status:rpm:max" << "DME:status:rpm:mean"
+                               << "DME:status:rpm:count" << "DME:status:rpm:last");
+        QCOMPARE(aggregator.row().size(), 1 + WindowAggregator::VALUES_PER_COLUMN);
+    }
+
+    void Window::statistics()
+    {
+        using namespace DS2PlusPlus;
+        WindowAggregator aggregator(1, QVector<int>() << 1 << 2);
+
+        QVERIFY(!aggregator.advance(0.1));
+        aggregator.add(row(0.1, 800, QString("P")), 0, 2);
+        QVERIFY(!aggregator.advance(0.5));
+        aggregator.add(row(0.5, 1200, QString("D")), 0, 2);
+        QVERIFY(!aggregator.advance(0.9));
+        aggregator.add(row(0.9, 1000, QString("D")), 0, 2);
+
+        QVERIFY(aggregator.advance(1.2));
+        const QVector<QVariant> &window = aggregator.row();
+        QCOMPARE(window.at(0).toDouble(), 0.0);
+        QCOMPARE(window.at(1).toDouble(), 800.0);
+        QCOMPARE(window.at(2).toDouble(), 1200.0);
+        QCOMPARE(window.at(3).toDouble(), 1000.0);
+        QCOMPARE(window.at(4).toULongLong(), Q_UINT64_C(3));
+        QCOMPARE(window.at(5).toInt(), 1000);
+
+        // Text only has a count and last value
+        QVERIFY(!window.at(6).isValid());
+        QVERIFY(!window.at(8).isValid());
+        QCOMPARE(window.at(9).toULongLong(), Q_UINT64_C(3));
+        QCOMPARE(window.at(10).toString(), QString("D"));
+    }
+
+    void Window::onlyAddsRequestedColumns()
+    {
+        using namespace DS2PlusPlus;
+        WindowAggregator aggregator(1, QVector<int>() << 1 << 2);
+
+        aggregator.advance(0);
+        aggregator.add(row(0, 800, QString("P")), 0, 2);
+        // Only the gear was sampled again; the rpm in the row is just being held.
+        aggregator.add(row(0, 800, QString("D")), 2, 2);
+
+        QVERIFY(aggregator.advance(1));
+        QCOMPARE(aggregator.row().at(4).toULongLong(), Q_UINT64_C(1));
+        QCOMPARE(aggregator.row().at(9).toULongLong(), Q_UINT64_C(2));
+    }
+
+    void Window::skipsEmptyWindows()
+    {
+        using namespace DS2PlusPlus;
+        WindowAggregator aggregator(10, QVector<int>() << 1);
+
+        aggregator.advance(3);
+        aggregator.add(row(3, 800, QVariant()), 1, 1);
+        QVERIFY(aggregator.advance(45));
+        QCOMPARE(aggregator.row().at(0).toDouble(), 0.0);
+
+        // Nothing arrived in the 40 s window, so there's nothing to write when it closes.
+        QVERIFY(!aggregator.advance(52));
+        aggregator.add(row(52, 900, QVariant()), 1, 1);
+        QVERIFY(aggregator.advance(60));
+        QCOMPARE(aggregator.row().at(0).toDouble(), 50.0);
+        QCOMPARE(aggregator.row().at(3).toDouble(), 900.0);
+    }
+
+    void Window::flush()
+    {
+        using namespace DS2PlusPlus;
+        WindowAggregator aggregator(60, QVector<int>() << 1);
+        QVERIFY(!aggregator.flush());
+
+        aggregator.advance(5);
+        aggregator.add(row(5, 800, QVariant()), 1, 1);
+        QVERIFY(aggregator.flush());
+        QCOMPARE(aggregator.row().at(4).toULongLong(), Q_UINT64_C(1));
+        QVERIFY(!aggregator.flush());
+    }
+
+    void Window::invalidWindow()
+    {
+        using namespace DS2PlusPlus;
+        QVERIFY_EXCEPTION_THROWN(WindowAggregator(0, QVector<int>() << 1), std::invalid_argument);
+    }
+}
+
+int main(int argc, char** argv)
+{
+  Test_WindowAggregator::Window tc;
+  return QTest::qExec(&tc, argc, argv);
+}
+
+#include "main.moc"